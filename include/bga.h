@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BGA_PCI_VENDOR_QEMU 0x1234
+#define BGA_PCI_DEVICE_QEMU 0x1111
+#define BGA_PCI_VENDOR_VBOX 0x80EE
+#define BGA_PCI_DEVICE_VBOX 0xBEEF
+
+struct bga_device {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+    uint16_t version;
+    uint32_t lfb_addr;
+    uint32_t vram_bytes;
+    uint32_t width;
+    uint32_t height;
+    uint32_t virt_height;
+    uint32_t pitch;
+    uint32_t bpp;
+};
+
+int bga_probe(struct bga_device *out);
+int bga_set_mode(struct bga_device *bga, uint32_t width, uint32_t height, uint32_t virt_height, uint32_t bpp);
+void bga_set_y_offset(struct bga_device *bga, uint32_t y);
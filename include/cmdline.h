@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#define CMDLINE_MAX 256
+
+void cmdline_init(const char *cmdline);
+const char *cmdline_raw(void);
+int cmdline_get(const char *key, char *out, uint32_t out_size);
+int cmdline_get_u32(const char *key, uint32_t *out);
+int cmdline_has(const char *flag);
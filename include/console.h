@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define CONSOLE_LINES 256u
+#define CONSOLE_COLS 128u
+#define CONSOLE_LINE_HEIGHT 10
+
+struct console {
+    char text[CONSOLE_LINES][CONSOLE_COLS + 1];
+    uint8_t length[CONSOLE_LINES];
+    uint32_t stamp[CONSOLE_LINES];
+    uint32_t first;
+    uint32_t last;
+    uint32_t generation;
+};
+
+struct console_viewport {
+    uint32_t rows;
+    uint32_t top;
+    uint32_t seen;
+    int valid;
+};
+
+struct console_view {
+    const struct framebuffer *fb;
+    struct rect area;
+    uint32_t fg;
+    uint32_t bg;
+    struct console_viewport port;
+};
+
+struct console *console_system(void);
+void console_init(struct console *con);
+void console_putc(struct console *con, char c);
+void console_write(struct console *con, const char *s, uint32_t len);
+const char *console_line(const struct console *con, uint32_t line, uint32_t *len);
+uint32_t console_generation(const struct console *con);
+
+void console_viewport_init(struct console_viewport *port, uint32_t rows);
+int console_viewport_sync(struct console_viewport *port, const struct console *con,
+                          uint32_t *first_row, uint32_t *end_row);
+
+void console_view_init(struct console_view *view, const struct framebuffer *fb, struct rect area,
+                       uint32_t fg, uint32_t bg);
+void console_view_flush(struct console_view *view, const struct console *con);
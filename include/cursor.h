@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+#include "magicui.h"
+
+struct cursor_plane {
+    const struct framebuffer *fb;
+    int x;
+    int y;
+    int visible;
+    uint32_t saved[MUI_CURSOR_WIDTH * MUI_CURSOR_HEIGHT];
+};
+
+void cursor_init(struct cursor_plane *cursor, const struct framebuffer *fb);
+void cursor_show(struct cursor_plane *cursor, int x, int y);
+void cursor_hide(struct cursor_plane *cursor);
+void cursor_move(struct cursor_plane *cursor, int x, int y);
+struct rect cursor_bounds(const struct cursor_plane *cursor);
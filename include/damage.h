@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define DAMAGE_MAX_RECTS 16
+
+struct damage_list {
+    struct rect rects[DAMAGE_MAX_RECTS];
+    int count;
+};
+
+void damage_clear(struct damage_list *damage);
+void damage_add(struct damage_list *damage, struct rect r);
+int damage_empty(const struct damage_list *damage);
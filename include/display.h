@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include "bga.h"
+#include "damage.h"
+#include "framebuffer.h"
+#include "virtio_gpu.h"
+
+enum display_backend {
+    DISPLAY_LINEAR = 0,
+    DISPLAY_BGA,
+    DISPLAY_VIRTIO_GPU
+};
+
+struct display {
+    uint8_t backend;
+    struct framebuffer scanout;
+    struct framebuffer back;
+    uint32_t back_page;
+    struct bga_device bga;
+    struct virtio_gpu gpu;
+};
+
+int display_init(struct display *disp, const struct framebuffer *boot_fb, uint8_t format);
+void display_present(struct display *disp, const struct damage_list *damage);
+void display_flush(struct display *disp, struct rect r);
+uint32_t display_buffer_age(const struct display *disp);
+const char *display_backend_name(const struct display *disp);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define DRAW_STACK_DEPTH 8
+#define DRAW_LIST_MAX 768
+#define DRAW_TEXT_ARENA 8192
+
+enum draw_op {
+    DRAW_OP_FILL = 0,
+    DRAW_OP_GRADIENT,
+    DRAW_OP_TEXT,
+    DRAW_OP_IMAGE
+};
+
+struct draw_cmd {
+    uint8_t op;
+    uint16_t text;
+    int x;
+    int y;
+    struct rect bounds;
+    uint32_t color0;
+    uint32_t color1;
+    const struct framebuffer *image;
+};
+
+struct draw_list {
+    struct draw_cmd cmds[DRAW_LIST_MAX];
+    uint32_t count;
+    char text[DRAW_TEXT_ARENA];
+    uint32_t text_used;
+    int overflow;
+};
+
+struct draw_frame {
+    int origin_x;
+    int origin_y;
+    int width;
+    int height;
+    struct rect clip;
+};
+
+struct draw_ctx {
+    const struct framebuffer *fb;
+    struct draw_frame top;
+    struct draw_frame stack[DRAW_STACK_DEPTH];
+    int depth;
+    struct draw_list *list;
+};
+
+void draw_init(struct draw_ctx *ctx, const struct framebuffer *fb);
+void draw_record(struct draw_ctx *ctx, struct draw_list *list);
+void draw_list_clear(struct draw_list *list);
+int draw_push(struct draw_ctx *ctx, struct rect r);
+int draw_push_clip(struct draw_ctx *ctx, struct rect r);
+void draw_pop(struct draw_ctx *ctx);
+struct rect draw_bounds(const struct draw_ctx *ctx);
+struct rect draw_to_screen(const struct draw_ctx *ctx, struct rect r);
+int draw_visible(const struct draw_ctx *ctx, struct rect r);
+
+void draw_fill_rect(const struct draw_ctx *ctx, struct rect r, uint32_t color);
+void draw_fill_rect_excluding(const struct draw_ctx *ctx, struct rect r,
+                               const struct rect *holes, int hole_count, uint32_t color);
+void draw_vertical_gradient(const struct draw_ctx *ctx, uint32_t top, uint32_t bottom);
+void draw_image(const struct draw_ctx *ctx, int x, int y, const struct framebuffer *image);
+void draw_put_pixel(const struct draw_ctx *ctx, int x, int y, uint32_t color);
+void draw_string(const struct draw_ctx *ctx, int x, int y, const char *text, uint32_t fg, uint32_t bg);
@@ -1,6 +1,75 @@
 #pragma once
 
 #include <stdint.h>
+#include "usb.h"
+
+#define EHCI_MAX_ENDPOINTS 32
+#define EHCI_QTD_POOL_SIZE 64
+#define EHCI_FRAME_LIST_SIZE 1024
+#define EHCI_PERIODIC_LEVELS 6
+#define EHCI_MAX_INTERRUPTS 8
+#define EHCI_MAX_TRANSFERS 8
+#define EHCI_CONTROL_TIMEOUT_US 500000u
+#define EHCI_RETIRE_TIMEOUT_US 10000u
+#define EHCI_NO_IRQ 0xFFu
+#define EHCI_MAX_ADDRESSES 128
+
+struct ehci_qh;
+struct ehci_qtd;
+
+enum ehci_state {
+    EHCI_STATE_HALTING = 0,
+    EHCI_STATE_RESETTING,
+    EHCI_STATE_STARTING,
+    EHCI_STATE_POWERING,
+    EHCI_STATE_READY,
+    EHCI_STATE_FAILED
+};
+
+struct ehci_route {
+    uint8_t speed;
+    uint8_t hub_addr;
+    uint8_t hub_port;
+};
+
+struct ehci_endpoint {
+    struct ehci_qh *qh;
+    uint8_t dev_addr;
+    uint8_t ep;
+    uint16_t max_packet;
+    uint8_t periodic;
+    uint8_t used;
+    uint8_t retiring;
+    uint32_t retire_frame;
+    uint64_t retire_deadline_tsc;
+};
+
+struct ehci_transfer {
+    struct ehci_qh *qh;
+    struct ehci_qtd *qtd[3];
+    uint8_t setup[8];
+    void *data;
+    uint32_t length;
+    uint64_t deadline_tsc;
+    usb_callback_fn callback;
+    void *ctx;
+    uint8_t status;
+    uint8_t retiring;
+    uint8_t used;
+};
+
+struct ehci_interrupt {
+    struct ehci_qh *qh;
+    struct ehci_qtd *qtd;
+    void *buf;
+    uint16_t len;
+    uint8_t interval;
+    uint8_t used;
+    uint8_t halted;
+    uint8_t releasing;
+    usb_callback_fn callback;
+    void *ctx;
+};
 
 struct ehci_controller {
     volatile uint8_t *base;
@@ -8,14 +77,61 @@ struct ehci_controller {
     uint32_t cap_length;
     uint32_t hcs_params;
     uint32_t hcc_params;
+    uint8_t state;
+    uint64_t deadline_us;
+    uint8_t reset_port;
+    uint8_t reset_phase;
+    uint64_t reset_deadline_us;
+    struct ehci_qh *async_head;
+    struct ehci_qh *qh_pool;
+    struct ehci_route routes[EHCI_MAX_ADDRESSES];
+    struct ehci_endpoint endpoints[EHCI_MAX_ENDPOINTS];
+    uint32_t endpoint_count;
+    struct ehci_qtd *qtd_pool;
+    uint8_t qtd_free[EHCI_QTD_POOL_SIZE];
+    uint32_t qtd_free_count;
+    uint32_t *frame_list;
+    struct ehci_qh *periodic[EHCI_PERIODIC_LEVELS];
+    struct ehci_interrupt interrupts[EHCI_MAX_INTERRUPTS];
+    struct ehci_transfer transfers[EHCI_MAX_TRANSFERS];
+    uint8_t irq;
+    volatile uint32_t irq_status;
+    volatile uint32_t irq_events;
+    uint8_t doorbell_busy;
+    uint64_t doorbell_deadline_tsc;
 };
 
 int ehci_init(struct ehci_controller *out, uint32_t bar0);
-int ehci_control_transfer(struct ehci_controller *ctrl,
-                          uint8_t dev_addr,
-                          uint8_t ep,
-                          uint16_t max_packet,
-                          const void *setup,
-                          void *data,
-                          uint32_t length,
-                          int in_dir);
+enum ehci_state ehci_step(struct ehci_controller *ctrl, uint64_t now_us);
+int ehci_schedule_init(struct ehci_controller *ctrl);
+uint32_t ehci_port_count(const struct ehci_controller *ctrl);
+int ehci_port_connected(struct ehci_controller *ctrl, uint32_t port);
+int ehci_port_changed(struct ehci_controller *ctrl, uint32_t port);
+int ehci_port_reset_begin(struct ehci_controller *ctrl, uint32_t port, uint64_t now_us);
+enum usb_status ehci_port_reset_poll(struct ehci_controller *ctrl, uint64_t now_us);
+void ehci_set_route(struct ehci_controller *ctrl, uint8_t dev_addr, enum usb_speed speed,
+                    uint8_t hub_addr, uint8_t hub_port);
+void ehci_release_device(struct ehci_controller *ctrl, uint8_t dev_addr);
+int ehci_enable_irq(struct ehci_controller *ctrl, uint8_t irq);
+int ehci_irq_live(const struct ehci_controller *ctrl);
+void ehci_process(struct ehci_controller *ctrl);
+int ehci_control_submit(struct ehci_controller *ctrl,
+                        uint8_t dev_addr,
+                        uint8_t ep,
+                        uint16_t max_packet,
+                        const void *setup,
+                        void *data,
+                        uint32_t length,
+                        int in_dir,
+                        usb_callback_fn callback,
+                        void *ctx);
+int ehci_interrupt_open(struct ehci_controller *ctrl,
+                        uint8_t dev_addr,
+                        uint8_t ep,
+                        uint16_t max_packet,
+                        uint8_t frames,
+                        void *buf,
+                        uint16_t len,
+                        usb_callback_fn callback,
+                        void *ctx);
+int ehci_interrupt_resume(struct ehci_controller *ctrl, int handle);
@@ -17,7 +17,20 @@ struct fat_fs {
     uint8_t fat_type;
 };
 
+struct fat_file {
+    const struct fat_fs *fs;
+    uint32_t first_cluster;
+    uint32_t cluster;
+    uint32_t size;
+    uint32_t pos;
+    uint32_t cluster_pos;
+    uint32_t cached_lba;
+    uint8_t sector[512];
+};
+
 typedef void (*fat_dir_cb)(const char *name, uint32_t size, uint8_t attr, void *ctx);
 
 int fat_mount(struct fat_fs *fs, uint32_t part_lba);
 int fat_list_root(struct fat_fs *fs, fat_dir_cb cb, void *ctx);
+int fat_open_root(struct fat_fs *fs, const char *name, struct fat_file *file);
+uint32_t fat_read(struct fat_file *file, void *buf, uint32_t len);
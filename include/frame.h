@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define FRAME_DEFAULT_HZ 60u
+#define FRAME_STATS_HISTORY 64
+#define FRAME_HUD_WIDTH 208
+#define FRAME_HUD_HEIGHT 112
+#define FRAME_SUMMARY_BUCKETS 128u
+#define FRAME_SUMMARY_BUCKET_US 250u
+
+struct frame_pacer {
+    uint32_t target_hz;
+    uint64_t period_tsc;
+    uint64_t next_tsc;
+    int vsync;
+};
+
+struct frame_sample {
+    uint32_t update_us;
+    uint32_t render_us;
+    uint32_t present_us;
+    uint32_t interval_us;
+    uint32_t pixels_written;
+    uint32_t tiles_dirty;
+};
+
+struct frame_stats {
+    struct frame_sample samples[FRAME_STATS_HISTORY];
+    uint32_t head;
+    uint32_t count;
+};
+
+struct frame_summary {
+    uint64_t start_tsc;
+    uint32_t frames;
+    uint32_t late_frames;
+    uint32_t work_total_us;
+    uint32_t work_max_us;
+    uint32_t interval_max_us;
+    uint32_t work[FRAME_SUMMARY_BUCKETS];
+    uint32_t interval[FRAME_SUMMARY_BUCKETS];
+};
+
+int frame_retrace_probe(void);
+void frame_pacer_init(struct frame_pacer *pacer, uint32_t target_hz, int vsync);
+int frame_pacer_ready(const struct frame_pacer *pacer, uint64_t now_tsc);
+void frame_pacer_advance(struct frame_pacer *pacer, uint64_t now_tsc);
+int frame_pacer_sync(const struct frame_pacer *pacer, uint64_t since_tsc, uint64_t now_tsc);
+
+void frame_stats_init(struct frame_stats *stats);
+void frame_stats_push(struct frame_stats *stats, const struct frame_sample *sample);
+const struct frame_sample *frame_stats_at(const struct frame_stats *stats, uint32_t age);
+uint32_t frame_stats_fps(const struct frame_stats *stats);
+
+void frame_summary_reset(struct frame_summary *summary, uint64_t now_tsc);
+void frame_summary_add(struct frame_summary *summary, const struct frame_sample *sample, const struct frame_pacer *pacer);
+void frame_summary_log(const struct frame_summary *summary, uint64_t now_tsc);
+
+struct rect frame_hud_rect(const struct framebuffer *fb);
+void frame_hud_draw(const struct framebuffer *fb, const struct frame_stats *stats, const struct frame_pacer *pacer);
@@ -2,14 +2,27 @@
 
 #include <stdint.h>
 
+enum fb_format {
+    FB_FORMAT_UNKNOWN = 0,
+    FB_FORMAT_XRGB8888,
+    FB_FORMAT_XBGR8888,
+    FB_FORMAT_RGB888,
+    FB_FORMAT_BGR888,
+    FB_FORMAT_RGB565,
+    FB_FORMAT_BGR565
+};
+
 struct framebuffer {
     uint8_t *base;
     uint32_t width;
     uint32_t height;
     uint32_t pitch;
     uint8_t bpp;
+    uint8_t format;
 };
 
+#define FB_PITCH_ALIGN 64u
+
 struct rect {
     int x;
     int y;
@@ -18,10 +31,36 @@ struct rect {
 };
 
 uint32_t rgb(uint8_t r, uint8_t g, uint8_t b);
+uint8_t fb_format_from_layout(uint8_t bpp, uint8_t red_pos, uint8_t red_size,
+                              uint8_t green_pos, uint8_t green_size,
+                              uint8_t blue_pos, uint8_t blue_size);
+uint8_t fb_format_bpp(uint8_t format);
+uint8_t fb_format_from_name(const char *name);
+int fb_alloc_surface(struct framebuffer *out, uint32_t width, uint32_t height, uint8_t format);
+void fb_free_surface(struct framebuffer *fb);
+uint32_t fb_pack_color(const struct framebuffer *fb, uint32_t color);
 void fb_put_pixel(const struct framebuffer *fb, int x, int y, uint32_t color);
+void fb_put_pixel_raw(const struct framebuffer *fb, int x, int y, uint32_t raw);
+uint32_t fb_get_pixel_raw(const struct framebuffer *fb, int x, int y);
 void fb_fill_rect(const struct framebuffer *fb, struct rect r, uint32_t color);
+void fb_fill_rect_clip(const struct framebuffer *fb, struct rect r, struct rect clip, uint32_t color);
 void fb_draw_vertical_gradient(const struct framebuffer *fb, uint32_t top, uint32_t bottom);
+void fb_draw_vertical_gradient_clip(const struct framebuffer *fb, uint32_t top, uint32_t bottom, struct rect clip);
 void fb_draw_char(const struct framebuffer *fb, int x, int y, char c, uint32_t fg, uint32_t bg);
 void fb_draw_string(const struct framebuffer *fb, int x, int y, const char *text, uint32_t fg, uint32_t bg);
+void fb_draw_string_clip(const struct framebuffer *fb, int x, int y, const char *text,
+                         uint32_t fg, uint32_t bg, struct rect clip);
+struct rect fb_bounds(const struct framebuffer *fb);
 int point_in_rect(int x, int y, struct rect r);
+int rect_contains(struct rect outer, struct rect inner);
+struct rect rect_intersect(struct rect a, struct rect b);
+struct rect rect_union(struct rect a, struct rect b);
+uint32_t fb_pixel_writes(void);
+void fb_reset_pixel_writes(void);
+int fb_heatmap_begin(const struct framebuffer *fb);
+void fb_heatmap_end(void);
 void fb_blit(const struct framebuffer *dst, const struct framebuffer *src);
+void fb_draw_image_clip(const struct framebuffer *fb, int x, int y,
+                        const struct framebuffer *image, struct rect clip);
+void fb_store_row(const struct framebuffer *fb, int y, const uint32_t *pixels);
+void fb_blit_rect(const struct framebuffer *dst, const struct framebuffer *src, struct rect r);
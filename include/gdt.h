@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+
+void gdt_init(void);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#define IDT_EXCEPTION_COUNT 32
+#define IDT_VECTOR_COUNT 48
+#define IRQ_MAX_SHARED 4
+#define IRQ_UNCLAIMED_LIMIT 10000u
+
+struct interrupt_frame {
+    uint32_t edi;
+    uint32_t esi;
+    uint32_t ebp;
+    uint32_t esp;
+    uint32_t ebx;
+    uint32_t edx;
+    uint32_t ecx;
+    uint32_t eax;
+    uint32_t vector;
+    uint32_t error;
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+};
+
+typedef int (*irq_handler_fn)(uint8_t irq);
+
+void idt_init(void);
+int irq_register(uint8_t irq, irq_handler_fn handler);
+uint32_t irq_count(uint8_t irq);
+int irq_active(uint8_t irq);
+void interrupts_enable(void);
+int interrupts_enabled(void);
+void interrupt_dispatch(struct interrupt_frame *frame);
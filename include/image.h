@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define IMAGE_MAX_WIDTH 4096u
+#define IMAGE_MAX_HEIGHT 4096u
+
+enum image_type {
+    IMAGE_UNKNOWN = 0,
+    IMAGE_BMP,
+    IMAGE_TGA
+};
+
+struct image_info {
+    uint8_t type;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_read;
+};
+
+int image_load_scaled(const char *name, const struct framebuffer *dst, struct image_info *info);
@@ -2,9 +2,6 @@
 
 #include <stdint.h>
 
-struct ui_state;
-struct framebuffer;
-
 enum key_action {
     KEY_NONE,
     KEY_UP,
@@ -14,11 +11,69 @@ enum key_action {
     KEY_ENTER,
     KEY_ESC,
     KEY_TAB,
-    KEY_START
+    KEY_START,
+    KEY_HUD,
+    KEY_HEATMAP,
+    KEY_LATENCY,
+    KEY_RECORD
+};
+
+enum input_device {
+    INPUT_DEVICE_PS2_KEYBOARD = 0,
+    INPUT_DEVICE_PS2_MOUSE,
+    INPUT_DEVICE_USB_KEYBOARD,
+    INPUT_DEVICE_USB_MOUSE,
+    INPUT_DEVICE_COUNT
+};
+
+enum input_event_type {
+    INPUT_EVENT_KEY = 0,
+    INPUT_EVENT_MOUSE
+};
+
+struct input_event {
+    uint64_t tsc;
+    uint8_t device;
+    uint8_t type;
+    uint8_t key;
+    uint8_t buttons;
+    int16_t dx;
+    int16_t dy;
+};
+
+typedef void (*input_record_fn)(const struct input_event *event);
+
+struct input_latency {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+};
+
+struct input_stats {
+    uint32_t kbd_bytes;
+    uint32_t kbd_dropped;
+    uint32_t mouse_bytes;
+    uint32_t mouse_dropped;
+    uint32_t mouse_resyncs;
+    uint32_t mouse_overflows;
+    uint32_t events_dropped;
+    uint32_t trace_dropped;
 };
 
 void init_ps2_mouse(void);
-enum key_action poll_keyboard(void);
-void poll_mouse(struct ui_state *state, const struct framebuffer *fb);
-void input_inject_key(enum key_action action);
-void input_inject_mouse(int dx, int dy, uint8_t buttons);
+void input_pump(void);
+int input_next_event(struct input_event *event);
+void input_inject_key(uint8_t device, enum key_action action);
+void input_inject_mouse(uint8_t device, int dx, int dy, uint8_t buttons);
+void input_inject_event(const struct input_event *event);
+void input_set_live(int enabled);
+void input_set_recorder(input_record_fn fn);
+void input_get_stats(struct input_stats *stats);
+
+void input_trace_present(uint64_t tsc);
+void input_trace_discard(void);
+uint8_t input_trace_last_device(void);
+void input_latency_get(uint8_t device, struct input_latency *out);
+const char *input_device_name(uint8_t device);
+void input_latency_log(void);
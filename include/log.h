@@ -2,7 +2,10 @@
 
 #include <stdint.h>
 
+typedef void (*log_mirror_fn)(const char *s, uint32_t len);
+
 void log_init(void);
+void log_set_mirror(log_mirror_fn fn);
 void log_putc(char c);
 void log_puts(const char *s);
 void log_write(const char *s, uint32_t len);
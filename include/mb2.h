@@ -18,3 +18,4 @@ int mb2_get_mmap(uint32_t mb_info_addr,
 				 const struct mb2_mmap_entry **entries,
 				 uint32_t *entry_size,
 				 uint32_t *entry_count);
+int mb2_find_cmdline(uint32_t mb_info_addr, const char **out_cmdline);
@@ -12,5 +12,6 @@ struct memory_stats {
 void memory_init(uint32_t mb_info_addr);
 void *kmalloc(uint32_t size, uint32_t align);
 uint32_t phys_alloc_page(void);
+uint32_t phys_alloc_pages(uint32_t count);
 void phys_free_page(uint32_t addr);
 void memory_get_stats(struct memory_stats *out);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "draw.h"
+#include "framebuffer.h"
+
+#define MUI_TREE_MAX 32
+#define MUI_WIDGET_TEXT 64
+#define MUI_LIST_ROW_HEIGHT 16
+
+enum mui_widget_type {
+    MUI_WIDGET_LABEL = 0,
+    MUI_WIDGET_BUTTON,
+    MUI_WIDGET_PROGRESS,
+    MUI_WIDGET_LIST
+};
+
+struct mui_widget {
+    uint8_t type;
+    uint8_t visible;
+    uint8_t selected;
+    int8_t parent;
+    struct rect rect;
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t value;
+    uint32_t max_value;
+    char text[MUI_WIDGET_TEXT];
+};
+
+struct mui_tree {
+    struct mui_widget widgets[MUI_TREE_MAX];
+    int count;
+    int layout_dirty;
+    struct rect dirty;
+};
+
+void mui_tree_init(struct mui_tree *tree);
+int mui_tree_add(struct mui_tree *tree, enum mui_widget_type type, int parent, struct rect rect);
+void mui_set_text(struct mui_tree *tree, int id, const char *text);
+void mui_set_colors(struct mui_tree *tree, int id, uint32_t fg, uint32_t bg);
+void mui_set_value(struct mui_tree *tree, int id, uint32_t value, uint32_t max_value);
+void mui_set_selected(struct mui_tree *tree, int id, int selected);
+void mui_set_visible(struct mui_tree *tree, int id, int visible);
+void mui_tree_invalidate(struct mui_tree *tree, struct rect r);
+struct rect mui_tree_take_dirty(struct mui_tree *tree);
+int mui_tree_hit(struct mui_tree *tree, int x, int y);
+void mui_tree_render(const struct mui_tree *tree, const struct draw_ctx *ctx);
@@ -2,5 +2,8 @@
 
 struct framebuffer;
 
+typedef void (*panic_flush_fn)(void);
+
 void panic_set_framebuffer(const struct framebuffer *fb);
+void panic_set_flush(panic_flush_fn fn);
 void panic(const char *msg) __attribute__((noreturn));
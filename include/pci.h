@@ -9,6 +9,10 @@ typedef void (*pci_device_cb)(uint8_t bus, uint8_t dev, uint8_t func,
 uint32_t pci_read_config32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 uint16_t pci_read_config16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 uint8_t pci_read_config8(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
+void pci_write_config32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint32_t value);
+void pci_write_config16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint16_t value);
+void pci_enable_bus_master(uint8_t bus, uint8_t dev, uint8_t func);
+uint8_t pci_enable_intx(uint8_t bus, uint8_t dev, uint8_t func);
 
 void pci_scan(pci_device_cb cb, void *ctx);
 void pci_scan_bus0(pci_device_cb cb, void *ctx);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+#define PIC_IRQ_BASE 0x20
+#define PIC_IRQ_COUNT 16
+
+void pic_init(void);
+void pic_unmask(uint8_t irq);
+void pic_mask(uint8_t irq);
+int pic_spurious(uint8_t irq);
+void pic_eoi(uint8_t irq);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define REGION_MAX_RECTS 32
+
+struct region {
+    struct rect rects[REGION_MAX_RECTS];
+    int count;
+};
+
+void region_init(struct region *region, struct rect r);
+int region_subtract(struct region *region, struct rect r);
+int region_empty(const struct region *region);
+uint32_t region_area(const struct region *region);
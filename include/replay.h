@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#define REPLAY_MAX_EVENTS 4096u
+#define REPLAY_TAIL_US 1000000u
+
+void replay_record_start(uint64_t now_tsc);
+void replay_record_finish(void);
+int replay_recording(void);
+
+int replay_load(const char *name);
+void replay_start(uint64_t now_tsc);
+int replay_active(void);
+int replay_poll(uint64_t now_tsc);
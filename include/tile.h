@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include "damage.h"
+#include "draw.h"
+#include "framebuffer.h"
+
+#define TILE_SIZE 64
+#define TILE_BIN_POOL 8192
+#define TILE_BIN_ALL 0xFFFFu
+
+struct tile_renderer {
+    const struct framebuffer *fb;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t dirty_count;
+    uint32_t next;
+    uint8_t *dirty;
+    uint8_t *prev_dirty;
+    uint16_t *bin_start;
+    uint16_t *bin_count;
+    uint16_t *bins;
+    struct draw_list *list;
+};
+
+int tile_renderer_init(struct tile_renderer *tiles, const struct framebuffer *fb);
+void tile_begin_frame(struct tile_renderer *tiles, const struct damage_list *damage, uint32_t buffer_age);
+void tile_mark_all(struct tile_renderer *tiles);
+struct rect tile_dirty_bounds(const struct tile_renderer *tiles);
+struct rect tile_rect(const struct tile_renderer *tiles, uint32_t index);
+int tile_bin(struct tile_renderer *tiles);
+void tile_render(const struct tile_renderer *tiles, uint32_t index);
+int tile_prepare(struct tile_renderer *tiles);
+int tile_render_next(struct tile_renderer *tiles);
+void tile_dirty_damage(const struct tile_renderer *tiles, struct damage_list *out);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+void timer_init(void);
+uint64_t timer_tsc(void);
+uint32_t timer_tsc_khz(void);
+uint64_t timer_us_to_tsc(uint32_t us);
+uint32_t timer_tsc_to_us(uint64_t delta);
+uint32_t timer_us_to_ms(uint64_t us);
+uint64_t timer_us(void);
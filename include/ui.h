@@ -1,44 +1,95 @@
 #pragma once
 
 #include <stdint.h>
+#include "console.h"
+#include "damage.h"
+#include "draw.h"
 #include "framebuffer.h"
+#include "mui_widget.h"
+#include "usb.h"
+#include "wm.h"
 
 #define SYSINFO_STR_LEN 64
+#define UI_CONSOLE_ROWS 32u
+
+enum {
+    SETTINGS_THEME_COUNT = 5,
+    SETTINGS_INFO_ROWS = 7
+};
 
 struct system_info {
     char version[16];
     char kernel[32];
     char cpu[SYSINFO_STR_LEN];
+    char display[16];
     uint32_t ram_kb;
     uint32_t width;
     uint32_t height;
     uint8_t bpp;
 };
 
+struct settings_view {
+    struct mui_tree tree;
+    int built;
+    int theme_index;
+    int swatches[SETTINGS_THEME_COUNT];
+    int theme_name;
+    int info_rows[SETTINGS_INFO_ROWS];
+    int progress;
+};
+
+struct console_lines {
+    struct console_viewport port;
+    char text[UI_CONSOLE_ROWS][CONSOLE_COLS + 1];
+    uint8_t length[UI_CONSOLE_ROWS];
+};
+
+struct usb_view {
+    uint32_t generation;
+    int valid;
+    uint32_t controller_count;
+    struct usb_controller_info controllers[USB_MAX_CONTROLLERS];
+    struct usb_device_info devices[USB_MAX_DEVICES];
+};
+
 struct ui_state {
     int menu_open;
     int menu_index;
-    int apps_open;
-    int settings_open;
-    int files_open;
-    int usb_open;
-    int test_open;
     int mouse_x;
     int mouse_y;
     uint8_t mouse_buttons;
     uint8_t prev_mouse_buttons;
     int theme_index;
-    int drag_app_id;
+    int hud_visible;
+    int heatmap_visible;
+    int drag_window;
     int drag_offset_x;
     int drag_offset_y;
-    struct rect apps_rect;
-    struct rect settings_rect;
-    struct rect files_rect;
-    struct rect usb_rect;
-    struct rect test_rect;
+    struct window_manager wm;
+    int app_windows[WM_MAX_WINDOWS];
     struct system_info info;
+    struct console_lines console;
+    struct usb_view usb;
+    struct settings_view settings;
+    const struct framebuffer *wallpaper;
+    struct damage_list damage;
+};
+
+struct ui_snapshots {
+    struct ui_state slots[2];
+    struct damage_list damage;
+    uint32_t front;
+    uint32_t reading;
+    uint32_t published;
+    uint32_t consumed;
 };
 
 void ui_init(struct ui_state *state, const struct framebuffer *fb, const struct system_info *info);
+void ui_set_wallpaper(struct ui_state *state, const struct framebuffer *fb, const struct framebuffer *wallpaper);
 void ui_update(struct ui_state *state, const struct framebuffer *fb);
-void ui_render(const struct framebuffer *fb, const struct ui_state *state);
+void ui_render(struct draw_ctx *ctx, const struct ui_state *state);
+
+void ui_snapshots_init(struct ui_snapshots *snaps, struct ui_state *state);
+void ui_publish(struct ui_snapshots *snaps, struct ui_state *state);
+int ui_snapshot_pending(const struct ui_snapshots *snaps);
+const struct ui_state *ui_acquire(struct ui_snapshots *snaps, struct damage_list *damage);
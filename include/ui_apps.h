@@ -1,5 +1,6 @@
 #pragma once
 
+#include "draw.h"
 #include "framebuffer.h"
 #include "ui.h"
 
@@ -9,7 +10,8 @@ enum ui_app_id {
 	UI_APP_FILES = 2,
 	UI_APP_USB = 3,
     UI_APP_TEST = 4,
-	UI_APP_COUNT = 5
+    UI_APP_CONSOLE = 5,
+	UI_APP_COUNT = 6
 };
 
 int ui_app_count(void);
@@ -21,15 +23,21 @@ const char *ui_app_desktop_icon_label(enum ui_app_id app_id);
 
 int ui_app_is_open(const struct ui_state *state, enum ui_app_id app_id);
 void ui_app_set_open(struct ui_state *state, enum ui_app_id app_id, int open);
-struct rect *ui_app_rect_mut(struct ui_state *state, enum ui_app_id app_id);
+void ui_app_register_windows(struct ui_state *state);
+int ui_app_window(const struct ui_state *state, enum ui_app_id app_id);
 struct rect ui_app_rect(const struct ui_state *state, enum ui_app_id app_id);
 
 int ui_app_handle_click(struct ui_state *state, enum ui_app_id app_id, int mouse_x, int mouse_y);
-void ui_app_render(enum ui_app_id app_id, const struct framebuffer *fb, const struct ui_state *state, uint32_t accent);
+struct rect ui_app_update(struct ui_state *state, enum ui_app_id app_id);
+void ui_app_render(enum ui_app_id app_id, struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
 
-void app_apps_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent);
-void app_files_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent);
-void app_usb_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent);
-void app_settings_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent);
-void app_test_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent);
+void app_apps_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
+void app_files_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
+void app_usb_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
+void app_settings_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
+void app_test_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
+void app_console_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent);
 int app_settings_handle_click(struct ui_state *state, int mouse_x, int mouse_y);
+struct rect app_settings_update(struct ui_state *state);
+struct rect app_console_update(struct ui_state *state);
+struct rect app_usb_update(struct ui_state *state);
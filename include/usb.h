@@ -3,6 +3,20 @@
 #include <stdint.h>
 
 #define USB_MAX_CONTROLLERS 8
+#define USB_MAX_DEVICES 16
+#define USB_EVENT_QUEUE_SIZE 16
+
+enum usb_speed {
+	USB_SPEED_FULL = 0,
+	USB_SPEED_LOW,
+	USB_SPEED_HIGH,
+	USB_SPEED_SUPER
+};
+
+enum usb_hid_kind {
+	USB_HID_KEYBOARD = 1u << 0,
+	USB_HID_MOUSE = 1u << 1
+};
 
 struct usb_controller_info {
 	uint8_t bus;
@@ -14,7 +28,45 @@ struct usb_controller_info {
 	uint32_t bar0;
 };
 
+enum usb_status {
+	USB_STATUS_PENDING = 0,
+	USB_STATUS_OK,
+	USB_STATUS_STALL,
+	USB_STATUS_ERROR,
+	USB_STATUS_TIMEOUT
+};
+
+typedef void (*usb_callback_fn)(void *ctx, enum usb_status status, const uint8_t *data, uint32_t len);
+
+enum usb_event_type {
+	USB_EVENT_READY = 1,
+	USB_EVENT_REMOVED
+};
+
+struct usb_device_info {
+	uint8_t controller;
+	uint8_t addr;
+	uint8_t speed;
+	uint8_t parent;
+	uint8_t port;
+	uint8_t depth;
+	uint8_t hub_ports;
+	uint8_t hid_mask;
+	uint16_t vendor;
+	uint16_t product;
+};
+
+struct usb_event {
+	uint8_t type;
+	struct usb_device_info info;
+	uint64_t time_us;
+};
+
 void usb_init(void);
 void usb_poll(void);
 uint32_t usb_controller_count(void);
 const struct usb_controller_info *usb_controller_list(void);
+const struct usb_device_info *usb_device_at(uint32_t index);
+int usb_next_event(struct usb_event *out);
+uint32_t usb_generation(void);
+const char *usb_status_name(enum usb_status status);
@@ -2,7 +2,12 @@
 
 #include <stdint.h>
 
+struct usb_hid_keyboard {
+	uint8_t last_keys[6];
+};
+
 void usb_hid_init(void);
 void usb_hid_poll(void);
-void usb_hid_on_keyboard_report(const uint8_t *report, uint32_t len);
+void usb_hid_keyboard_init(struct usb_hid_keyboard *kbd);
+void usb_hid_on_keyboard_report(struct usb_hid_keyboard *kbd, const uint8_t *report, uint32_t len);
 void usb_hid_on_mouse_report(const uint8_t *report, uint32_t len);
@@ -1,7 +1,14 @@
 #pragma once
 
 #include <stdint.h>
+#include "fat.h"
+
+struct vfs_file {
+    struct fat_file fat;
+};
 
 void vfs_init(void);
 int vfs_mount_fat(uint32_t part_lba);
 int vfs_list_root(void);
+int vfs_open(const char *name, struct vfs_file *file);
+uint32_t vfs_read(struct vfs_file *file, void *buf, uint32_t len);
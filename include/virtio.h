@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#define VIRTIO_PCI_VENDOR 0x1AF4
+#define VIRTIO_PCI_DEVICE_GPU 0x1050
+
+#define VIRTQ_DESC_F_NEXT 1u
+#define VIRTQ_DESC_F_WRITE 2u
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed));
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+struct virtqueue {
+    uint16_t index;
+    uint16_t size;
+    uint16_t last_used;
+    volatile struct virtq_desc *desc;
+    volatile struct virtq_avail *avail;
+    volatile struct virtq_used *used;
+    volatile uint16_t *notify;
+};
+
+struct virtio_device {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+    volatile uint8_t *common;
+    volatile uint8_t *notify_base;
+    volatile uint8_t *isr;
+    volatile uint8_t *device_cfg;
+    uint32_t notify_off_multiplier;
+};
+
+int virtio_pci_find(uint16_t device_id, struct virtio_device *out);
+int virtio_negotiate(struct virtio_device *vdev, uint32_t features_lo);
+int virtio_setup_queue(struct virtio_device *vdev, struct virtqueue *vq, uint16_t index, uint16_t max_size);
+void virtio_driver_ok(struct virtio_device *vdev);
+void virtio_fail(struct virtio_device *vdev);
+
+void virtq_add_buffer_pair(struct virtqueue *vq, uint16_t head,
+                           const void *req, uint32_t req_len,
+                           void *resp, uint32_t resp_len);
+void virtq_kick(struct virtqueue *vq);
+int virtq_wait_idle(struct virtqueue *vq, uint32_t spins);
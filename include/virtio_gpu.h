@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+#include "virtio.h"
+
+struct virtio_gpu {
+    struct virtio_device vdev;
+    struct virtqueue ctrlq;
+    uint8_t *cmd_area;
+    uint32_t cmd_slots;
+    uint32_t resource_id;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+};
+
+int virtio_gpu_init(struct virtio_gpu *gpu);
+int virtio_gpu_attach_surface(struct virtio_gpu *gpu, const struct framebuffer *surface);
+int virtio_gpu_flush_rects(struct virtio_gpu *gpu, const struct rect *rects, int count);
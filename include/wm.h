@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define WM_MAX_WINDOWS 32
+#define WM_CELL_SIZE 64
+
+struct wm_window {
+    int owner;
+    struct rect rect;
+    uint8_t used;
+    uint8_t open;
+    uint8_t z;
+};
+
+struct window_manager {
+    struct wm_window windows[WM_MAX_WINDOWS];
+    uint8_t order[WM_MAX_WINDOWS];
+    int open_count;
+    uint32_t grid_cols;
+    uint32_t grid_rows;
+    uint32_t *grid;
+};
+
+void wm_init(struct window_manager *wm, uint32_t width, uint32_t height);
+int wm_register(struct window_manager *wm, int owner, struct rect rect);
+void wm_unregister(struct window_manager *wm, int id);
+int wm_is_open(const struct window_manager *wm, int id);
+void wm_open(struct window_manager *wm, int id);
+void wm_close(struct window_manager *wm, int id);
+int wm_raise(struct window_manager *wm, int id);
+void wm_move(struct window_manager *wm, int id, int x, int y);
+struct rect wm_rect(const struct window_manager *wm, int id);
+int wm_owner(const struct window_manager *wm, int id);
+int wm_window_at(const struct window_manager *wm, int x, int y);
+int wm_count(const struct window_manager *wm);
+int wm_at_depth(const struct window_manager *wm, int depth);
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stdint.h>
+#include "usb.h"
+
+#define XHCI_MAX_SLOTS 16
+#define XHCI_MAX_PORTS 32
+#define XHCI_MAX_ENDPOINTS 32
+#define XHCI_MAX_TRANSFERS 8
+#define XHCI_MAX_INTERRUPTS 8
+#define XHCI_COMMAND_QUEUE 16
+#define XHCI_RING_TRBS 64
+#define XHCI_EVENT_TRBS 128
+#define XHCI_CONTROL_TIMEOUT_US 500000u
+#define XHCI_COMMAND_TIMEOUT_US 500000u
+#define XHCI_NO_IRQ 0xFFu
+
+enum xhci_state {
+    XHCI_STATE_HANDOFF = 0,
+    XHCI_STATE_HALTING,
+    XHCI_STATE_RESETTING,
+    XHCI_STATE_STARTING,
+    XHCI_STATE_POWERING,
+    XHCI_STATE_READY,
+    XHCI_STATE_FAILED
+};
+
+struct xhci_trb {
+    uint32_t param_lo;
+    uint32_t param_hi;
+    uint32_t status;
+    uint32_t control;
+};
+
+struct xhci_ring {
+    struct xhci_trb *trbs;
+    uint32_t index;
+    uint8_t cycle;
+};
+
+struct xhci_device {
+    uint8_t used;
+    uint8_t serial;
+    uint8_t addr;
+    uint8_t slot;
+    uint8_t addressed;
+    uint8_t speed;
+    uint8_t root_port;
+    uint8_t tt_slot;
+    uint8_t tt_port;
+    uint8_t hub_ports;
+    uint8_t context_entries;
+    uint32_t route;
+    uint8_t *context;
+};
+
+struct xhci_endpoint {
+    struct xhci_ring ring;
+    uint8_t used;
+    uint8_t dev;
+    uint8_t dci;
+    uint8_t type;
+    uint8_t interval;
+    uint8_t configured;
+    uint8_t recovering;
+    uint16_t max_packet;
+};
+
+struct xhci_transfer {
+    struct xhci_endpoint *ep;
+    void *data;
+    uint32_t length;
+    uint32_t actual;
+    uint32_t first_trb;
+    uint32_t last_trb;
+    uint64_t deadline_tsc;
+    usb_callback_fn callback;
+    void *ctx;
+    uint8_t status;
+    uint8_t short_packet;
+    uint8_t used;
+};
+
+struct xhci_interrupt {
+    struct xhci_endpoint *ep;
+    void *buf;
+    uint16_t len;
+    uint8_t interval;
+    uint8_t used;
+    uint8_t halted;
+    uint8_t armed;
+    uint8_t resume;
+    uint32_t first_trb;
+    usb_callback_fn callback;
+    void *ctx;
+};
+
+struct xhci_command {
+    uint8_t type;
+    uint8_t dev;
+    uint8_t serial;
+    uint8_t slot;
+    uint8_t dci;
+    usb_callback_fn callback;
+    void *ctx;
+};
+
+struct xhci_controller {
+    volatile uint8_t *base;
+    volatile uint8_t *op_base;
+    volatile uint8_t *rt_base;
+    volatile uint32_t *doorbells;
+    uint32_t hcs_params1;
+    uint32_t hcs_params2;
+    uint32_t hcc_params1;
+    uint32_t context_size;
+    uint32_t legacy_cap;
+    uint32_t usb3_ports;
+    uint8_t max_slots;
+    uint8_t port_count;
+    uint8_t state;
+    uint64_t deadline_us;
+    uint8_t reset_port;
+    uint8_t reset_phase;
+    uint64_t reset_deadline_us;
+    uint64_t *dcbaa;
+    uint32_t *erst;
+    uint8_t *input_context;
+    uint8_t *context_pool;
+    struct xhci_trb *ring_pool;
+    struct xhci_ring command_ring;
+    struct xhci_ring event_ring;
+    struct xhci_device devices[XHCI_MAX_SLOTS];
+    struct xhci_endpoint endpoints[XHCI_MAX_ENDPOINTS];
+    struct xhci_transfer transfers[XHCI_MAX_TRANSFERS];
+    struct xhci_interrupt interrupts[XHCI_MAX_INTERRUPTS];
+    struct xhci_command commands[XHCI_COMMAND_QUEUE];
+    uint32_t command_head;
+    uint32_t command_tail;
+    uint8_t command_busy;
+    uint8_t command_aborting;
+    uint32_t command_trb;
+    uint64_t command_deadline_tsc;
+    uint8_t irq;
+    volatile uint32_t irq_status;
+    volatile uint32_t irq_events;
+};
+
+int xhci_init(struct xhci_controller *out, uint32_t bar0);
+enum xhci_state xhci_step(struct xhci_controller *ctrl, uint64_t now_us);
+int xhci_schedule_init(struct xhci_controller *ctrl);
+uint32_t xhci_port_count(const struct xhci_controller *ctrl);
+int xhci_port_connected(struct xhci_controller *ctrl, uint32_t port);
+int xhci_port_changed(struct xhci_controller *ctrl, uint32_t port);
+enum usb_speed xhci_port_speed(struct xhci_controller *ctrl, uint32_t port);
+int xhci_port_reset_begin(struct xhci_controller *ctrl, uint32_t port, uint64_t now_us);
+enum usb_status xhci_port_reset_poll(struct xhci_controller *ctrl, uint64_t now_us);
+int xhci_enable_irq(struct xhci_controller *ctrl, uint8_t irq);
+void xhci_process(struct xhci_controller *ctrl);
+int xhci_address_device(struct xhci_controller *ctrl,
+                        uint8_t dev_addr,
+                        enum usb_speed speed,
+                        uint8_t root_port,
+                        uint32_t route,
+                        uint8_t hub_addr,
+                        uint8_t hub_port,
+                        uint16_t max_packet0,
+                        usb_callback_fn callback,
+                        void *ctx);
+int xhci_update_max_packet0(struct xhci_controller *ctrl, uint8_t dev_addr, uint16_t max_packet0,
+                            usb_callback_fn callback, void *ctx);
+int xhci_set_hub(struct xhci_controller *ctrl, uint8_t dev_addr, uint8_t ports);
+void xhci_release_device(struct xhci_controller *ctrl, uint8_t dev_addr);
+int xhci_control_submit(struct xhci_controller *ctrl,
+                        uint8_t dev_addr,
+                        const void *setup,
+                        void *data,
+                        uint32_t length,
+                        int in_dir,
+                        usb_callback_fn callback,
+                        void *ctx);
+int xhci_interrupt_open(struct xhci_controller *ctrl,
+                        uint8_t dev_addr,
+                        uint8_t ep,
+                        uint16_t max_packet,
+                        uint8_t interval,
+                        void *buf,
+                        uint16_t len,
+                        usb_callback_fn callback,
+                        void *ctx);
+int xhci_interrupt_resume(struct xhci_controller *ctrl, int handle);
+int xhci_bulk_open(struct xhci_controller *ctrl, uint8_t dev_addr, uint8_t ep, uint16_t max_packet);
+int xhci_bulk_submit(struct xhci_controller *ctrl, int handle, void *data, uint32_t length,
+                     usb_callback_fn callback, void *ctx);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#define XHCI_CAPLENGTH 0x00
+#define XHCI_HCSPARAMS1 0x04
+#define XHCI_HCSPARAMS2 0x08
+#define XHCI_HCCPARAMS1 0x10
+#define XHCI_DBOFF 0x14
+#define XHCI_RTSOFF 0x18
+
+#define XHCI_USBCMD 0x00
+#define XHCI_USBSTS 0x04
+#define XHCI_CRCR 0x18
+#define XHCI_DCBAAP 0x30
+#define XHCI_CONFIG 0x38
+#define XHCI_PORTSC(n) (0x400u + (n) * 0x10u)
+
+#define XHCI_IMAN 0x20
+#define XHCI_IMOD 0x24
+#define XHCI_ERSTSZ 0x28
+#define XHCI_ERSTBA 0x30
+#define XHCI_ERDP 0x38
+
+#define XHCI_CMD_RUN (1u << 0)
+#define XHCI_CMD_RESET (1u << 1)
+#define XHCI_CMD_INTE (1u << 2)
+#define XHCI_STS_HALTED (1u << 0)
+#define XHCI_STS_HOST_ERROR (1u << 2)
+#define XHCI_STS_EVENT (1u << 3)
+#define XHCI_STS_NOT_READY (1u << 11)
+#define XHCI_CRCR_CA (1u << 2)
+#define XHCI_CRCR_CRR (1u << 3)
+#define XHCI_IMAN_PENDING (1u << 0)
+#define XHCI_IMAN_ENABLE (1u << 1)
+#define XHCI_ERDP_BUSY (1u << 3)
+
+static inline uint32_t mmio_read32(volatile uint8_t *base, uint32_t off) {
+    return *(volatile uint32_t *)(base + off);
+}
+
+static inline void mmio_write32(volatile uint8_t *base, uint32_t off, uint32_t value) {
+    *(volatile uint32_t *)(base + off) = value;
+}
@@ -81,29 +81,61 @@ struct rect mui_window_close_rect(struct rect r) {
     return close;
 }
 
-void mui_draw_window(const struct framebuffer *fb, struct rect r, const char *title, uint32_t accent) {
+static int str_len(const char *s) {
+    int len = 0;
+    while (s[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+static struct rect text_rect(int x, int y, const char *text) {
+    return (struct rect){ x, y, str_len(text) * 8, 8 };
+}
+
+void mui_draw_window(const struct draw_ctx *ctx, struct rect r, const char *title, uint32_t accent) {
+    if (!draw_visible(ctx, r)) {
+        return;
+    }
     uint32_t border = rgb(15, 24, 42);
     uint32_t body = rgb(230, 234, 240);
-    fb_fill_rect(fb, r, border);
-    struct rect inner = { r.x + 2, r.y + 2, r.w - 4, r.h - 4 };
-    fb_fill_rect(fb, inner, body);
+    draw_fill_rect(ctx, (struct rect){ r.x, r.y, r.w, 2 }, border);
+    draw_fill_rect(ctx, (struct rect){ r.x, r.y + r.h - 2, r.w, 2 }, border);
+    draw_fill_rect(ctx, (struct rect){ r.x, r.y + 2, 2, r.h - 4 }, border);
+    draw_fill_rect(ctx, (struct rect){ r.x + r.w - 2, r.y + 2, 2, r.h - 4 }, border);
+
     struct rect bar = mui_window_titlebar_rect(r);
-    fb_fill_rect(fb, bar, accent);
-    fb_draw_string(fb, r.x + 8, r.y + 6, title, rgb(255, 255, 255), accent);
+    struct rect inner = { r.x + 2, bar.y + bar.h, r.w - 4, r.h - 4 - bar.h };
+    draw_fill_rect(ctx, inner, body);
+
+    if (draw_visible(ctx, bar)) {
+        struct rect close = mui_window_close_rect(r);
+        struct rect holes[2] = { text_rect(r.x + 8, r.y + 6, title), close };
+        holes[0] = rect_intersect(holes[0], bar);
+        draw_fill_rect_excluding(ctx, bar, holes, 2, accent);
+        draw_string(ctx, r.x + 8, r.y + 6, title, rgb(255, 255, 255), accent);
 
-    struct rect close = mui_window_close_rect(r);
-    fb_fill_rect(fb, close, rgb(200, 64, 64));
-    fb_draw_string(fb, close.x + 4, close.y + 3, "X", rgb(255, 255, 255), rgb(200, 64, 64));
+        struct rect glyph = text_rect(close.x + 4, close.y + 3, "X");
+        draw_fill_rect_excluding(ctx, close, &glyph, 1, rgb(200, 64, 64));
+        draw_string(ctx, close.x + 4, close.y + 3, "X", rgb(255, 255, 255), rgb(200, 64, 64));
+    }
 }
 
-void mui_draw_button(const struct framebuffer *fb, struct rect r, const char *label, uint32_t bg, uint32_t fg) {
-    fb_fill_rect(fb, r, bg);
-    fb_draw_string(fb, r.x + 8, r.y + 7, label, fg, bg);
+void mui_draw_button(const struct draw_ctx *ctx, struct rect r, const char *label, uint32_t bg, uint32_t fg) {
+    if (!draw_visible(ctx, r)) {
+        return;
+    }
+    struct rect text = rect_intersect(text_rect(r.x + 8, r.y + 7, label), r);
+    draw_fill_rect_excluding(ctx, r, &text, 1, bg);
+    draw_string(ctx, r.x + 8, r.y + 7, label, fg, bg);
 }
 
-void mui_draw_progress(const struct framebuffer *fb, struct rect r, uint32_t value, uint32_t max_value, uint32_t fill, uint32_t empty) {
-    fb_fill_rect(fb, r, empty);
+void mui_draw_progress(const struct draw_ctx *ctx, struct rect r, uint32_t value, uint32_t max_value, uint32_t fill, uint32_t empty) {
+    if (!draw_visible(ctx, r)) {
+        return;
+    }
     if (max_value == 0) {
+        draw_fill_rect(ctx, r, empty);
         return;
     }
     if (value > max_value) {
@@ -119,7 +151,9 @@ void mui_draw_progress(const struct framebuffer *fb, struct rect r, uint32_t val
         fill_w = r.w;
     }
     struct rect fill_rect = { r.x, r.y, fill_w, r.h };
-    fb_fill_rect(fb, fill_rect, fill);
+    struct rect empty_rect = { r.x + fill_w, r.y, r.w - fill_w, r.h };
+    draw_fill_rect(ctx, fill_rect, fill);
+    draw_fill_rect(ctx, empty_rect, empty);
 }
 
 void mui_draw_cursor(const struct framebuffer *fb, int x, int y) {
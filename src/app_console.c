@@ -0,0 +1,88 @@
+#include <stdint.h>
+
+#include "ui_apps.h"
+#include "console.h"
+#include "draw.h"
+#include "magicui.h"
+#include "framebuffer.h"
+
+#define CONSOLE_APP_TEXT_X 10
+#define CONSOLE_APP_TEXT_Y 32
+
+static struct rect text_area(const struct ui_state *state) {
+    struct rect window = ui_app_rect(state, UI_APP_CONSOLE);
+    return (struct rect){ CONSOLE_APP_TEXT_X, CONSOLE_APP_TEXT_Y,
+                          window.w - CONSOLE_APP_TEXT_X * 2, window.h - CONSOLE_APP_TEXT_Y - 8 };
+}
+
+static uint32_t text_rows(struct rect area) {
+    uint32_t rows = area.h > 0 ? (uint32_t)area.h / CONSOLE_LINE_HEIGHT : 0;
+    return rows < UI_CONSOLE_ROWS ? rows : UI_CONSOLE_ROWS;
+}
+
+struct rect app_console_update(struct ui_state *state) {
+    struct console_lines *lines = &state->console;
+    struct console_viewport *port = &lines->port;
+    const struct console *con = console_system();
+    struct rect area = text_area(state);
+    uint32_t rows = text_rows(area);
+    if (port->rows != rows) {
+        console_viewport_init(port, rows);
+    }
+    uint32_t first = 0;
+    uint32_t end = 0;
+    if (!console_viewport_sync(port, con, &first, &end)) {
+        return (struct rect){ 0, 0, 0, 0 };
+    }
+    for (uint32_t row = first; row < end; ++row) {
+        uint32_t len = 0;
+        const char *text = console_line(con, port->top + row, &len);
+        if (!text || len > CONSOLE_COLS) {
+            len = text ? CONSOLE_COLS : 0;
+        }
+        for (uint32_t i = 0; i < len; ++i) {
+            lines->text[row][i] = text[i];
+        }
+        lines->text[row][len] = '\0';
+        lines->length[row] = (uint8_t)len;
+    }
+    return (struct rect){ area.x, area.y + (int)first * CONSOLE_LINE_HEIGHT,
+                          area.w, (int)(end - first) * CONSOLE_LINE_HEIGHT };
+}
+
+void app_console_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent) {
+    mui_draw_window(ctx, draw_bounds(ctx), "Console", accent);
+    struct rect area = text_area(state);
+    uint32_t fg = rgb(200, 220, 200);
+    uint32_t bg = rgb(16, 20, 28);
+    const struct console_lines *lines = &state->console;
+    const struct console_viewport *port = &lines->port;
+    int used = (int)port->rows * CONSOLE_LINE_HEIGHT;
+    draw_fill_rect(ctx, (struct rect){ area.x, area.y + used, area.w, area.h - used }, bg);
+    if (!draw_push_clip(ctx, area)) {
+        return;
+    }
+    uint32_t cols = (uint32_t)area.w / 8u;
+    if (cols > CONSOLE_COLS) {
+        cols = CONSOLE_COLS;
+    }
+    for (uint32_t row = 0; row < port->rows; ++row) {
+        struct rect line = { area.x, area.y + (int)row * CONSOLE_LINE_HEIGHT, area.w, CONSOLE_LINE_HEIGHT };
+        if (!draw_visible(ctx, line)) {
+            continue;
+        }
+        uint32_t len = lines->length[row] < cols ? lines->length[row] : cols;
+        if (len > 0) {
+            char visible[CONSOLE_COLS + 1];
+            for (uint32_t i = 0; i < len; ++i) {
+                visible[i] = lines->text[row][i];
+            }
+            visible[len] = '\0';
+            draw_string(ctx, line.x, line.y, visible, fg, bg);
+        }
+        int text_w = (int)len * 8;
+        draw_fill_rect(ctx, (struct rect){ line.x + text_w, line.y, line.w - text_w, 8 }, bg);
+        draw_fill_rect(ctx, (struct rect){ line.x, line.y + 8, line.w, CONSOLE_LINE_HEIGHT - 8 }, bg);
+    }
+    draw_pop(ctx);
+}
@@ -1,11 +1,13 @@
 #include <stdint.h>
 
 #include "ui_apps.h"
+#include "draw.h"
 #include "magicui.h"
 #include "framebuffer.h"
 
-void app_files_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent) {
-    mui_draw_window(fb, state->files_rect, "Folders", accent);
-    fb_draw_string(fb, state->files_rect.x + 20, state->files_rect.y + 40, "Documents", rgb(60, 60, 60), rgb(230, 234, 240));
-    fb_draw_string(fb, state->files_rect.x + 20, state->files_rect.y + 60, "Downloads", rgb(60, 60, 60), rgb(230, 234, 240));
+void app_files_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent) {
+    (void)state;
+    mui_draw_window(ctx, draw_bounds(ctx), "Folders", accent);
+    draw_string(ctx, 20, 40, "Documents", rgb(60, 60, 60), rgb(230, 234, 240));
+    draw_string(ctx, 20, 60, "Downloads", rgb(60, 60, 60), rgb(230, 234, 240));
 }
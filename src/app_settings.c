@@ -1,7 +1,9 @@
 #include <stdint.h>
 
 #include "ui_apps.h"
+#include "draw.h"
 #include "magicui.h"
+#include "mui_widget.h"
 #include "framebuffer.h"
 
 static uint32_t str_len(const char *s) {
@@ -92,83 +94,109 @@ static void format_bpp(uint8_t bpp, char *out, uint32_t max_len) {
     str_append(out, " bpp", max_len);
 }
 
-int app_settings_handle_click(struct ui_state *state, int mouse_x, int mouse_y) {
-    struct rect panel = state->settings_rect;
-    int y = panel.y + 44;
-    int x = panel.x + 16;
-    int spacing = 34;
-
-    for (int i = 0; i < 5; ++i) {
-        struct rect button = { x + i * spacing, y, 24, 24 };
-        if (point_in_rect(mouse_x, mouse_y, button)) {
-            state->theme_index = i;
-            return 1;
-        }
+static void format_info(const struct ui_state *state, int row, char *out, uint32_t max_len) {
+    char value[64];
+    switch (row) {
+    case 0:
+        str_copy(out, "OS: ", max_len);
+        str_append(out, state->info.version, max_len);
+        break;
+    case 1:
+        str_copy(out, "Kernel: ", max_len);
+        str_append(out, state->info.kernel, max_len);
+        break;
+    case 2:
+        str_copy(out, "CPU: ", max_len);
+        str_append(out, state->info.cpu[0] ? state->info.cpu : "Unknown", max_len);
+        break;
+    case 3:
+        format_ram(state->info.ram_kb, value, sizeof(value));
+        str_copy(out, "RAM: ", max_len);
+        str_append(out, value, max_len);
+        break;
+    case 4:
+        format_resolution(state->info.width, state->info.height, value, sizeof(value));
+        str_copy(out, "Resolution: ", max_len);
+        str_append(out, value, max_len);
+        break;
+    case 5:
+        format_bpp(state->info.bpp, value, sizeof(value));
+        str_copy(out, "Color Depth: ", max_len);
+        str_append(out, value, max_len);
+        break;
+    default:
+        str_copy(out, "Display: ", max_len);
+        str_append(out, state->info.display[0] ? state->info.display : "Unknown", max_len);
+        break;
     }
-
-    return 0;
 }
 
-void app_settings_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent) {
-    mui_draw_window(fb, state->settings_rect, "Settings", accent);
-
-    int content_x = state->settings_rect.x + 16;
-    int content_y = state->settings_rect.y + 36;
-    fb_draw_string(fb, content_x, content_y, "Theme Colors", rgb(60, 60, 60), rgb(230, 234, 240));
+static void settings_build(struct ui_state *state) {
+    struct settings_view *view = &state->settings;
+    struct mui_tree *tree = &view->tree;
+    struct rect window = ui_app_rect(state, UI_APP_SETTINGS);
+    struct rect bounds = { 0, 0, window.w, window.h };
+    mui_tree_init(tree);
 
-    int btn_y = content_y + 14;
-    int btn_x = content_x;
-    int spacing = 34;
+    int heading = mui_tree_add(tree, MUI_WIDGET_LABEL, -1, (struct rect){ 16, 36, 0, 8 });
+    mui_set_text(tree, heading, "Theme Colors");
 
-    for (int i = 0; i < 5; ++i) {
-        struct rect button = { btn_x + i * spacing, btn_y, 24, 24 };
-        fb_fill_rect(fb, button, mui_theme_color(i));
-        if (state->theme_index == i) {
-            struct rect outline = { button.x - 2, button.y - 2, button.w + 4, button.h + 4 };
-            fb_fill_rect(fb, outline, rgb(20, 20, 20));
-            fb_fill_rect(fb, button, mui_theme_color(i));
-        }
+    for (int i = 0; i < SETTINGS_THEME_COUNT; ++i) {
+        view->swatches[i] = mui_tree_add(tree, MUI_WIDGET_BUTTON, -1, (struct rect){ 16 + i * 34, 50, 24, 24 });
+        mui_set_colors(tree, view->swatches[i], rgb(255, 255, 255), mui_theme_color(i));
     }
 
-    int labels_y = btn_y + 30;
-    fb_draw_string(fb, content_x, labels_y, mui_theme_name(state->theme_index), rgb(60, 60, 60), rgb(230, 234, 240));
+    view->theme_name = mui_tree_add(tree, MUI_WIDGET_LABEL, -1, (struct rect){ 16, 80, 0, 8 });
 
-    int info_y = labels_y + 24;
-    char buffer[64];
+    int list = mui_tree_add(tree, MUI_WIDGET_LIST, -1, (struct rect){ 16, 104, bounds.w - 32, SETTINGS_INFO_ROWS * MUI_LIST_ROW_HEIGHT });
     char line[64];
+    for (int i = 0; i < SETTINGS_INFO_ROWS; ++i) {
+        view->info_rows[i] = mui_tree_add(tree, MUI_WIDGET_LABEL, list, (struct rect){ 0, 0, 0, 0 });
+        format_info(state, i, line, sizeof(line));
+        mui_set_text(tree, view->info_rows[i], line);
+    }
+
+    view->progress = mui_tree_add(tree, MUI_WIDGET_PROGRESS, -1, (struct rect){ 16, bounds.h - 24, bounds.w - 32, 10 });
+    view->theme_index = -1;
+    view->built = 1;
+}
+
+static void settings_sync(struct ui_state *state) {
+    struct settings_view *view = &state->settings;
+    if (!view->built) {
+        settings_build(state);
+    }
+    if (view->theme_index == state->theme_index) {
+        return;
+    }
+    struct mui_tree *tree = &view->tree;
+    for (int i = 0; i < SETTINGS_THEME_COUNT; ++i) {
+        mui_set_selected(tree, view->swatches[i], state->theme_index == i);
+    }
+    mui_set_text(tree, view->theme_name, mui_theme_name(state->theme_index));
+    mui_set_value(tree, view->progress, (uint32_t)(state->theme_index + 1), SETTINGS_THEME_COUNT);
+    mui_set_colors(tree, view->progress, mui_theme_color(state->theme_index), rgb(180, 185, 195));
+    view->theme_index = state->theme_index;
+}
+
+struct rect app_settings_update(struct ui_state *state) {
+    settings_sync(state);
+    return mui_tree_take_dirty(&state->settings.tree);
+}
+
+int app_settings_handle_click(struct ui_state *state, int mouse_x, int mouse_y) {
+    settings_sync(state);
+    int hit = mui_tree_hit(&state->settings.tree, mouse_x, mouse_y);
+    for (int i = 0; i < SETTINGS_THEME_COUNT; ++i) {
+        if (hit >= 0 && hit == state->settings.swatches[i]) {
+            state->theme_index = i;
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    str_copy(buffer, "OS: ", sizeof(buffer));
-    str_append(buffer, state->info.version, sizeof(buffer));
-    fb_draw_string(fb, content_x, info_y, buffer, rgb(60, 60, 60), rgb(230, 234, 240));
-    info_y += 16;
-
-    str_copy(buffer, "Kernel: ", sizeof(buffer));
-    str_append(buffer, state->info.kernel, sizeof(buffer));
-    fb_draw_string(fb, content_x, info_y, buffer, rgb(60, 60, 60), rgb(230, 234, 240));
-    info_y += 16;
-
-    str_copy(buffer, "CPU: ", sizeof(buffer));
-    str_append(buffer, state->info.cpu[0] ? state->info.cpu : "Unknown", sizeof(buffer));
-    fb_draw_string(fb, content_x, info_y, buffer, rgb(60, 60, 60), rgb(230, 234, 240));
-    info_y += 16;
-
-    format_ram(state->info.ram_kb, buffer, sizeof(buffer));
-    str_copy(line, "RAM: ", sizeof(line));
-    str_append(line, buffer, sizeof(line));
-    fb_draw_string(fb, content_x, info_y, line, rgb(60, 60, 60), rgb(230, 234, 240));
-    info_y += 16;
-
-    format_resolution(state->info.width, state->info.height, buffer, sizeof(buffer));
-    str_copy(line, "Resolution: ", sizeof(line));
-    str_append(line, buffer, sizeof(line));
-    fb_draw_string(fb, content_x, info_y, line, rgb(60, 60, 60), rgb(230, 234, 240));
-    info_y += 16;
-
-    format_bpp(state->info.bpp, buffer, sizeof(buffer));
-    str_copy(line, "Color Depth: ", sizeof(line));
-    str_append(line, buffer, sizeof(line));
-    fb_draw_string(fb, content_x, info_y, line, rgb(60, 60, 60), rgb(230, 234, 240));
-
-    struct rect progress = { state->settings_rect.x + 16, state->settings_rect.y + state->settings_rect.h - 24, state->settings_rect.w - 32, 10 };
-    mui_draw_progress(fb, progress, (uint32_t)(state->theme_index + 1), 5, accent, rgb(180, 185, 195));
+void app_settings_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent) {
+    mui_draw_window(ctx, draw_bounds(ctx), "Settings", accent);
+    mui_tree_render(&state->settings.tree, ctx);
 }
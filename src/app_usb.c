@@ -1,21 +1,128 @@
 #include <stdint.h>
 
 #include "ui_apps.h"
+#include "draw.h"
 #include "magicui.h"
 #include "framebuffer.h"
 #include "usb.h"
 
-void app_usb_render(const struct framebuffer *fb, const struct ui_state *state, uint32_t accent) {
-    mui_draw_window(fb, state->usb_rect, "USB Manager", accent);
-    int x = state->usb_rect.x + 16;
-    int y = state->usb_rect.y + 40;
-    fb_draw_string(fb, x, y, "Controllers:", rgb(60, 60, 60), rgb(230, 234, 240));
-    y += 16;
+static int put_text(char *line, int pos, const char *text) {
+    while (*text) {
+        line[pos++] = *text++;
+    }
+    return pos;
+}
+
+static int put_dec(char *line, int pos, uint32_t value) {
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10u);
+        value /= 10u;
+    } while (value > 0);
+    while (count > 0) {
+        line[pos++] = digits[--count];
+    }
+    return pos;
+}
+
+static const char *speed_label(uint8_t speed) {
+    switch (speed) {
+    case USB_SPEED_LOW:
+        return " LS";
+    case USB_SPEED_FULL:
+        return " FS";
+    case USB_SPEED_HIGH:
+        return " HS";
+    case USB_SPEED_SUPER:
+        return " SS";
+    default:
+        return " ??";
+    }
+}
+
+static int format_device(char *line, const struct usb_device_info *info) {
+    int pos = 0;
+    for (uint32_t i = 0; i < info->depth; ++i) {
+        pos = put_text(line, pos, "  ");
+    }
+    pos = put_text(line, pos, "A");
+    pos = put_dec(line, pos, info->addr);
+    pos = put_text(line, pos, " P");
+    pos = put_dec(line, pos, info->port);
+    pos = put_text(line, pos, speed_label(info->speed));
+    if (info->hub_ports) {
+        pos = put_text(line, pos, " hub/");
+        pos = put_dec(line, pos, info->hub_ports);
+    }
+    if (info->hid_mask & USB_HID_KEYBOARD) {
+        pos = put_text(line, pos, " kbd");
+    }
+    if (info->hid_mask & USB_HID_MOUSE) {
+        pos = put_text(line, pos, " mouse");
+    }
+    line[pos] = '\0';
+    return pos;
+}
 
+static int draw_subtree(struct draw_ctx *ctx, const struct usb_view *usb, int x, int y, uint8_t controller,
+                        uint8_t parent) {
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        const struct usb_device_info *info = &usb->devices[i];
+        if (info->addr == 0 || info->controller != controller || info->parent != parent) {
+            continue;
+        }
+        char line[48];
+        format_device(line, info);
+        draw_string(ctx, x, y, line, rgb(60, 60, 60), rgb(230, 234, 240));
+        y += 16;
+        if (info->hub_ports) {
+            y = draw_subtree(ctx, usb, x, y, controller, info->addr);
+        }
+    }
+    return y;
+}
+
+struct rect app_usb_update(struct ui_state *state) {
+    struct usb_view *usb = &state->usb;
+    uint32_t generation = usb_generation();
+    if (usb->valid && generation == usb->generation) {
+        return (struct rect){ 0, 0, 0, 0 };
+    }
+    usb->generation = generation;
+    usb->valid = 1;
+    usb->controller_count = usb_controller_count();
+    if (usb->controller_count > USB_MAX_CONTROLLERS) {
+        usb->controller_count = USB_MAX_CONTROLLERS;
+    }
     const struct usb_controller_info *list = usb_controller_list();
-    uint32_t count = usb_controller_count();
+    for (uint32_t i = 0; i < usb->controller_count; ++i) {
+        usb->controllers[i] = list[i];
+    }
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        const struct usb_device_info *info = usb_device_at(i);
+        if (info) {
+            usb->devices[i] = *info;
+        } else {
+            usb->devices[i].addr = 0;
+        }
+    }
+    struct rect window = ui_app_rect(state, UI_APP_USB);
+    return (struct rect){ 0, 0, window.w, window.h };
+}
+
+void app_usb_render(struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent) {
+    const struct usb_view *usb = &state->usb;
+    mui_draw_window(ctx, draw_bounds(ctx), "USB Manager", accent);
+    int x = 16;
+    int y = 40;
+    draw_string(ctx, x, y, "Controllers:", rgb(60, 60, 60), rgb(230, 234, 240));
+    y += 16;
+
+    const struct usb_controller_info *list = usb->controllers;
+    uint32_t count = usb->controller_count;
     if (count == 0) {
-        fb_draw_string(fb, x, y, "None found", rgb(60, 60, 60), rgb(230, 234, 240));
+        draw_string(ctx, x, y, "None found", rgb(60, 60, 60), rgb(230, 234, 240));
     }
 
     for (uint32_t i = 0; i < count; ++i) {
@@ -37,7 +144,18 @@ void app_usb_render(const struct framebuffer *fb, const struct ui_state *state,
         line[14] = "0123456789ABCDEF"[(list[i].prog_if >> 4) & 0xF];
         line[15] = "0123456789ABCDEF"[list[i].prog_if & 0xF];
         line[16] = '\0';
-        fb_draw_string(fb, x, y, line, rgb(60, 60, 60), rgb(230, 234, 240));
+        draw_string(ctx, x, y, line, rgb(60, 60, 60), rgb(230, 234, 240));
         y += 16;
     }
+
+    y += 8;
+    draw_string(ctx, x, y, "Devices:", rgb(60, 60, 60), rgb(230, 234, 240));
+    y += 16;
+    int first = y;
+    for (uint8_t hc = 0; hc < USB_MAX_CONTROLLERS; ++hc) {
+        y = draw_subtree(ctx, usb, x, y, hc, 0);
+    }
+    if (y == first) {
+        draw_string(ctx, x, y, "None attached", rgb(60, 60, 60), rgb(230, 234, 240));
+    }
 }
@@ -0,0 +1,133 @@
+#include "bga.h"
+#include "log.h"
+#include "pci.h"
+#include "portio.h"
+
+#define VBE_DISPI_IOPORT_INDEX 0x01CE
+#define VBE_DISPI_IOPORT_DATA 0x01CF
+
+#define VBE_DISPI_INDEX_ID 0x0
+#define VBE_DISPI_INDEX_XRES 0x1
+#define VBE_DISPI_INDEX_YRES 0x2
+#define VBE_DISPI_INDEX_BPP 0x3
+#define VBE_DISPI_INDEX_ENABLE 0x4
+#define VBE_DISPI_INDEX_VIRT_WIDTH 0x6
+#define VBE_DISPI_INDEX_VIRT_HEIGHT 0x7
+#define VBE_DISPI_INDEX_X_OFFSET 0x8
+#define VBE_DISPI_INDEX_Y_OFFSET 0x9
+#define VBE_DISPI_INDEX_VIDEO_MEMORY_64K 0xA
+
+#define VBE_DISPI_ID0 0xB0C0
+#define VBE_DISPI_ID5 0xB0C5
+
+#define VBE_DISPI_ENABLED 0x01
+#define VBE_DISPI_LFB_ENABLED 0x40
+
+static void dispi_write(uint16_t index, uint16_t value) {
+    outw(VBE_DISPI_IOPORT_INDEX, index);
+    outw(VBE_DISPI_IOPORT_DATA, value);
+}
+
+static uint16_t dispi_read(uint16_t index) {
+    outw(VBE_DISPI_IOPORT_INDEX, index);
+    return inw(VBE_DISPI_IOPORT_DATA);
+}
+
+static void bga_device_cb(uint8_t bus, uint8_t dev, uint8_t func,
+                          uint8_t class_code, uint8_t subclass,
+                          uint8_t prog_if, void *ctx) {
+    (void)subclass;
+    (void)prog_if;
+    struct bga_device *out = (struct bga_device *)ctx;
+    if (class_code != 0x03 || out->lfb_addr != 0) {
+        return;
+    }
+    uint16_t vendor = pci_read_config16(bus, dev, func, 0x00);
+    uint16_t device = pci_read_config16(bus, dev, func, 0x02);
+    int match = (vendor == BGA_PCI_VENDOR_QEMU && device == BGA_PCI_DEVICE_QEMU) ||
+                (vendor == BGA_PCI_VENDOR_VBOX && device == BGA_PCI_DEVICE_VBOX);
+    if (!match) {
+        return;
+    }
+    uint32_t bar0 = pci_read_config32(bus, dev, func, 0x10);
+    if ((bar0 & 0x1u) != 0 || (bar0 & 0xFFFFFFF0u) == 0) {
+        return;
+    }
+    out->bus = bus;
+    out->dev = dev;
+    out->func = func;
+    out->lfb_addr = bar0 & 0xFFFFFFF0u;
+}
+
+int bga_probe(struct bga_device *out) {
+    if (!out) {
+        return 0;
+    }
+    out->lfb_addr = 0;
+    out->vram_bytes = 0;
+    out->width = 0;
+    out->height = 0;
+    out->virt_height = 0;
+    out->pitch = 0;
+    out->bpp = 0;
+    pci_scan_bus0(bga_device_cb, out);
+    if (out->lfb_addr == 0) {
+        return 0;
+    }
+
+    out->version = dispi_read(VBE_DISPI_INDEX_ID);
+    if (out->version < VBE_DISPI_ID0 || out->version > VBE_DISPI_ID5) {
+        out->lfb_addr = 0;
+        return 0;
+    }
+    if (out->version >= VBE_DISPI_ID5) {
+        out->vram_bytes = (uint32_t)dispi_read(VBE_DISPI_INDEX_VIDEO_MEMORY_64K) << 16;
+    }
+
+    log_puts("BGA: id=");
+    log_hex32(out->version);
+    log_puts(" lfb=");
+    log_hex32(out->lfb_addr);
+    log_puts(" vram=");
+    log_dec32(out->vram_bytes >> 10);
+    log_puts(" KiB\n");
+    return 1;
+}
+
+int bga_set_mode(struct bga_device *bga, uint32_t width, uint32_t height, uint32_t virt_height, uint32_t bpp) {
+    if (!bga || bga->lfb_addr == 0 || width == 0 || height == 0 || virt_height < height) {
+        return 0;
+    }
+    if (bpp != 16 && bpp != 32) {
+        return 0;
+    }
+
+    dispi_write(VBE_DISPI_INDEX_ENABLE, 0);
+    dispi_write(VBE_DISPI_INDEX_XRES, (uint16_t)width);
+    dispi_write(VBE_DISPI_INDEX_YRES, (uint16_t)height);
+    dispi_write(VBE_DISPI_INDEX_BPP, (uint16_t)bpp);
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED);
+    dispi_write(VBE_DISPI_INDEX_VIRT_WIDTH, (uint16_t)width);
+    dispi_write(VBE_DISPI_INDEX_VIRT_HEIGHT, (uint16_t)virt_height);
+    dispi_write(VBE_DISPI_INDEX_X_OFFSET, 0);
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, 0);
+
+    if (dispi_read(VBE_DISPI_INDEX_XRES) != width || dispi_read(VBE_DISPI_INDEX_YRES) != height ||
+        dispi_read(VBE_DISPI_INDEX_BPP) != bpp) {
+        return 0;
+    }
+
+    bga->width = width;
+    bga->height = height;
+    bga->virt_height = dispi_read(VBE_DISPI_INDEX_VIRT_HEIGHT);
+    bga->pitch = (uint32_t)dispi_read(VBE_DISPI_INDEX_VIRT_WIDTH) * (bpp / 8u);
+    bga->bpp = bpp;
+    return 1;
+}
+
+void bga_set_y_offset(struct bga_device *bga, uint32_t y) {
+    if (!bga || y + bga->height > bga->virt_height) {
+        return;
+    }
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, (uint16_t)y);
+}
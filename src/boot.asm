@@ -6,6 +6,10 @@ BITS 32
 %define MULTIBOOT2_MAGIC 0xE85250D6
 %define MULTIBOOT2_ARCH 0x00000000
 
+%ifndef FB_BPP
+%define FB_BPP 32
+%endif
+
 section .multiboot
 align 8
 mb2_header_start:
@@ -20,7 +24,7 @@ mb2_header_start:
     dd 24
     dd 1024
     dd 768
-    dd 32
+    dd FB_BPP
     dd 0
 
     ; End tag
@@ -0,0 +1,86 @@
+#include "cmdline.h"
+
+static char cmdline_buffer[CMDLINE_MAX];
+
+void cmdline_init(const char *cmdline) {
+    uint32_t len = 0;
+    if (cmdline) {
+        while (cmdline[len] && len + 1 < CMDLINE_MAX) {
+            cmdline_buffer[len] = cmdline[len];
+            len++;
+        }
+    }
+    cmdline_buffer[len] = '\0';
+}
+
+const char *cmdline_raw(void) {
+    return cmdline_buffer;
+}
+
+static const char *find_token(const char *name, const char **value) {
+    const char *p = cmdline_buffer;
+    while (*p) {
+        while (*p == ' ') {
+            p++;
+        }
+        const char *start = p;
+        uint32_t i = 0;
+        while (name[i] && p[i] == name[i]) {
+            i++;
+        }
+        if (!name[i] && (p[i] == '=' || p[i] == ' ' || p[i] == '\0')) {
+            *value = p[i] == '=' ? p + i + 1 : 0;
+            return start;
+        }
+        while (*p && *p != ' ') {
+            p++;
+        }
+    }
+    return 0;
+}
+
+int cmdline_get(const char *key, char *out, uint32_t out_size) {
+    const char *value = 0;
+    if (!key || !out || out_size == 0) {
+        return 0;
+    }
+    if (!find_token(key, &value) || !value) {
+        return 0;
+    }
+    uint32_t len = 0;
+    while (value[len] && value[len] != ' ' && len + 1 < out_size) {
+        out[len] = value[len];
+        len++;
+    }
+    out[len] = '\0';
+    return 1;
+}
+
+int cmdline_get_u32(const char *key, uint32_t *out) {
+    char text[12];
+    if (!out || !cmdline_get(key, text, sizeof(text))) {
+        return 0;
+    }
+    uint32_t value = 0;
+    uint32_t i = 0;
+    if (text[0] == '\0') {
+        return 0;
+    }
+    while (text[i]) {
+        if (text[i] < '0' || text[i] > '9') {
+            return 0;
+        }
+        value = value * 10u + (uint32_t)(text[i] - '0');
+        i++;
+    }
+    *out = value;
+    return 1;
+}
+
+int cmdline_has(const char *flag) {
+    const char *value = 0;
+    if (!flag) {
+        return 0;
+    }
+    return find_token(flag, &value) != 0;
+}
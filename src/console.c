@@ -0,0 +1,175 @@
+#include "console.h"
+
+#define CONSOLE_MASK (CONSOLE_LINES - 1u)
+#define CONSOLE_TAB 4u
+
+static struct console system_console;
+
+struct console *console_system(void) {
+    return &system_console;
+}
+
+void console_init(struct console *con) {
+    if (!con) {
+        return;
+    }
+    for (uint32_t i = 0; i < CONSOLE_LINES; ++i) {
+        con->text[i][0] = '\0';
+        con->length[i] = 0;
+        con->stamp[i] = 0;
+    }
+    con->first = 0;
+    con->last = 0;
+    con->generation = 1;
+    con->stamp[0] = con->generation;
+}
+
+static void new_line(struct console *con) {
+    con->last++;
+    if (con->last - con->first >= CONSOLE_LINES) {
+        con->first++;
+    }
+    uint32_t slot = con->last & CONSOLE_MASK;
+    con->text[slot][0] = '\0';
+    con->length[slot] = 0;
+    con->stamp[slot] = con->generation;
+}
+
+static void append(struct console *con, char c) {
+    uint32_t slot = con->last & CONSOLE_MASK;
+    if (con->length[slot] >= CONSOLE_COLS) {
+        new_line(con);
+        slot = con->last & CONSOLE_MASK;
+    }
+    con->text[slot][con->length[slot]++] = c;
+    con->text[slot][con->length[slot]] = '\0';
+    con->stamp[slot] = con->generation;
+}
+
+static void put_char(struct console *con, char c) {
+    uint32_t slot = con->last & CONSOLE_MASK;
+    switch (c) {
+    case '\n':
+        new_line(con);
+        break;
+    case '\r':
+        con->length[slot] = 0;
+        con->text[slot][0] = '\0';
+        con->stamp[slot] = con->generation;
+        break;
+    case '\b':
+        if (con->length[slot] > 0) {
+            con->text[slot][--con->length[slot]] = '\0';
+            con->stamp[slot] = con->generation;
+        }
+        break;
+    case '\t':
+        do {
+            append(con, ' ');
+        } while ((con->length[con->last & CONSOLE_MASK] % CONSOLE_TAB) != 0);
+        break;
+    default:
+        append(con, (c >= 32 && c <= 126) ? c : '?');
+        break;
+    }
+}
+
+void console_write(struct console *con, const char *s, uint32_t len) {
+    if (!con || !s || len == 0) {
+        return;
+    }
+    con->generation++;
+    for (uint32_t i = 0; i < len; ++i) {
+        put_char(con, s[i]);
+    }
+}
+
+void console_putc(struct console *con, char c) {
+    console_write(con, &c, 1);
+}
+
+const char *console_line(const struct console *con, uint32_t line, uint32_t *len) {
+    if (!con || line < con->first || line > con->last) {
+        return 0;
+    }
+    uint32_t slot = line & CONSOLE_MASK;
+    if (len) {
+        *len = con->length[slot];
+    }
+    return con->text[slot];
+}
+
+uint32_t console_generation(const struct console *con) {
+    return con ? con->generation : 0;
+}
+
+void console_viewport_init(struct console_viewport *port, uint32_t rows) {
+    port->rows = rows;
+    port->top = 0;
+    port->seen = 0;
+    port->valid = 0;
+}
+
+int console_viewport_sync(struct console_viewport *port, const struct console *con,
+                          uint32_t *first_row, uint32_t *end_row) {
+    uint32_t top = con->last + 1u > port->rows ? con->last + 1u - port->rows : 0;
+    if (top < con->first) {
+        top = con->first;
+    }
+    uint32_t first = port->rows;
+    uint32_t end = 0;
+    if (!port->valid || top != port->top) {
+        first = 0;
+        end = port->rows;
+    } else {
+        for (uint32_t row = 0; row < port->rows && top + row <= con->last; ++row) {
+            if (con->stamp[(top + row) & CONSOLE_MASK] > port->seen) {
+                if (first == port->rows) {
+                    first = row;
+                }
+                end = row + 1u;
+            }
+        }
+    }
+    port->top = top;
+    port->seen = con->generation;
+    port->valid = 1;
+    *first_row = first;
+    *end_row = end;
+    return end > first;
+}
+
+void console_view_init(struct console_view *view, const struct framebuffer *fb, struct rect area,
+                       uint32_t fg, uint32_t bg) {
+    view->fb = fb;
+    view->area = area;
+    view->fg = fg;
+    view->bg = bg;
+    console_viewport_init(&view->port, area.h > 0 ? (uint32_t)area.h / CONSOLE_LINE_HEIGHT : 0);
+}
+
+static void draw_row(const struct console_view *view, const struct console *con, uint32_t row) {
+    struct rect line = { view->area.x, view->area.y + (int)row * CONSOLE_LINE_HEIGHT, view->area.w, CONSOLE_LINE_HEIGHT };
+    uint32_t len = 0;
+    const char *text = console_line(con, view->port.top + row, &len);
+    int text_w = (int)len * 8 < line.w ? (int)len * 8 : line.w;
+    if (text && len > 0) {
+        fb_draw_string_clip(view->fb, line.x, line.y, text, view->fg, view->bg, line);
+    }
+    fb_fill_rect(view->fb, (struct rect){ line.x + text_w, line.y, line.w - text_w, 8 }, view->bg);
+    fb_fill_rect(view->fb, (struct rect){ line.x, line.y + 8, line.w, CONSOLE_LINE_HEIGHT - 8 }, view->bg);
+}
+
+void console_view_flush(struct console_view *view, const struct console *con) {
+    if (!view || !view->fb || !con) {
+        return;
+    }
+    uint32_t first = 0;
+    uint32_t end = 0;
+    if (!console_viewport_sync(&view->port, con, &first, &end)) {
+        return;
+    }
+    for (uint32_t row = first; row < end; ++row) {
+        draw_row(view, con, row);
+    }
+}
@@ -0,0 +1,58 @@
+#include "cursor.h"
+#include "framebuffer.h"
+#include "magicui.h"
+
+void cursor_init(struct cursor_plane *cursor, const struct framebuffer *fb) {
+    if (!cursor) {
+        return;
+    }
+    cursor->fb = fb;
+    cursor->x = 0;
+    cursor->y = 0;
+    cursor->visible = 0;
+}
+
+void cursor_show(struct cursor_plane *cursor, int x, int y) {
+    if (!cursor || !cursor->fb || cursor->visible) {
+        return;
+    }
+    cursor->x = x;
+    cursor->y = y;
+    for (int row = 0; row < MUI_CURSOR_HEIGHT; ++row) {
+        for (int col = 0; col < MUI_CURSOR_WIDTH; ++col) {
+            cursor->saved[row * MUI_CURSOR_WIDTH + col] = fb_get_pixel_raw(cursor->fb, x + col, y + row);
+        }
+    }
+    mui_draw_cursor(cursor->fb, x, y);
+    cursor->visible = 1;
+}
+
+void cursor_hide(struct cursor_plane *cursor) {
+    if (!cursor || !cursor->fb || !cursor->visible) {
+        return;
+    }
+    for (int row = 0; row < MUI_CURSOR_HEIGHT; ++row) {
+        for (int col = 0; col < MUI_CURSOR_WIDTH; ++col) {
+            fb_put_pixel_raw(cursor->fb, cursor->x + col, cursor->y + row, cursor->saved[row * MUI_CURSOR_WIDTH + col]);
+        }
+    }
+    cursor->visible = 0;
+}
+
+void cursor_move(struct cursor_plane *cursor, int x, int y) {
+    if (!cursor) {
+        return;
+    }
+    if (cursor->visible && cursor->x == x && cursor->y == y) {
+        return;
+    }
+    cursor_hide(cursor);
+    cursor_show(cursor, x, y);
+}
+
+struct rect cursor_bounds(const struct cursor_plane *cursor) {
+    if (!cursor || !cursor->visible) {
+        return (struct rect){ 0, 0, 0, 0 };
+    }
+    return (struct rect){ cursor->x, cursor->y, MUI_CURSOR_WIDTH, MUI_CURSOR_HEIGHT };
+}
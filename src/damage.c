@@ -0,0 +1,51 @@
+#include "damage.h"
+#include "framebuffer.h"
+
+static uint32_t rect_area(struct rect r) {
+    if (r.w <= 0 || r.h <= 0) {
+        return 0;
+    }
+    return (uint32_t)r.w * (uint32_t)r.h;
+}
+
+void damage_clear(struct damage_list *damage) {
+    if (!damage) {
+        return;
+    }
+    damage->count = 0;
+}
+
+int damage_empty(const struct damage_list *damage) {
+    return !damage || damage->count == 0;
+}
+
+void damage_add(struct damage_list *damage, struct rect r) {
+    if (!damage || r.w <= 0 || r.h <= 0) {
+        return;
+    }
+    for (int i = 0; i < damage->count; ++i) {
+        if (rect_contains(damage->rects[i], r)) {
+            return;
+        }
+        if (rect_contains(r, damage->rects[i])) {
+            damage->rects[i] = damage->rects[--damage->count];
+            i--;
+        }
+    }
+    if (damage->count < DAMAGE_MAX_RECTS) {
+        damage->rects[damage->count++] = r;
+        return;
+    }
+
+    int best = 0;
+    uint32_t best_growth = 0xFFFFFFFFu;
+    for (int i = 0; i < damage->count; ++i) {
+        struct rect merged = rect_union(damage->rects[i], r);
+        uint32_t growth = rect_area(merged) - rect_area(damage->rects[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    damage->rects[best] = rect_union(damage->rects[best], r);
+}
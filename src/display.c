@@ -0,0 +1,155 @@
+#include "display.h"
+#include "bga.h"
+#include "framebuffer.h"
+#include "log.h"
+#include "virtio_gpu.h"
+
+static int display_restore_boot_mode(struct display *disp, const struct framebuffer *boot_fb) {
+    bga_set_mode(&disp->bga, boot_fb->width, boot_fb->height, boot_fb->height, boot_fb->bpp);
+    return 0;
+}
+
+static int display_init_bga(struct display *disp, const struct framebuffer *boot_fb, uint8_t format) {
+    if (boot_fb->width == 0 || (boot_fb->bpp != 16 && boot_fb->bpp != 32)) {
+        return 0;
+    }
+    if (!bga_probe(&disp->bga)) {
+        return 0;
+    }
+    uint8_t bpp = fb_format_bpp(format);
+    if (disp->bga.vram_bytes / 2u / (bpp / 8u) / boot_fb->width < boot_fb->height) {
+        log_puts("BGA: not enough VRAM for two pages\n");
+        return 0;
+    }
+    if (!bga_set_mode(&disp->bga, boot_fb->width, boot_fb->height, boot_fb->height * 2u, bpp)) {
+        log_puts("BGA: mode set failed\n");
+        return display_restore_boot_mode(disp, boot_fb);
+    }
+    if (disp->bga.virt_height < boot_fb->height * 2u) {
+        log_puts("BGA: virtual height too small for two pages\n");
+        return display_restore_boot_mode(disp, boot_fb);
+    }
+
+    struct framebuffer page = { 0 };
+    page.base = (uint8_t *)(uintptr_t)disp->bga.lfb_addr;
+    page.width = disp->bga.width;
+    page.height = disp->bga.height;
+    page.pitch = disp->bga.pitch;
+    page.bpp = bpp;
+    page.format = format;
+
+    disp->backend = DISPLAY_BGA;
+    disp->scanout = page;
+    disp->back = page;
+    disp->back.base = page.base + page.pitch * page.height;
+    disp->back_page = 1;
+    return 1;
+}
+
+static int display_init_virtio_gpu(struct display *disp) {
+    if (!virtio_gpu_init(&disp->gpu)) {
+        return 0;
+    }
+    if (!fb_alloc_surface(&disp->back, disp->gpu.width, disp->gpu.height, FB_FORMAT_XRGB8888)) {
+        return 0;
+    }
+    if (!virtio_gpu_attach_surface(&disp->gpu, &disp->back)) {
+        log_puts("virtio-gpu: scanout setup failed\n");
+        return 0;
+    }
+    disp->backend = DISPLAY_VIRTIO_GPU;
+    disp->scanout = disp->back;
+    disp->back_page = 0;
+    return 1;
+}
+
+int display_init(struct display *disp, const struct framebuffer *boot_fb, uint8_t format) {
+    if (!disp || !boot_fb) {
+        return 0;
+    }
+    if (format != FB_FORMAT_RGB565) {
+        format = FB_FORMAT_XRGB8888;
+    }
+    if (display_init_virtio_gpu(disp)) {
+        log_puts("Display: virtio-gpu\n");
+        if (format == FB_FORMAT_RGB565) {
+            log_puts("virtio-gpu: no 16bpp scanout, rendering XRGB8888\n");
+        }
+        return 1;
+    }
+    if (display_init_bga(disp, boot_fb, format)) {
+        log_puts("Display: BGA page flipping\n");
+        return 1;
+    }
+
+    disp->backend = DISPLAY_LINEAR;
+    disp->scanout = *boot_fb;
+    disp->back_page = 0;
+    if (!fb_alloc_surface(&disp->back, boot_fb->width, boot_fb->height, format)) {
+        return 0;
+    }
+    log_puts("Display: linear framebuffer\n");
+    if (format != boot_fb->format) {
+        log_puts("Display: converting on present\n");
+    }
+    return 1;
+}
+
+void display_present(struct display *disp, const struct damage_list *damage) {
+    if (!disp || damage_empty(damage)) {
+        return;
+    }
+    switch (disp->backend) {
+    case DISPLAY_VIRTIO_GPU:
+        virtio_gpu_flush_rects(&disp->gpu, damage->rects, damage->count);
+        break;
+    case DISPLAY_BGA: {
+        bga_set_y_offset(&disp->bga, disp->back_page * disp->bga.height);
+        uint8_t *visible = disp->back.base;
+        disp->back.base = disp->scanout.base;
+        disp->scanout.base = visible;
+        disp->back_page ^= 1u;
+        break;
+    }
+    default:
+        for (int i = 0; i < damage->count; ++i) {
+            fb_blit_rect(&disp->scanout, &disp->back, damage->rects[i]);
+        }
+        break;
+    }
+}
+
+void display_flush(struct display *disp, struct rect r) {
+    if (!disp || r.w <= 0 || r.h <= 0) {
+        return;
+    }
+    if (disp->backend == DISPLAY_VIRTIO_GPU) {
+        virtio_gpu_flush_rects(&disp->gpu, &r, 1);
+    }
+}
+
+uint32_t display_buffer_age(const struct display *disp) {
+    if (!disp) {
+        return 0;
+    }
+    switch (disp->backend) {
+    case DISPLAY_BGA:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+const char *display_backend_name(const struct display *disp) {
+    if (!disp) {
+        return "None";
+    }
+    switch (disp->backend) {
+    case DISPLAY_BGA:
+        return "BGA";
+    case DISPLAY_VIRTIO_GPU:
+        return "virtio-gpu";
+    default:
+        return "Linear";
+    }
+}
@@ -0,0 +1,186 @@
+#include "draw.h"
+#include "region.h"
+
+void draw_init(struct draw_ctx *ctx, const struct framebuffer *fb) {
+    ctx->fb = fb;
+    ctx->top.origin_x = 0;
+    ctx->top.origin_y = 0;
+    ctx->top.width = (int)fb->width;
+    ctx->top.height = (int)fb->height;
+    ctx->top.clip = fb_bounds(fb);
+    ctx->depth = 0;
+    ctx->list = 0;
+}
+
+void draw_record(struct draw_ctx *ctx, struct draw_list *list) {
+    ctx->list = list;
+}
+
+void draw_list_clear(struct draw_list *list) {
+    list->count = 0;
+    list->text_used = 0;
+    list->overflow = 0;
+}
+
+static struct draw_cmd *emit(const struct draw_ctx *ctx, uint8_t op, struct rect bounds) {
+    struct draw_list *list = ctx->list;
+    if (list->count >= DRAW_LIST_MAX) {
+        list->overflow = 1;
+        return 0;
+    }
+    struct draw_cmd *cmd = &list->cmds[list->count++];
+    cmd->op = op;
+    cmd->bounds = bounds;
+    return cmd;
+}
+
+static void emit_fill(const struct draw_ctx *ctx, struct rect visible, uint32_t color) {
+    if (!ctx->list) {
+        fb_fill_rect(ctx->fb, visible, color);
+        return;
+    }
+    struct draw_cmd *cmd = emit(ctx, DRAW_OP_FILL, visible);
+    if (cmd) {
+        cmd->color0 = color;
+    }
+}
+
+static int push_frame(struct draw_ctx *ctx, struct rect screen, int set_origin) {
+    if (ctx->depth >= DRAW_STACK_DEPTH) {
+        return 0;
+    }
+    ctx->stack[ctx->depth++] = ctx->top;
+    if (set_origin) {
+        ctx->top.origin_x = screen.x;
+        ctx->top.origin_y = screen.y;
+        ctx->top.width = screen.w;
+        ctx->top.height = screen.h;
+    }
+    ctx->top.clip = rect_intersect(ctx->top.clip, screen);
+    return 1;
+}
+
+int draw_push(struct draw_ctx *ctx, struct rect r) {
+    return push_frame(ctx, draw_to_screen(ctx, r), 1);
+}
+
+int draw_push_clip(struct draw_ctx *ctx, struct rect r) {
+    return push_frame(ctx, draw_to_screen(ctx, r), 0);
+}
+
+void draw_pop(struct draw_ctx *ctx) {
+    if (ctx->depth == 0) {
+        return;
+    }
+    ctx->top = ctx->stack[--ctx->depth];
+}
+
+struct rect draw_bounds(const struct draw_ctx *ctx) {
+    return (struct rect){ 0, 0, ctx->top.width, ctx->top.height };
+}
+
+struct rect draw_to_screen(const struct draw_ctx *ctx, struct rect r) {
+    return (struct rect){ r.x + ctx->top.origin_x, r.y + ctx->top.origin_y, r.w, r.h };
+}
+
+int draw_visible(const struct draw_ctx *ctx, struct rect r) {
+    struct rect visible = rect_intersect(draw_to_screen(ctx, r), ctx->top.clip);
+    return visible.w > 0 && visible.h > 0;
+}
+
+void draw_fill_rect(const struct draw_ctx *ctx, struct rect r, uint32_t color) {
+    struct rect visible = rect_intersect(draw_to_screen(ctx, r), ctx->top.clip);
+    if (visible.w <= 0 || visible.h <= 0) {
+        return;
+    }
+    emit_fill(ctx, visible, color);
+}
+
+void draw_fill_rect_excluding(const struct draw_ctx *ctx, struct rect r,
+                               const struct rect *holes, int hole_count, uint32_t color) {
+    struct region region;
+    region_init(&region, rect_intersect(draw_to_screen(ctx, r), ctx->top.clip));
+    for (int i = 0; i < hole_count && !region_empty(&region); ++i) {
+        region_subtract(&region, draw_to_screen(ctx, holes[i]));
+    }
+    for (int i = 0; i < region.count; ++i) {
+        emit_fill(ctx, region.rects[i], color);
+    }
+}
+
+void draw_vertical_gradient(const struct draw_ctx *ctx, uint32_t top, uint32_t bottom) {
+    if (!ctx->list) {
+        fb_draw_vertical_gradient_clip(ctx->fb, top, bottom, ctx->top.clip);
+        return;
+    }
+    if (ctx->top.clip.w <= 0 || ctx->top.clip.h <= 0) {
+        return;
+    }
+    struct draw_cmd *cmd = emit(ctx, DRAW_OP_GRADIENT, ctx->top.clip);
+    if (cmd) {
+        cmd->color0 = top;
+        cmd->color1 = bottom;
+    }
+}
+
+void draw_image(const struct draw_ctx *ctx, int x, int y, const struct framebuffer *image) {
+    x += ctx->top.origin_x;
+    y += ctx->top.origin_y;
+    if (!ctx->list) {
+        fb_draw_image_clip(ctx->fb, x, y, image, ctx->top.clip);
+        return;
+    }
+    struct rect visible = rect_intersect((struct rect){ x, y, (int)image->width, (int)image->height }, ctx->top.clip);
+    if (visible.w <= 0 || visible.h <= 0) {
+        return;
+    }
+    struct draw_cmd *cmd = emit(ctx, DRAW_OP_IMAGE, visible);
+    if (cmd) {
+        cmd->x = x;
+        cmd->y = y;
+        cmd->image = image;
+    }
+}
+
+void draw_put_pixel(const struct draw_ctx *ctx, int x, int y, uint32_t color) {
+    x += ctx->top.origin_x;
+    y += ctx->top.origin_y;
+    if (!point_in_rect(x, y, ctx->top.clip)) {
+        return;
+    }
+    emit_fill(ctx, (struct rect){ x, y, 1, 1 }, color);
+}
+
+void draw_string(const struct draw_ctx *ctx, int x, int y, const char *text, uint32_t fg, uint32_t bg) {
+    x += ctx->top.origin_x;
+    y += ctx->top.origin_y;
+    if (!ctx->list) {
+        fb_draw_string_clip(ctx->fb, x, y, text, fg, bg, ctx->top.clip);
+        return;
+    }
+    uint32_t len = 0;
+    while (text[len] != '\0') {
+        len++;
+    }
+    struct rect visible = rect_intersect((struct rect){ x, y, (int)len * 8, 8 }, ctx->top.clip);
+    if (visible.w <= 0 || visible.h <= 0) {
+        return;
+    }
+    struct draw_list *list = ctx->list;
+    if (list->text_used + len + 1 > DRAW_TEXT_ARENA) {
+        list->overflow = 1;
+        return;
+    }
+    struct draw_cmd *cmd = emit(ctx, DRAW_OP_TEXT, visible);
+    if (!cmd) {
+        return;
+    }
+    cmd->x = x;
+    cmd->y = y;
+    cmd->color0 = fg;
+    cmd->color1 = bg;
+    cmd->text = (uint16_t)list->text_used;
+    for (uint32_t i = 0; i <= len; ++i) {
+        list->text[list->text_used++] = text[i];
+    }
+}
@@ -1,5 +1,50 @@
 #include "ehci.h"
+#include "idt.h"
 #include "log.h"
+#include "pic.h"
+#include "timer.h"
+
+#define EHCI_USBCMD 0x00
+#define EHCI_USBSTS 0x04
+#define EHCI_USBINTR 0x08
+#define EHCI_CONFIGFLAG 0x40
+#define EHCI_CMD_RUN (1u << 0)
+#define EHCI_CMD_RESET (1u << 1)
+#define EHCI_STS_HALTED (1u << 12)
+#define EHCI_STS_PERIODIC (1u << 14)
+#define EHCI_STS_ASYNC (1u << 15)
+#define EHCI_HALT_TIMEOUT_US 20000u
+#define EHCI_RESET_TIMEOUT_US 250000u
+#define EHCI_START_TIMEOUT_US 20000u
+#define EHCI_POWER_DELAY_US 20000u
+#define EHCI_PORT_RESET_US 50000u
+#define EHCI_PORT_RELEASE_US 2000u
+#define EHCI_PORT_SETTLE_US 2000u
+#define EHCI_INTR_ENABLE 0x13u
+#define EHCI_MAX_IRQ_CONTROLLERS 8
+#define EHCI_PORTSC 0x44
+#define EHCI_HCS_PORT_POWER (1u << 4)
+#define PORT_CONNECT (1u << 0)
+#define PORT_CONNECT_CHANGE (1u << 1)
+#define PORT_ENABLE (1u << 2)
+#define PORT_ENABLE_CHANGE (1u << 3)
+#define PORT_OVERCURRENT_CHANGE (1u << 5)
+#define PORT_RESET (1u << 8)
+#define PORT_LINE_STATUS (3u << 10)
+#define PORT_LINE_K_STATE (1u << 10)
+#define PORT_POWER (1u << 12)
+#define PORT_OWNER (1u << 13)
+#define PORT_WRITE_CLEAR (PORT_CONNECT_CHANGE | PORT_ENABLE_CHANGE | PORT_OVERCURRENT_CHANGE)
+
+enum port_reset_phase {
+    PORT_RESET_IDLE = 0,
+    PORT_RESET_ASSERT,
+    PORT_RESET_RELEASE,
+    PORT_RESET_SETTLE
+};
+
+static struct ehci_controller *irq_ctrls[EHCI_MAX_IRQ_CONTROLLERS];
+static uint32_t irq_ctrl_count;
 
 static uint32_t mmio_read32(volatile uint8_t *base, uint32_t off) {
     return *(volatile uint32_t *)(base + off);
@@ -9,11 +54,6 @@ static void mmio_write32(volatile uint8_t *base, uint32_t off, uint32_t value) {
     *(volatile uint32_t *)(base + off) = value;
 }
 
-static void spin_delay(uint32_t loops) {
-    for (volatile uint32_t i = 0; i < loops; ++i) {
-    }
-}
-
 int ehci_init(struct ehci_controller *out, uint32_t bar0) {
     if (!out) {
         return 0;
@@ -28,6 +68,11 @@ int ehci_init(struct ehci_controller *out, uint32_t bar0) {
     out->hcs_params = mmio_read32(out->base, 0x04);
     out->hcc_params = mmio_read32(out->base, 0x08);
     out->op_base = out->base + out->cap_length;
+    out->irq = EHCI_NO_IRQ;
+    out->irq_status = 0;
+    out->irq_events = 0;
+    out->async_head = 0;
+    out->reset_phase = PORT_RESET_IDLE;
 
     if (out->cap_length < 0x10u || out->cap_length > 0x40u) {
         return 0;
@@ -39,30 +84,207 @@ int ehci_init(struct ehci_controller *out, uint32_t bar0) {
     log_dec32((out->hcs_params >> 0) & 0x0F);
     log_puts("\n");
 
-    uint32_t usbcmd = mmio_read32(out->op_base, 0x00);
-    usbcmd &= ~1u;
-    mmio_write32(out->op_base, 0x00, usbcmd);
-    spin_delay(100000);
-    mmio_write32(out->op_base, 0x04, 0x3F);
-    mmio_write32(out->op_base, 0x08, 0);
-    mmio_write32(out->op_base, 0x00, usbcmd | (1u << 1));
-    spin_delay(100000);
-    mmio_write32(out->op_base, 0x00, usbcmd & ~(1u << 1));
-    spin_delay(100000);
-
-    mmio_write32(out->op_base, 0x40, 1u);
-    uint32_t ports = (out->hcs_params >> 0) & 0x0F;
-    for (uint32_t i = 0; i < ports; ++i) {
-        uint32_t portsc = mmio_read32(out->op_base, 0x44 + i * 4);
-        if (portsc & 1u) {
-            log_puts("EHCI port connect: ");
-            log_dec32(i + 1);
-            log_puts("\n");
-            mmio_write32(out->op_base, 0x44 + i * 4, portsc | (1u << 8));
-            spin_delay(200000);
-            portsc = mmio_read32(out->op_base, 0x44 + i * 4);
-            mmio_write32(out->op_base, 0x44 + i * 4, portsc & ~(1u << 8));
+    mmio_write32(out->op_base, EHCI_USBINTR, 0);
+    mmio_write32(out->op_base, EHCI_USBCMD, mmio_read32(out->op_base, EHCI_USBCMD) & ~EHCI_CMD_RUN);
+    out->state = EHCI_STATE_HALTING;
+    out->deadline_us = timer_us() + EHCI_HALT_TIMEOUT_US;
+    return 1;
+}
+
+static enum ehci_state step_fail(struct ehci_controller *ctrl, const char *why) {
+    log_puts("EHCI: ");
+    log_puts(why);
+    log_puts("\n");
+    ctrl->state = EHCI_STATE_FAILED;
+    return EHCI_STATE_FAILED;
+}
+
+enum ehci_state ehci_step(struct ehci_controller *ctrl, uint64_t now_us) {
+    if (!ctrl || !ctrl->op_base) {
+        return EHCI_STATE_FAILED;
+    }
+    uint32_t sts = mmio_read32(ctrl->op_base, EHCI_USBSTS);
+    switch (ctrl->state) {
+    case EHCI_STATE_HALTING:
+        if ((sts & EHCI_STS_HALTED) == 0 && now_us < ctrl->deadline_us) {
+            break;
+        }
+        mmio_write32(ctrl->op_base, EHCI_USBSTS, 0x3F);
+        mmio_write32(ctrl->op_base, EHCI_USBCMD, EHCI_CMD_RESET);
+        ctrl->state = EHCI_STATE_RESETTING;
+        ctrl->deadline_us = now_us + EHCI_RESET_TIMEOUT_US;
+        break;
+    case EHCI_STATE_RESETTING:
+        if (mmio_read32(ctrl->op_base, EHCI_USBCMD) & EHCI_CMD_RESET) {
+            if (now_us >= ctrl->deadline_us) {
+                return step_fail(ctrl, "controller reset timed out");
+            }
+            break;
+        }
+        if (!ehci_schedule_init(ctrl)) {
+            return step_fail(ctrl, "schedule allocation failed");
+        }
+        ctrl->state = EHCI_STATE_STARTING;
+        ctrl->deadline_us = now_us + EHCI_START_TIMEOUT_US;
+        break;
+    case EHCI_STATE_STARTING: {
+        uint32_t running = EHCI_STS_ASYNC | EHCI_STS_PERIODIC;
+        if ((sts & running) != running || (sts & EHCI_STS_HALTED)) {
+            if (now_us >= ctrl->deadline_us) {
+                return step_fail(ctrl, "async schedule did not start");
+            }
+            break;
+        }
+        mmio_write32(ctrl->op_base, EHCI_CONFIGFLAG, 1u);
+        if (ctrl->hcs_params & EHCI_HCS_PORT_POWER) {
+            for (uint32_t i = 0; i < ehci_port_count(ctrl); ++i) {
+                uint32_t portsc = mmio_read32(ctrl->op_base, EHCI_PORTSC + i * 4);
+                mmio_write32(ctrl->op_base, EHCI_PORTSC + i * 4, (portsc & ~PORT_WRITE_CLEAR) | PORT_POWER);
+            }
+        }
+        ctrl->state = EHCI_STATE_POWERING;
+        ctrl->deadline_us = now_us + EHCI_POWER_DELAY_US;
+        break;
+    }
+    case EHCI_STATE_POWERING:
+        if (now_us >= ctrl->deadline_us) {
+            ctrl->state = EHCI_STATE_READY;
+        }
+        break;
+    default:
+        break;
+    }
+    return (enum ehci_state)ctrl->state;
+}
+
+uint32_t ehci_port_count(const struct ehci_controller *ctrl) {
+    return ctrl ? ctrl->hcs_params & 0x0Fu : 0;
+}
+
+int ehci_port_connected(struct ehci_controller *ctrl, uint32_t port) {
+    if (port >= ehci_port_count(ctrl)) {
+        return 0;
+    }
+    return (mmio_read32(ctrl->op_base, EHCI_PORTSC + port * 4) & PORT_CONNECT) != 0;
+}
+
+int ehci_port_changed(struct ehci_controller *ctrl, uint32_t port) {
+    if (port >= ehci_port_count(ctrl)) {
+        return 0;
+    }
+    uint32_t portsc = mmio_read32(ctrl->op_base, EHCI_PORTSC + port * 4);
+    if ((portsc & PORT_CONNECT_CHANGE) == 0) {
+        return 0;
+    }
+    mmio_write32(ctrl->op_base, EHCI_PORTSC + port * 4, (portsc & ~PORT_WRITE_CLEAR) | PORT_CONNECT_CHANGE);
+    return 1;
+}
+
+static void port_release(struct ehci_controller *ctrl, uint32_t port) {
+    uint32_t portsc = mmio_read32(ctrl->op_base, EHCI_PORTSC + port * 4);
+    mmio_write32(ctrl->op_base, EHCI_PORTSC + port * 4, (portsc & ~PORT_WRITE_CLEAR) | PORT_OWNER);
+    log_puts("EHCI port ");
+    log_dec32(port + 1);
+    log_puts(": full/low-speed device, released to companion\n");
+}
+
+int ehci_port_reset_begin(struct ehci_controller *ctrl, uint32_t port, uint64_t now_us) {
+    if (port >= ehci_port_count(ctrl) || ctrl->reset_phase != PORT_RESET_IDLE) {
+        return 0;
+    }
+    uint32_t off = EHCI_PORTSC + port * 4;
+    uint32_t portsc = mmio_read32(ctrl->op_base, off);
+    if ((portsc & PORT_CONNECT) == 0) {
+        return 0;
+    }
+    if ((portsc & PORT_LINE_STATUS) == PORT_LINE_K_STATE) {
+        port_release(ctrl, port);
+        return 0;
+    }
+    mmio_write32(ctrl->op_base, off, (portsc & ~(PORT_WRITE_CLEAR | PORT_ENABLE)) | PORT_RESET);
+    ctrl->reset_port = (uint8_t)port;
+    ctrl->reset_phase = PORT_RESET_ASSERT;
+    ctrl->reset_deadline_us = now_us + EHCI_PORT_RESET_US;
+    return 1;
+}
+
+enum usb_status ehci_port_reset_poll(struct ehci_controller *ctrl, uint64_t now_us) {
+    if (!ctrl || ctrl->reset_phase == PORT_RESET_IDLE) {
+        return USB_STATUS_ERROR;
+    }
+    uint32_t port = ctrl->reset_port;
+    uint32_t off = EHCI_PORTSC + port * 4;
+    uint32_t portsc = mmio_read32(ctrl->op_base, off);
+    if (now_us < ctrl->reset_deadline_us && ctrl->reset_phase != PORT_RESET_RELEASE) {
+        return USB_STATUS_PENDING;
+    }
+    switch (ctrl->reset_phase) {
+    case PORT_RESET_ASSERT:
+        mmio_write32(ctrl->op_base, off, portsc & ~(PORT_WRITE_CLEAR | PORT_RESET));
+        ctrl->reset_phase = PORT_RESET_RELEASE;
+        ctrl->reset_deadline_us = now_us + EHCI_PORT_RELEASE_US;
+        return USB_STATUS_PENDING;
+    case PORT_RESET_RELEASE:
+        if (portsc & PORT_RESET) {
+            if (now_us >= ctrl->reset_deadline_us) {
+                ctrl->reset_phase = PORT_RESET_IDLE;
+                return USB_STATUS_TIMEOUT;
+            }
+            return USB_STATUS_PENDING;
+        }
+        ctrl->reset_phase = PORT_RESET_SETTLE;
+        ctrl->reset_deadline_us = now_us + EHCI_PORT_SETTLE_US;
+        return USB_STATUS_PENDING;
+    default:
+        break;
+    }
+    ctrl->reset_phase = PORT_RESET_IDLE;
+    if ((portsc & PORT_CONNECT) == 0) {
+        return USB_STATUS_ERROR;
+    }
+    if ((portsc & PORT_ENABLE) == 0) {
+        port_release(ctrl, port);
+        return USB_STATUS_ERROR;
+    }
+    return USB_STATUS_OK;
+}
+
+static int ehci_irq(uint8_t irq) {
+    int handled = 0;
+    for (uint32_t i = 0; i < irq_ctrl_count; ++i) {
+        struct ehci_controller *ctrl = irq_ctrls[i];
+        if (ctrl->irq != irq) {
+            continue;
+        }
+        uint32_t sts = mmio_read32(ctrl->op_base, EHCI_USBSTS) & EHCI_INTR_ENABLE;
+        if (sts == 0) {
+            continue;
         }
+        mmio_write32(ctrl->op_base, EHCI_USBSTS, sts);
+        ctrl->irq_status |= sts;
+        ctrl->irq_events++;
+        handled = 1;
     }
+    return handled;
+}
+
+int ehci_enable_irq(struct ehci_controller *ctrl, uint8_t irq) {
+    if (!ctrl || !ctrl->op_base || irq >= PIC_IRQ_COUNT || irq_ctrl_count >= EHCI_MAX_IRQ_CONTROLLERS) {
+        return 0;
+    }
+    mmio_write32(ctrl->op_base, EHCI_USBINTR, 0);
+    mmio_write32(ctrl->op_base, EHCI_USBSTS, EHCI_INTR_ENABLE);
+    ctrl->irq = irq;
+    irq_ctrls[irq_ctrl_count++] = ctrl;
+    if (!irq_register(irq, ehci_irq)) {
+        irq_ctrl_count--;
+        ctrl->irq = EHCI_NO_IRQ;
+        return 0;
+    }
+    mmio_write32(ctrl->op_base, EHCI_USBINTR, EHCI_INTR_ENABLE);
     return 1;
 }
+
+int ehci_irq_live(const struct ehci_controller *ctrl) {
+    return ctrl && ctrl->irq != EHCI_NO_IRQ && irq_active(ctrl->irq) && interrupts_enabled();
+}
@@ -1,25 +1,76 @@
 #include "ehci.h"
+#include "log.h"
 #include "memory.h"
+#include "timer.h"
 
+#define QTD_TERMINATE 1u
+#define QTD_TOKEN_STATUS_MASK 0xFFu
 #define QTD_TOKEN_ACTIVE (1u << 7)
+#define QTD_TOKEN_HALTED (1u << 6)
+#define QTD_TOKEN_FAULTS 0x3Cu
 #define QTD_TOKEN_PID_SETUP (2u << 8)
 #define QTD_TOKEN_PID_IN (1u << 8)
 #define QTD_TOKEN_PID_OUT (0u << 8)
+#define QTD_TOKEN_CERR (3u << 10)
+#define QTD_TOKEN_IOC (1u << 15)
+#define QTD_TOKEN_TOGGLE (1u << 31)
+#define QTD_MAX_BYTES 0x4000u
+
+#define QH_TYPE 0x2u
+#define QH_EP_HEAD (1u << 15)
+#define QH_EP_SPEED_SHIFT 12
+#define QH_EP_DTC (1u << 14)
+#define QH_EP_CONTROL (1u << 27)
+#define QH_EP_NAK_RELOAD (4u << 28)
+#define QH_EP_SPEED_FULL 0u
+#define QH_EP_SPEED_LOW 1u
+#define QH_EP_SPEED_HIGH 2u
+#define QH_CAP_MULT_ONE (1u << 30)
+#define QH_CAP_SMASK 0x01u
+#define QH_CAP_CMASK (0x1Cu << 8)
+#define QH_CAP_HUB_SHIFT 16
+#define QH_CAP_PORT_SHIFT 23
+#define QH_LINK_MASK 0xFFFFFFE0u
+#define FRAME_LIST_QH(qh) (phys(qh) | QH_TYPE)
+
+#define EHCI_USBCMD 0x00
+#define EHCI_USBSTS 0x04
+#define EHCI_FRINDEX 0x0C
+#define EHCI_CTRLDSSEGMENT 0x10
+#define EHCI_PERIODICLISTBASE 0x14
+#define EHCI_ASYNCLISTADDR 0x18
+#define EHCI_CMD_RUN (1u << 0)
+#define EHCI_CMD_FRAME_LIST_MASK (3u << 2)
+#define EHCI_CMD_PERIODIC (1u << 4)
+#define EHCI_CMD_ASYNC (1u << 5)
+#define EHCI_CMD_DOORBELL (1u << 6)
+#define EHCI_STS_HOST_ERROR (1u << 4)
+#define EHCI_STS_ASYNC_ADVANCE (1u << 5)
+#define EHCI_FRINDEX_FRAMES 0x7FFu
+
+#define RETIRE_WAIT 1u
+#define RETIRE_DOORBELL 2u
+#define RETIRE_FRAMES 3u
 
 struct ehci_qtd {
     uint32_t next;
     uint32_t alt_next;
     uint32_t token;
     uint32_t buf[5];
-} __attribute__((packed, aligned(32)));
+    uint32_t ext_buf[5];
+} __attribute__((aligned(32)));
 
 struct ehci_qh {
     uint32_t horiz_link;
     uint32_t ep_char;
     uint32_t ep_cap;
     uint32_t curr_qtd;
-    struct ehci_qtd overlay;
-} __attribute__((packed, aligned(32)));
+    uint32_t next;
+    uint32_t alt_next;
+    uint32_t token;
+    uint32_t buf[5];
+    uint32_t ext_buf[5];
+} __attribute__((aligned(32)));
 
 static void mmio_write32(volatile uint8_t *base, uint32_t off, uint32_t value) {
     *(volatile uint32_t *)(base + off) = value;
@@ -29,106 +80,638 @@ static uint32_t mmio_read32(volatile uint8_t *base, uint32_t off) {
     return *(volatile uint32_t *)(base + off);
 }
 
-static struct ehci_qtd *alloc_qtd(void) {
-    struct ehci_qtd *qtd = (struct ehci_qtd *)kmalloc(sizeof(struct ehci_qtd), 32);
-    if (!qtd) {
-        return 0;
+static void zero_words(void *p, uint32_t bytes) {
+    volatile uint32_t *w = (volatile uint32_t *)p;
+    for (uint32_t i = 0; i < bytes / 4u; ++i) {
+        w[i] = 0;
     }
-    for (uint32_t i = 0; i < sizeof(*qtd) / 4; ++i) {
-        ((uint32_t *)qtd)[i] = 0;
+}
+
+static uint32_t phys(const void *p) {
+    return (uint32_t)(uintptr_t)p;
+}
+
+static void qh_reset(struct ehci_qh *qh) {
+    qh->curr_qtd = 0;
+    qh->next = QTD_TERMINATE;
+    qh->alt_next = QTD_TERMINATE;
+    qh->token = 0;
+}
+
+static void periodic_init(struct ehci_controller *ctrl) {
+    for (uint32_t level = 0; level < EHCI_PERIODIC_LEVELS; ++level) {
+        struct ehci_qh *skel = &ctrl->qh_pool[EHCI_MAX_ENDPOINTS + 1u + level];
+        skel->horiz_link = level == 0 ? QTD_TERMINATE : FRAME_LIST_QH(ctrl->periodic[level - 1u]);
+        skel->ep_char = 0;
+        skel->ep_cap = QH_CAP_MULT_ONE;
+        qh_reset(skel);
+        skel->token = QTD_TOKEN_HALTED;
+        ctrl->periodic[level] = skel;
+    }
+    for (uint32_t frame = 0; frame < EHCI_FRAME_LIST_SIZE; ++frame) {
+        uint32_t level = 0;
+        while (level + 1u < EHCI_PERIODIC_LEVELS && (frame & ((2u << level) - 1u)) == 0) {
+            level++;
+        }
+        ctrl->frame_list[frame] = FRAME_LIST_QH(ctrl->periodic[level]);
+    }
+    for (uint32_t i = 0; i < EHCI_MAX_INTERRUPTS; ++i) {
+        ctrl->interrupts[i].used = 0;
+    }
+    for (uint32_t i = 0; i < EHCI_MAX_TRANSFERS; ++i) {
+        ctrl->transfers[i].used = 0;
+        ctrl->transfers[i].retiring = 0;
     }
-    qtd->next = 1;
-    qtd->alt_next = 1;
-    return qtd;
 }
 
-static struct ehci_qh *alloc_qh(void) {
-    struct ehci_qh *qh = (struct ehci_qh *)kmalloc(sizeof(struct ehci_qh), 32);
-    if (!qh) {
+int ehci_schedule_init(struct ehci_controller *ctrl) {
+    if (!ctrl || !ctrl->op_base) {
+        return 0;
+    }
+    uint32_t qh_bytes = (uint32_t)sizeof(struct ehci_qh) * (EHCI_MAX_ENDPOINTS + 1u + EHCI_PERIODIC_LEVELS);
+    uint32_t qtd_bytes = (uint32_t)sizeof(struct ehci_qtd) * EHCI_QTD_POOL_SIZE;
+    ctrl->qh_pool = (struct ehci_qh *)kmalloc(qh_bytes, 32);
+    ctrl->qtd_pool = (struct ehci_qtd *)kmalloc(qtd_bytes, 32);
+    ctrl->frame_list = (uint32_t *)kmalloc(EHCI_FRAME_LIST_SIZE * 4u, 4096);
+    if (!ctrl->qh_pool || !ctrl->qtd_pool || !ctrl->frame_list) {
         return 0;
     }
-    for (uint32_t i = 0; i < sizeof(*qh) / 4; ++i) {
-        ((uint32_t *)qh)[i] = 0;
+    zero_words(ctrl->qh_pool, qh_bytes);
+    zero_words(ctrl->qtd_pool, qtd_bytes);
+    for (uint32_t i = 0; i < EHCI_QTD_POOL_SIZE; ++i) {
+        ctrl->qtd_free[i] = (uint8_t)i;
     }
-    qh->horiz_link = ((uint32_t)(uintptr_t)qh) | 0x2u;
-    qh->overlay.next = 1;
-    qh->overlay.alt_next = 1;
-    return qh;
+    ctrl->qtd_free_count = EHCI_QTD_POOL_SIZE;
+    ctrl->endpoint_count = 0;
+    ctrl->doorbell_busy = 0;
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        ctrl->endpoints[i].used = 0;
+        ctrl->endpoints[i].retiring = 0;
+    }
+    for (uint32_t i = 0; i < EHCI_MAX_ADDRESSES; ++i) {
+        ctrl->routes[i].speed = USB_SPEED_HIGH;
+        ctrl->routes[i].hub_addr = 0;
+        ctrl->routes[i].hub_port = 0;
+    }
+
+    struct ehci_qh *head = &ctrl->qh_pool[EHCI_MAX_ENDPOINTS];
+    head->horiz_link = FRAME_LIST_QH(head);
+    head->ep_char = QH_EP_HEAD;
+    head->ep_cap = QH_CAP_MULT_ONE;
+    qh_reset(head);
+    head->token = QTD_TOKEN_HALTED;
+    ctrl->async_head = head;
+    periodic_init(ctrl);
+
+    if (ctrl->hcc_params & 1u) {
+        mmio_write32(ctrl->op_base, EHCI_CTRLDSSEGMENT, 0);
+    }
+    mmio_write32(ctrl->op_base, EHCI_ASYNCLISTADDR, phys(head));
+    mmio_write32(ctrl->op_base, EHCI_PERIODICLISTBASE, phys(ctrl->frame_list));
+    mmio_write32(ctrl->op_base, EHCI_FRINDEX, 0);
+    uint32_t cmd = mmio_read32(ctrl->op_base, EHCI_USBCMD) & ~EHCI_CMD_FRAME_LIST_MASK;
+    mmio_write32(ctrl->op_base, EHCI_USBCMD, cmd | EHCI_CMD_RUN | EHCI_CMD_ASYNC | EHCI_CMD_PERIODIC);
+    return 1;
 }
 
-static void qtd_set_buffer(struct ehci_qtd *qtd, void *buf, uint32_t len) {
-    uint32_t addr = (uint32_t)(uintptr_t)buf;
-    for (int i = 0; i < 5; ++i) {
-        qtd->buf[i] = addr;
-        uint32_t next = (addr & 0xFFFFF000u) + 0x1000u;
-        addr = next;
+void ehci_set_route(struct ehci_controller *ctrl, uint8_t dev_addr, enum usb_speed speed,
+                    uint8_t hub_addr, uint8_t hub_port) {
+    if (!ctrl || dev_addr >= EHCI_MAX_ADDRESSES) {
+        return;
+    }
+    struct ehci_route *route = &ctrl->routes[dev_addr];
+    route->speed = (uint8_t)speed;
+    route->hub_addr = speed == USB_SPEED_HIGH ? 0 : hub_addr;
+    route->hub_port = speed == USB_SPEED_HIGH ? 0 : hub_port;
+}
+
+static uint32_t route_speed(const struct ehci_route *route) {
+    switch (route->speed) {
+    case USB_SPEED_LOW:
+        return QH_EP_SPEED_LOW;
+    case USB_SPEED_FULL:
+        return QH_EP_SPEED_FULL;
+    default:
+        return QH_EP_SPEED_HIGH;
+    }
+}
+
+static void qh_program(struct ehci_controller *ctrl, struct ehci_qh *qh, uint8_t dev_addr, uint8_t ep,
+                       uint16_t max_packet, int periodic) {
+    const struct ehci_route *route = &ctrl->routes[dev_addr & 0x7Fu];
+    uint32_t ep_char = ((max_packet & 0x7FFu) << 16) | (route_speed(route) << QH_EP_SPEED_SHIFT) |
+                       ((ep & 0x0Fu) << 8) | (dev_addr & 0x7Fu);
+    uint32_t ep_cap = QH_CAP_MULT_ONE;
+    if (!periodic) {
+        ep_char |= QH_EP_NAK_RELOAD | QH_EP_DTC;
+    } else {
+        ep_cap |= QH_CAP_SMASK;
+    }
+    if (route->speed != USB_SPEED_HIGH) {
+        ep_cap |= ((uint32_t)route->hub_addr << QH_CAP_HUB_SHIFT) | ((uint32_t)route->hub_port << QH_CAP_PORT_SHIFT);
+        if (periodic) {
+            ep_cap |= QH_CAP_CMASK;
+        } else {
+            ep_char |= QH_EP_CONTROL;
+        }
+    }
+    qh->ep_char = ep_char;
+    qh->ep_cap = ep_cap;
+}
+
+static struct ehci_endpoint *endpoint_find(struct ehci_controller *ctrl, uint8_t dev_addr, uint8_t ep) {
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        struct ehci_endpoint *e = &ctrl->endpoints[i];
+        if (e->used && !e->retiring && e->dev_addr == dev_addr && e->ep == ep) {
+            return e;
+        }
     }
-    qtd->token |= (len << 16);
+    return 0;
 }
 
-static int wait_qtd_complete(struct ehci_qtd *qtd) {
-    for (uint32_t i = 0; i < 1000000; ++i) {
-        if ((qtd->token & QTD_TOKEN_ACTIVE) == 0) {
+static struct ehci_endpoint *endpoint_add(struct ehci_controller *ctrl, uint8_t dev_addr, uint8_t ep,
+                                          uint16_t max_packet, int periodic) {
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        struct ehci_endpoint *e = &ctrl->endpoints[i];
+        if (e->used) {
+            continue;
+        }
+        struct ehci_qh *qh = &ctrl->qh_pool[i];
+        qh_program(ctrl, qh, dev_addr, ep, max_packet, periodic);
+        qh_reset(qh);
+        e->qh = qh;
+        e->dev_addr = dev_addr;
+        e->ep = ep;
+        e->max_packet = max_packet;
+        e->periodic = (uint8_t)periodic;
+        e->retiring = 0;
+        e->used = 1;
+        ctrl->endpoint_count++;
+        return e;
+    }
+    return 0;
+}
+
+static void qh_link_after(struct ehci_qh *prev, struct ehci_qh *qh) {
+    qh->horiz_link = prev->horiz_link;
+    __asm__ volatile ("" : : : "memory");
+    prev->horiz_link = FRAME_LIST_QH(qh);
+}
+
+static int qh_unlink(struct ehci_qh *first, struct ehci_qh *qh) {
+    struct ehci_qh *prev = first;
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS + EHCI_PERIODIC_LEVELS + 1u; ++i) {
+        uint32_t link = prev->horiz_link;
+        if (link & QTD_TERMINATE) {
+            return 0;
+        }
+        struct ehci_qh *next = (struct ehci_qh *)(uintptr_t)(link & QH_LINK_MASK);
+        if (next == qh) {
+            prev->horiz_link = qh->horiz_link;
             return 1;
         }
+        if (next == first) {
+            return 0;
+        }
+        prev = next;
     }
     return 0;
 }
 
-int ehci_control_transfer(struct ehci_controller *ctrl,
-                          uint8_t dev_addr,
-                          uint8_t ep,
-                          uint16_t max_packet,
-                          const void *setup,
-                          void *data,
-                          uint32_t length,
-                          int in_dir) {
-    if (!ctrl || !ctrl->op_base || !setup) {
+static struct ehci_qh *control_qh(struct ehci_controller *ctrl, uint8_t dev_addr, uint8_t ep, uint16_t max_packet) {
+    struct ehci_endpoint *e = endpoint_find(ctrl, dev_addr, ep);
+    if (e) {
+        e->max_packet = max_packet;
+        qh_program(ctrl, e->qh, dev_addr, ep, max_packet, 0);
+        return e->qh;
+    }
+    e = endpoint_add(ctrl, dev_addr, ep, max_packet, 0);
+    if (!e) {
         return 0;
     }
+    qh_link_after(ctrl->async_head, e->qh);
+    return e->qh;
+}
 
-    struct ehci_qh *qh = alloc_qh();
-    struct ehci_qtd *qtd_setup = alloc_qtd();
-    struct ehci_qtd *qtd_data = length ? alloc_qtd() : 0;
-    struct ehci_qtd *qtd_status = alloc_qtd();
-    if (!qh || !qtd_setup || !qtd_status || (length && !qtd_data)) {
+static struct ehci_qtd *qtd_alloc(struct ehci_controller *ctrl) {
+    if (ctrl->qtd_free_count == 0) {
         return 0;
     }
+    struct ehci_qtd *qtd = &ctrl->qtd_pool[ctrl->qtd_free[--ctrl->qtd_free_count]];
+    qtd->next = QTD_TERMINATE;
+    qtd->alt_next = QTD_TERMINATE;
+    qtd->token = 0;
+    return qtd;
+}
+
+static void qtd_free(struct ehci_controller *ctrl, struct ehci_qtd *qtd) {
+    if (qtd) {
+        ctrl->qtd_free[ctrl->qtd_free_count++] = (uint8_t)(qtd - ctrl->qtd_pool);
+    }
+}
+
+static void qtd_fill(struct ehci_qtd *qtd, uint32_t token, const void *buf, uint32_t len) {
+    uint32_t addr = phys(buf);
+    qtd->buf[0] = addr;
+    addr &= 0xFFFFF000u;
+    for (int i = 1; i < 5; ++i) {
+        addr += 0x1000u;
+        qtd->buf[i] = addr;
+    }
+    for (int i = 0; i < 5; ++i) {
+        qtd->ext_buf[i] = 0;
+    }
+    qtd->token = token | QTD_TOKEN_CERR | (len << 16);
+}
+
+static enum usb_status token_status(uint32_t token) {
+    if (token & QTD_TOKEN_ACTIVE) {
+        return USB_STATUS_PENDING;
+    }
+    if ((token & QTD_TOKEN_HALTED) == 0) {
+        return USB_STATUS_OK;
+    }
+    return (token & QTD_TOKEN_FAULTS) ? USB_STATUS_ERROR : USB_STATUS_STALL;
+}
+
+static uint32_t qtd_token(const struct ehci_qtd *qtd) {
+    return *(volatile const uint32_t *)&qtd->token;
+}
+
+static void async_doorbell(struct ehci_controller *ctrl) {
+    if (ctrl->doorbell_busy) {
+        return;
+    }
+    int waiting = 0;
+    for (int i = 0; i < EHCI_MAX_TRANSFERS; ++i) {
+        struct ehci_transfer *t = &ctrl->transfers[i];
+        if (t->used && t->retiring == RETIRE_WAIT) {
+            t->retiring = RETIRE_DOORBELL;
+            waiting = 1;
+        }
+    }
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        struct ehci_endpoint *e = &ctrl->endpoints[i];
+        if (e->used && e->retiring == RETIRE_WAIT) {
+            e->retiring = RETIRE_DOORBELL;
+            waiting = 1;
+        }
+    }
+    if (!waiting) {
+        return;
+    }
+    mmio_write32(ctrl->op_base, EHCI_USBSTS, EHCI_STS_ASYNC_ADVANCE);
+    mmio_write32(ctrl->op_base, EHCI_USBCMD, mmio_read32(ctrl->op_base, EHCI_USBCMD) | EHCI_CMD_DOORBELL);
+    ctrl->doorbell_busy = 1;
+    ctrl->doorbell_deadline_tsc = timer_tsc() + timer_us_to_tsc(EHCI_RETIRE_TIMEOUT_US);
+}
+
+static void transfer_release(struct ehci_controller *ctrl, struct ehci_transfer *t, enum usb_status status);
+static void endpoint_release(struct ehci_controller *ctrl, struct ehci_endpoint *e);
+
+static void async_advanced(struct ehci_controller *ctrl, uint64_t now) {
+    if (!ctrl->doorbell_busy) {
+        return;
+    }
+    if (!(mmio_read32(ctrl->op_base, EHCI_USBSTS) & EHCI_STS_ASYNC_ADVANCE)) {
+        if (now < ctrl->doorbell_deadline_tsc) {
+            return;
+        }
+        log_puts("EHCI: async advance timed out\n");
+    }
+    mmio_write32(ctrl->op_base, EHCI_USBSTS, EHCI_STS_ASYNC_ADVANCE);
+    ctrl->doorbell_busy = 0;
+    for (int i = 0; i < EHCI_MAX_TRANSFERS; ++i) {
+        struct ehci_transfer *t = &ctrl->transfers[i];
+        if (t->used && t->retiring == RETIRE_DOORBELL) {
+            transfer_release(ctrl, t, (enum usb_status)t->status);
+        }
+    }
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        struct ehci_endpoint *e = &ctrl->endpoints[i];
+        if (e->used && e->retiring == RETIRE_DOORBELL) {
+            endpoint_release(ctrl, e);
+        }
+    }
+    async_doorbell(ctrl);
+}
+
+static void periodic_advanced(struct ehci_controller *ctrl, uint64_t now) {
+    uint32_t frame = mmio_read32(ctrl->op_base, EHCI_FRINDEX) >> 3;
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        struct ehci_endpoint *e = &ctrl->endpoints[i];
+        if (!e->used || e->retiring != RETIRE_FRAMES) {
+            continue;
+        }
+        if (((frame - e->retire_frame) & EHCI_FRINDEX_FRAMES) >= 2u || now >= e->retire_deadline_tsc) {
+            endpoint_release(ctrl, e);
+        }
+    }
+}
+
+static int transfer_slot(struct ehci_controller *ctrl, const struct ehci_qh *qh) {
+    int slot = -1;
+    for (int i = 0; i < EHCI_MAX_TRANSFERS; ++i) {
+        if (!ctrl->transfers[i].used) {
+            if (slot < 0) {
+                slot = i;
+            }
+        } else if (ctrl->transfers[i].qh == qh) {
+            return -1;
+        }
+    }
+    return slot;
+}
+
+int ehci_control_submit(struct ehci_controller *ctrl,
+                        uint8_t dev_addr,
+                        uint8_t ep,
+                        uint16_t max_packet,
+                        const void *setup,
+                        void *data,
+                        uint32_t length,
+                        int in_dir,
+                        usb_callback_fn callback,
+                        void *ctx) {
+    if (!ctrl || !ctrl->async_head || !setup || length > QTD_MAX_BYTES) {
+        return -1;
+    }
+    struct ehci_qh *qh = control_qh(ctrl, dev_addr, ep, max_packet);
+    if (!qh) {
+        return -1;
+    }
+    int slot = transfer_slot(ctrl, qh);
+    if (slot < 0) {
+        return -1;
+    }
 
-    qtd_setup->next = length ? (uint32_t)(uintptr_t)qtd_data : (uint32_t)(uintptr_t)qtd_status;
-    qtd_setup->token = QTD_TOKEN_ACTIVE | QTD_TOKEN_PID_SETUP | (8u << 16);
-    qtd_set_buffer(qtd_setup, (void *)setup, 8);
+    struct ehci_qtd *qtd_setup = qtd_alloc(ctrl);
+    struct ehci_qtd *qtd_data = length ? qtd_alloc(ctrl) : 0;
+    struct ehci_qtd *qtd_status = qtd_alloc(ctrl);
+    if (!qtd_setup || !qtd_status || (length && !qtd_data)) {
+        qtd_free(ctrl, qtd_status);
+        qtd_free(ctrl, qtd_data);
+        qtd_free(ctrl, qtd_setup);
+        return -1;
+    }
+
+    struct ehci_transfer *t = &ctrl->transfers[slot];
+    const uint8_t *src = (const uint8_t *)setup;
+    for (int i = 0; i < 8; ++i) {
+        t->setup[i] = src[i];
+    }
+    t->qh = qh;
+    t->qtd[0] = qtd_setup;
+    t->qtd[1] = qtd_data;
+    t->qtd[2] = qtd_status;
+    t->data = data;
+    t->length = length;
+    t->callback = callback;
+    t->ctx = ctx;
+    t->deadline_tsc = timer_tsc() + timer_us_to_tsc(EHCI_CONTROL_TIMEOUT_US);
+    t->used = 1;
 
+    qtd_fill(qtd_setup, QTD_TOKEN_ACTIVE | QTD_TOKEN_PID_SETUP, t->setup, 8);
+    qtd_setup->next = phys(length ? qtd_data : qtd_status);
     if (length) {
-        qtd_data->next = (uint32_t)(uintptr_t)qtd_status;
-        qtd_data->token = QTD_TOKEN_ACTIVE | (in_dir ? QTD_TOKEN_PID_IN : QTD_TOKEN_PID_OUT) | (length << 16);
-        qtd_set_buffer(qtd_data, data, length);
+        qtd_fill(qtd_data, QTD_TOKEN_ACTIVE | QTD_TOKEN_TOGGLE | (in_dir ? QTD_TOKEN_PID_IN : QTD_TOKEN_PID_OUT),
+                 data, length);
+        qtd_data->next = phys(qtd_status);
     }
+    qtd_fill(qtd_status, QTD_TOKEN_ACTIVE | QTD_TOKEN_TOGGLE | QTD_TOKEN_IOC |
+             (in_dir ? QTD_TOKEN_PID_OUT : QTD_TOKEN_PID_IN), 0, 0);
 
-    qtd_status->next = 1;
-    qtd_status->token = QTD_TOKEN_ACTIVE | (in_dir ? QTD_TOKEN_PID_OUT : QTD_TOKEN_PID_IN) | (0u << 16);
+    __asm__ volatile ("" : : : "memory");
+    qh->next = phys(qtd_setup);
+    return slot;
+}
 
-    qh->ep_char = (max_packet & 0x7FFu) << 16;
-    qh->ep_char |= (ep & 0x0Fu) << 8;
-    qh->ep_char |= (dev_addr & 0x7Fu);
-    qh->ep_char |= (1u << 14);
+static enum usb_status transfer_status(const struct ehci_transfer *t) {
+    for (int i = 0; i < 3; ++i) {
+        if (!t->qtd[i]) {
+            continue;
+        }
+        enum usb_status status = token_status(qtd_token(t->qtd[i]));
+        if (status != USB_STATUS_OK) {
+            return status;
+        }
+    }
+    return USB_STATUS_OK;
+}
 
-    qh->curr_qtd = 0;
-    qh->overlay.next = (uint32_t)(uintptr_t)qtd_setup;
-    qh->overlay.alt_next = 1;
+static void transfer_release(struct ehci_controller *ctrl, struct ehci_transfer *t, enum usb_status status) {
+    uint32_t actual = 0;
+    if (status == USB_STATUS_OK && t->qtd[1]) {
+        actual = t->length - ((qtd_token(t->qtd[1]) >> 16) & 0x7FFFu);
+    }
+    qtd_free(ctrl, t->qtd[2]);
+    qtd_free(ctrl, t->qtd[1]);
+    qtd_free(ctrl, t->qtd[0]);
+    usb_callback_fn callback = t->callback;
+    void *ctx = t->ctx;
+    const uint8_t *data = (const uint8_t *)t->data;
+    t->retiring = 0;
+    t->used = 0;
+    if (callback) {
+        callback(ctx, status, data, actual);
+    }
+}
 
-    mmio_write32(ctrl->op_base, 0x18, (uint32_t)(uintptr_t)qh);
-    uint32_t cmd = mmio_read32(ctrl->op_base, 0x00);
-    cmd |= (1u << 5);
-    mmio_write32(ctrl->op_base, 0x00, cmd);
+static void transfer_retire(struct ehci_transfer *t, enum usb_status status) {
+    qh_reset(t->qh);
+    t->status = (uint8_t)status;
+    t->retiring = RETIRE_WAIT;
+}
 
-    if (!wait_qtd_complete(qtd_status)) {
-        return 0;
+static void transfer_finish(struct ehci_controller *ctrl, struct ehci_transfer *t, enum usb_status status) {
+    if (status == USB_STATUS_OK) {
+        transfer_release(ctrl, t, status);
+        return;
+    }
+    transfer_retire(t, status);
+    async_doorbell(ctrl);
+}
+
+static void endpoint_release(struct ehci_controller *ctrl, struct ehci_endpoint *e) {
+    for (int i = 0; i < EHCI_MAX_INTERRUPTS; ++i) {
+        struct ehci_interrupt *intr = &ctrl->interrupts[i];
+        if (intr->used && intr->releasing && intr->qh == e->qh) {
+            qtd_free(ctrl, intr->qtd);
+            intr->releasing = 0;
+            intr->used = 0;
+        }
+    }
+    e->retiring = 0;
+    e->used = 0;
+    ctrl->endpoint_count--;
+}
+
+static void interrupt_complete(struct ehci_interrupt *intr);
+
+void ehci_process(struct ehci_controller *ctrl) {
+    if (!ctrl || !ctrl->async_head) {
+        return;
+    }
+    uint32_t pending = __atomic_exchange_n(&ctrl->irq_status, 0, __ATOMIC_SEQ_CST);
+    if (pending & EHCI_STS_HOST_ERROR) {
+        log_puts("EHCI: host system error\n");
+    }
+    int scan = pending != 0 || !ehci_irq_live(ctrl);
+    uint64_t now = timer_tsc();
+    async_advanced(ctrl, now);
+    periodic_advanced(ctrl, now);
+    for (int i = 0; i < EHCI_MAX_TRANSFERS; ++i) {
+        struct ehci_transfer *t = &ctrl->transfers[i];
+        if (!t->used || t->retiring || (!scan && now < t->deadline_tsc)) {
+            continue;
+        }
+        enum usb_status status = transfer_status(t);
+        if (status == USB_STATUS_PENDING && now >= t->deadline_tsc) {
+            status = USB_STATUS_TIMEOUT;
+        }
+        if (status != USB_STATUS_PENDING) {
+            transfer_finish(ctrl, t, status);
+        }
+    }
+    if (!scan) {
+        return;
+    }
+    for (int i = 0; i < EHCI_MAX_INTERRUPTS; ++i) {
+        struct ehci_interrupt *intr = &ctrl->interrupts[i];
+        if (intr->used && !intr->halted && !intr->releasing) {
+            interrupt_complete(intr);
+        }
+    }
+}
+
+static uint32_t interval_level(uint8_t frames) {
+    uint32_t level = 0;
+    while (level + 1u < EHCI_PERIODIC_LEVELS && (2u << level) <= frames) {
+        level++;
+    }
+    return level;
+}
+
+static void interrupt_arm(struct ehci_interrupt *intr) {
+    qtd_fill(intr->qtd, QTD_TOKEN_ACTIVE | QTD_TOKEN_PID_IN | QTD_TOKEN_IOC, intr->buf, intr->len);
+    intr->qtd->next = QTD_TERMINATE;
+    __asm__ volatile ("" : : : "memory");
+    intr->qh->next = phys(intr->qtd);
+}
+
+int ehci_interrupt_open(struct ehci_controller *ctrl,
+                        uint8_t dev_addr,
+                        uint8_t ep,
+                        uint16_t max_packet,
+                        uint8_t frames,
+                        void *buf,
+                        uint16_t len,
+                        usb_callback_fn callback,
+                        void *ctx) {
+    if (!ctrl || !ctrl->frame_list || !buf || !callback || len == 0 || len > max_packet) {
+        return -1;
+    }
+    int handle = -1;
+    for (int i = 0; i < EHCI_MAX_INTERRUPTS; ++i) {
+        if (!ctrl->interrupts[i].used) {
+            handle = i;
+            break;
+        }
+    }
+    if (handle < 0 || endpoint_find(ctrl, dev_addr, ep & 0x0Fu)) {
+        return -1;
+    }
+    struct ehci_qtd *qtd = qtd_alloc(ctrl);
+    if (!qtd) {
+        return -1;
+    }
+    struct ehci_endpoint *e = endpoint_add(ctrl, dev_addr, ep & 0x0Fu, max_packet, 1);
+    if (!e) {
+        qtd_free(ctrl, qtd);
+        return -1;
     }
 
-    cmd = mmio_read32(ctrl->op_base, 0x00);
-    cmd &= ~(1u << 5);
-    mmio_write32(ctrl->op_base, 0x00, cmd);
+    struct ehci_interrupt *intr = &ctrl->interrupts[handle];
+    uint32_t level = interval_level(frames);
+    intr->qh = e->qh;
+    intr->qtd = qtd;
+    intr->buf = buf;
+    intr->len = len;
+    intr->interval = (uint8_t)(1u << level);
+    intr->halted = 0;
+    intr->releasing = 0;
+    intr->callback = callback;
+    intr->ctx = ctx;
+    intr->used = 1;
+    interrupt_arm(intr);
+    qh_link_after(ctrl->periodic[level], e->qh);
+    return handle;
+}
 
+static void interrupt_complete(struct ehci_interrupt *intr) {
+    enum usb_status status = token_status(qtd_token(intr->qtd));
+    if (status == USB_STATUS_PENDING) {
+        return;
+    }
+    uint32_t got = 0;
+    if (status == USB_STATUS_OK) {
+        got = intr->len - ((qtd_token(intr->qtd) >> 16) & 0x7FFFu);
+    } else {
+        intr->halted = 1;
+    }
+    intr->callback(intr->ctx, status, (const uint8_t *)intr->buf, got);
+    if (!intr->halted) {
+        interrupt_arm(intr);
+    }
+}
+
+int ehci_interrupt_resume(struct ehci_controller *ctrl, int handle) {
+    if (!ctrl || handle < 0 || handle >= EHCI_MAX_INTERRUPTS || !ctrl->interrupts[handle].used ||
+        ctrl->interrupts[handle].releasing) {
+        return 0;
+    }
+    struct ehci_interrupt *intr = &ctrl->interrupts[handle];
+    if (!intr->halted) {
+        return 1;
+    }
+    qh_reset(intr->qh);
+    intr->halted = 0;
+    interrupt_arm(intr);
     return 1;
 }
+
+void ehci_release_device(struct ehci_controller *ctrl, uint8_t dev_addr) {
+    if (!ctrl || !ctrl->async_head) {
+        return;
+    }
+    for (int i = 0; i < EHCI_MAX_INTERRUPTS; ++i) {
+        struct ehci_interrupt *intr = &ctrl->interrupts[i];
+        if (intr->used && !intr->releasing && (intr->qh->ep_char & 0x7Fu) == dev_addr) {
+            intr->releasing = 1;
+        }
+    }
+    for (int i = 0; i < EHCI_MAX_TRANSFERS; ++i) {
+        struct ehci_transfer *t = &ctrl->transfers[i];
+        if (t->used && !t->retiring && (t->qh->ep_char & 0x7Fu) == dev_addr) {
+            transfer_retire(t, USB_STATUS_ERROR);
+        }
+    }
+    uint32_t frame = mmio_read32(ctrl->op_base, EHCI_FRINDEX) >> 3;
+    uint64_t deadline = timer_tsc() + timer_us_to_tsc(EHCI_RETIRE_TIMEOUT_US);
+    for (uint32_t i = 0; i < EHCI_MAX_ENDPOINTS; ++i) {
+        struct ehci_endpoint *e = &ctrl->endpoints[i];
+        if (!e->used || e->retiring || e->dev_addr != dev_addr) {
+            continue;
+        }
+        if (e->periodic) {
+            qh_unlink(ctrl->periodic[EHCI_PERIODIC_LEVELS - 1u], e->qh);
+            e->retire_frame = frame;
+            e->retire_deadline_tsc = deadline;
+            e->retiring = RETIRE_FRAMES;
+        } else {
+            qh_unlink(ctrl->async_head, e->qh);
+            e->retiring = RETIRE_WAIT;
+        }
+    }
+    async_doorbell(ctrl);
+}
@@ -164,52 +164,60 @@ int fat_mount(struct fat_fs *fs, uint32_t part_lba) {
     return 1;
 }
 
-int fat_list_root(struct fat_fs *fs, fat_dir_cb cb, void *ctx) {
-    if (!fs || !cb) {
-        return 0;
+typedef int (*dir_visit)(const struct dir_entry *ent, void *ctx);
+
+static int visit_sector(const uint8_t *sector, uint32_t bytes, dir_visit visit, void *ctx, int *done) {
+    for (uint32_t off = 0; off < bytes; off += sizeof(struct dir_entry)) {
+        const struct dir_entry *ent = (const struct dir_entry *)(sector + off);
+        if (ent->name[0] == 0x00) {
+            *done = 1;
+            return 1;
+        }
+        if (ent->name[0] == 0xE5 || ent->attr == 0x0F) {
+            continue;
+        }
+        if (visit(ent, ctx)) {
+            *done = 1;
+            return 1;
+        }
+    }
+    return 1;
+}
+
+static int is_end_cluster(const struct fat_fs *fs, uint32_t cluster) {
+    if (fs->fat_type == FAT_TYPE_16) {
+        return cluster < 2u || cluster >= 0xFFF8u;
     }
+    return cluster < 2u || cluster >= 0x0FFFFFF8u;
+}
+
+static uint32_t cluster_lba(const struct fat_fs *fs, uint32_t cluster) {
+    return fs->data_lba + (cluster - 2u) * fs->sectors_per_cluster;
+}
+
+static int walk_root(const struct fat_fs *fs, dir_visit visit, void *ctx) {
     uint8_t sector[512];
-    char name[13];
+    int done = 0;
 
     if (fs->fat_type == FAT_TYPE_16) {
-        for (uint32_t i = 0; i < fs->root_dir_sectors; ++i) {
-            if (!read_sector(fs->part_lba + fs->root_dir_lba + i, sector)) {
+        for (uint32_t i = 0; i < fs->root_dir_sectors && !done; ++i) {
+            if (!read_sector(fs->root_dir_lba + i, sector)) {
                 return 0;
             }
-            for (uint32_t off = 0; off < fs->bytes_per_sector; off += sizeof(struct dir_entry)) {
-                struct dir_entry *ent = (struct dir_entry *)(sector + off);
-                if (ent->name[0] == 0x00) {
-                    return 1;
-                }
-                if (ent->name[0] == 0xE5 || ent->attr == 0x0F) {
-                    continue;
-                }
-                name_to_str(ent->name, name);
-                cb(name, ent->file_size, ent->attr, ctx);
-            }
+            visit_sector(sector, fs->bytes_per_sector, visit, ctx, &done);
         }
         return 1;
     }
 
     uint32_t cluster = fs->root_cluster;
     uint8_t fat_sector[512];
-    while (cluster < 0x0FFFFFF8u) {
-        uint32_t first_lba = fs->data_lba + (cluster - 2u) * fs->sectors_per_cluster;
-        for (uint32_t s = 0; s < fs->sectors_per_cluster; ++s) {
-            if (!read_sector(fs->part_lba + first_lba + s, sector)) {
+    while (!is_end_cluster(fs, cluster) && !done) {
+        uint32_t first_lba = cluster_lba(fs, cluster);
+        for (uint32_t s = 0; s < fs->sectors_per_cluster && !done; ++s) {
+            if (!read_sector(first_lba + s, sector)) {
                 return 0;
             }
-            for (uint32_t off = 0; off < fs->bytes_per_sector; off += sizeof(struct dir_entry)) {
-                struct dir_entry *ent = (struct dir_entry *)(sector + off);
-                if (ent->name[0] == 0x00) {
-                    return 1;
-                }
-                if (ent->name[0] == 0xE5 || ent->attr == 0x0F) {
-                    continue;
-                }
-                name_to_str(ent->name, name);
-                cb(name, ent->file_size, ent->attr, ctx);
-            }
+            visit_sector(sector, fs->bytes_per_sector, visit, ctx, &done);
         }
         cluster = fat_get_next_cluster(fs, cluster, fat_sector);
         if (cluster == 0xFFFFFFFFu) {
@@ -219,3 +227,126 @@ int fat_list_root(struct fat_fs *fs, fat_dir_cb cb, void *ctx) {
 
     return 1;
 }
+
+struct list_ctx {
+    fat_dir_cb cb;
+    void *ctx;
+};
+
+static int list_visit(const struct dir_entry *ent, void *ctx) {
+    struct list_ctx *list = (struct list_ctx *)ctx;
+    char name[13];
+    name_to_str(ent->name, name);
+    list->cb(name, ent->file_size, ent->attr, list->ctx);
+    return 0;
+}
+
+int fat_list_root(struct fat_fs *fs, fat_dir_cb cb, void *ctx) {
+    if (!fs || !cb) {
+        return 0;
+    }
+    struct list_ctx list = { cb, ctx };
+    return walk_root(fs, list_visit, &list);
+}
+
+static char upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+struct open_ctx {
+    const char *name;
+    int found;
+    struct dir_entry entry;
+};
+
+static int open_visit(const struct dir_entry *ent, void *ctx) {
+    struct open_ctx *open = (struct open_ctx *)ctx;
+    if ((ent->attr & 0x18) != 0) {
+        return 0;
+    }
+    char name[13];
+    name_to_str(ent->name, name);
+    uint32_t i = 0;
+    while (name[i] != '\0' && upper(open->name[i]) == name[i]) {
+        i++;
+    }
+    if (name[i] != '\0' || open->name[i] != '\0') {
+        return 0;
+    }
+    open->entry = *ent;
+    open->found = 1;
+    return 1;
+}
+
+int fat_open_root(struct fat_fs *fs, const char *name, struct fat_file *file) {
+    if (!fs || !name || !file || fs->bytes_per_sector != sizeof(file->sector)) {
+        return 0;
+    }
+    struct open_ctx open;
+    open.name = name;
+    open.found = 0;
+    if (!walk_root(fs, open_visit, &open) || !open.found) {
+        return 0;
+    }
+    file->fs = fs;
+    file->first_cluster = ((uint32_t)open.entry.first_cluster_hi << 16) | open.entry.first_cluster_lo;
+    if (fs->fat_type == FAT_TYPE_16) {
+        file->first_cluster &= 0xFFFFu;
+    }
+    file->cluster = file->first_cluster;
+    file->size = open.entry.file_size;
+    file->pos = 0;
+    file->cluster_pos = 0;
+    file->cached_lba = 0xFFFFFFFFu;
+    return 1;
+}
+
+uint32_t fat_read(struct fat_file *file, void *buf, uint32_t len) {
+    if (!file || !file->fs || !buf) {
+        return 0;
+    }
+    const struct fat_fs *fs = file->fs;
+    uint32_t bps = fs->bytes_per_sector;
+    uint32_t cluster_bytes = bps * fs->sectors_per_cluster;
+    uint8_t *out = (uint8_t *)buf;
+    uint8_t fat_sector[512];
+    uint32_t done = 0;
+
+    if (len > file->size - file->pos) {
+        len = file->size - file->pos;
+    }
+    while (done < len) {
+        if (file->cluster_pos == cluster_bytes) {
+            file->cluster = fat_get_next_cluster(fs, file->cluster, fat_sector);
+            file->cluster_pos = 0;
+        }
+        if (is_end_cluster(fs, file->cluster)) {
+            break;
+        }
+        uint32_t lba = cluster_lba(fs, file->cluster) + file->cluster_pos / bps;
+        uint32_t offset = file->cluster_pos % bps;
+        uint32_t chunk = bps - offset;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        if (offset == 0 && chunk == bps) {
+            if (!read_sector(lba, out + done)) {
+                break;
+            }
+        } else {
+            if (file->cached_lba != lba) {
+                if (!read_sector(lba, file->sector)) {
+                    break;
+                }
+                file->cached_lba = lba;
+            }
+            for (uint32_t i = 0; i < chunk; ++i) {
+                out[done + i] = file->sector[offset + i];
+            }
+        }
+        done += chunk;
+        file->pos += chunk;
+        file->cluster_pos += chunk;
+    }
+    return done;
+}
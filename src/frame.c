@@ -0,0 +1,303 @@
+#include "frame.h"
+#include "input.h"
+#include "log.h"
+#include "portio.h"
+#include "timer.h"
+
+#define VGA_INPUT_STATUS 0x3DA
+#define VGA_RETRACE 0x08
+#define HUD_GRAPH_HEIGHT 40
+#define HUD_BAR_WIDTH 3
+#define HUD_US_PER_PIXEL 500u
+
+int frame_retrace_probe(void) {
+    uint64_t end = timer_tsc() + timer_us_to_tsc(50000);
+    int seen_set = 0;
+    int seen_clear = 0;
+    while (timer_tsc() < end) {
+        if (inb(VGA_INPUT_STATUS) & VGA_RETRACE) {
+            seen_set = 1;
+        } else {
+            seen_clear = 1;
+        }
+        if (seen_set && seen_clear) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void frame_pacer_init(struct frame_pacer *pacer, uint32_t target_hz, int vsync) {
+    if (!pacer) {
+        return;
+    }
+    if (target_hz == 0 || target_hz > 1000u) {
+        target_hz = FRAME_DEFAULT_HZ;
+    }
+    pacer->target_hz = target_hz;
+    pacer->period_tsc = timer_us_to_tsc(1000000u / target_hz);
+    pacer->next_tsc = 0;
+    pacer->vsync = vsync;
+}
+
+int frame_pacer_ready(const struct frame_pacer *pacer, uint64_t now_tsc) {
+    return now_tsc >= pacer->next_tsc;
+}
+
+void frame_pacer_advance(struct frame_pacer *pacer, uint64_t now_tsc) {
+    pacer->next_tsc += pacer->period_tsc;
+    if (pacer->next_tsc <= now_tsc) {
+        pacer->next_tsc = now_tsc + pacer->period_tsc;
+    }
+}
+
+int frame_pacer_sync(const struct frame_pacer *pacer, uint64_t since_tsc, uint64_t now_tsc) {
+    if (!pacer->vsync || (inb(VGA_INPUT_STATUS) & VGA_RETRACE)) {
+        return 1;
+    }
+    return now_tsc >= since_tsc + pacer->period_tsc;
+}
+
+void frame_stats_init(struct frame_stats *stats) {
+    stats->head = 0;
+    stats->count = 0;
+}
+
+void frame_stats_push(struct frame_stats *stats, const struct frame_sample *sample) {
+    stats->samples[stats->head] = *sample;
+    stats->head = (stats->head + 1) % FRAME_STATS_HISTORY;
+    if (stats->count < FRAME_STATS_HISTORY) {
+        stats->count++;
+    }
+}
+
+const struct frame_sample *frame_stats_at(const struct frame_stats *stats, uint32_t age) {
+    if (age >= stats->count) {
+        return 0;
+    }
+    uint32_t index = (stats->head + FRAME_STATS_HISTORY - 1 - age) % FRAME_STATS_HISTORY;
+    return &stats->samples[index];
+}
+
+uint32_t frame_stats_fps(const struct frame_stats *stats) {
+    uint32_t total = 0;
+    uint32_t frames = 0;
+    for (uint32_t i = 0; i < stats->count; ++i) {
+        uint32_t interval = frame_stats_at(stats, i)->interval_us;
+        if (interval == 0) {
+            continue;
+        }
+        total += interval;
+        frames++;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    return (frames * 1000000u + total / 2) / total;
+}
+
+static uint32_t summary_bucket(uint32_t us) {
+    uint32_t bucket = us / FRAME_SUMMARY_BUCKET_US;
+    return bucket < FRAME_SUMMARY_BUCKETS ? bucket : FRAME_SUMMARY_BUCKETS - 1u;
+}
+
+void frame_summary_reset(struct frame_summary *summary, uint64_t now_tsc) {
+    summary->start_tsc = now_tsc;
+    summary->frames = 0;
+    summary->late_frames = 0;
+    summary->work_total_us = 0;
+    summary->work_max_us = 0;
+    summary->interval_max_us = 0;
+    for (uint32_t i = 0; i < FRAME_SUMMARY_BUCKETS; ++i) {
+        summary->work[i] = 0;
+        summary->interval[i] = 0;
+    }
+}
+
+void frame_summary_add(struct frame_summary *summary, const struct frame_sample *sample, const struct frame_pacer *pacer) {
+    uint32_t work = sample->update_us + sample->render_us + sample->present_us;
+    summary->frames++;
+    summary->work_total_us += work;
+    summary->work[summary_bucket(work)]++;
+    if (work > summary->work_max_us) {
+        summary->work_max_us = work;
+    }
+    if (sample->interval_us == 0) {
+        return;
+    }
+    summary->interval[summary_bucket(sample->interval_us)]++;
+    if (sample->interval_us > summary->interval_max_us) {
+        summary->interval_max_us = sample->interval_us;
+    }
+    uint32_t period_us = 1000000u / pacer->target_hz;
+    if (sample->interval_us > period_us + period_us / 2u) {
+        summary->late_frames++;
+    }
+}
+
+static uint32_t summary_percentile(const uint32_t *buckets, uint32_t percent, uint32_t max_us) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < FRAME_SUMMARY_BUCKETS; ++i) {
+        total += buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint32_t target = (total * percent + 99u) / 100u;
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < FRAME_SUMMARY_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            uint32_t upper = (i + 1u) * FRAME_SUMMARY_BUCKET_US;
+            return upper < max_us ? upper : max_us;
+        }
+    }
+    return max_us;
+}
+
+void frame_summary_log(const struct frame_summary *summary, uint64_t now_tsc) {
+    uint32_t elapsed_ms = timer_tsc_to_us(now_tsc - summary->start_tsc) / 1000u;
+    log_puts("Frame summary: ");
+    log_dec32(summary->frames);
+    log_puts(" frames in ");
+    log_dec32(elapsed_ms);
+    log_puts(" ms, ");
+    log_dec32(elapsed_ms ? summary->frames * 1000u / elapsed_ms : 0);
+    log_puts(" fps, ");
+    log_dec32(summary->late_frames);
+    log_puts(" late\n");
+    log_puts("  work us: avg=");
+    log_dec32(summary->frames ? summary->work_total_us / summary->frames : 0);
+    log_puts(" p50=");
+    log_dec32(summary_percentile(summary->work, 50, summary->work_max_us));
+    log_puts(" p95=");
+    log_dec32(summary_percentile(summary->work, 95, summary->work_max_us));
+    log_puts(" p99=");
+    log_dec32(summary_percentile(summary->work, 99, summary->work_max_us));
+    log_puts(" max=");
+    log_dec32(summary->work_max_us);
+    log_puts("\n  interval us: p50=");
+    log_dec32(summary_percentile(summary->interval, 50, summary->interval_max_us));
+    log_puts(" p99=");
+    log_dec32(summary_percentile(summary->interval, 99, summary->interval_max_us));
+    log_puts(" max=");
+    log_dec32(summary->interval_max_us);
+    log_puts("\n");
+}
+
+static char *append_str(char *out, const char *s) {
+    while (*s) {
+        *out++ = *s++;
+    }
+    *out = '\0';
+    return out;
+}
+
+static char *append_dec(char *out, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10u);
+        value /= 10u;
+    } while (value && n < 10);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    *out = '\0';
+    return out;
+}
+
+struct rect frame_hud_rect(const struct framebuffer *fb) {
+    return (struct rect){ (int)fb->width - FRAME_HUD_WIDTH - 8, 8, FRAME_HUD_WIDTH, FRAME_HUD_HEIGHT };
+}
+
+static int bar_height(uint32_t us) {
+    uint32_t h = us / HUD_US_PER_PIXEL;
+    if (h > HUD_GRAPH_HEIGHT) {
+        h = HUD_GRAPH_HEIGHT;
+    }
+    if (us != 0 && h == 0) {
+        h = 1;
+    }
+    return (int)h;
+}
+
+void frame_hud_draw(const struct framebuffer *fb, const struct frame_stats *stats, const struct frame_pacer *pacer) {
+    uint32_t bg = rgb(10, 14, 24);
+    uint32_t fg = rgb(220, 230, 240);
+    struct rect hud = frame_hud_rect(fb);
+    fb_fill_rect(fb, hud, bg);
+
+    char line[40];
+    char *p = append_str(line, "FPS ");
+    p = append_dec(p, frame_stats_fps(stats));
+    p = append_str(p, "/");
+    p = append_dec(p, pacer->target_hz);
+    append_str(p, pacer->vsync ? " vsync" : "");
+    fb_draw_string(fb, hud.x + 4, hud.y + 4, line, fg, bg);
+
+    const struct frame_sample *last = frame_stats_at(stats, 0);
+    p = append_str(line, "U");
+    p = append_dec(p, last ? last->update_us : 0);
+    p = append_str(p, " R");
+    p = append_dec(p, last ? last->render_us : 0);
+    p = append_str(p, " P");
+    append_dec(p, last ? last->present_us : 0);
+    fb_draw_string(fb, hud.x + 4, hud.y + 16, line, fg, bg);
+
+    uint32_t screen_pixels = fb->width * fb->height;
+    uint32_t overdraw = 0;
+    if (last && screen_pixels >= 100u) {
+        overdraw = last->pixels_written / (screen_pixels / 100u);
+    }
+    p = append_str(line, "Overdraw ");
+    p = append_dec(p, overdraw / 100u);
+    p = append_str(p, ".");
+    p = append_str(p, overdraw % 100u < 10u ? "0" : "");
+    p = append_dec(p, overdraw % 100u);
+    p = append_str(p, "x T");
+    append_dec(p, last ? last->tiles_dirty : 0);
+    fb_draw_string(fb, hud.x + 4, hud.y + 28, line, fg, bg);
+
+    struct input_stats input;
+    input_get_stats(&input);
+    p = append_str(line, "PS/2 drop ");
+    p = append_dec(p, input.kbd_dropped);
+    p = append_str(p, "/");
+    p = append_dec(p, input.mouse_dropped);
+    p = append_str(p, " resync ");
+    append_dec(p, input.mouse_resyncs);
+    fb_draw_string(fb, hud.x + 4, hud.y + 40, line, fg, bg);
+
+    uint8_t device = input_trace_last_device();
+    struct input_latency latency;
+    input_latency_get(device, &latency);
+    p = append_str(line, input_device_name(device));
+    p = append_str(p, " ");
+    p = append_dec(p, latency.p50_us / 1000u);
+    p = append_str(p, ".");
+    p = append_dec(p, (latency.p50_us % 1000u) / 100u);
+    p = append_str(p, "/");
+    p = append_dec(p, latency.p99_us / 1000u);
+    p = append_str(p, ".");
+    p = append_dec(p, (latency.p99_us % 1000u) / 100u);
+    append_str(p, "ms");
+    fb_draw_string(fb, hud.x + 4, hud.y + 52, line, fg, bg);
+
+    int base_y = hud.y + hud.h - 4;
+    int graph_x = hud.x + 4;
+    int slots = (hud.w - 8) / HUD_BAR_WIDTH;
+    for (int i = 0; i < slots; ++i) {
+        const struct frame_sample *s = frame_stats_at(stats, (uint32_t)(slots - 1 - i));
+        if (!s) {
+            continue;
+        }
+        int x = graph_x + i * HUD_BAR_WIDTH;
+        int work = bar_height(s->update_us + s->render_us);
+        int total = bar_height(s->update_us + s->render_us + s->present_us);
+        fb_fill_rect(fb, (struct rect){ x, base_y - work, HUD_BAR_WIDTH - 1, work }, rgb(80, 200, 120));
+        fb_fill_rect(fb, (struct rect){ x, base_y - total, HUD_BAR_WIDTH - 1, total - work }, rgb(90, 140, 240));
+    }
+    int budget = bar_height(1000000u / pacer->target_hz);
+    fb_fill_rect(fb, (struct rect){ graph_x, base_y - budget, hud.w - 8, 1 }, rgb(240, 90, 80));
+}
@@ -1,16 +1,300 @@
 #include "framebuffer.h"
 #include "font8x8.h"
+#include "memory.h"
+
+#define FB_INLINE static inline __attribute__((always_inline))
+
+static uint32_t pixel_writes;
+static const struct framebuffer *heat_fb;
+static uint8_t *heat_counts;
+static uint32_t heat_capacity;
 
 uint32_t rgb(uint8_t r, uint8_t g, uint8_t b) {
     return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
 }
 
-void fb_put_pixel(const struct framebuffer *fb, int x, int y, uint32_t color) {
+uint8_t fb_format_from_layout(uint8_t bpp, uint8_t red_pos, uint8_t red_size,
+                              uint8_t green_pos, uint8_t green_size,
+                              uint8_t blue_pos, uint8_t blue_size) {
+    if (bpp == 32 || bpp == 24) {
+        if (red_size != 8 || green_size != 8 || blue_size != 8 || green_pos != 8) {
+            return FB_FORMAT_UNKNOWN;
+        }
+        if (red_pos == 16 && blue_pos == 0) {
+            return bpp == 32 ? FB_FORMAT_XRGB8888 : FB_FORMAT_RGB888;
+        }
+        if (red_pos == 0 && blue_pos == 16) {
+            return bpp == 32 ? FB_FORMAT_XBGR8888 : FB_FORMAT_BGR888;
+        }
+        return FB_FORMAT_UNKNOWN;
+    }
+    if (bpp == 16) {
+        if (red_size != 5 || green_size != 6 || blue_size != 5 || green_pos != 5) {
+            return FB_FORMAT_UNKNOWN;
+        }
+        if (red_pos == 11 && blue_pos == 0) {
+            return FB_FORMAT_RGB565;
+        }
+        if (red_pos == 0 && blue_pos == 11) {
+            return FB_FORMAT_BGR565;
+        }
+    }
+    return FB_FORMAT_UNKNOWN;
+}
+
+uint8_t fb_format_bpp(uint8_t format) {
+    switch (format) {
+    case FB_FORMAT_XRGB8888:
+    case FB_FORMAT_XBGR8888:
+        return 32;
+    case FB_FORMAT_RGB888:
+    case FB_FORMAT_BGR888:
+        return 24;
+    case FB_FORMAT_RGB565:
+    case FB_FORMAT_BGR565:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+static int name_equals(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+uint8_t fb_format_from_name(const char *name) {
+    if (!name) {
+        return FB_FORMAT_UNKNOWN;
+    }
+    if (name_equals(name, "xrgb8888")) {
+        return FB_FORMAT_XRGB8888;
+    }
+    if (name_equals(name, "rgb565")) {
+        return FB_FORMAT_RGB565;
+    }
+    return FB_FORMAT_UNKNOWN;
+}
+
+int fb_alloc_surface(struct framebuffer *out, uint32_t width, uint32_t height, uint8_t format) {
+    if (!out || width == 0 || height == 0) {
+        return 0;
+    }
+    if (format != FB_FORMAT_XRGB8888 && format != FB_FORMAT_RGB565) {
+        return 0;
+    }
+    uint8_t bpp = fb_format_bpp(format);
+    uint32_t pitch = (width * (bpp / 8u) + FB_PITCH_ALIGN - 1u) & ~(FB_PITCH_ALIGN - 1u);
+    uint32_t pages = (pitch * height + 4095u) / 4096u;
+    uint32_t addr = phys_alloc_pages(pages);
+    if (addr == 0) {
+        return 0;
+    }
+    out->base = (uint8_t *)(uintptr_t)addr;
+    out->width = width;
+    out->height = height;
+    out->pitch = pitch;
+    out->bpp = bpp;
+    out->format = format;
+    return 1;
+}
+
+void fb_free_surface(struct framebuffer *fb) {
+    if (!fb || !fb->base) {
+        return;
+    }
+    uint32_t pages = (fb->pitch * fb->height + 4095u) / 4096u;
+    uint32_t addr = (uint32_t)(uintptr_t)fb->base;
+    for (uint32_t i = 0; i < pages; ++i) {
+        phys_free_page(addr + i * 4096u);
+    }
+    fb->base = 0;
+}
+
+FB_INLINE uint32_t swap_red_blue(uint32_t c) {
+    return (c & 0x0000FF00u) | ((c >> 16) & 0xFFu) | ((c & 0xFFu) << 16);
+}
+
+FB_INLINE uint32_t pack_565(uint32_t c) {
+    return ((c >> 8) & 0xF800u) | ((c >> 5) & 0x07E0u) | ((c >> 3) & 0x001Fu);
+}
+
+FB_INLINE uint32_t expand_565(uint32_t c) {
+    uint32_t r = (c >> 11) & 0x1Fu;
+    uint32_t g = (c >> 5) & 0x3Fu;
+    uint32_t b = c & 0x1Fu;
+    return (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+}
+
+FB_INLINE uint32_t swap_565(uint32_t c) {
+    return ((c & 0x1Fu) << 11) | (c & 0x07E0u) | ((c >> 11) & 0x1Fu);
+}
+
+FB_INLINE uint32_t pack_color(uint8_t format, uint32_t color) {
+    switch (format) {
+    case FB_FORMAT_XBGR8888:
+    case FB_FORMAT_BGR888:
+        return swap_red_blue(color);
+    case FB_FORMAT_RGB565:
+        return pack_565(color);
+    case FB_FORMAT_BGR565:
+        return pack_565(swap_red_blue(color));
+    default:
+        return color & 0x00FFFFFFu;
+    }
+}
+
+uint32_t fb_pack_color(const struct framebuffer *fb, uint32_t color) {
+    return pack_color(fb->format, color);
+}
+
+FB_INLINE uint32_t bytes_per_pixel(const struct framebuffer *fb) {
+    return ((uint32_t)fb->bpp + 7u) / 8u;
+}
+
+FB_INLINE uint8_t *pixel_addr(const struct framebuffer *fb, uint32_t x, uint32_t y) {
+    return fb->base + y * fb->pitch + x * bytes_per_pixel(fb);
+}
+
+static void heat_record(const struct framebuffer *fb, const uint8_t *dst, uint32_t count) {
+    uint32_t offset = (uint32_t)(dst - fb->base);
+    uint32_t y = offset / fb->pitch;
+    uint32_t x = (offset % fb->pitch) / bytes_per_pixel(fb);
+    uint8_t *cell = heat_counts + y * fb->width + x;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (cell[i] != 0xFF) {
+            cell[i]++;
+        }
+    }
+}
+
+static void fill_span_raw(const struct framebuffer *fb, uint8_t *dst, uint32_t count, uint32_t raw) {
+    pixel_writes += count;
+    if (fb == heat_fb) {
+        heat_record(fb, dst, count);
+    }
+    switch (bytes_per_pixel(fb)) {
+    case 4: {
+        uint32_t *row = (uint32_t *)dst;
+        for (uint32_t i = 0; i < count; ++i) {
+            row[i] = raw;
+        }
+        break;
+    }
+    case 3:
+        for (uint32_t i = 0; i < count; ++i) {
+            dst[i * 3 + 0] = (uint8_t)raw;
+            dst[i * 3 + 1] = (uint8_t)(raw >> 8);
+            dst[i * 3 + 2] = (uint8_t)(raw >> 16);
+        }
+        break;
+    case 2: {
+        uint16_t *row = (uint16_t *)dst;
+        for (uint32_t i = 0; i < count; ++i) {
+            row[i] = (uint16_t)raw;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+uint32_t fb_pixel_writes(void) {
+    return pixel_writes;
+}
+
+void fb_reset_pixel_writes(void) {
+    pixel_writes = 0;
+}
+
+int fb_heatmap_begin(const struct framebuffer *fb) {
+    if (!fb) {
+        return 0;
+    }
+    uint32_t cells = fb->width * fb->height;
+    if (cells > heat_capacity) {
+        uint32_t addr = phys_alloc_pages((cells + 4095u) / 4096u);
+        if (addr == 0) {
+            return 0;
+        }
+        heat_counts = (uint8_t *)(uintptr_t)addr;
+        heat_capacity = cells;
+    }
+    for (uint32_t i = 0; i < cells; ++i) {
+        heat_counts[i] = 0;
+    }
+    heat_fb = fb;
+    return 1;
+}
+
+static uint32_t heat_color(uint8_t count) {
+    switch (count) {
+    case 0:
+        return rgb(0, 0, 0);
+    case 1:
+        return rgb(30, 90, 200);
+    case 2:
+        return rgb(40, 180, 80);
+    case 3:
+        return rgb(230, 210, 40);
+    case 4:
+        return rgb(240, 130, 30);
+    default:
+        return rgb(220, 40, 40);
+    }
+}
+
+void fb_heatmap_end(void) {
+    const struct framebuffer *fb = heat_fb;
+    if (!fb) {
+        return;
+    }
+    heat_fb = 0;
+    uint32_t palette[6];
+    for (uint8_t i = 0; i < 6; ++i) {
+        palette[i] = fb_pack_color(fb, heat_color(i));
+    }
+    const uint8_t *cell = heat_counts;
+    for (uint32_t y = 0; y < fb->height; ++y) {
+        uint8_t *dst = pixel_addr(fb, 0, y);
+        for (uint32_t x = 0; x < fb->width; ++x) {
+            uint8_t count = *cell++;
+            fill_span_raw(fb, dst, 1, palette[count > 5 ? 5 : count]);
+            dst += bytes_per_pixel(fb);
+        }
+    }
+}
+
+void fb_put_pixel_raw(const struct framebuffer *fb, int x, int y, uint32_t raw) {
     if (x < 0 || y < 0 || (uint32_t)x >= fb->width || (uint32_t)y >= fb->height) {
         return;
     }
-    uint32_t *pixel = (uint32_t *)(fb->base + (uint32_t)y * fb->pitch + (uint32_t)x * 4);
-    *pixel = color;
+    fill_span_raw(fb, pixel_addr(fb, (uint32_t)x, (uint32_t)y), 1, raw);
+}
+
+void fb_put_pixel(const struct framebuffer *fb, int x, int y, uint32_t color) {
+    fb_put_pixel_raw(fb, x, y, fb_pack_color(fb, color));
+}
+
+uint32_t fb_get_pixel_raw(const struct framebuffer *fb, int x, int y) {
+    if (x < 0 || y < 0 || (uint32_t)x >= fb->width || (uint32_t)y >= fb->height) {
+        return 0;
+    }
+    const uint8_t *p = pixel_addr(fb, (uint32_t)x, (uint32_t)y);
+    switch (bytes_per_pixel(fb)) {
+    case 4:
+        return *(const uint32_t *)p;
+    case 3:
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    case 2:
+        return *(const uint16_t *)p;
+    default:
+        return 0;
+    }
 }
 
 void fb_fill_rect(const struct framebuffer *fb, struct rect r, uint32_t color) {
@@ -30,64 +314,387 @@ void fb_fill_rect(const struct framebuffer *fb, struct rect r, uint32_t color) {
     if (y1 > (int)fb->height) {
         y1 = (int)fb->height;
     }
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
 
+    uint32_t raw = fb_pack_color(fb, color);
     for (int y = y0; y < y1; ++y) {
-        uint32_t *row = (uint32_t *)(fb->base + (uint32_t)y * fb->pitch + (uint32_t)x0 * 4);
-        for (int x = x0; x < x1; ++x) {
-            row[x - x0] = color;
-        }
+        fill_span_raw(fb, pixel_addr(fb, (uint32_t)x0, (uint32_t)y), (uint32_t)(x1 - x0), raw);
     }
 }
 
-void fb_draw_vertical_gradient(const struct framebuffer *fb, uint32_t top, uint32_t bottom) {
-    for (uint32_t y = 0; y < fb->height; ++y) {
-        uint32_t r = ((top >> 16) & 0xFF) + (((bottom >> 16) & 0xFF) - ((top >> 16) & 0xFF)) * y / (fb->height - 1);
-        uint32_t g = ((top >> 8) & 0xFF) + (((bottom >> 8) & 0xFF) - ((top >> 8) & 0xFF)) * y / (fb->height - 1);
-        uint32_t b = (top & 0xFF) + ((bottom & 0xFF) - (top & 0xFF)) * y / (fb->height - 1);
+void fb_fill_rect_clip(const struct framebuffer *fb, struct rect r, struct rect clip, uint32_t color) {
+    fb_fill_rect(fb, rect_intersect(r, clip), color);
+}
+
+struct rect fb_bounds(const struct framebuffer *fb) {
+    return (struct rect){ 0, 0, (int)fb->width, (int)fb->height };
+}
+
+void fb_draw_vertical_gradient_clip(const struct framebuffer *fb, uint32_t top, uint32_t bottom, struct rect clip) {
+    clip = rect_intersect(clip, fb_bounds(fb));
+    if (clip.w <= 0 || clip.h <= 0) {
+        return;
+    }
+    uint32_t span = fb->height > 1 ? fb->height - 1 : 1;
+    for (uint32_t y = (uint32_t)clip.y; y < (uint32_t)(clip.y + clip.h); ++y) {
+        uint32_t r = ((top >> 16) & 0xFF) + (((bottom >> 16) & 0xFF) - ((top >> 16) & 0xFF)) * y / span;
+        uint32_t g = ((top >> 8) & 0xFF) + (((bottom >> 8) & 0xFF) - ((top >> 8) & 0xFF)) * y / span;
+        uint32_t b = (top & 0xFF) + ((bottom & 0xFF) - (top & 0xFF)) * y / span;
         uint32_t color = (r << 16) | (g << 8) | b;
-        uint32_t *row = (uint32_t *)(fb->base + y * fb->pitch);
-        for (uint32_t x = 0; x < fb->width; ++x) {
-            row[x] = color;
-        }
+        fill_span_raw(fb, pixel_addr(fb, (uint32_t)clip.x, y), (uint32_t)clip.w, fb_pack_color(fb, color));
     }
 }
 
-void fb_draw_char(const struct framebuffer *fb, int x, int y, char c, uint32_t fg, uint32_t bg) {
+void fb_draw_vertical_gradient(const struct framebuffer *fb, uint32_t top, uint32_t bottom) {
+    fb_draw_vertical_gradient_clip(fb, top, bottom, fb_bounds(fb));
+}
+
+static void draw_glyph(const struct framebuffer *fb, int x, int y, char c,
+                       uint32_t fg_raw, uint32_t bg_raw, struct rect clip) {
+    int col0 = clip.x > x ? clip.x - x : 0;
+    int row0 = clip.y > y ? clip.y - y : 0;
+    int col1 = clip.x + clip.w < x + 8 ? clip.x + clip.w - x : 8;
+    int row1 = clip.y + clip.h < y + 8 ? clip.y + clip.h - y : 8;
+    if (col0 >= col1 || row0 >= row1) {
+        return;
+    }
     uint8_t glyph = (uint8_t)c;
-    for (int row = 0; row < 8; ++row) {
+    uint32_t bpp = bytes_per_pixel(fb);
+    for (int row = row0; row < row1; ++row) {
         uint8_t bits = font8x8_basic[glyph][row];
-        for (int col = 0; col < 8; ++col) {
-            uint32_t color = (bits & (1u << (7 - col))) ? fg : bg;
-            fb_put_pixel(fb, x + col, y + row, color);
+        uint8_t *dst = pixel_addr(fb, (uint32_t)(x + col0), (uint32_t)(y + row));
+        int col = col0;
+        while (col < col1) {
+            int on = (bits >> (7 - col)) & 1;
+            int end = col + 1;
+            while (end < col1 && ((bits >> (7 - end)) & 1) == on) {
+                end++;
+            }
+            fill_span_raw(fb, dst, (uint32_t)(end - col), on ? fg_raw : bg_raw);
+            dst += (uint32_t)(end - col) * bpp;
+            col = end;
         }
     }
 }
 
-void fb_draw_string(const struct framebuffer *fb, int x, int y, const char *text, uint32_t fg, uint32_t bg) {
+void fb_draw_char(const struct framebuffer *fb, int x, int y, char c, uint32_t fg, uint32_t bg) {
+    draw_glyph(fb, x, y, c, fb_pack_color(fb, fg), fb_pack_color(fb, bg), fb_bounds(fb));
+}
+
+void fb_draw_string_clip(const struct framebuffer *fb, int x, int y, const char *text,
+                         uint32_t fg, uint32_t bg, struct rect clip) {
+    clip = rect_intersect(clip, fb_bounds(fb));
+    if (clip.w <= 0 || clip.h <= 0 || y >= clip.y + clip.h || y + 8 <= clip.y || x >= clip.x + clip.w) {
+        return;
+    }
+    uint32_t fg_raw = fb_pack_color(fb, fg);
+    uint32_t bg_raw = fb_pack_color(fb, bg);
     int cursor = 0;
+    if (x + 8 <= clip.x) {
+        cursor = (clip.x - x) / 8;
+        for (int i = 0; i < cursor; ++i) {
+            if (text[i] == '\0') {
+                return;
+            }
+        }
+    }
     while (text[cursor] != '\0') {
-        fb_draw_char(fb, x + cursor * 8, y, text[cursor], fg, bg);
+        int cx = x + cursor * 8;
+        if (cx >= clip.x + clip.w) {
+            break;
+        }
+        draw_glyph(fb, cx, y, text[cursor], fg_raw, bg_raw, clip);
         cursor++;
     }
 }
 
+void fb_draw_string(const struct framebuffer *fb, int x, int y, const char *text, uint32_t fg, uint32_t bg) {
+    fb_draw_string_clip(fb, x, y, text, fg, bg, fb_bounds(fb));
+}
+
 int point_in_rect(int x, int y, struct rect r) {
     return x >= r.x && x < (r.x + r.w) && y >= r.y && y < (r.y + r.h);
 }
 
-void fb_blit(const struct framebuffer *dst, const struct framebuffer *src) {
-    if (!dst || !src || !dst->base || !src->base) {
-        return;
+int rect_contains(struct rect outer, struct rect inner) {
+    return inner.x >= outer.x && inner.y >= outer.y &&
+           inner.x + inner.w <= outer.x + outer.w &&
+           inner.y + inner.h <= outer.y + outer.h;
+}
+
+struct rect rect_intersect(struct rect a, struct rect b) {
+    int x0 = a.x > b.x ? a.x : b.x;
+    int y0 = a.y > b.y ? a.y : b.y;
+    int x1 = (a.x + a.w) < (b.x + b.w) ? (a.x + a.w) : (b.x + b.w);
+    int y1 = (a.y + a.h) < (b.y + b.h) ? (a.y + a.h) : (b.y + b.h);
+    if (x1 <= x0 || y1 <= y0) {
+        return (struct rect){ x0, y0, 0, 0 };
+    }
+    return (struct rect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+struct rect rect_union(struct rect a, struct rect b) {
+    if (a.w <= 0 || a.h <= 0) {
+        return b;
     }
-    uint32_t rows = dst->height < src->height ? dst->height : src->height;
-    uint32_t cols = dst->width < src->width ? dst->width : src->width;
-    for (uint32_t y = 0; y < rows; ++y) {
-        uint32_t *dst_row = (uint32_t *)(dst->base + y * dst->pitch);
-        const uint32_t *src_row = (const uint32_t *)(src->base + y * src->pitch);
-        uint32_t count = cols;
-        __asm__ volatile ("rep movsd"
-                          : "+D"(dst_row), "+S"(src_row), "+c"(count)
+    if (b.w <= 0 || b.h <= 0) {
+        return a;
+    }
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = (a.x + a.w) > (b.x + b.w) ? (a.x + a.w) : (b.x + b.w);
+    int y1 = (a.y + a.h) > (b.y + b.h) ? (a.y + a.h) : (b.y + b.h);
+    return (struct rect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+FB_INLINE void convert_row(uint8_t *dst, const uint32_t *src, uint32_t count, const uint8_t format) {
+    switch (format) {
+    case FB_FORMAT_XRGB8888:
+        __asm__ volatile ("rep movsl"
+                          : "+D"(dst), "+S"(src), "+c"(count)
+                          :
+                          : "memory");
+        break;
+    case FB_FORMAT_XBGR8888: {
+        uint32_t *out = (uint32_t *)dst;
+        for (uint32_t i = 0; i < count; ++i) {
+            out[i] = swap_red_blue(src[i]);
+        }
+        break;
+    }
+    case FB_FORMAT_RGB888:
+    case FB_FORMAT_BGR888: {
+        uint32_t i = 0;
+        uint32_t *out = (uint32_t *)dst;
+        for (; i + 4 <= count; i += 4) {
+            uint32_t p0 = pack_color(format, src[i + 0]);
+            uint32_t p1 = pack_color(format, src[i + 1]);
+            uint32_t p2 = pack_color(format, src[i + 2]);
+            uint32_t p3 = pack_color(format, src[i + 3]);
+            *out++ = p0 | (p1 << 24);
+            *out++ = (p1 >> 8) | (p2 << 16);
+            *out++ = (p2 >> 16) | (p3 << 8);
+        }
+        uint8_t *tail = (uint8_t *)out;
+        for (; i < count; ++i) {
+            uint32_t p = pack_color(format, src[i]);
+            *tail++ = (uint8_t)p;
+            *tail++ = (uint8_t)(p >> 8);
+            *tail++ = (uint8_t)(p >> 16);
+        }
+        break;
+    }
+    case FB_FORMAT_RGB565:
+    case FB_FORMAT_BGR565: {
+        uint32_t i = 0;
+        if (((uint32_t)(uintptr_t)dst & 2u) != 0 && count > 0) {
+            *(uint16_t *)dst = (uint16_t)pack_color(format, src[0]);
+            dst += 2;
+            i = 1;
+        }
+        uint32_t *out = (uint32_t *)dst;
+        for (; i + 2 <= count; i += 2) {
+            *out++ = pack_color(format, src[i]) | (pack_color(format, src[i + 1]) << 16);
+        }
+        if (i < count) {
+            *(uint16_t *)out = (uint16_t)pack_color(format, src[i]);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+FB_INLINE void blit_rows(const struct framebuffer *dst, const struct framebuffer *src,
+                         struct rect r, int dx, int dy, const uint8_t format) {
+    uint32_t dst_bpp = bytes_per_pixel(dst);
+    for (int y = r.y; y < r.y + r.h; ++y) {
+        uint8_t *dst_row = dst->base + (uint32_t)y * dst->pitch + (uint32_t)r.x * dst_bpp;
+        const uint32_t *src_row = (const uint32_t *)(src->base + (uint32_t)(y - dy) * src->pitch) + (r.x - dx);
+        convert_row(dst_row, src_row, (uint32_t)r.w, format);
+    }
+}
+
+FB_INLINE void convert_row_565(uint8_t *dst, const uint16_t *src, uint32_t count, const uint8_t format) {
+    switch (format) {
+    case FB_FORMAT_RGB565:
+        __asm__ volatile ("rep movsw"
+                          : "+D"(dst), "+S"(src), "+c"(count)
                           :
                           : "memory");
+        break;
+    case FB_FORMAT_BGR565: {
+        uint16_t *out = (uint16_t *)dst;
+        for (uint32_t i = 0; i < count; ++i) {
+            out[i] = (uint16_t)swap_565(src[i]);
+        }
+        break;
+    }
+    case FB_FORMAT_XRGB8888:
+    case FB_FORMAT_XBGR8888: {
+        uint32_t *out = (uint32_t *)dst;
+        for (uint32_t i = 0; i < count; ++i) {
+            out[i] = pack_color(format, expand_565(src[i]));
+        }
+        break;
+    }
+    case FB_FORMAT_RGB888:
+    case FB_FORMAT_BGR888:
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t p = pack_color(format, expand_565(src[i]));
+            *dst++ = (uint8_t)p;
+            *dst++ = (uint8_t)(p >> 8);
+            *dst++ = (uint8_t)(p >> 16);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+FB_INLINE void blit_rows_565(const struct framebuffer *dst, const struct framebuffer *src,
+                             struct rect r, int dx, int dy, const uint8_t format) {
+    uint32_t dst_bpp = bytes_per_pixel(dst);
+    for (int y = r.y; y < r.y + r.h; ++y) {
+        uint8_t *dst_row = dst->base + (uint32_t)y * dst->pitch + (uint32_t)r.x * dst_bpp;
+        const uint16_t *src_row = (const uint16_t *)(src->base + (uint32_t)(y - dy) * src->pitch) + (r.x - dx);
+        convert_row_565(dst_row, src_row, (uint32_t)r.w, format);
+    }
+}
+
+static void blit_from_rgb565(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    switch (dst->format) {
+    case FB_FORMAT_RGB565:
+        blit_rows_565(dst, src, r, dx, dy, FB_FORMAT_RGB565);
+        break;
+    case FB_FORMAT_BGR565:
+        blit_rows_565(dst, src, r, dx, dy, FB_FORMAT_BGR565);
+        break;
+    case FB_FORMAT_XRGB8888:
+        blit_rows_565(dst, src, r, dx, dy, FB_FORMAT_XRGB8888);
+        break;
+    case FB_FORMAT_XBGR8888:
+        blit_rows_565(dst, src, r, dx, dy, FB_FORMAT_XBGR8888);
+        break;
+    case FB_FORMAT_RGB888:
+        blit_rows_565(dst, src, r, dx, dy, FB_FORMAT_RGB888);
+        break;
+    case FB_FORMAT_BGR888:
+        blit_rows_565(dst, src, r, dx, dy, FB_FORMAT_BGR888);
+        break;
+    default:
+        break;
+    }
+}
+
+static void blit_xrgb8888(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    blit_rows(dst, src, r, dx, dy, FB_FORMAT_XRGB8888);
+}
+
+static void blit_xbgr8888(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    blit_rows(dst, src, r, dx, dy, FB_FORMAT_XBGR8888);
+}
+
+static void blit_rgb888(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    blit_rows(dst, src, r, dx, dy, FB_FORMAT_RGB888);
+}
+
+static void blit_bgr888(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    blit_rows(dst, src, r, dx, dy, FB_FORMAT_BGR888);
+}
+
+static void blit_rgb565(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    blit_rows(dst, src, r, dx, dy, FB_FORMAT_RGB565);
+}
+
+static void blit_bgr565(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    blit_rows(dst, src, r, dx, dy, FB_FORMAT_BGR565);
+}
+
+static void blit_region(const struct framebuffer *dst, const struct framebuffer *src, struct rect r, int dx, int dy) {
+    if (src->format == FB_FORMAT_RGB565) {
+        blit_from_rgb565(dst, src, r, dx, dy);
+        return;
+    }
+    switch (dst->format) {
+    case FB_FORMAT_XRGB8888:
+        blit_xrgb8888(dst, src, r, dx, dy);
+        break;
+    case FB_FORMAT_XBGR8888:
+        blit_xbgr8888(dst, src, r, dx, dy);
+        break;
+    case FB_FORMAT_RGB888:
+        blit_rgb888(dst, src, r, dx, dy);
+        break;
+    case FB_FORMAT_BGR888:
+        blit_bgr888(dst, src, r, dx, dy);
+        break;
+    case FB_FORMAT_RGB565:
+        blit_rgb565(dst, src, r, dx, dy);
+        break;
+    case FB_FORMAT_BGR565:
+        blit_bgr565(dst, src, r, dx, dy);
+        break;
+    default:
+        break;
+    }
+}
+
+void fb_blit_rect(const struct framebuffer *dst, const struct framebuffer *src, struct rect r) {
+    if (!dst || !src || !dst->base || !src->base) {
+        return;
+    }
+    if (src->format != FB_FORMAT_XRGB8888 && src->format != FB_FORMAT_RGB565) {
+        return;
+    }
+    struct rect bounds = {
+        0, 0,
+        (int)(dst->width < src->width ? dst->width : src->width),
+        (int)(dst->height < src->height ? dst->height : src->height)
+    };
+    r = rect_intersect(r, bounds);
+    if (r.w <= 0 || r.h <= 0) {
+        return;
+    }
+    blit_region(dst, src, r, 0, 0);
+}
+
+void fb_draw_image_clip(const struct framebuffer *fb, int x, int y,
+                        const struct framebuffer *image, struct rect clip) {
+    if (!fb || !image || !image->base) {
+        return;
+    }
+    if (image->format != FB_FORMAT_XRGB8888 && image->format != FB_FORMAT_RGB565) {
+        return;
+    }
+    struct rect r = rect_intersect(rect_intersect(clip, fb_bounds(fb)),
+                                   (struct rect){ x, y, (int)image->width, (int)image->height });
+    if (r.w <= 0 || r.h <= 0) {
+        return;
+    }
+    pixel_writes += (uint32_t)r.w * (uint32_t)r.h;
+    if (fb == heat_fb) {
+        for (int row = r.y; row < r.y + r.h; ++row) {
+            heat_record(fb, pixel_addr(fb, (uint32_t)r.x, (uint32_t)row), (uint32_t)r.w);
+        }
+    }
+    blit_region(fb, image, r, x, y);
+}
+
+void fb_store_row(const struct framebuffer *fb, int y, const uint32_t *pixels) {
+    if (!fb || !pixels || y < 0 || (uint32_t)y >= fb->height) {
+        return;
+    }
+    convert_row(pixel_addr(fb, 0, (uint32_t)y), pixels, fb->width, fb->format);
+}
+
+void fb_blit(const struct framebuffer *dst, const struct framebuffer *src) {
+    if (!dst || !src) {
+        return;
     }
+    struct rect all = { 0, 0, (int)dst->width, (int)dst->height };
+    fb_blit_rect(dst, src, all);
 }
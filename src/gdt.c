@@ -0,0 +1,46 @@
+#include "gdt.h"
+
+struct gdt_entry {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+static struct gdt_entry gdt[3];
+
+static void gdt_set(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    gdt[index].limit_low = (uint16_t)(limit & 0xFFFF);
+    gdt[index].base_low = (uint16_t)(base & 0xFFFF);
+    gdt[index].base_mid = (uint8_t)((base >> 16) & 0xFF);
+    gdt[index].access = access;
+    gdt[index].granularity = (uint8_t)(((limit >> 16) & 0x0F) | (flags << 4));
+    gdt[index].base_high = (uint8_t)((base >> 24) & 0xFF);
+}
+
+void gdt_init(void) {
+    gdt_set(0, 0, 0, 0, 0);
+    gdt_set(1, 0, 0xFFFFF, 0x9A, 0xC);
+    gdt_set(2, 0, 0xFFFFF, 0x92, 0xC);
+
+    struct gdt_ptr ptr = { sizeof(gdt) - 1, (uint32_t)(uintptr_t)gdt };
+    __asm__ volatile ("lgdt %0\n\t"
+                      "ljmp %1, $1f\n"
+                      "1:\n\t"
+                      "mov %2, %%ax\n\t"
+                      "mov %%ax, %%ds\n\t"
+                      "mov %%ax, %%es\n\t"
+                      "mov %%ax, %%fs\n\t"
+                      "mov %%ax, %%gs\n\t"
+                      "mov %%ax, %%ss"
+                      :
+                      : "m"(ptr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+                      : "eax", "memory");
+}
@@ -0,0 +1,134 @@
+#include "idt.h"
+#include "gdt.h"
+#include "log.h"
+#include "panic.h"
+#include "pic.h"
+
+#define IDT_GATE_INTERRUPT 0x8E
+
+struct idt_entry {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed));
+
+struct idt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+extern const uint32_t isr_stub_table[IDT_VECTOR_COUNT];
+
+static struct idt_entry idt[IDT_VECTOR_COUNT];
+static irq_handler_fn irq_handlers[PIC_IRQ_COUNT][IRQ_MAX_SHARED];
+static uint8_t irq_handler_count[PIC_IRQ_COUNT];
+static volatile uint32_t irq_counts[PIC_IRQ_COUNT];
+static volatile uint32_t irq_unclaimed[PIC_IRQ_COUNT];
+static volatile uint8_t irq_storm[PIC_IRQ_COUNT];
+
+static const char *exception_name(uint32_t vector) {
+    switch (vector) {
+    case 0:
+        return "Divide error";
+    case 6:
+        return "Invalid opcode";
+    case 8:
+        return "Double fault";
+    case 13:
+        return "General protection fault";
+    case 14:
+        return "Page fault";
+    default:
+        return "CPU exception";
+    }
+}
+
+void idt_init(void) {
+    for (uint32_t i = 0; i < IDT_VECTOR_COUNT; ++i) {
+        uint32_t offset = isr_stub_table[i];
+        idt[i].offset_low = (uint16_t)(offset & 0xFFFF);
+        idt[i].selector = GDT_KERNEL_CODE;
+        idt[i].zero = 0;
+        idt[i].type_attr = IDT_GATE_INTERRUPT;
+        idt[i].offset_high = (uint16_t)(offset >> 16);
+    }
+    for (uint32_t i = 0; i < PIC_IRQ_COUNT; ++i) {
+        irq_handler_count[i] = 0;
+        irq_counts[i] = 0;
+        irq_unclaimed[i] = 0;
+        irq_storm[i] = 0;
+    }
+    pic_init();
+
+    struct idt_ptr ptr = { sizeof(idt) - 1, (uint32_t)(uintptr_t)idt };
+    __asm__ volatile ("lidt %0" : : "m"(ptr) : "memory");
+}
+
+int irq_register(uint8_t irq, irq_handler_fn handler) {
+    if (irq >= PIC_IRQ_COUNT || !handler) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < irq_handler_count[irq]; ++i) {
+        if (irq_handlers[irq][i] == handler) {
+            return 1;
+        }
+    }
+    if (irq_handler_count[irq] >= IRQ_MAX_SHARED) {
+        return 0;
+    }
+    irq_handlers[irq][irq_handler_count[irq]] = handler;
+    __asm__ volatile ("" : : : "memory");
+    irq_handler_count[irq]++;
+    pic_unmask(irq);
+    return 1;
+}
+
+int irq_active(uint8_t irq) {
+    return irq < PIC_IRQ_COUNT && irq_handler_count[irq] > 0 && !irq_storm[irq];
+}
+
+uint32_t irq_count(uint8_t irq) {
+    return irq < PIC_IRQ_COUNT ? irq_counts[irq] : 0;
+}
+
+void interrupts_enable(void) {
+    __asm__ volatile ("sti" : : : "memory");
+}
+
+int interrupts_enabled(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0" : "=r"(flags));
+    return (flags & (1u << 9)) != 0;
+}
+
+void interrupt_dispatch(struct interrupt_frame *frame) {
+    if (frame->vector < IDT_EXCEPTION_COUNT) {
+        log_puts("Exception ");
+        log_dec32(frame->vector);
+        log_puts(" eip=");
+        log_hex32(frame->eip);
+        log_puts(" err=");
+        log_hex32(frame->error);
+        log_puts("\n");
+        panic(exception_name(frame->vector));
+    }
+
+    uint8_t irq = (uint8_t)(frame->vector - PIC_IRQ_BASE);
+    if (irq >= PIC_IRQ_COUNT || pic_spurious(irq)) {
+        return;
+    }
+    irq_counts[irq]++;
+    int handled = 0;
+    for (uint32_t i = 0; i < irq_handler_count[irq]; ++i) {
+        handled |= irq_handlers[irq][i](irq);
+    }
+    if (handled) {
+        irq_unclaimed[irq] = 0;
+    } else if (++irq_unclaimed[irq] >= IRQ_UNCLAIMED_LIMIT) {
+        irq_storm[irq] = 1;
+        pic_mask(irq);
+    }
+    pic_eoi(irq);
+}
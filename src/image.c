@@ -0,0 +1,401 @@
+#include "image.h"
+#include "memory.h"
+#include "vfs.h"
+
+#define IMAGE_INLINE static inline __attribute__((always_inline))
+
+struct image_stream {
+    struct vfs_file file;
+    uint8_t buf[512];
+    uint32_t pos;
+    uint32_t len;
+    uint32_t consumed;
+};
+
+struct image_scaler {
+    const struct framebuffer *dst;
+    uint32_t src_w;
+    uint32_t src_h;
+    uint32_t *src_row;
+    uint32_t *rows[2];
+    uint32_t *out_row;
+    uint32_t *x_map;
+    uint32_t step_y;
+    int next_y;
+    int bottom_up;
+    uint32_t scratch;
+    uint32_t scratch_pages;
+};
+
+struct bmp_channel {
+    uint32_t mask;
+    uint32_t shift;
+    uint32_t bits;
+};
+
+struct tga_rle {
+    uint32_t remaining;
+    int repeat;
+    uint32_t pixel;
+};
+
+static int stream_read(struct image_stream *s, uint8_t *out, uint32_t len) {
+    while (len > 0) {
+        if (s->pos == s->len) {
+            s->len = vfs_read(&s->file, s->buf, sizeof(s->buf));
+            s->pos = 0;
+            if (s->len == 0) {
+                return 0;
+            }
+        }
+        uint32_t chunk = s->len - s->pos;
+        if (chunk > len) {
+            chunk = len;
+        }
+        if (out) {
+            for (uint32_t i = 0; i < chunk; ++i) {
+                *out++ = s->buf[s->pos + i];
+            }
+        }
+        s->pos += chunk;
+        s->consumed += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+static int stream_skip(struct image_stream *s, uint32_t len) {
+    return stream_read(s, 0, len);
+}
+
+static uint32_t le16(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return le16(p) | (le16(p + 2) << 16);
+}
+
+IMAGE_INLINE uint32_t blend(uint32_t a, uint32_t b, uint32_t w) {
+    uint32_t iw = 256u - w;
+    uint32_t rb = ((a & 0x00FF00FFu) * iw + (b & 0x00FF00FFu) * w) >> 8;
+    uint32_t g = ((a & 0x0000FF00u) * iw + (b & 0x0000FF00u) * w) >> 8;
+    return (rb & 0x00FF00FFu) | (g & 0x0000FF00u);
+}
+
+static uint32_t scale_step(uint32_t src, uint32_t dst) {
+    if (src < 2 || dst < 2) {
+        return 0;
+    }
+    return ((src - 1u) << 16) / (dst - 1u);
+}
+
+static uint32_t map_coord(uint32_t pos, uint32_t step, uint32_t limit) {
+    uint32_t fixed = pos * step;
+    uint32_t index = fixed >> 16;
+    uint32_t weight = (fixed >> 8) & 0xFFu;
+    if (index + 1u >= limit) {
+        index = limit - 1u;
+        weight = 0;
+    }
+    return (index << 8) | weight;
+}
+
+static void scaler_end(struct image_scaler *sc) {
+    for (uint32_t i = 0; i < sc->scratch_pages; ++i) {
+        phys_free_page(sc->scratch + i * 4096u);
+    }
+    sc->scratch_pages = 0;
+}
+
+static int scaler_begin(struct image_scaler *sc, const struct framebuffer *dst,
+                        uint32_t src_w, uint32_t src_h, int bottom_up) {
+    if (src_w == 0 || src_h == 0 || src_w > IMAGE_MAX_WIDTH || src_h > IMAGE_MAX_HEIGHT) {
+        return 0;
+    }
+    uint32_t dst_w = dst->width;
+    uint32_t words = src_w + dst_w * 4u;
+    sc->scratch_pages = (words * 4u + 4095u) / 4096u;
+    sc->scratch = phys_alloc_pages(sc->scratch_pages);
+    if (sc->scratch == 0) {
+        sc->scratch_pages = 0;
+        return 0;
+    }
+    uint32_t *base = (uint32_t *)(uintptr_t)sc->scratch;
+    sc->dst = dst;
+    sc->src_w = src_w;
+    sc->src_h = src_h;
+    sc->src_row = base;
+    sc->rows[0] = base + src_w;
+    sc->rows[1] = sc->rows[0] + dst_w;
+    sc->out_row = sc->rows[1] + dst_w;
+    sc->x_map = sc->out_row + dst_w;
+    sc->step_y = scale_step(src_h, dst->height);
+    sc->bottom_up = bottom_up;
+    sc->next_y = bottom_up ? (int)dst->height - 1 : 0;
+
+    uint32_t step_x = scale_step(src_w, dst_w);
+    for (uint32_t x = 0; x < dst_w; ++x) {
+        sc->x_map[x] = map_coord(x, step_x, src_w);
+    }
+    return 1;
+}
+
+static void scale_row(const struct image_scaler *sc, uint32_t *out) {
+    const uint32_t *src = sc->src_row;
+    const uint32_t *map = sc->x_map;
+    uint32_t dst_w = sc->dst->width;
+    for (uint32_t x = 0; x < dst_w; ++x) {
+        uint32_t index = map[x] >> 8;
+        uint32_t weight = map[x] & 0xFFu;
+        out[x] = weight ? blend(src[index], src[index + 1u], weight) : src[index];
+    }
+}
+
+static void emit_row(struct image_scaler *sc, int y, uint32_t mapped) {
+    uint32_t s0 = mapped >> 8;
+    uint32_t weight = mapped & 0xFFu;
+    const uint32_t *top = sc->rows[s0 & 1u];
+    if (weight == 0) {
+        fb_store_row(sc->dst, y, top);
+        return;
+    }
+    const uint32_t *bottom = sc->rows[(s0 + 1u) & 1u];
+    uint32_t dst_w = sc->dst->width;
+    for (uint32_t x = 0; x < dst_w; ++x) {
+        sc->out_row[x] = blend(top[x], bottom[x], weight);
+    }
+    fb_store_row(sc->dst, y, sc->out_row);
+}
+
+static void scaler_push(struct image_scaler *sc, uint32_t row) {
+    scale_row(sc, sc->rows[row & 1u]);
+    if (sc->bottom_up) {
+        while (sc->next_y >= 0) {
+            uint32_t mapped = map_coord((uint32_t)sc->next_y, sc->step_y, sc->src_h);
+            if ((mapped >> 8) < row) {
+                break;
+            }
+            emit_row(sc, sc->next_y--, mapped);
+        }
+        return;
+    }
+    while (sc->next_y < (int)sc->dst->height) {
+        uint32_t mapped = map_coord((uint32_t)sc->next_y, sc->step_y, sc->src_h);
+        uint32_t last = (mapped >> 8) + ((mapped & 0xFFu) ? 1u : 0u);
+        if (last > row) {
+            break;
+        }
+        emit_row(sc, sc->next_y++, mapped);
+    }
+}
+
+static void expand_row(uint32_t *row, uint32_t width, uint32_t bytes_pp) {
+    const uint8_t *raw = (const uint8_t *)row;
+    for (uint32_t i = width; i-- > 0;) {
+        const uint8_t *p = raw + i * bytes_pp;
+        row[i] = ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+    }
+}
+
+static int bmp_channel_init(struct bmp_channel *ch, uint32_t mask) {
+    if (mask == 0) {
+        return 0;
+    }
+    uint32_t shift = (uint32_t)__builtin_ctz(mask);
+    uint32_t run = (mask >> shift) + 1u;
+    if (run == 0 || (run & (run - 1u)) != 0) {
+        return 0;
+    }
+    ch->mask = mask;
+    ch->shift = shift;
+    ch->bits = (uint32_t)__builtin_ctz(run);
+    return 1;
+}
+
+IMAGE_INLINE uint32_t bmp_channel_get(const struct bmp_channel *ch, uint32_t pixel) {
+    uint32_t value = (pixel & ch->mask) >> ch->shift;
+    if (ch->bits >= 8u) {
+        return value >> (ch->bits - 8u);
+    }
+    return value * 255u / ((1u << ch->bits) - 1u);
+}
+
+static void expand_row_masked(uint32_t *row, uint32_t width, const struct bmp_channel *masks) {
+    for (uint32_t i = 0; i < width; ++i) {
+        uint32_t pixel = row[i];
+        row[i] = (bmp_channel_get(&masks[0], pixel) << 16) |
+                 (bmp_channel_get(&masks[1], pixel) << 8) |
+                 bmp_channel_get(&masks[2], pixel);
+    }
+}
+
+static int decode_bmp(struct image_stream *s, const uint8_t *header,
+                      const struct framebuffer *dst, struct image_info *info) {
+    uint8_t dib[36];
+    if (!stream_read(s, dib, sizeof(dib))) {
+        return 0;
+    }
+    uint32_t data_offset = le32(header + 10);
+    uint32_t dib_size = le32(header + 14);
+    uint32_t width = le32(dib);
+    int32_t height = (int32_t)le32(dib + 4);
+    uint32_t bpp = le16(dib + 10);
+    uint32_t compression = le32(dib + 12);
+    if (dib_size < 40 || (bpp != 24 && bpp != 32)) {
+        return 0;
+    }
+    if (compression != 0 && !(compression == 3 && bpp == 32)) {
+        return 0;
+    }
+    if (height == INT32_MIN) {
+        return 0;
+    }
+    struct bmp_channel masks[3];
+    if (compression == 3) {
+        uint8_t raw[12];
+        if (!stream_read(s, raw, sizeof(raw))) {
+            return 0;
+        }
+        for (uint32_t c = 0; c < 3; ++c) {
+            if (!bmp_channel_init(&masks[c], le32(raw + c * 4u))) {
+                return 0;
+            }
+        }
+    }
+    int bottom_up = height > 0;
+    uint32_t rows = bottom_up ? (uint32_t)height : (uint32_t)-height;
+    if (data_offset < s->consumed || !stream_skip(s, data_offset - s->consumed)) {
+        return 0;
+    }
+
+    struct image_scaler sc;
+    if (!scaler_begin(&sc, dst, width, rows, bottom_up)) {
+        return 0;
+    }
+    uint32_t bytes_pp = bpp / 8u;
+    uint32_t row_bytes = width * bytes_pp;
+    uint32_t padding = ((row_bytes + 3u) & ~3u) - row_bytes;
+    int ok = 1;
+    for (uint32_t i = 0; i < rows && ok; ++i) {
+        uint32_t row = bottom_up ? rows - 1u - i : i;
+        ok = stream_read(s, (uint8_t *)sc.src_row, row_bytes) && stream_skip(s, padding);
+        if (ok) {
+            if (compression == 3) {
+                expand_row_masked(sc.src_row, width, masks);
+            } else {
+                expand_row(sc.src_row, width, bytes_pp);
+            }
+            scaler_push(&sc, row);
+        }
+    }
+    scaler_end(&sc);
+    info->type = IMAGE_BMP;
+    info->width = width;
+    info->height = rows;
+    return ok;
+}
+
+static int tga_read_row(struct image_stream *s, struct tga_rle *rle, uint32_t *row,
+                        uint32_t width, uint32_t bytes_pp) {
+    uint8_t px[4];
+    uint32_t x = 0;
+    while (x < width) {
+        if (rle->remaining == 0) {
+            uint8_t packet;
+            if (!stream_read(s, &packet, 1)) {
+                return 0;
+            }
+            rle->remaining = (uint32_t)(packet & 0x7Fu) + 1u;
+            rle->repeat = (packet & 0x80u) != 0;
+            if (rle->repeat) {
+                if (!stream_read(s, px, bytes_pp)) {
+                    return 0;
+                }
+                rle->pixel = ((uint32_t)px[2] << 16) | ((uint32_t)px[1] << 8) | px[0];
+            }
+        }
+        if (rle->repeat) {
+            row[x] = rle->pixel;
+        } else {
+            if (!stream_read(s, px, bytes_pp)) {
+                return 0;
+            }
+            row[x] = ((uint32_t)px[2] << 16) | ((uint32_t)px[1] << 8) | px[0];
+        }
+        rle->remaining--;
+        x++;
+    }
+    return 1;
+}
+
+static int decode_tga(struct image_stream *s, const uint8_t *header,
+                      const struct framebuffer *dst, struct image_info *info) {
+    uint32_t id_len = header[0];
+    uint32_t type = header[2];
+    uint32_t width = le16(header + 12);
+    uint32_t height = le16(header + 14);
+    uint32_t bpp = header[16];
+    int bottom_up = (header[17] & 0x20u) == 0;
+    if (header[1] != 0 || (type != 2 && type != 10) || (bpp != 24 && bpp != 32)) {
+        return 0;
+    }
+    if (!stream_skip(s, id_len)) {
+        return 0;
+    }
+
+    struct image_scaler sc;
+    if (!scaler_begin(&sc, dst, width, height, bottom_up)) {
+        return 0;
+    }
+    uint32_t bytes_pp = bpp / 8u;
+    struct tga_rle rle = { 0, 0, 0 };
+    int ok = 1;
+    for (uint32_t i = 0; i < height && ok; ++i) {
+        uint32_t row = bottom_up ? height - 1u - i : i;
+        if (type == 10) {
+            ok = tga_read_row(s, &rle, sc.src_row, width, bytes_pp);
+        } else {
+            ok = stream_read(s, (uint8_t *)sc.src_row, width * bytes_pp);
+            if (ok) {
+                expand_row(sc.src_row, width, bytes_pp);
+            }
+        }
+        if (ok) {
+            scaler_push(&sc, row);
+        }
+    }
+    scaler_end(&sc);
+    info->type = IMAGE_TGA;
+    info->width = width;
+    info->height = height;
+    return ok;
+}
+
+int image_load_scaled(const char *name, const struct framebuffer *dst, struct image_info *info) {
+    if (!name || !dst || !dst->base || !info || dst->width == 0 || dst->height == 0) {
+        return 0;
+    }
+    static struct image_stream stream;
+    stream.pos = 0;
+    stream.len = 0;
+    stream.consumed = 0;
+    if (!vfs_open(name, &stream.file)) {
+        return 0;
+    }
+
+    info->type = IMAGE_UNKNOWN;
+    info->width = 0;
+    info->height = 0;
+    uint8_t header[18];
+    int ok = 0;
+    if (stream_read(&stream, header, sizeof(header))) {
+        if (header[0] == 'B' && header[1] == 'M') {
+            ok = decode_bmp(&stream, header, dst, info);
+        } else {
+            ok = decode_tga(&stream, header, dst, info);
+        }
+    }
+    info->bytes_read = stream.consumed;
+    return ok;
+}
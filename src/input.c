@@ -1,101 +1,269 @@
 #include "input.h"
-#include "framebuffer.h"
+#include "idt.h"
+#include "log.h"
 #include "portio.h"
-#include "ui.h"
+#include "timer.h"
 
-#define KEY_QUEUE_SIZE 16
+#define INPUT_QUEUE_SIZE 64u
+#define INPUT_QUEUE_MASK (INPUT_QUEUE_SIZE - 1u)
+#define INPUT_TRACE_PENDING 64u
+#define INPUT_LATENCY_BUCKETS 128u
+#define INPUT_LATENCY_BUCKET_US 250u
+#define PS2_RING_SIZE 256u
+#define PS2_RING_MASK (PS2_RING_SIZE - 1u)
 
-static enum key_action key_queue[KEY_QUEUE_SIZE];
-static uint8_t key_head;
-static uint8_t key_tail;
-static int pending_mouse_dx;
-static int pending_mouse_dy;
-static uint8_t pending_mouse_buttons;
-static uint8_t pending_mouse_valid;
+#define PS2_DATA 0x60
+#define PS2_STATUS 0x64
+#define PS2_STATUS_OUTPUT 0x01
+#define PS2_STATUS_INPUT 0x02
+#define PS2_STATUS_AUX 0x20
+#define PS2_CONFIG_KBD_IRQ 0x01
+#define PS2_CONFIG_AUX_IRQ 0x02
+#define PS2_CONFIG_AUX_CLOCK_OFF 0x20
+#define PS2_TIMEOUT_US 20000u
+#define PS2_DRAIN_LIMIT 32
+#define PS2_IRQ_KEYBOARD 1
+#define PS2_IRQ_MOUSE 12
+#define PS2_MOUSE_ACK 0xFA
+#define PS2_MOUSE_SAMPLE_RATE 200
 
-void input_inject_key(enum key_action action) {
-    uint8_t next = (uint8_t)((key_tail + 1) % KEY_QUEUE_SIZE);
-    if (next == key_head) {
+#define MOUSE_ALWAYS_ONE 0x08
+#define MOUSE_X_SIGN 0x10
+#define MOUSE_Y_SIGN 0x20
+#define MOUSE_OVERFLOW 0xC0
+
+struct ps2_ring {
+    uint8_t data[PS2_RING_SIZE];
+    uint64_t stamp[PS2_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+    volatile uint32_t received;
+};
+
+struct input_trace {
+    uint64_t pending_tsc[INPUT_TRACE_PENDING];
+    uint8_t pending_device[INPUT_TRACE_PENDING];
+    uint32_t pending;
+    uint32_t dropped;
+    uint8_t last_device;
+    uint32_t buckets[INPUT_DEVICE_COUNT][INPUT_LATENCY_BUCKETS];
+    uint32_t count[INPUT_DEVICE_COUNT];
+    uint32_t max_us[INPUT_DEVICE_COUNT];
+};
+
+static struct input_event event_queue[INPUT_QUEUE_SIZE];
+static uint32_t event_head;
+static uint32_t event_tail;
+static uint32_t events_dropped;
+static struct input_trace trace;
+static input_record_fn recorder;
+static int live_enabled = 1;
+
+static struct ps2_ring kbd_ring;
+static struct ps2_ring mouse_ring;
+static uint8_t mouse_packet[3];
+static uint8_t mouse_cycle;
+static uint64_t mouse_packet_tsc;
+static uint32_t mouse_resyncs;
+static uint32_t mouse_overflows;
+
+static void ring_push(struct ps2_ring *ring, uint8_t byte, uint64_t tsc) {
+    uint32_t head = ring->head;
+    ring->received++;
+    if (head - ring->tail >= PS2_RING_SIZE) {
+        ring->dropped++;
         return;
     }
-    key_queue[key_tail] = action;
-    key_tail = next;
+    ring->data[head & PS2_RING_MASK] = byte;
+    ring->stamp[head & PS2_RING_MASK] = tsc;
+    __asm__ volatile ("" : : : "memory");
+    ring->head = head + 1u;
 }
 
-void input_inject_mouse(int dx, int dy, uint8_t buttons) {
-    pending_mouse_dx += dx;
-    pending_mouse_dy += dy;
-    pending_mouse_buttons = buttons;
-    pending_mouse_valid = 1;
+static int ring_pop(struct ps2_ring *ring, uint8_t *byte, uint64_t *tsc) {
+    uint32_t tail = ring->tail;
+    if (tail == ring->head) {
+        return 0;
+    }
+    __asm__ volatile ("" : : : "memory");
+    *byte = ring->data[tail & PS2_RING_MASK];
+    *tsc = ring->stamp[tail & PS2_RING_MASK];
+    __asm__ volatile ("" : : : "memory");
+    ring->tail = tail + 1u;
+    return 1;
 }
 
-static void ps2_wait_read(void) {
-    while ((inb(0x64) & 0x01) == 0) {
+static int ps2_irq(uint8_t irq) {
+    (void)irq;
+    uint64_t tsc = timer_tsc();
+    int drained = 0;
+    for (; drained < PS2_DRAIN_LIMIT; ++drained) {
+        uint8_t status = inb(PS2_STATUS);
+        if ((status & PS2_STATUS_OUTPUT) == 0) {
+            break;
+        }
+        uint8_t byte = inb(PS2_DATA);
+        ring_push((status & PS2_STATUS_AUX) ? &mouse_ring : &kbd_ring, byte, tsc);
     }
+    return drained > 0;
 }
 
-static void ps2_wait_write(void) {
-    while ((inb(0x64) & 0x02) != 0) {
+static void push_event(const struct input_event *event) {
+    if (event_head - event_tail >= INPUT_QUEUE_SIZE) {
+        events_dropped++;
+        return;
+    }
+    event_queue[event_head & INPUT_QUEUE_MASK] = *event;
+    event_head++;
+    if (recorder) {
+        recorder(event);
     }
 }
 
-static void ps2_write_cmd(uint8_t cmd) {
-    ps2_wait_write();
-    outb(0x64, cmd);
+static void push_key(uint8_t device, enum key_action action, uint64_t tsc) {
+    struct input_event event = { tsc, device, INPUT_EVENT_KEY, (uint8_t)action, 0, 0, 0 };
+    push_event(&event);
 }
 
-static void ps2_write_data(uint8_t data) {
-    ps2_wait_write();
-    outb(0x60, data);
+static void push_mouse(uint8_t device, int dx, int dy, uint8_t buttons, uint64_t tsc) {
+    struct input_event event = { tsc, device, INPUT_EVENT_MOUSE, KEY_NONE, buttons, (int16_t)dx, (int16_t)dy };
+    push_event(&event);
 }
 
-static uint8_t ps2_read_data(void) {
-    ps2_wait_read();
-    return inb(0x60);
+void input_inject_key(uint8_t device, enum key_action action) {
+    if (live_enabled) {
+        push_key(device, action, timer_tsc());
+    }
 }
 
-static void ps2_mouse_write(uint8_t data) {
-    ps2_write_cmd(0xD4);
-    ps2_write_data(data);
+void input_inject_mouse(uint8_t device, int dx, int dy, uint8_t buttons) {
+    if (live_enabled) {
+        push_mouse(device, dx, dy, buttons, timer_tsc());
+    }
 }
 
-void init_ps2_mouse(void) {
-    ps2_write_cmd(0xA8);
+void input_inject_event(const struct input_event *event) {
+    struct input_event stamped = *event;
+    stamped.tsc = timer_tsc();
+    push_event(&stamped);
+}
 
-    ps2_write_cmd(0x20);
-    uint8_t status = ps2_read_data();
-    status |= 0x02;
-    ps2_write_cmd(0x60);
-    ps2_write_data(status);
+void input_set_live(int enabled) {
+    live_enabled = enabled;
+}
 
-    ps2_mouse_write(0xF6);
-    (void)ps2_read_data();
-    ps2_mouse_write(0xF4);
-    (void)ps2_read_data();
+void input_set_recorder(input_record_fn fn) {
+    recorder = fn;
 }
 
-enum key_action poll_keyboard(void) {
-    if (key_head != key_tail) {
-        enum key_action action = key_queue[key_head];
-        key_head = (uint8_t)((key_head + 1) % KEY_QUEUE_SIZE);
-        return action;
+void input_get_stats(struct input_stats *stats) {
+    if (!stats) {
+        return;
     }
+    stats->kbd_bytes = kbd_ring.received;
+    stats->kbd_dropped = kbd_ring.dropped;
+    stats->mouse_bytes = mouse_ring.received;
+    stats->mouse_dropped = mouse_ring.dropped;
+    stats->mouse_resyncs = mouse_resyncs;
+    stats->mouse_overflows = mouse_overflows;
+    stats->events_dropped = events_dropped;
+    stats->trace_dropped = trace.dropped;
+}
 
-    static uint8_t extended = 0;
-    uint8_t status = inb(0x64);
-    if ((status & 0x01) == 0) {
-        return KEY_NONE;
+static int ps2_wait_read(void) {
+    uint64_t deadline = timer_tsc() + timer_us_to_tsc(PS2_TIMEOUT_US);
+    while ((inb(PS2_STATUS) & PS2_STATUS_OUTPUT) == 0) {
+        if (timer_tsc() >= deadline) {
+            return 0;
+        }
     }
-    if (status & 0x20) {
-        return KEY_NONE;
+    return 1;
+}
+
+static int ps2_wait_write(void) {
+    uint64_t deadline = timer_tsc() + timer_us_to_tsc(PS2_TIMEOUT_US);
+    while ((inb(PS2_STATUS) & PS2_STATUS_INPUT) != 0) {
+        if (timer_tsc() >= deadline) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int ps2_write_cmd(uint8_t cmd) {
+    if (!ps2_wait_write()) {
+        return 0;
+    }
+    outb(PS2_STATUS, cmd);
+    return 1;
+}
+
+static int ps2_write_data(uint8_t data) {
+    if (!ps2_wait_write()) {
+        return 0;
+    }
+    outb(PS2_DATA, data);
+    return 1;
+}
+
+static int ps2_read_data(uint8_t *data) {
+    if (!ps2_wait_read()) {
+        return 0;
+    }
+    *data = inb(PS2_DATA);
+    return 1;
+}
+
+static void ps2_flush(void) {
+    for (int i = 0; i < PS2_DRAIN_LIMIT && (inb(PS2_STATUS) & PS2_STATUS_OUTPUT); ++i) {
+        (void)inb(PS2_DATA);
+    }
+}
+
+static int ps2_mouse_write(uint8_t data) {
+    uint8_t ack = 0;
+    if (!ps2_write_cmd(0xD4) || !ps2_write_data(data) || !ps2_read_data(&ack)) {
+        return 0;
+    }
+    return ack == PS2_MOUSE_ACK;
+}
+
+void init_ps2_mouse(void) {
+    ps2_flush();
+    ps2_write_cmd(0xA8);
+
+    uint8_t config = 0;
+    if (ps2_write_cmd(0x20) && ps2_read_data(&config)) {
+        config |= PS2_CONFIG_KBD_IRQ | PS2_CONFIG_AUX_IRQ;
+        config &= (uint8_t)~PS2_CONFIG_AUX_CLOCK_OFF;
+        ps2_write_cmd(0x60);
+        ps2_write_data(config);
     }
 
-    uint8_t sc = inb(0x60);
+    ps2_mouse_write(0xF6);
+    if (ps2_mouse_write(0xF3)) {
+        ps2_mouse_write(PS2_MOUSE_SAMPLE_RATE);
+    }
+    ps2_mouse_write(0xF4);
+    ps2_flush();
+
+    mouse_cycle = 0;
+    irq_register(PS2_IRQ_KEYBOARD, ps2_irq);
+    irq_register(PS2_IRQ_MOUSE, ps2_irq);
+}
+
+static enum key_action decode_scancode(uint8_t sc, uint64_t tsc, uint64_t *first_tsc) {
+    static uint8_t extended = 0;
+    static uint64_t extended_tsc = 0;
     if (sc == 0xE0) {
         extended = 1;
+        extended_tsc = tsc;
         return KEY_NONE;
     }
+    *first_tsc = extended ? extended_tsc : tsc;
     if (sc & 0x80) {
+        extended = 0;
         return KEY_NONE;
     }
 
@@ -124,75 +292,189 @@ enum key_action poll_keyboard(void) {
         return KEY_TAB;
     case 0x1F:
         return KEY_START;
+    case 0x3C:
+        return KEY_HUD;
+    case 0x3D:
+        return KEY_HEATMAP;
+    case 0x3E:
+        return KEY_LATENCY;
+    case 0x3F:
+        return KEY_RECORD;
     default:
         return KEY_NONE;
     }
 }
 
-void poll_mouse(struct ui_state *state, const struct framebuffer *fb) {
-    static uint8_t packet[3];
-    static uint8_t cycle = 0;
-    uint8_t status = inb(0x64);
-    if ((status & 0x01) == 0) {
-        return;
-    }
-    if ((status & 0x20) == 0) {
-        if (pending_mouse_valid) {
-            int dx = pending_mouse_dx;
-            int dy = pending_mouse_dy;
-            state->mouse_buttons = pending_mouse_buttons;
-            pending_mouse_dx = 0;
-            pending_mouse_dy = 0;
-            pending_mouse_valid = 0;
-            state->mouse_x += dx;
-            state->mouse_y -= dy;
-        } else {
-            return;
+static int mouse_feed(uint8_t byte, uint64_t tsc, int *dx, int *dy, uint8_t *buttons) {
+    if (mouse_cycle == 0) {
+        if ((byte & MOUSE_ALWAYS_ONE) == 0) {
+            mouse_resyncs++;
+            return 0;
         }
+        mouse_packet_tsc = tsc;
+    }
+    mouse_packet[mouse_cycle++] = byte;
+    if (mouse_cycle < 3) {
+        return 0;
     }
+    mouse_cycle = 0;
 
-    packet[cycle++] = inb(0x60);
-    if (cycle < 3) {
-        return;
+    uint8_t flags = mouse_packet[0];
+    if (flags & MOUSE_OVERFLOW) {
+        mouse_overflows++;
+        return 0;
     }
-    cycle = 0;
+    *dx = (int)mouse_packet[1] - ((flags & MOUSE_X_SIGN) ? 256 : 0);
+    *dy = (int)mouse_packet[2] - ((flags & MOUSE_Y_SIGN) ? 256 : 0);
+    *buttons = flags & 0x07;
+    return 1;
+}
 
-    int dx = (int8_t)packet[1];
-    int dy = (int8_t)packet[2];
-    state->mouse_buttons = packet[0] & 0x07;
-    state->mouse_x += dx;
-    state->mouse_y -= dy;
-    if (state->mouse_x < 0) {
-        state->mouse_x = 0;
+void input_pump(void) {
+    uint8_t byte;
+    uint64_t tsc;
+    while (ring_pop(&kbd_ring, &byte, &tsc)) {
+        uint64_t first_tsc = tsc;
+        enum key_action action = decode_scancode(byte, tsc, &first_tsc);
+        if (action != KEY_NONE && live_enabled) {
+            push_key(INPUT_DEVICE_PS2_KEYBOARD, action, first_tsc);
+        }
     }
-    if (state->mouse_y < 0) {
-        state->mouse_y = 0;
+    while (ring_pop(&mouse_ring, &byte, &tsc)) {
+        int dx = 0;
+        int dy = 0;
+        uint8_t buttons = 0;
+        if (mouse_feed(byte, tsc, &dx, &dy, &buttons) && live_enabled) {
+            push_mouse(INPUT_DEVICE_PS2_MOUSE, dx, dy, buttons, mouse_packet_tsc);
+        }
     }
-    if (state->mouse_x > (int)fb->width - 1) {
-        state->mouse_x = (int)fb->width - 1;
+}
+
+int input_next_event(struct input_event *event) {
+    if (event_tail == event_head) {
+        return 0;
     }
-    if (state->mouse_y > (int)fb->height - 1) {
-        state->mouse_y = (int)fb->height - 1;
+    *event = event_queue[event_tail & INPUT_QUEUE_MASK];
+    event_tail++;
+    if (event->device >= INPUT_DEVICE_COUNT) {
+        return 1;
     }
+    if (trace.pending < INPUT_TRACE_PENDING) {
+        trace.pending_tsc[trace.pending] = event->tsc;
+        trace.pending_device[trace.pending] = event->device;
+        trace.pending++;
+    } else {
+        trace.dropped++;
+    }
+    trace.last_device = event->device;
+    return 1;
+}
 
-    if (pending_mouse_valid) {
-        state->mouse_buttons = pending_mouse_buttons;
-        state->mouse_x += pending_mouse_dx;
-        state->mouse_y -= pending_mouse_dy;
-        pending_mouse_dx = 0;
-        pending_mouse_dy = 0;
-        pending_mouse_valid = 0;
-        if (state->mouse_x < 0) {
-            state->mouse_x = 0;
+void input_trace_present(uint64_t tsc) {
+    for (uint32_t i = 0; i < trace.pending; ++i) {
+        uint8_t device = trace.pending_device[i];
+        uint64_t stamp = trace.pending_tsc[i];
+        uint32_t us = tsc > stamp ? timer_tsc_to_us(tsc - stamp) : 0;
+        uint32_t bucket = us / INPUT_LATENCY_BUCKET_US;
+        if (bucket >= INPUT_LATENCY_BUCKETS) {
+            bucket = INPUT_LATENCY_BUCKETS - 1u;
         }
-        if (state->mouse_y < 0) {
-            state->mouse_y = 0;
+        trace.buckets[device][bucket]++;
+        trace.count[device]++;
+        if (us > trace.max_us[device]) {
+            trace.max_us[device] = us;
         }
-        if (state->mouse_x > (int)fb->width - 1) {
-            state->mouse_x = (int)fb->width - 1;
+    }
+    trace.pending = 0;
+}
+
+void input_trace_discard(void) {
+    trace.pending = 0;
+}
+
+uint8_t input_trace_last_device(void) {
+    return trace.last_device;
+}
+
+static uint32_t latency_percentile(uint8_t device, uint32_t percent) {
+    uint32_t count = trace.count[device];
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t target = (count * percent + 99u) / 100u;
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < INPUT_LATENCY_BUCKETS; ++i) {
+        seen += trace.buckets[device][i];
+        if (seen >= target) {
+            uint32_t upper = (i + 1u) * INPUT_LATENCY_BUCKET_US;
+            return upper < trace.max_us[device] ? upper : trace.max_us[device];
+        }
+    }
+    return trace.max_us[device];
+}
+
+void input_latency_get(uint8_t device, struct input_latency *out) {
+    if (!out) {
+        return;
+    }
+    if (device >= INPUT_DEVICE_COUNT) {
+        out->count = 0;
+        out->p50_us = 0;
+        out->p99_us = 0;
+        out->max_us = 0;
+        return;
+    }
+    out->count = trace.count[device];
+    out->p50_us = latency_percentile(device, 50);
+    out->p99_us = latency_percentile(device, 99);
+    out->max_us = trace.max_us[device];
+}
+
+const char *input_device_name(uint8_t device) {
+    switch (device) {
+    case INPUT_DEVICE_PS2_KEYBOARD:
+        return "ps2-kbd";
+    case INPUT_DEVICE_PS2_MOUSE:
+        return "ps2-mouse";
+    case INPUT_DEVICE_USB_KEYBOARD:
+        return "usb-kbd";
+    case INPUT_DEVICE_USB_MOUSE:
+        return "usb-mouse";
+    default:
+        return "unknown";
+    }
+}
+
+void input_latency_log(void) {
+    for (uint8_t device = 0; device < INPUT_DEVICE_COUNT; ++device) {
+        struct input_latency lat;
+        input_latency_get(device, &lat);
+        if (lat.count == 0) {
+            continue;
         }
-        if (state->mouse_y > (int)fb->height - 1) {
-            state->mouse_y = (int)fb->height - 1;
+        log_puts("Latency ");
+        log_puts(input_device_name(device));
+        log_puts(": n=");
+        log_dec32(lat.count);
+        log_puts(" p50=");
+        log_dec32(lat.p50_us);
+        log_puts("us p90=");
+        log_dec32(latency_percentile(device, 90));
+        log_puts("us p99=");
+        log_dec32(lat.p99_us);
+        log_puts("us max=");
+        log_dec32(lat.max_us);
+        log_puts("us\n");
+        for (uint32_t i = 0; i < INPUT_LATENCY_BUCKETS; ++i) {
+            uint32_t n = trace.buckets[device][i];
+            if (n == 0) {
+                continue;
+            }
+            log_puts("  <");
+            log_dec32((i + 1u) * INPUT_LATENCY_BUCKET_US);
+            log_puts(i + 1u == INPUT_LATENCY_BUCKETS ? "us+ " : "us ");
+            log_dec32(n);
+            log_puts("\n");
         }
     }
 }
@@ -1,6 +1,14 @@
 #include <stdint.h>
 
+#include "cmdline.h"
+#include "console.h"
+#include "cursor.h"
+#include "display.h"
+#include "frame.h"
 #include "framebuffer.h"
+#include "gdt.h"
+#include "idt.h"
+#include "image.h"
 #include "input.h"
 #include "ata.h"
 #include "log.h"
@@ -8,11 +16,51 @@
 #include "memory.h"
 #include "mbr.h"
 #include "panic.h"
+#include "replay.h"
 #include "scheduler.h"
+#include "tile.h"
+#include "timer.h"
 #include "usb.h"
 #include "vfs.h"
 #include "ui.h"
 
+#define BOOT_CONSOLE_FLUSH_US 16000u
+#define INPUT_DEFAULT_HZ 1000u
+#define RENDER_DEFAULT_SLICE_US 1000u
+
+static struct console_view boot_view;
+static int boot_view_active;
+static uint64_t boot_view_next_tsc;
+static struct display *boot_display;
+
+static void boot_display_flush(void) {
+    if (boot_display) {
+        display_flush(boot_display, fb_bounds(&boot_display->scanout));
+    }
+}
+
+static void console_mirror(const char *s, uint32_t len) {
+    console_write(console_system(), s, len);
+    if (!boot_view_active) {
+        return;
+    }
+    uint64_t now = timer_tsc();
+    if (now < boot_view_next_tsc) {
+        return;
+    }
+    boot_view_next_tsc = now + timer_us_to_tsc(BOOT_CONSOLE_FLUSH_US);
+    console_view_flush(&boot_view, console_system());
+    boot_display_flush();
+}
+
+static void boot_console_attach(const struct framebuffer *fb) {
+    struct rect area = { 8, 8, (int)fb->width - 16, (int)fb->height - 16 };
+    console_view_init(&boot_view, fb, area, rgb(255, 255, 255), rgb(0, 0, 0));
+    console_view_flush(&boot_view, console_system());
+    boot_display_flush();
+    boot_view_active = 1;
+}
+
 static void text_fallback(void) {
     volatile uint16_t *vga = (uint16_t *)0xB8000;
     const char *msg = "ExonOS: framebuffer unavailable";
@@ -114,52 +162,266 @@ static void fill_cpu_string(char *out, uint32_t max_len) {
 }
 
 struct ui_task_ctx {
-    struct framebuffer fb;
-    struct framebuffer draw_fb;
+    struct display display;
     struct ui_state state;
+    struct ui_snapshots snapshots;
+    struct damage_list damage;
+    struct cursor_plane cursor;
+    struct tile_renderer tiles;
+    struct frame_pacer pacer;
+    struct frame_stats stats;
+    struct frame_summary summary;
+    struct frame_sample sample;
+    const struct ui_state *frame_view;
+    int frame_heatmap;
+    uint64_t update_tsc;
+    uint64_t render_tsc;
+    uint64_t rendered_tsc;
+    uint64_t slice_tsc;
+    uint64_t last_present_tsc;
+    uint32_t input_hz;
+    uint64_t input_period_tsc;
+    uint64_t input_next_tsc;
 };
 
+static int load_wallpaper(const struct framebuffer *back, struct framebuffer *out) {
+    char name[16];
+    if (!cmdline_get("wallpaper", name, sizeof(name))) {
+        str_copy(name, "WALLPAPR.BMP", sizeof(name));
+    }
+    if (!fb_alloc_surface(out, back->width, back->height, back->format)) {
+        return 0;
+    }
+    struct image_info image;
+    uint64_t start = timer_us();
+    if (!image_load_scaled(name, out, &image)) {
+        fb_free_surface(out);
+        log_puts("Wallpaper: ");
+        log_puts(name);
+        log_puts(" not loaded\n");
+        return 0;
+    }
+    uint32_t elapsed = (uint32_t)(timer_us() - start);
+    log_puts("Wallpaper: ");
+    log_puts(name);
+    log_puts(image.type == IMAGE_BMP ? " BMP " : " TGA ");
+    log_dec32(image.width);
+    log_puts("x");
+    log_dec32(image.height);
+    log_puts(" -> ");
+    log_dec32(out->width);
+    log_puts("x");
+    log_dec32(out->height);
+    log_puts(" in ");
+    log_dec32(elapsed);
+    log_puts(" us, ");
+    log_dec32(image.bytes_read);
+    log_puts(" bytes\n");
+    return 1;
+}
+
 static void usb_task(void *ctx) {
     (void)ctx;
-    static uint32_t div;
-    div++;
-    if ((div & 0x7) == 0) {
-        usb_poll();
+    usb_poll();
+    struct usb_event event;
+    while (usb_next_event(&event)) {
+        log_puts("USB: ");
+        log_puts(event.type == USB_EVENT_READY ? "ready" : "removed");
+        log_puts(" device ");
+        log_dec32(event.info.addr);
+        log_puts(" at ");
+        log_dec32(timer_us_to_ms(event.time_us));
+        log_puts(" ms\n");
+    }
+}
+
+static void replay_task(void *ctx) {
+    struct ui_task_ctx *ui = (struct ui_task_ctx *)ctx;
+    uint64_t now = timer_tsc();
+    if (replay_poll(now)) {
+        frame_summary_log(&ui->summary, now);
+        input_latency_log();
+    }
+}
+
+static void ui_begin_frame(struct ui_task_ctx *ui, const struct ui_state *view) {
+    struct draw_ctx ctx;
+    ui->frame_view = view;
+    ui->render_tsc = 0;
+    ui->rendered_tsc = 0;
+    ui->frame_heatmap = view->heatmap_visible && fb_heatmap_begin(&ui->display.back);
+    fb_reset_pixel_writes();
+    tile_begin_frame(&ui->tiles, &ui->damage, display_buffer_age(&ui->display));
+    draw_init(&ctx, &ui->display.back);
+    draw_record(&ctx, ui->tiles.list);
+    if (draw_push_clip(&ctx, tile_dirty_bounds(&ui->tiles))) {
+        ui_render(&ctx, view);
+        draw_pop(&ctx);
+    }
+    if (!tile_prepare(&ui->tiles)) {
+        log_puts("Draw list overflow, full redraw\n");
+        draw_init(&ctx, &ui->display.back);
+        ui_render(&ctx, view);
+        tile_mark_all(&ui->tiles);
+    }
+    tile_dirty_damage(&ui->tiles, &ui->damage);
+}
+
+static int ui_render_slice(struct ui_task_ctx *ui, uint64_t start_tsc) {
+    uint64_t deadline = start_tsc + ui->slice_tsc;
+    int done = 0;
+    for (;;) {
+        if (!tile_render_next(&ui->tiles)) {
+            done = 1;
+            break;
+        }
+        if (timer_tsc() >= deadline) {
+            break;
+        }
+    }
+    ui->render_tsc += timer_tsc() - start_tsc;
+    return done;
+}
+
+static void ui_finish_render(struct ui_task_ctx *ui) {
+    const struct ui_state *view = ui->frame_view;
+    ui->sample.pixels_written = fb_pixel_writes();
+    ui->sample.tiles_dirty = ui->tiles.dirty_count;
+    if (ui->frame_heatmap) {
+        fb_heatmap_end();
+    }
+    if (view->hud_visible) {
+        frame_hud_draw(&ui->display.back, &ui->stats, &ui->pacer);
+    }
+    ui->rendered_tsc = timer_tsc();
+}
+
+static void ui_present_frame(struct ui_task_ctx *ui) {
+    struct frame_sample *sample = &ui->sample;
+    display_present(&ui->display, &ui->damage);
+    damage_clear(&ui->damage);
+    cursor_show(&ui->cursor, ui->cursor.x, ui->cursor.y);
+    uint64_t presented_tsc = timer_tsc();
+    input_trace_present(presented_tsc);
+
+    sample->update_us = timer_tsc_to_us(ui->update_tsc);
+    sample->render_us = timer_tsc_to_us(ui->render_tsc);
+    sample->present_us = timer_tsc_to_us(presented_tsc - ui->rendered_tsc);
+    sample->interval_us = 0;
+    if (ui->last_present_tsc != 0) {
+        sample->interval_us = timer_tsc_to_us(presented_tsc - ui->last_present_tsc);
+        if (sample->interval_us > 1000000u) {
+            sample->interval_us = 1000000u;
+        }
     }
+    frame_stats_push(&ui->stats, sample);
+    frame_summary_add(&ui->summary, sample, &ui->pacer);
+    ui->update_tsc = 0;
+    ui->last_present_tsc = presented_tsc;
+    ui->frame_view = 0;
+    frame_pacer_advance(&ui->pacer, presented_tsc);
 }
 
-static void ui_task(void *ctx) {
+static void input_task(void *ctx) {
     struct ui_task_ctx *ui = (struct ui_task_ctx *)ctx;
-    static uint32_t frame_div;
-    ui_update(&ui->state, &ui->draw_fb);
-    frame_div++;
-    if ((frame_div & 0x1) == 0) {
-        ui_render(&ui->draw_fb, &ui->state);
-        fb_blit(&ui->fb, &ui->draw_fb);
+    uint64_t start = timer_tsc();
+    if (start < ui->input_next_tsc) {
+        return;
+    }
+    ui->input_next_tsc += ui->input_period_tsc;
+    if (ui->input_next_tsc <= start) {
+        ui->input_next_tsc = start + ui->input_period_tsc;
+    }
+
+    ui_update(&ui->state, &ui->display.back);
+    if (!damage_empty(&ui->state.damage)) {
+        ui_publish(&ui->snapshots, &ui->state);
+    }
+    ui->update_tsc += timer_tsc() - start;
+
+    struct rect cursor_prev = cursor_bounds(&ui->cursor);
+    cursor_move(&ui->cursor, ui->state.mouse_x, ui->state.mouse_y);
+    struct rect cursor_now = cursor_bounds(&ui->cursor);
+    int cursor_moved = cursor_now.x != cursor_prev.x || cursor_now.y != cursor_prev.y;
+    if (cursor_moved) {
+        display_flush(&ui->display, rect_union(cursor_prev, cursor_now));
+    }
+    if (!ui_snapshot_pending(&ui->snapshots) && damage_empty(&ui->damage)) {
+        if (cursor_moved) {
+            input_trace_present(timer_tsc());
+        } else {
+            input_trace_discard();
+        }
     }
 }
 
+static void render_task(void *ctx) {
+    struct ui_task_ctx *ui = (struct ui_task_ctx *)ctx;
+    uint64_t now = timer_tsc();
+    if (!ui->frame_view) {
+        if (!frame_pacer_ready(&ui->pacer, now)) {
+            return;
+        }
+        const struct ui_state *view = ui_acquire(&ui->snapshots, &ui->damage);
+        if (view->heatmap_visible) {
+            const struct framebuffer *back = &ui->display.back;
+            damage_add(&ui->damage, (struct rect){ 0, 0, (int)back->width, (int)back->height });
+        } else if (view->hud_visible) {
+            damage_add(&ui->damage, frame_hud_rect(&ui->display.back));
+        }
+        if (damage_empty(&ui->damage)) {
+            return;
+        }
+        cursor_hide(&ui->cursor);
+        ui_begin_frame(ui, view);
+    } else {
+        cursor_hide(&ui->cursor);
+    }
+    if (ui->rendered_tsc == 0) {
+        if (!ui_render_slice(ui, now)) {
+            cursor_show(&ui->cursor, ui->cursor.x, ui->cursor.y);
+            return;
+        }
+        ui_finish_render(ui);
+    }
+    if (!frame_pacer_sync(&ui->pacer, ui->rendered_tsc, timer_tsc())) {
+        cursor_show(&ui->cursor, ui->cursor.x, ui->cursor.y);
+        return;
+    }
+    struct rect cursor_prev = cursor_bounds(&ui->cursor);
+    ui_present_frame(ui);
+    display_flush(&ui->display, rect_union(cursor_prev, cursor_bounds(&ui->cursor)));
+}
+
 void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info_addr) {
     log_init();
     log_puts("ExonOS booting...\n");
     if (multiboot_magic != MULTIBOOT2_MAGIC) {
         panic("Bad Multiboot2 magic");
     }
+    gdt_init();
+    idt_init();
+
+    const char *cmdline = 0;
+    mb2_find_cmdline(multiboot_info_addr, &cmdline);
+    cmdline_init(cmdline);
+    timer_init();
 
     struct framebuffer fb = { 0 };
     if (!mb2_find_framebuffer(multiboot_info_addr, &fb)) {
         panic("No framebuffer tag");
     }
-    if (fb.base == 0 || fb.bpp != 32) {
+    if (fb.base == 0 || fb.format == FB_FORMAT_UNKNOWN) {
         text_fallback();
     }
 
     panic_set_framebuffer(&fb);
-    fb_draw_string(&fb, 8, 8, "Booting...", rgb(255, 255, 255), rgb(0, 0, 0));
-    fb_draw_string(&fb, 8, 24, "Step 1", rgb(255, 255, 255), rgb(0, 0, 0));
+    console_init(console_system());
+    log_set_mirror(console_mirror);
+    boot_console_attach(&fb);
+    log_puts("Framebuffer console ready\n");
 
     memory_init(multiboot_info_addr);
-    fb_draw_string(&fb, 8, 40, "Step 2", rgb(255, 255, 255), rgb(0, 0, 0));
     log_puts("Memory init done\n");
 
     vfs_init();
@@ -192,30 +454,42 @@ void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info_addr) {
     } else {
         log_puts("No ATA disk\n");
     }
-    fb_draw_string(&fb, 8, 56, "Step 3", rgb(255, 255, 255), rgb(0, 0, 0));
-    fb_draw_string(&fb, 8, 72, "USB scan...", rgb(255, 255, 255), rgb(0, 0, 0));
+    log_puts("USB scan...\n");
 
     usb_init();
-    fb_draw_string(&fb, 8, 88, "Step 4", rgb(255, 255, 255), rgb(0, 0, 0));
+    log_puts("USB scan done, enumerating in background\n");
+
+    uint8_t render_format = fb.bpp == 16 ? FB_FORMAT_RGB565 : FB_FORMAT_XRGB8888;
+    char render_name[16];
+    if (cmdline_get("render", render_name, sizeof(render_name))) {
+        uint8_t requested = fb_format_from_name(render_name);
+        if (requested != FB_FORMAT_UNKNOWN) {
+            render_format = requested;
+        }
+    }
 
-    enum { BACKBUFFER_W = 1024, BACKBUFFER_H = 768 };
-    static uint32_t backbuffer[BACKBUFFER_W * BACKBUFFER_H];
-    if (fb.width > BACKBUFFER_W || fb.height > BACKBUFFER_H) {
-        panic("Framebuffer too large");
+    static struct ui_task_ctx ui_ctx;
+    if (!display_init(&ui_ctx.display, &fb, render_format)) {
+        panic("Display init failed");
     }
-    struct framebuffer draw_fb = fb;
-    draw_fb.base = (uint8_t *)backbuffer;
-    draw_fb.pitch = fb.width * 4;
+    const struct framebuffer *screen = &ui_ctx.display.scanout;
+    boot_display = &ui_ctx.display;
+    panic_set_framebuffer(screen);
+    panic_set_flush(boot_display_flush);
+    boot_console_attach(screen);
 
     init_ps2_mouse();
+    interrupts_enable();
+    log_puts("PS/2 IRQs enabled\n");
 
     struct system_info info;
     str_copy(info.version, "Exon OS 0.0.8", sizeof(info.version));
     str_copy(info.kernel, "Exon kernel", sizeof(info.kernel));
     fill_cpu_string(info.cpu, sizeof(info.cpu));
-    info.width = fb.width;
-    info.height = fb.height;
-    info.bpp = fb.bpp;
+    info.width = screen->width;
+    info.height = screen->height;
+    info.bpp = screen->bpp;
+    str_copy(info.display, display_backend_name(&ui_ctx.display), sizeof(info.display));
     uint32_t mem_lower = 0;
     uint32_t mem_upper = 0;
     if (mb2_find_basic_meminfo(multiboot_info_addr, &mem_lower, &mem_upper)) {
@@ -225,17 +499,81 @@ void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info_addr) {
     }
     log_puts("Init UI\n");
 
-    struct ui_task_ctx ui_ctx;
-    ui_ctx.fb = fb;
-    ui_ctx.draw_fb = draw_fb;
-    ui_init(&ui_ctx.state, &draw_fb, &info);
-    fb_draw_string(&fb, 8, 104, "Step 5", rgb(255, 255, 255), rgb(0, 0, 0));
+    ui_init(&ui_ctx.state, &ui_ctx.display.back, &info);
+    static struct framebuffer wallpaper;
+    if (load_wallpaper(&ui_ctx.display.back, &wallpaper)) {
+        ui_set_wallpaper(&ui_ctx.state, &ui_ctx.display.back, &wallpaper);
+    }
+    ui_snapshots_init(&ui_ctx.snapshots, &ui_ctx.state);
+    damage_clear(&ui_ctx.damage);
+    cursor_init(&ui_ctx.cursor, screen);
+    if (!tile_renderer_init(&ui_ctx.tiles, &ui_ctx.display.back)) {
+        panic("Tile renderer init failed");
+    }
+
+    uint32_t target_fps = FRAME_DEFAULT_HZ;
+    cmdline_get_u32("fps", &target_fps);
+    uint32_t vsync = 1;
+    cmdline_get_u32("vsync", &vsync);
+    if (vsync && ui_ctx.display.backend != DISPLAY_VIRTIO_GPU) {
+        vsync = (uint32_t)frame_retrace_probe();
+    } else {
+        vsync = 0;
+    }
+    frame_pacer_init(&ui_ctx.pacer, target_fps, (int)vsync);
+    frame_stats_init(&ui_ctx.stats);
+    ui_ctx.update_tsc = 0;
+    ui_ctx.last_present_tsc = 0;
+    ui_ctx.frame_view = 0;
+    log_puts("Frame pacing: ");
+    log_dec32(ui_ctx.pacer.target_hz);
+    log_puts(vsync ? " Hz, vsync\n" : " Hz\n");
+
+    ui_ctx.input_hz = INPUT_DEFAULT_HZ;
+    cmdline_get_u32("input_hz", &ui_ctx.input_hz);
+    if (ui_ctx.input_hz == 0 || ui_ctx.input_hz > 10000u) {
+        ui_ctx.input_hz = INPUT_DEFAULT_HZ;
+    }
+    ui_ctx.input_period_tsc = timer_us_to_tsc(1000000u / ui_ctx.input_hz);
+    ui_ctx.input_next_tsc = 0;
+    log_puts("Input sampling: ");
+    log_dec32(ui_ctx.input_hz);
+    log_puts(" Hz\n");
+
+    uint32_t slice_us = RENDER_DEFAULT_SLICE_US;
+    cmdline_get_u32("render_slice_us", &slice_us);
+    if (slice_us == 0 || slice_us > 100000u) {
+        slice_us = RENDER_DEFAULT_SLICE_US;
+    }
+    ui_ctx.slice_tsc = timer_us_to_tsc(slice_us);
+    log_puts("Render slice: ");
+    log_dec32(slice_us);
+    log_puts(" us\n");
+
+    char replay_name[16];
+    if (cmdline_get("replay", replay_name, sizeof(replay_name)) && !replay_load(replay_name)) {
+        log_puts("Replay: cannot load ");
+        log_puts(replay_name);
+        log_puts("\n");
+    }
+    uint32_t record = 0;
+    cmdline_get_u32("record", &record);
 
     scheduler_init();
-    scheduler_add(ui_task, &ui_ctx);
+    scheduler_add(input_task, &ui_ctx);
+    scheduler_add(render_task, &ui_ctx);
     scheduler_add(usb_task, 0);
+    scheduler_add(replay_task, &ui_ctx);
     log_puts("Scheduler start\n");
-    fb_draw_string(&fb, 8, 120, "Step 6", rgb(255, 255, 255), rgb(0, 0, 0));
+    console_view_flush(&boot_view, console_system());
+    boot_display_flush();
+    boot_view_active = 0;
+    uint64_t start_tsc = timer_tsc();
+    frame_summary_reset(&ui_ctx.summary, start_tsc);
+    replay_start(start_tsc);
+    if (record) {
+        replay_record_start(start_tsc);
+    }
 
     for (;;) {
         scheduler_tick();
@@ -3,6 +3,8 @@
 
 #define COM1 0x3F8
 
+static log_mirror_fn mirror;
+
 static int log_ready(void) {
     return (inb(COM1 + 5) & 0x20) != 0;
 }
@@ -17,7 +19,11 @@ void log_init(void) {
     outb(COM1 + 4, 0x0B);
 }
 
-void log_putc(char c) {
+void log_set_mirror(log_mirror_fn fn) {
+    mirror = fn;
+}
+
+static void serial_putc(char c) {
     for (uint32_t i = 0; i < 100000; ++i) {
         if (log_ready()) {
             outb(COM1, (uint8_t)c);
@@ -26,12 +32,19 @@ void log_putc(char c) {
     }
 }
 
+void log_putc(char c) {
+    log_write(&c, 1);
+}
+
 void log_write(const char *s, uint32_t len) {
     if (!s) {
         return;
     }
     for (uint32_t i = 0; i < len; ++i) {
-        log_putc(s[i]);
+        serial_putc(s[i]);
+    }
+    if (mirror) {
+        mirror(s, len);
     }
 }
 
@@ -39,32 +52,30 @@ void log_puts(const char *s) {
     if (!s) {
         return;
     }
-    while (*s) {
-        log_putc(*s++);
+    uint32_t len = 0;
+    while (s[len]) {
+        len++;
     }
+    log_write(s, len);
 }
 
 void log_hex32(uint32_t value) {
     const char *hex = "0123456789ABCDEF";
-    log_puts("0x");
-    for (int i = 7; i >= 0; --i) {
-        uint8_t nibble = (uint8_t)((value >> (i * 4)) & 0xF);
-        log_putc(hex[nibble]);
+    char buf[10];
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (int i = 0; i < 8; ++i) {
+        buf[2 + i] = hex[(value >> ((7 - i) * 4)) & 0xF];
     }
+    log_write(buf, sizeof(buf));
 }
 
 void log_dec32(uint32_t value) {
-    char buf[11];
-    int i = 0;
-    if (value == 0) {
-        log_putc('0');
-        return;
-    }
-    while (value > 0 && i < (int)(sizeof(buf) - 1)) {
-        buf[i++] = (char)('0' + (value % 10));
+    char buf[10];
+    int i = (int)sizeof(buf);
+    do {
+        buf[--i] = (char)('0' + (value % 10));
         value /= 10;
-    }
-    while (i > 0) {
-        log_putc(buf[--i]);
-    }
+    } while (value > 0);
+    log_write(buf + i, (uint32_t)sizeof(buf) - (uint32_t)i);
 }
@@ -17,6 +17,15 @@ struct mb2_tag_framebuffer {
     uint16_t reserved;
 };
 
+struct mb2_fb_rgb_info {
+    uint8_t red_field_position;
+    uint8_t red_mask_size;
+    uint8_t green_field_position;
+    uint8_t green_mask_size;
+    uint8_t blue_field_position;
+    uint8_t blue_mask_size;
+};
+
 struct mb2_tag_basic_meminfo {
     uint32_t type;
     uint32_t size;
@@ -41,6 +50,7 @@ int mb2_find_framebuffer(uint32_t mb_info_addr, struct framebuffer *out_fb) {
     out_fb->height = 0;
     out_fb->pitch = 0;
     out_fb->bpp = 0;
+    out_fb->format = FB_FORMAT_UNKNOWN;
 
     uint8_t *base = (uint8_t *)(uintptr_t)mb_info_addr;
     uint32_t total_size = *(uint32_t *)base;
@@ -63,6 +73,14 @@ int mb2_find_framebuffer(uint32_t mb_info_addr, struct framebuffer *out_fb) {
             out_fb->height = fb_tag->height;
             out_fb->pitch = fb_tag->pitch;
             out_fb->bpp = fb_tag->bpp;
+            if (fb_tag->framebuffer_type == 1 &&
+                tag->size >= sizeof(struct mb2_tag_framebuffer) + sizeof(struct mb2_fb_rgb_info)) {
+                const struct mb2_fb_rgb_info *info = (const struct mb2_fb_rgb_info *)(fb_tag + 1);
+                out_fb->format = fb_format_from_layout(fb_tag->bpp,
+                                                       info->red_field_position, info->red_mask_size,
+                                                       info->green_field_position, info->green_mask_size,
+                                                       info->blue_field_position, info->blue_mask_size);
+            }
             return 1;
         }
         uint32_t next = (tag->size + 7u) & ~7u;
@@ -157,3 +175,37 @@ int mb2_get_mmap(uint32_t mb_info_addr,
 
     return 0;
 }
+
+int mb2_find_cmdline(uint32_t mb_info_addr, const char **out_cmdline) {
+    if (!out_cmdline) {
+        return 0;
+    }
+    *out_cmdline = 0;
+
+    uint8_t *base = (uint8_t *)(uintptr_t)mb_info_addr;
+    uint32_t total_size = *(uint32_t *)base;
+    if (total_size < 8) {
+        return 0;
+    }
+
+    uint8_t *ptr = base + 8;
+    uint8_t *end = base + total_size;
+
+    while (ptr + sizeof(struct mb2_tag) <= end) {
+        struct mb2_tag *tag = (struct mb2_tag *)ptr;
+        if (tag->type == 0) {
+            break;
+        }
+        if (tag->type == 1 && tag->size > sizeof(struct mb2_tag)) {
+            *out_cmdline = (const char *)(tag + 1);
+            return 1;
+        }
+        uint32_t next = (tag->size + 7u) & ~7u;
+        if (next == 0) {
+            break;
+        }
+        ptr += next;
+    }
+
+    return 0;
+}
@@ -120,6 +120,7 @@ void memory_init(uint32_t mb_info_addr) {
     }
 
     reserve_range(0, (uint32_t)(uintptr_t)heap_limit);
+    reserve_range(mb_info_addr, mb_info_addr + *(const uint32_t *)(uintptr_t)mb_info_addr);
 }
 
 void *kmalloc(uint32_t size, uint32_t align) {
@@ -154,6 +155,35 @@ uint32_t phys_alloc_page(void) {
     return 0;
 }
 
+uint32_t phys_alloc_pages(uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (count == 1) {
+        return phys_alloc_page();
+    }
+    uint32_t run_start = 0;
+    uint32_t run_len = 0;
+    for (uint32_t i = 1; i < total_pages; ++i) {
+        if (bitmap_test(i)) {
+            run_len = 0;
+            continue;
+        }
+        if (run_len == 0) {
+            run_start = i;
+        }
+        run_len++;
+        if (run_len == count) {
+            for (uint32_t j = run_start; j < run_start + count; ++j) {
+                bitmap_set(j);
+            }
+            free_pages -= count;
+            return run_start * PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
 void phys_free_page(uint32_t addr) {
     if (addr % PAGE_SIZE != 0) {
         return;
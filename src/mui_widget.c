@@ -0,0 +1,233 @@
+#include "mui_widget.h"
+#include "magicui.h"
+
+static int valid_id(const struct mui_tree *tree, int id) {
+    return tree && id >= 0 && id < tree->count;
+}
+
+static struct rect widget_extent(const struct mui_widget *w) {
+    if (w->selected) {
+        return (struct rect){ w->rect.x - 2, w->rect.y - 2, w->rect.w + 4, w->rect.h + 4 };
+    }
+    return w->rect;
+}
+
+static int text_equal(const char *stored, const char *text) {
+    uint32_t i = 0;
+    while (i + 1 < MUI_WIDGET_TEXT && stored[i] != '\0' && stored[i] == text[i]) {
+        i++;
+    }
+    if (i + 1 == MUI_WIDGET_TEXT) {
+        return 1;
+    }
+    return stored[i] == text[i];
+}
+
+void mui_tree_init(struct mui_tree *tree) {
+    tree->count = 0;
+    tree->layout_dirty = 0;
+    tree->dirty = (struct rect){ 0, 0, 0, 0 };
+}
+
+void mui_tree_invalidate(struct mui_tree *tree, struct rect r) {
+    tree->dirty = rect_union(tree->dirty, r);
+}
+
+int mui_tree_add(struct mui_tree *tree, enum mui_widget_type type, int parent, struct rect rect) {
+    if (!tree || tree->count >= MUI_TREE_MAX) {
+        return -1;
+    }
+    if (parent >= tree->count) {
+        return -1;
+    }
+    int id = tree->count++;
+    struct mui_widget *w = &tree->widgets[id];
+    w->type = (uint8_t)type;
+    w->visible = 1;
+    w->selected = 0;
+    w->parent = (int8_t)parent;
+    w->rect = rect;
+    w->fg = rgb(60, 60, 60);
+    w->bg = rgb(230, 234, 240);
+    w->value = 0;
+    w->max_value = 0;
+    w->text[0] = '\0';
+    if (parent >= 0) {
+        tree->layout_dirty = 1;
+    }
+    mui_tree_invalidate(tree, rect);
+    return id;
+}
+
+static void layout_list(struct mui_tree *tree, int list_id) {
+    struct mui_widget *list = &tree->widgets[list_id];
+    int y = list->rect.y;
+    for (int i = list_id + 1; i < tree->count; ++i) {
+        struct mui_widget *row = &tree->widgets[i];
+        if (row->parent != list_id || !row->visible) {
+            continue;
+        }
+        struct rect placed = { list->rect.x, y, row->rect.w, MUI_LIST_ROW_HEIGHT };
+        if (placed.x != row->rect.x || placed.y != row->rect.y || placed.h != row->rect.h) {
+            mui_tree_invalidate(tree, row->rect);
+            row->rect = placed;
+            mui_tree_invalidate(tree, row->rect);
+        }
+        y += MUI_LIST_ROW_HEIGHT;
+    }
+}
+
+static void tree_layout(struct mui_tree *tree) {
+    if (!tree->layout_dirty) {
+        return;
+    }
+    for (int i = 0; i < tree->count; ++i) {
+        if (tree->widgets[i].type == MUI_WIDGET_LIST) {
+            layout_list(tree, i);
+        }
+    }
+    tree->layout_dirty = 0;
+}
+
+struct rect mui_tree_take_dirty(struct mui_tree *tree) {
+    tree_layout(tree);
+    struct rect dirty = tree->dirty;
+    tree->dirty = (struct rect){ 0, 0, 0, 0 };
+    return dirty;
+}
+
+void mui_set_text(struct mui_tree *tree, int id, const char *text) {
+    if (!valid_id(tree, id) || !text) {
+        return;
+    }
+    struct mui_widget *w = &tree->widgets[id];
+    if (text_equal(w->text, text)) {
+        return;
+    }
+    mui_tree_invalidate(tree, w->rect);
+    uint32_t len = 0;
+    while (len + 1 < MUI_WIDGET_TEXT && text[len] != '\0') {
+        w->text[len] = text[len];
+        len++;
+    }
+    w->text[len] = '\0';
+    if (w->type == MUI_WIDGET_LABEL) {
+        w->rect.w = (int)len * 8;
+        w->rect.h = 8;
+        if (w->parent >= 0) {
+            w->rect.h = MUI_LIST_ROW_HEIGHT;
+        }
+    }
+    mui_tree_invalidate(tree, w->rect);
+}
+
+void mui_set_colors(struct mui_tree *tree, int id, uint32_t fg, uint32_t bg) {
+    if (!valid_id(tree, id)) {
+        return;
+    }
+    struct mui_widget *w = &tree->widgets[id];
+    if (w->fg == fg && w->bg == bg) {
+        return;
+    }
+    w->fg = fg;
+    w->bg = bg;
+    mui_tree_invalidate(tree, w->rect);
+}
+
+void mui_set_value(struct mui_tree *tree, int id, uint32_t value, uint32_t max_value) {
+    if (!valid_id(tree, id)) {
+        return;
+    }
+    struct mui_widget *w = &tree->widgets[id];
+    if (w->value == value && w->max_value == max_value) {
+        return;
+    }
+    w->value = value;
+    w->max_value = max_value;
+    mui_tree_invalidate(tree, w->rect);
+}
+
+void mui_set_selected(struct mui_tree *tree, int id, int selected) {
+    if (!valid_id(tree, id)) {
+        return;
+    }
+    struct mui_widget *w = &tree->widgets[id];
+    uint8_t value = selected ? 1 : 0;
+    if (w->selected == value) {
+        return;
+    }
+    mui_tree_invalidate(tree, widget_extent(w));
+    w->selected = value;
+    mui_tree_invalidate(tree, widget_extent(w));
+}
+
+void mui_set_visible(struct mui_tree *tree, int id, int visible) {
+    if (!valid_id(tree, id)) {
+        return;
+    }
+    struct mui_widget *w = &tree->widgets[id];
+    uint8_t value = visible ? 1 : 0;
+    if (w->visible == value) {
+        return;
+    }
+    w->visible = value;
+    mui_tree_invalidate(tree, widget_extent(w));
+    if (w->parent >= 0) {
+        tree->layout_dirty = 1;
+    }
+}
+
+static int widget_shown(const struct mui_tree *tree, int id) {
+    while (id >= 0) {
+        if (!tree->widgets[id].visible) {
+            return 0;
+        }
+        id = tree->widgets[id].parent;
+    }
+    return 1;
+}
+
+int mui_tree_hit(struct mui_tree *tree, int x, int y) {
+    if (!tree) {
+        return -1;
+    }
+    tree_layout(tree);
+    for (int i = tree->count - 1; i >= 0; --i) {
+        const struct mui_widget *w = &tree->widgets[i];
+        if (w->type != MUI_WIDGET_BUTTON || !widget_shown(tree, i)) {
+            continue;
+        }
+        if (point_in_rect(x, y, w->rect)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void mui_tree_render(const struct mui_tree *tree, const struct draw_ctx *ctx) {
+    if (!tree) {
+        return;
+    }
+    for (int i = 0; i < tree->count; ++i) {
+        const struct mui_widget *w = &tree->widgets[i];
+        if (!widget_shown(tree, i) || !draw_visible(ctx, widget_extent(w))) {
+            continue;
+        }
+        switch (w->type) {
+        case MUI_WIDGET_LABEL:
+            draw_string(ctx, w->rect.x, w->rect.y, w->text, w->fg, w->bg);
+            break;
+        case MUI_WIDGET_BUTTON:
+            if (w->selected) {
+                draw_fill_rect_excluding(ctx, widget_extent(w), &w->rect, 1, rgb(20, 20, 20));
+            }
+            mui_draw_button(ctx, w->rect, w->text, w->bg, w->fg);
+            break;
+        case MUI_WIDGET_PROGRESS:
+            mui_draw_progress(ctx, w->rect, w->value, w->max_value, w->fg, w->bg);
+            break;
+        default:
+            break;
+        }
+    }
+}
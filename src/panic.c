@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 static const struct framebuffer *panic_fb;
+static panic_flush_fn panic_flush;
 
 static void vga_panic(const char *msg) {
     volatile uint16_t *vga = (uint16_t *)0xB8000;
@@ -27,8 +28,12 @@ void panic_set_framebuffer(const struct framebuffer *fb) {
     panic_fb = fb;
 }
 
+void panic_set_flush(panic_flush_fn fn) {
+    panic_flush = fn;
+}
+
 static void fb_panic(const char *msg) {
-    if (!panic_fb || !panic_fb->base || panic_fb->bpp != 32) {
+    if (!panic_fb || !panic_fb->base || panic_fb->format == FB_FORMAT_UNKNOWN) {
         return;
     }
     struct rect banner = { 0, 0, (int)panic_fb->width, 48 };
@@ -47,6 +52,9 @@ void panic(const char *msg) {
     log_puts("\n");
     vga_panic(msg);
     fb_panic(msg);
+    if (panic_flush) {
+        panic_flush();
+    }
     for (;;) {
         __asm__ volatile ("cli; hlt");
     }
@@ -24,6 +24,34 @@ uint8_t pci_read_config8(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset)
     return (uint8_t)(value >> ((offset & 3u) * 8u));
 }
 
+void pci_write_config32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDR, pci_address(bus, dev, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_write_config16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2u) * 8u;
+    uint32_t dword = pci_read_config32(bus, dev, func, offset);
+    dword &= ~(0xFFFFu << shift);
+    dword |= (uint32_t)value << shift;
+    pci_write_config32(bus, dev, func, offset, dword);
+}
+
+void pci_enable_bus_master(uint8_t bus, uint8_t dev, uint8_t func) {
+    uint16_t cmd = pci_read_config16(bus, dev, func, 0x04);
+    cmd |= (1u << 1) | (1u << 2);
+    pci_write_config16(bus, dev, func, 0x04, cmd);
+}
+
+uint8_t pci_enable_intx(uint8_t bus, uint8_t dev, uint8_t func) {
+    if (pci_read_config8(bus, dev, func, 0x3D) == 0) {
+        return 0xFF;
+    }
+    uint16_t cmd = pci_read_config16(bus, dev, func, 0x04);
+    pci_write_config16(bus, dev, func, 0x04, (uint16_t)(cmd & ~(1u << 10)));
+    return pci_read_config8(bus, dev, func, 0x3C);
+}
+
 void pci_scan(pci_device_cb cb, void *ctx) {
     if (!cb) {
         return;
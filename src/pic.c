@@ -0,0 +1,86 @@
+#include "pic.h"
+#include "portio.h"
+
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+
+#define PIC_ICW1_INIT 0x11
+#define PIC_ICW4_8086 0x01
+#define PIC_READ_ISR 0x0B
+#define PIC_EOI 0x20
+#define PIC_CASCADE_IRQ 2
+
+static void io_wait(void) {
+    outb(0x80, 0);
+}
+
+void pic_init(void) {
+    outb(PIC1_CMD, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC2_CMD, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC1_DATA, PIC_IRQ_BASE);
+    io_wait();
+    outb(PIC2_DATA, PIC_IRQ_BASE + 8);
+    io_wait();
+    outb(PIC1_DATA, 1u << PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC2_DATA, PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC1_DATA, PIC_ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, PIC_ICW4_8086);
+    io_wait();
+
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_unmask(uint8_t irq) {
+    if (irq >= PIC_IRQ_COUNT) {
+        return;
+    }
+    if (irq < 8) {
+        outb(PIC1_DATA, (uint8_t)(inb(PIC1_DATA) & ~(1u << irq)));
+        return;
+    }
+    outb(PIC2_DATA, (uint8_t)(inb(PIC2_DATA) & ~(1u << (irq - 8))));
+    outb(PIC1_DATA, (uint8_t)(inb(PIC1_DATA) & ~(1u << PIC_CASCADE_IRQ)));
+}
+
+void pic_mask(uint8_t irq) {
+    if (irq >= PIC_IRQ_COUNT) {
+        return;
+    }
+    if (irq < 8) {
+        outb(PIC1_DATA, (uint8_t)(inb(PIC1_DATA) | (1u << irq)));
+        return;
+    }
+    outb(PIC2_DATA, (uint8_t)(inb(PIC2_DATA) | (1u << (irq - 8))));
+}
+
+int pic_spurious(uint8_t irq) {
+    switch (irq) {
+    case 7:
+        outb(PIC1_CMD, PIC_READ_ISR);
+        return (inb(PIC1_CMD) & 0x80) == 0;
+    case 15:
+        outb(PIC2_CMD, PIC_READ_ISR);
+        if ((inb(PIC2_CMD) & 0x80) == 0) {
+            outb(PIC1_CMD, PIC_EOI);
+            return 1;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+void pic_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_CMD, PIC_EOI);
+    }
+    outb(PIC1_CMD, PIC_EOI);
+}
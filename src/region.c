@@ -0,0 +1,73 @@
+#include "region.h"
+
+void region_init(struct region *region, struct rect r) {
+    region->count = 0;
+    if (r.w > 0 && r.h > 0) {
+        region->rects[region->count++] = r;
+    }
+}
+
+static int split_rect(struct rect r, struct rect cut, struct rect *out) {
+    int n = 0;
+    int r_x1 = r.x + r.w;
+    int r_y1 = r.y + r.h;
+    int c_x1 = cut.x + cut.w;
+    int c_y1 = cut.y + cut.h;
+    if (cut.y > r.y) {
+        out[n++] = (struct rect){ r.x, r.y, r.w, cut.y - r.y };
+    }
+    if (c_y1 < r_y1) {
+        out[n++] = (struct rect){ r.x, c_y1, r.w, r_y1 - c_y1 };
+    }
+    if (cut.x > r.x) {
+        out[n++] = (struct rect){ r.x, cut.y, cut.x - r.x, cut.h };
+    }
+    if (c_x1 < r_x1) {
+        out[n++] = (struct rect){ c_x1, cut.y, r_x1 - c_x1, cut.h };
+    }
+    return n;
+}
+
+int region_subtract(struct region *region, struct rect r) {
+    if (r.w <= 0 || r.h <= 0) {
+        return 1;
+    }
+    struct rect pieces[REGION_MAX_RECTS];
+    int count = 0;
+    for (int i = 0; i < region->count; ++i) {
+        struct rect cur = region->rects[i];
+        struct rect cut = rect_intersect(cur, r);
+        if (cut.w <= 0 || cut.h <= 0) {
+            if (count >= REGION_MAX_RECTS) {
+                return 0;
+            }
+            pieces[count++] = cur;
+            continue;
+        }
+        struct rect split[4];
+        int n = split_rect(cur, cut, split);
+        if (count + n > REGION_MAX_RECTS) {
+            return 0;
+        }
+        for (int j = 0; j < n; ++j) {
+            pieces[count++] = split[j];
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        region->rects[i] = pieces[i];
+    }
+    region->count = count;
+    return 1;
+}
+
+int region_empty(const struct region *region) {
+    return region->count == 0;
+}
+
+uint32_t region_area(const struct region *region) {
+    uint32_t area = 0;
+    for (int i = 0; i < region->count; ++i) {
+        area += (uint32_t)region->rects[i].w * (uint32_t)region->rects[i].h;
+    }
+    return area;
+}
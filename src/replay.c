@@ -0,0 +1,220 @@
+#include "replay.h"
+#include "input.h"
+#include "log.h"
+#include "timer.h"
+#include "vfs.h"
+
+#define REPLAY_MAX_DIGITS 9
+
+enum replay_mode {
+    REPLAY_IDLE = 0,
+    REPLAY_RECORDING,
+    REPLAY_LOADED,
+    REPLAY_PLAYING
+};
+
+struct replay_entry {
+    uint32_t us;
+    struct input_event event;
+};
+
+static struct replay_entry entries[REPLAY_MAX_EVENTS];
+static uint32_t entry_count;
+static uint32_t entry_next;
+static uint64_t base_tsc;
+static enum replay_mode mode;
+
+static void record_event(const struct input_event *event) {
+    if (mode != REPLAY_RECORDING) {
+        return;
+    }
+    if (event->type == INPUT_EVENT_KEY && event->key == KEY_RECORD) {
+        return;
+    }
+    struct replay_entry *entry = &entries[entry_count++];
+    entry->us = event->tsc > base_tsc ? timer_tsc_to_us(event->tsc - base_tsc) : 0;
+    entry->event = *event;
+    if (entry_count == REPLAY_MAX_EVENTS) {
+        replay_record_finish();
+    }
+}
+
+void replay_record_start(uint64_t now_tsc) {
+    if (mode == REPLAY_LOADED || mode == REPLAY_PLAYING) {
+        return;
+    }
+    entry_count = 0;
+    base_tsc = now_tsc;
+    mode = REPLAY_RECORDING;
+    input_set_recorder(record_event);
+    log_puts("Input recording started, F5 to stop\n");
+}
+
+static void log_signed(int value) {
+    if (value < 0) {
+        log_putc('-');
+        value = -value;
+    }
+    log_dec32((uint32_t)value);
+}
+
+void replay_record_finish(void) {
+    if (mode != REPLAY_RECORDING) {
+        return;
+    }
+    input_set_recorder(0);
+    mode = REPLAY_IDLE;
+    log_puts("REC-BEGIN ");
+    log_dec32(entry_count);
+    log_puts("\n");
+    for (uint32_t i = 0; i < entry_count; ++i) {
+        const struct replay_entry *entry = &entries[i];
+        log_puts("REC ");
+        log_dec32(entry->us);
+        log_putc(' ');
+        log_dec32(entry->event.device);
+        log_putc(' ');
+        log_dec32(entry->event.type);
+        log_putc(' ');
+        log_dec32(entry->event.key);
+        log_putc(' ');
+        log_dec32(entry->event.buttons);
+        log_putc(' ');
+        log_signed(entry->event.dx);
+        log_putc(' ');
+        log_signed(entry->event.dy);
+        log_putc('\n');
+    }
+    log_puts("REC-END\n");
+}
+
+int replay_recording(void) {
+    return mode == REPLAY_RECORDING;
+}
+
+static const char *parse_int(const char *p, int *out) {
+    while (*p == ' ') {
+        p++;
+    }
+    int negative = 0;
+    if (*p == '-') {
+        negative = 1;
+        p++;
+    }
+    if (*p < '0' || *p > '9') {
+        return 0;
+    }
+    int value = 0;
+    int digits = 0;
+    while (*p >= '0' && *p <= '9') {
+        if (++digits > REPLAY_MAX_DIGITS) {
+            return 0;
+        }
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    *out = negative ? -value : value;
+    return p;
+}
+
+static void parse_line(const char *line) {
+    if (line[0] != 'R' || line[1] != 'E' || line[2] != 'C' || line[3] != ' ') {
+        return;
+    }
+    int fields[7];
+    const char *p = line + 4;
+    for (int i = 0; i < 7; ++i) {
+        p = parse_int(p, &fields[i]);
+        if (!p) {
+            return;
+        }
+    }
+    if (fields[0] < 0 || fields[1] < 0 || fields[1] >= INPUT_DEVICE_COUNT || entry_count == REPLAY_MAX_EVENTS) {
+        return;
+    }
+    if (entry_count > 0 && (uint32_t)fields[0] < entries[entry_count - 1].us) {
+        return;
+    }
+    struct replay_entry *entry = &entries[entry_count++];
+    entry->us = (uint32_t)fields[0];
+    entry->event.tsc = 0;
+    entry->event.device = (uint8_t)fields[1];
+    entry->event.type = fields[2] == INPUT_EVENT_KEY ? INPUT_EVENT_KEY : INPUT_EVENT_MOUSE;
+    entry->event.key = (uint8_t)fields[3];
+    entry->event.buttons = (uint8_t)(fields[4] & 0x07);
+    entry->event.dx = (int16_t)fields[5];
+    entry->event.dy = (int16_t)fields[6];
+}
+
+int replay_load(const char *name) {
+    static struct vfs_file file;
+    static uint8_t buf[512];
+    char line[96];
+    uint32_t len = 0;
+    if (mode != REPLAY_IDLE || !vfs_open(name, &file)) {
+        return 0;
+    }
+    entry_count = 0;
+    for (;;) {
+        uint32_t got = vfs_read(&file, buf, sizeof(buf));
+        if (got == 0) {
+            break;
+        }
+        for (uint32_t i = 0; i < got; ++i) {
+            char c = (char)buf[i];
+            if (c == '\n' || c == '\r') {
+                line[len] = '\0';
+                parse_line(line);
+                len = 0;
+            } else if (len + 1u < sizeof(line)) {
+                line[len++] = c;
+            }
+        }
+    }
+    line[len] = '\0';
+    parse_line(line);
+    if (entry_count == 0) {
+        return 0;
+    }
+    mode = REPLAY_LOADED;
+    log_puts("Replay: ");
+    log_puts(name);
+    log_puts(", ");
+    log_dec32(entry_count);
+    log_puts(" events over ");
+    log_dec32(entries[entry_count - 1].us / 1000u);
+    log_puts(" ms\n");
+    return 1;
+}
+
+void replay_start(uint64_t now_tsc) {
+    if (mode != REPLAY_LOADED) {
+        return;
+    }
+    entry_next = 0;
+    base_tsc = now_tsc;
+    mode = REPLAY_PLAYING;
+    input_set_live(0);
+}
+
+int replay_active(void) {
+    return mode == REPLAY_PLAYING;
+}
+
+int replay_poll(uint64_t now_tsc) {
+    if (mode != REPLAY_PLAYING) {
+        return 0;
+    }
+    uint32_t elapsed = timer_tsc_to_us(now_tsc - base_tsc);
+    while (entry_next < entry_count && entries[entry_next].us <= elapsed) {
+        input_inject_event(&entries[entry_next].event);
+        entry_next++;
+    }
+    if (entry_next < entry_count || elapsed < entries[entry_count - 1].us + REPLAY_TAIL_US) {
+        return 0;
+    }
+    mode = REPLAY_IDLE;
+    input_set_live(1);
+    log_puts("Replay finished\n");
+    return 1;
+}
@@ -0,0 +1,256 @@
+#include "tile.h"
+#include "memory.h"
+
+int tile_renderer_init(struct tile_renderer *tiles, const struct framebuffer *fb) {
+    if (!tiles || !fb) {
+        return 0;
+    }
+    tiles->fb = fb;
+    tiles->cols = (fb->width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles->rows = (fb->height + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t count = tiles->cols * tiles->rows;
+    uint32_t pages = (count * 6u + 4095u) / 4096u;
+    uint32_t addr = phys_alloc_pages(pages);
+    if (addr == 0) {
+        return 0;
+    }
+    tiles->bin_start = (uint16_t *)(uintptr_t)addr;
+    tiles->bin_count = tiles->bin_start + count;
+    tiles->dirty = (uint8_t *)(tiles->bin_count + count);
+    tiles->prev_dirty = tiles->dirty + count;
+    tiles->list = (struct draw_list *)kmalloc(sizeof(struct draw_list), 16);
+    tiles->bins = (uint16_t *)kmalloc(TILE_BIN_POOL * sizeof(uint16_t), 16);
+    if (!tiles->list || !tiles->bins) {
+        return 0;
+    }
+    draw_list_clear(tiles->list);
+    for (uint32_t i = 0; i < count; ++i) {
+        tiles->dirty[i] = 0;
+        tiles->prev_dirty[i] = 1;
+    }
+    tiles->dirty_count = 0;
+    tiles->next = count;
+    return 1;
+}
+
+struct rect tile_rect(const struct tile_renderer *tiles, uint32_t index) {
+    struct rect r = {
+        (int)((index % tiles->cols) * TILE_SIZE),
+        (int)((index / tiles->cols) * TILE_SIZE),
+        TILE_SIZE,
+        TILE_SIZE
+    };
+    return rect_intersect(r, fb_bounds(tiles->fb));
+}
+
+static int tile_span(struct rect r, const struct tile_renderer *tiles,
+                     uint32_t *c0, uint32_t *c1, uint32_t *r0, uint32_t *r1) {
+    r = rect_intersect(r, fb_bounds(tiles->fb));
+    if (r.w <= 0 || r.h <= 0) {
+        return 0;
+    }
+    *c0 = (uint32_t)r.x / TILE_SIZE;
+    *r0 = (uint32_t)r.y / TILE_SIZE;
+    *c1 = (uint32_t)(r.x + r.w - 1) / TILE_SIZE;
+    *r1 = (uint32_t)(r.y + r.h - 1) / TILE_SIZE;
+    return 1;
+}
+
+void tile_begin_frame(struct tile_renderer *tiles, const struct damage_list *damage, uint32_t buffer_age) {
+    uint32_t count = tiles->cols * tiles->rows;
+    for (uint32_t i = 0; i < count; ++i) {
+        tiles->dirty[i] = 0;
+    }
+    for (int d = 0; damage && d < damage->count; ++d) {
+        uint32_t c0, c1, r0, r1;
+        if (!tile_span(damage->rects[d], tiles, &c0, &c1, &r0, &r1)) {
+            continue;
+        }
+        for (uint32_t row = r0; row <= r1; ++row) {
+            for (uint32_t col = c0; col <= c1; ++col) {
+                tiles->dirty[row * tiles->cols + col] = 1;
+            }
+        }
+    }
+
+    tiles->dirty_count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t now = tiles->dirty[i];
+        if (buffer_age != 1) {
+            tiles->dirty[i] |= tiles->prev_dirty[i];
+        }
+        tiles->prev_dirty[i] = now;
+        if (tiles->dirty[i]) {
+            tiles->dirty_count++;
+        }
+    }
+    if (buffer_age == 0 || buffer_age > 2) {
+        tile_mark_all(tiles);
+    }
+    draw_list_clear(tiles->list);
+}
+
+void tile_mark_all(struct tile_renderer *tiles) {
+    uint32_t count = tiles->cols * tiles->rows;
+    for (uint32_t i = 0; i < count; ++i) {
+        tiles->dirty[i] = 1;
+    }
+    tiles->dirty_count = count;
+}
+
+struct rect tile_dirty_bounds(const struct tile_renderer *tiles) {
+    struct rect bounds = { 0, 0, 0, 0 };
+    uint32_t count = tiles->cols * tiles->rows;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (tiles->dirty[i]) {
+            bounds = rect_union(bounds, tile_rect(tiles, i));
+        }
+    }
+    return bounds;
+}
+
+int tile_bin(struct tile_renderer *tiles) {
+    const struct draw_list *list = tiles->list;
+    uint32_t count = tiles->cols * tiles->rows;
+    for (uint32_t i = 0; i < count; ++i) {
+        tiles->bin_count[i] = 0;
+    }
+    for (uint32_t c = 0; c < list->count; ++c) {
+        uint32_t c0, c1, r0, r1;
+        if (!tile_span(list->cmds[c].bounds, tiles, &c0, &c1, &r0, &r1)) {
+            continue;
+        }
+        for (uint32_t row = r0; row <= r1; ++row) {
+            for (uint32_t col = c0; col <= c1; ++col) {
+                uint32_t t = row * tiles->cols + col;
+                if (tiles->dirty[t]) {
+                    tiles->bin_count[t]++;
+                }
+            }
+        }
+    }
+
+    uint32_t offset = 0;
+    int complete = 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!tiles->dirty[i]) {
+            continue;
+        }
+        if (offset + tiles->bin_count[i] > TILE_BIN_POOL) {
+            tiles->bin_count[i] = TILE_BIN_ALL;
+            complete = 0;
+            continue;
+        }
+        tiles->bin_start[i] = (uint16_t)offset;
+        offset += tiles->bin_count[i];
+        tiles->bin_count[i] = 0;
+    }
+
+    for (uint32_t c = 0; c < list->count; ++c) {
+        uint32_t c0, c1, r0, r1;
+        if (!tile_span(list->cmds[c].bounds, tiles, &c0, &c1, &r0, &r1)) {
+            continue;
+        }
+        for (uint32_t row = r0; row <= r1; ++row) {
+            for (uint32_t col = c0; col <= c1; ++col) {
+                uint32_t t = row * tiles->cols + col;
+                if (tiles->dirty[t] && tiles->bin_count[t] != TILE_BIN_ALL) {
+                    tiles->bins[tiles->bin_start[t] + tiles->bin_count[t]++] = (uint16_t)c;
+                }
+            }
+        }
+    }
+    return complete;
+}
+
+static void replay(const struct framebuffer *fb, const struct draw_list *list,
+                   const struct draw_cmd *cmd, struct rect clip) {
+    struct rect r = rect_intersect(cmd->bounds, clip);
+    if (r.w <= 0 || r.h <= 0) {
+        return;
+    }
+    switch (cmd->op) {
+    case DRAW_OP_FILL:
+        fb_fill_rect(fb, r, cmd->color0);
+        break;
+    case DRAW_OP_GRADIENT:
+        fb_draw_vertical_gradient_clip(fb, cmd->color0, cmd->color1, r);
+        break;
+    case DRAW_OP_TEXT:
+        fb_draw_string_clip(fb, cmd->x, cmd->y, &list->text[cmd->text], cmd->color0, cmd->color1, r);
+        break;
+    case DRAW_OP_IMAGE:
+        fb_draw_image_clip(fb, cmd->x, cmd->y, cmd->image, r);
+        break;
+    default:
+        break;
+    }
+}
+
+void tile_render(const struct tile_renderer *tiles, uint32_t index) {
+    const struct draw_list *list = tiles->list;
+    struct rect clip = tile_rect(tiles, index);
+    if (tiles->bin_count[index] == TILE_BIN_ALL) {
+        for (uint32_t c = 0; c < list->count; ++c) {
+            replay(tiles->fb, list, &list->cmds[c], clip);
+        }
+        return;
+    }
+    const uint16_t *bin = &tiles->bins[tiles->bin_start[index]];
+    for (uint32_t i = 0; i < tiles->bin_count[index]; ++i) {
+        replay(tiles->fb, list, &list->cmds[bin[i]], clip);
+    }
+}
+
+int tile_prepare(struct tile_renderer *tiles) {
+    if (tiles->list->overflow) {
+        tiles->next = tiles->cols * tiles->rows;
+        return 0;
+    }
+    tile_bin(tiles);
+    tiles->next = 0;
+    return 1;
+}
+
+int tile_render_next(struct tile_renderer *tiles) {
+    uint32_t count = tiles->cols * tiles->rows;
+    while (tiles->next < count && !tiles->dirty[tiles->next]) {
+        tiles->next++;
+    }
+    if (tiles->next == count) {
+        return 0;
+    }
+    tile_render(tiles, tiles->next++);
+    return 1;
+}
+
+void tile_dirty_damage(const struct tile_renderer *tiles, struct damage_list *out) {
+    damage_clear(out);
+    for (uint32_t row = 0; row < tiles->rows; ++row) {
+        uint32_t col = 0;
+        while (col < tiles->cols) {
+            if (!tiles->dirty[row * tiles->cols + col]) {
+                col++;
+                continue;
+            }
+            uint32_t start = col;
+            while (col < tiles->cols && tiles->dirty[row * tiles->cols + col]) {
+                col++;
+            }
+            struct rect run = rect_union(tile_rect(tiles, row * tiles->cols + start),
+                                         tile_rect(tiles, row * tiles->cols + col - 1));
+            int merged = 0;
+            for (int i = 0; i < out->count; ++i) {
+                struct rect *above = &out->rects[i];
+                if (above->x == run.x && above->w == run.w && above->y + above->h == run.y) {
+                    above->h += run.h;
+                    merged = 1;
+                    break;
+                }
+            }
+            if (!merged) {
+                damage_add(out, run);
+            }
+        }
+    }
+}
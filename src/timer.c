@@ -0,0 +1,88 @@
+#include "timer.h"
+#include "log.h"
+#include "portio.h"
+
+#define PIT_HZ 1193182u
+#define PIT_CALIBRATE_MS 10u
+
+static uint32_t tsc_khz;
+static uint32_t us_per_tsc_q32;
+
+static uint32_t div64_32(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q;
+    uint32_t r;
+    __asm__ ("divl %4" : "=a"(q), "=d"(r) : "a"(lo), "d"(hi % d), "rm"(d));
+    (void)r;
+    return q;
+}
+
+uint64_t timer_tsc(void) {
+    uint32_t lo;
+    uint32_t hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t calibrate_tsc_khz(void) {
+    uint16_t count = (uint16_t)(PIT_HZ / (1000u / PIT_CALIBRATE_MS));
+    uint8_t gate = inb(0x61);
+    outb(0x61, (uint8_t)((gate & ~0x02u) | 0x01u));
+    outb(0x43, 0xB0);
+    outb(0x42, (uint8_t)(count & 0xFF));
+    outb(0x42, (uint8_t)(count >> 8));
+
+    uint64_t start = timer_tsc();
+    uint32_t guard = 0;
+    while ((inb(0x61) & 0x20) == 0 && guard < 100000000u) {
+        guard++;
+    }
+    uint64_t end = timer_tsc();
+    outb(0x61, gate);
+
+    uint64_t delta = end - start;
+    if (guard >= 100000000u || delta == 0) {
+        return 0;
+    }
+    return div64_32(delta, PIT_CALIBRATE_MS);
+}
+
+void timer_init(void) {
+    tsc_khz = calibrate_tsc_khz();
+    if (tsc_khz < 1000u) {
+        log_puts("TSC calibration failed, assuming 1 GHz\n");
+        tsc_khz = 1000000u;
+    }
+    us_per_tsc_q32 = div64_32((uint64_t)1000u << 32, tsc_khz);
+    log_puts("TSC: ");
+    log_dec32(tsc_khz / 1000u);
+    log_puts(" MHz\n");
+}
+
+uint32_t timer_tsc_khz(void) {
+    return tsc_khz;
+}
+
+uint64_t timer_us_to_tsc(uint32_t us) {
+    uint64_t whole = (uint64_t)us * (tsc_khz / 1000u);
+    return whole + div64_32((uint64_t)us * (tsc_khz % 1000u), 1000u);
+}
+
+uint32_t timer_tsc_to_us(uint64_t delta) {
+    uint64_t lo = ((uint64_t)(uint32_t)delta * us_per_tsc_q32) >> 32;
+    uint64_t hi = (uint64_t)(uint32_t)(delta >> 32) * us_per_tsc_q32;
+    uint64_t us = lo + hi;
+    return us > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+uint32_t timer_us_to_ms(uint64_t us) {
+    return div64_32(us, 1000u);
+}
+
+uint64_t timer_us(void) {
+    uint64_t tsc = timer_tsc();
+    uint64_t lo = ((uint64_t)(uint32_t)tsc * us_per_tsc_q32) >> 32;
+    uint64_t hi = (uint64_t)(uint32_t)(tsc >> 32) * us_per_tsc_q32;
+    return lo + hi;
+}
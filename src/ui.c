@@ -1,9 +1,14 @@
 #include <stdint.h>
 
 #include "ui.h"
+#include "draw.h"
+#include "frame.h"
 #include "framebuffer.h"
 #include "input.h"
 #include "magicui.h"
+#include "region.h"
+#include "replay.h"
+#include "timer.h"
 #include "ui_apps.h"
 
 static void handle_menu_action(struct ui_state *state, int index) {
@@ -13,21 +18,38 @@ static void handle_menu_action(struct ui_state *state, int index) {
     }
 }
 
-static struct rect *drag_rect(struct ui_state *state) {
-    if (!state) {
-        return 0;
-    }
-    if (state->drag_app_id < 0 || state->drag_app_id >= ui_app_count()) {
-        return 0;
-    }
-    return ui_app_rect_mut(state, (enum ui_app_id)state->drag_app_id);
-}
-
 static struct rect menu_item_rect(struct rect panel, int index) {
     struct rect item = { panel.x + 8, panel.y + 10 + index * 42, 164, 28 };
     return item;
 }
 
+static struct rect menu_panel_rect(const struct framebuffer *fb) {
+    int app_count = ui_app_count();
+    int taskbar_y = (int)fb->height - 32;
+    struct rect panel = { 8, taskbar_y - (app_count * 42 + 12), 180, app_count * 42 + 12 };
+    return panel;
+}
+
+static void damage_screen(struct ui_state *state, const struct framebuffer *fb) {
+    struct rect screen = { 0, 0, (int)fb->width, (int)fb->height };
+    damage_add(&state->damage, screen);
+}
+
+static void damage_theme(struct ui_state *state, const struct framebuffer *fb, struct rect start_btn) {
+    if (!state->wallpaper) {
+        damage_screen(state, fb);
+        return;
+    }
+    damage_add(&state->damage, start_btn);
+    if (state->menu_open) {
+        damage_add(&state->damage, menu_panel_rect(fb));
+    }
+    int window_count = wm_count(&state->wm);
+    for (int z = 0; z < window_count; ++z) {
+        damage_add(&state->damage, mui_window_titlebar_rect(wm_rect(&state->wm, wm_at_depth(&state->wm, z))));
+    }
+}
+
 static void clamp_rect(struct rect *r, const struct framebuffer *fb) {
     if (!r || !fb) {
         return;
@@ -57,46 +79,106 @@ static void clamp_rect(struct rect *r, const struct framebuffer *fb) {
 void ui_init(struct ui_state *state, const struct framebuffer *fb, const struct system_info *info) {
     state->menu_open = 1;
     state->menu_index = 0;
-    state->apps_open = 0;
-    state->settings_open = 0;
-    state->files_open = 0;
-    state->usb_open = 0;
-    state->test_open = 0;
+    wm_init(&state->wm, fb->width, fb->height);
+    ui_app_register_windows(state);
     state->mouse_buttons = 0;
     state->prev_mouse_buttons = 0;
     state->mouse_x = (int)fb->width / 2;
     state->mouse_y = (int)fb->height / 2;
     state->theme_index = 2;
-    state->drag_app_id = -1;
+    state->hud_visible = 0;
+    state->heatmap_visible = 0;
+    state->drag_window = -1;
+    state->wallpaper = 0;
     state->drag_offset_x = 0;
     state->drag_offset_y = 0;
-    state->apps_rect = (struct rect){ 90, 90, 320, 200 };
-    state->settings_rect = (struct rect){ 150, 120, 420, 260 };
-    state->files_rect = (struct rect){ 220, 100, 320, 220 };
-    state->usb_rect = (struct rect){ 260, 160, 360, 220 };
-    state->test_rect = (struct rect){ 300, 120, 340, 200 };
+    console_viewport_init(&state->console.port, 0);
+    state->usb.generation = 0;
+    state->usb.valid = 0;
+    state->usb.controller_count = 0;
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        state->usb.devices[i].addr = 0;
+    }
+    state->settings.built = 0;
     if (info) {
         state->info = *info;
     } else {
         state->info.version[0] = '\0';
         state->info.kernel[0] = '\0';
         state->info.cpu[0] = '\0';
+        state->info.display[0] = '\0';
         state->info.ram_kb = 0;
         state->info.width = fb->width;
         state->info.height = fb->height;
         state->info.bpp = fb->bpp;
     }
+    damage_clear(&state->damage);
+    damage_screen(state, fb);
+}
+
+void ui_set_wallpaper(struct ui_state *state, const struct framebuffer *fb, const struct framebuffer *wallpaper) {
+    state->wallpaper = wallpaper;
+    damage_screen(state, fb);
+}
+
+static enum key_action read_input(struct ui_state *state, const struct framebuffer *fb) {
+    enum key_action key = KEY_NONE;
+    struct input_event event;
+    input_pump();
+    while (key == KEY_NONE && input_next_event(&event)) {
+        if (event.type == INPUT_EVENT_KEY) {
+            key = (enum key_action)event.key;
+            continue;
+        }
+        state->mouse_x += event.dx;
+        state->mouse_y -= event.dy;
+        if (event.buttons != state->mouse_buttons) {
+            state->mouse_buttons = event.buttons;
+            break;
+        }
+    }
+
+    if (state->mouse_x < 0) {
+        state->mouse_x = 0;
+    }
+    if (state->mouse_y < 0) {
+        state->mouse_y = 0;
+    }
+    if (state->mouse_x > (int)fb->width - 1) {
+        state->mouse_x = (int)fb->width - 1;
+    }
+    if (state->mouse_y > (int)fb->height - 1) {
+        state->mouse_y = (int)fb->height - 1;
+    }
+    return key;
 }
 
 void ui_update(struct ui_state *state, const struct framebuffer *fb) {
     int app_count = ui_app_count();
-    enum key_action key = poll_keyboard();
-    poll_mouse(state, fb);
+    enum key_action key = read_input(state, fb);
+
+    int prev_menu_open = state->menu_open;
+    int prev_menu_index = state->menu_index;
+    int prev_theme = state->theme_index;
 
     if (key == KEY_START) {
         state->menu_open = !state->menu_open;
     } else if (key == KEY_ESC) {
         state->menu_open = 0;
+    } else if (key == KEY_HUD) {
+        state->hud_visible = !state->hud_visible;
+        damage_add(&state->damage, frame_hud_rect(fb));
+    } else if (key == KEY_HEATMAP) {
+        state->heatmap_visible = !state->heatmap_visible;
+        damage_screen(state, fb);
+    } else if (key == KEY_LATENCY) {
+        input_latency_log();
+    } else if (key == KEY_RECORD) {
+        if (replay_recording()) {
+            replay_record_finish();
+        } else {
+            replay_record_start(timer_tsc());
+        }
     }
 
     if (state->menu_open) {
@@ -116,7 +198,7 @@ void ui_update(struct ui_state *state, const struct framebuffer *fb) {
 
     struct rect taskbar = { 0, (int)fb->height - 32, (int)fb->width, 32 };
     struct rect start_btn = { 8, taskbar.y + 4, 72, 24 };
-    struct rect menu_panel = { 8, taskbar.y - (app_count * 42 + 12), 180, app_count * 42 + 12 };
+    struct rect menu_panel = menu_panel_rect(fb);
 
     if (left_press) {
         int handled_click = 0;
@@ -151,78 +233,78 @@ void ui_update(struct ui_state *state, const struct framebuffer *fb) {
             }
         }
 
-        if (!handled_click) {
-            for (int i = app_count - 1; i >= 0; --i) {
-                enum ui_app_id app_id = (enum ui_app_id)i;
-                if (!ui_app_is_open(state, app_id)) {
-                    continue;
-                }
-                struct rect rect = ui_app_rect(state, app_id);
-                if (point_in_rect(state->mouse_x, state->mouse_y, mui_window_close_rect(rect))) {
-                    ui_app_set_open(state, app_id, 0);
-                    handled_click = 1;
-                    break;
-                }
+        int window = handled_click ? -1 : wm_window_at(&state->wm, state->mouse_x, state->mouse_y);
+        int owner = wm_owner(&state->wm, window);
+        if (window >= 0 && owner >= 0) {
+            enum ui_app_id app_id = (enum ui_app_id)owner;
+            struct rect rect = wm_rect(&state->wm, window);
+            if (wm_raise(&state->wm, window)) {
+                damage_add(&state->damage, rect);
             }
-        }
-
-        if (!handled_click) {
-            for (int i = app_count - 1; i >= 0; --i) {
-                enum ui_app_id app_id = (enum ui_app_id)i;
-                if (!ui_app_is_open(state, app_id)) {
-                    continue;
-                }
-                if (ui_app_handle_click(state, app_id, state->mouse_x, state->mouse_y)) {
-                    handled_click = 1;
-                    break;
-                }
+            if (point_in_rect(state->mouse_x, state->mouse_y, mui_window_close_rect(rect))) {
+                ui_app_set_open(state, app_id, 0);
+            } else if (!ui_app_handle_click(state, app_id, state->mouse_x, state->mouse_y) &&
+                       point_in_rect(state->mouse_x, state->mouse_y, mui_window_titlebar_rect(rect))) {
+                state->drag_window = window;
+                state->drag_offset_x = state->mouse_x - rect.x;
+                state->drag_offset_y = state->mouse_y - rect.y;
             }
         }
+    }
 
-        if (!handled_click) {
-            for (int i = app_count - 1; i >= 0; --i) {
-                enum ui_app_id app_id = (enum ui_app_id)i;
-                if (!ui_app_is_open(state, app_id)) {
-                    continue;
-                }
-                struct rect rect = ui_app_rect(state, app_id);
-                if (point_in_rect(state->mouse_x, state->mouse_y, mui_window_titlebar_rect(rect))) {
-                    state->drag_app_id = i;
-                    state->drag_offset_x = state->mouse_x - rect.x;
-                    state->drag_offset_y = state->mouse_y - rect.y;
-                    break;
-                }
-            }
+    if (left_down && wm_is_open(&state->wm, state->drag_window)) {
+        struct rect prev = wm_rect(&state->wm, state->drag_window);
+        struct rect next = prev;
+        next.x = state->mouse_x - state->drag_offset_x;
+        next.y = state->mouse_y - state->drag_offset_y;
+        clamp_rect(&next, fb);
+        if (next.x != prev.x || next.y != prev.y) {
+            wm_move(&state->wm, state->drag_window, next.x, next.y);
+            damage_add(&state->damage, prev);
+            damage_add(&state->damage, next);
         }
     }
 
-    if (left_down && state->drag_app_id >= 0) {
-        struct rect *r = drag_rect(state);
-        if (r) {
-            r->x = state->mouse_x - state->drag_offset_x;
-            r->y = state->mouse_y - state->drag_offset_y;
-            clamp_rect(r, fb);
+    if (left_release) {
+        state->drag_window = -1;
+    }
+
+    for (int i = 0; i < app_count; ++i) {
+        enum ui_app_id app_id = (enum ui_app_id)i;
+        if (ui_app_is_open(state, app_id)) {
+            damage_add(&state->damage, ui_app_update(state, app_id));
         }
     }
 
-    if (left_release) {
-        state->drag_app_id = -1;
+    if (state->theme_index != prev_theme) {
+        damage_theme(state, fb, start_btn);
+    }
+    if (state->menu_open != prev_menu_open ||
+        (state->menu_open && state->menu_index != prev_menu_index)) {
+        damage_add(&state->damage, menu_panel);
     }
 }
 
-void ui_render(const struct framebuffer *fb, const struct ui_state *state) {
-    uint32_t accent = mui_theme_color(state->theme_index);
+static void render_desktop(struct draw_ctx *ctx, const struct framebuffer *fb, const struct ui_state *state, uint32_t accent) {
     uint32_t top = mui_theme_background_top(state->theme_index);
     uint32_t bottom = mui_theme_background_bottom(state->theme_index);
-    fb_draw_vertical_gradient(fb, top, bottom);
-
     struct rect taskbar = { 0, (int)fb->height - 32, (int)fb->width, 32 };
-    fb_fill_rect(fb, taskbar, rgb(15, 24, 42));
-
     struct rect start_btn = { 8, taskbar.y + 4, 72, 24 };
-    mui_draw_button(fb, start_btn, "Start", accent, rgb(255, 255, 255));
+    struct rect label = { 100, taskbar.y + 10, 16 * 8, 8 };
+
+    if (draw_push_clip(ctx, (struct rect){ 0, 0, (int)fb->width, taskbar.y })) {
+        if (state->wallpaper) {
+            draw_image(ctx, 0, 0, state->wallpaper);
+        } else {
+            draw_vertical_gradient(ctx, top, bottom);
+        }
+        draw_pop(ctx);
+    }
 
-    fb_draw_string(fb, 100, taskbar.y + 10, "ExonOS Prototype", rgb(200, 210, 230), rgb(15, 24, 42));
+    struct rect holes[2] = { start_btn, label };
+    draw_fill_rect_excluding(ctx, taskbar, holes, 2, rgb(15, 24, 42));
+    mui_draw_button(ctx, start_btn, "Start", accent, rgb(255, 255, 255));
+    draw_string(ctx, label.x, label.y, "ExonOS Prototype", rgb(200, 210, 230), rgb(15, 24, 42));
 
     int app_count = ui_app_count();
     for (int i = 0; i < app_count; ++i) {
@@ -231,26 +313,97 @@ void ui_render(const struct framebuffer *fb, const struct ui_state *state) {
             continue;
         }
         struct rect icon = ui_app_desktop_icon_rect(app_id);
-        mui_draw_button(fb, icon, "USB", rgb(30, 40, 60), rgb(240, 240, 240));
-        fb_draw_string(fb, icon.x - 4, icon.y + 70, ui_app_desktop_icon_label(app_id), rgb(230, 230, 230), rgb(0, 0, 0));
+        mui_draw_button(ctx, icon, "USB", rgb(30, 40, 60), rgb(240, 240, 240));
+        draw_string(ctx, icon.x - 4, icon.y + 70, ui_app_desktop_icon_label(app_id), rgb(230, 230, 230), rgb(0, 0, 0));
     }
 
     if (state->menu_open) {
-        struct rect panel = { 8, taskbar.y - (app_count * 42 + 12), 180, app_count * 42 + 12 };
-        fb_fill_rect(fb, panel, rgb(30, 40, 60));
+        struct rect panel = menu_panel_rect(fb);
+        draw_fill_rect(ctx, panel, rgb(30, 40, 60));
 
         for (int i = 0; i < app_count; ++i) {
             struct rect item = menu_item_rect(panel, i);
-            mui_draw_button(fb, item, ui_app_menu_label((enum ui_app_id)i), state->menu_index == i ? accent : rgb(40, 52, 72), rgb(240, 240, 240));
+            mui_draw_button(ctx, item, ui_app_menu_label((enum ui_app_id)i), state->menu_index == i ? accent : rgb(40, 52, 72), rgb(240, 240, 240));
         }
     }
+}
 
-    for (int i = 0; i < app_count; ++i) {
-        enum ui_app_id app_id = (enum ui_app_id)i;
-        if (ui_app_is_open(state, app_id)) {
-            ui_app_render(app_id, fb, state, accent);
+void ui_render(struct draw_ctx *ctx, const struct ui_state *state) {
+    const struct framebuffer *fb = ctx->fb;
+    uint32_t accent = mui_theme_color(state->theme_index);
+    struct rect screen = { 0, 0, (int)fb->width, (int)fb->height };
+
+    int window_count = wm_count(&state->wm);
+    struct region desktop;
+    region_init(&desktop, screen);
+    for (int z = 0; z < window_count; ++z) {
+        region_subtract(&desktop, wm_rect(&state->wm, wm_at_depth(&state->wm, z)));
+    }
+
+    for (int r = 0; r < desktop.count; ++r) {
+        if (draw_push_clip(ctx, desktop.rects[r])) {
+            render_desktop(ctx, fb, state, accent);
+            draw_pop(ctx);
         }
     }
 
-    mui_draw_cursor(fb, state->mouse_x, state->mouse_y);
+    struct region visible;
+    for (int z = 0; z < window_count; ++z) {
+        int window = wm_at_depth(&state->wm, z);
+        region_init(&visible, rect_intersect(wm_rect(&state->wm, window), screen));
+        for (int above = z + 1; above < window_count && !region_empty(&visible); ++above) {
+            region_subtract(&visible, wm_rect(&state->wm, wm_at_depth(&state->wm, above)));
+        }
+        enum ui_app_id app_id = (enum ui_app_id)wm_owner(&state->wm, window);
+        for (int r = 0; r < visible.count; ++r) {
+            if (draw_push_clip(ctx, visible.rects[r])) {
+                ui_app_render(app_id, ctx, state, accent);
+                draw_pop(ctx);
+            }
+        }
+    }
+}
+
+static void copy_state(struct ui_state *dst, const struct ui_state *src) {
+    uint32_t words = sizeof(struct ui_state) / 4u;
+    __asm__ volatile ("rep movsl"
+                      : "+D"(dst), "+S"(src), "+c"(words)
+                      :
+                      : "memory");
+}
+
+void ui_snapshots_init(struct ui_snapshots *snaps, struct ui_state *state) {
+    damage_clear(&snaps->damage);
+    snaps->front = 0;
+    snaps->reading = 1;
+    snaps->published = 0;
+    snaps->consumed = 0;
+    ui_publish(snaps, state);
+}
+
+void ui_publish(struct ui_snapshots *snaps, struct ui_state *state) {
+    uint32_t slot = snaps->reading ^ 1u;
+    copy_state(&snaps->slots[slot], state);
+    for (int i = 0; i < state->damage.count; ++i) {
+        damage_add(&snaps->damage, state->damage.rects[i]);
+    }
+    damage_clear(&state->damage);
+    __asm__ volatile ("" : : : "memory");
+    snaps->front = slot;
+    snaps->published++;
+}
+
+int ui_snapshot_pending(const struct ui_snapshots *snaps) {
+    return snaps->published != snaps->consumed;
+}
+
+const struct ui_state *ui_acquire(struct ui_snapshots *snaps, struct damage_list *damage) {
+    snaps->reading = snaps->front;
+    __asm__ volatile ("" : : : "memory");
+    for (int i = 0; i < snaps->damage.count; ++i) {
+        damage_add(damage, snaps->damage.rects[i]);
+    }
+    damage_clear(&snaps->damage);
+    snaps->consumed = snaps->published;
+    return &snaps->slots[snaps->reading];
 }
@@ -7,7 +7,8 @@ static const char *k_menu_labels[UI_APP_COUNT] = {
     "Settings",
     "Folders",
     "USB Manager",
-    "Test App"
+    "Test App",
+    "Console"
 };
 
 static const int k_has_desktop_icon[UI_APP_COUNT] = {
@@ -15,7 +16,8 @@ static const int k_has_desktop_icon[UI_APP_COUNT] = {
     0,
     0,
     1,
-    1
+    1,
+    0
 };
 
 static const struct rect k_desktop_icon_rects[UI_APP_COUNT] = {
@@ -23,7 +25,17 @@ static const struct rect k_desktop_icon_rects[UI_APP_COUNT] = {
     { 0, 0, 0, 0 },
     { 0, 0, 0, 0 },
     { 24, 60, 64, 64 },
-    { 24, 132, 64, 64 }
+    { 24, 132, 64, 64 },
+    { 0, 0, 0, 0 }
+};
+
+static const struct rect k_default_window_rects[UI_APP_COUNT] = {
+    { 90, 90, 320, 200 },
+    { 150, 120, 420, 260 },
+    { 220, 100, 320, 220 },
+    { 260, 160, 360, 220 },
+    { 300, 120, 340, 200 },
+    { 120, 60, 500, 320 }
 };
 
 static const char *k_desktop_icon_labels[UI_APP_COUNT] = {
@@ -31,7 +43,8 @@ static const char *k_desktop_icon_labels[UI_APP_COUNT] = {
     "",
     "",
     "USB Manager",
-    "Test App"
+    "Test App",
+    ""
 };
 
 int ui_app_count(void) {
@@ -66,119 +79,113 @@ const char *ui_app_desktop_icon_label(enum ui_app_id app_id) {
     return k_desktop_icon_labels[app_id];
 }
 
+void ui_app_register_windows(struct ui_state *state) {
+    for (int i = 0; i < UI_APP_COUNT; ++i) {
+        state->app_windows[i] = wm_register(&state->wm, i, k_default_window_rects[i]);
+    }
+}
+
+int ui_app_window(const struct ui_state *state, enum ui_app_id app_id) {
+    if (!state || app_id < 0 || app_id >= UI_APP_COUNT) {
+        return -1;
+    }
+    return state->app_windows[app_id];
+}
+
 int ui_app_is_open(const struct ui_state *state, enum ui_app_id app_id) {
     if (!state) {
         return 0;
     }
-    switch (app_id) {
-    case UI_APP_APPS:
-        return state->apps_open;
-    case UI_APP_SETTINGS:
-        return state->settings_open;
-    case UI_APP_FILES:
-        return state->files_open;
-    case UI_APP_USB:
-        return state->usb_open;
-    case UI_APP_TEST:
-        return state->test_open;
-    default:
-        return 0;
-    }
+    return wm_is_open(&state->wm, ui_app_window(state, app_id));
 }
 
 void ui_app_set_open(struct ui_state *state, enum ui_app_id app_id, int open) {
     if (!state) {
         return;
     }
-    int value = open ? 1 : 0;
-    switch (app_id) {
-    case UI_APP_APPS:
-        state->apps_open = value;
-        break;
-    case UI_APP_SETTINGS:
-        state->settings_open = value;
-        break;
-    case UI_APP_FILES:
-        state->files_open = value;
-        break;
-    case UI_APP_USB:
-        state->usb_open = value;
-        break;
-    case UI_APP_TEST:
-        state->test_open = value;
-        break;
-    default:
-        break;
+    int window = ui_app_window(state, app_id);
+    if (open) {
+        if (!wm_is_open(&state->wm, window)) {
+            wm_open(&state->wm, window);
+            damage_add(&state->damage, wm_rect(&state->wm, window));
+        } else if (wm_raise(&state->wm, window)) {
+            damage_add(&state->damage, wm_rect(&state->wm, window));
+        }
+    } else if (wm_is_open(&state->wm, window)) {
+        wm_close(&state->wm, window);
+        damage_add(&state->damage, wm_rect(&state->wm, window));
     }
 }
 
-struct rect *ui_app_rect_mut(struct ui_state *state, enum ui_app_id app_id) {
+struct rect ui_app_rect(const struct ui_state *state, enum ui_app_id app_id) {
     if (!state) {
-        return 0;
+        return (struct rect){ 0, 0, 0, 0 };
     }
+    return wm_rect(&state->wm, ui_app_window(state, app_id));
+}
+
+int ui_app_handle_click(struct ui_state *state, enum ui_app_id app_id, int mouse_x, int mouse_y) {
+    struct rect rect = ui_app_rect(state, app_id);
+    int local_x = mouse_x - rect.x;
+    int local_y = mouse_y - rect.y;
     switch (app_id) {
-    case UI_APP_APPS:
-        return &state->apps_rect;
     case UI_APP_SETTINGS:
-        return &state->settings_rect;
-    case UI_APP_FILES:
-        return &state->files_rect;
-    case UI_APP_USB:
-        return &state->usb_rect;
-    case UI_APP_TEST:
-        return &state->test_rect;
+        return app_settings_handle_click(state, local_x, local_y);
     default:
         return 0;
     }
 }
 
-struct rect ui_app_rect(const struct ui_state *state, enum ui_app_id app_id) {
-    if (!state) {
-        return (struct rect){ 0, 0, 0, 0 };
-    }
+struct rect ui_app_update(struct ui_state *state, enum ui_app_id app_id) {
+    struct rect dirty = { 0, 0, 0, 0 };
     switch (app_id) {
-    case UI_APP_APPS:
-        return state->apps_rect;
     case UI_APP_SETTINGS:
-        return state->settings_rect;
-    case UI_APP_FILES:
-        return state->files_rect;
+        dirty = app_settings_update(state);
+        break;
+    case UI_APP_CONSOLE:
+        dirty = app_console_update(state);
+        break;
     case UI_APP_USB:
-        return state->usb_rect;
-    case UI_APP_TEST:
-        return state->test_rect;
+        dirty = app_usb_update(state);
+        break;
     default:
-        return (struct rect){ 0, 0, 0, 0 };
+        break;
     }
-}
-
-int ui_app_handle_click(struct ui_state *state, enum ui_app_id app_id, int mouse_x, int mouse_y) {
-    switch (app_id) {
-    case UI_APP_SETTINGS:
-        return app_settings_handle_click(state, mouse_x, mouse_y);
-    default:
-        return 0;
+    if (dirty.w <= 0 || dirty.h <= 0) {
+        return dirty;
     }
+    struct rect rect = ui_app_rect(state, app_id);
+    dirty.x += rect.x;
+    dirty.y += rect.y;
+    return rect_intersect(dirty, rect);
 }
 
-void ui_app_render(enum ui_app_id app_id, const struct framebuffer *fb, const struct ui_state *state, uint32_t accent) {
+void ui_app_render(enum ui_app_id app_id, struct draw_ctx *ctx, const struct ui_state *state, uint32_t accent) {
+    struct rect rect = ui_app_rect(state, app_id);
+    if (!draw_visible(ctx, rect) || !draw_push(ctx, rect)) {
+        return;
+    }
     switch (app_id) {
     case UI_APP_APPS:
-        app_apps_render(fb, state, accent);
+        app_apps_render(ctx, state, accent);
         break;
     case UI_APP_SETTINGS:
-        app_settings_render(fb, state, accent);
+        app_settings_render(ctx, state, accent);
         break;
     case UI_APP_FILES:
-        app_files_render(fb, state, accent);
+        app_files_render(ctx, state, accent);
         break;
     case UI_APP_USB:
-        app_usb_render(fb, state, accent);
+        app_usb_render(ctx, state, accent);
         break;
     case UI_APP_TEST:
-        app_test_render(fb, state, accent);
+        app_test_render(ctx, state, accent);
+        break;
+    case UI_APP_CONSOLE:
+        app_console_render(ctx, state, accent);
         break;
     default:
         break;
     }
+    draw_pop(ctx);
 }
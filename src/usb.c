@@ -1,53 +1,1115 @@
 #include "usb.h"
 #include "ehci.h"
+#include "xhci.h"
 #include "log.h"
 #include "pci.h"
+#include "timer.h"
 #include "usb_hid.h"
 
 static struct usb_controller_info controllers[USB_MAX_CONTROLLERS];
 static uint32_t controller_count;
 static struct ehci_controller ehci_ctrls[USB_MAX_CONTROLLERS];
-static uint32_t ehci_count;
+static struct xhci_controller xhci_ctrls[USB_MAX_CONTROLLERS];
 
-struct usb_device {
-    uint8_t addr;
-    uint8_t interface_num;
+#define USB_REPORT_POLL_DIVIDER 8
+#define USB_MAX_ENDPOINT_FAILURES 8
+#define USB_MAX_HID_INTERFACES 2
+#define USB_MAX_HUB_PORTS 15
+#define USB_MAX_DEPTH 5
+#define USB_ENUM_STEPS 16
+#define USB_PORT_POLL_US 250000u
+#define USB_DEBOUNCE_US 100000u
+#define USB_RESET_TIMEOUT_US 500000u
+#define USB_RESET_POLL_US 10000u
+#define USB_RESET_RECOVERY_US 10000u
+#define USB_SET_ADDRESS_US 2000u
+#define USB_CONFIG_MAX 256u
+
+#define USB_CLASS_HID 0x03
+#define USB_CLASS_HUB 0x09
+
+#define HUB_FEATURE_PORT_RESET 4
+#define HUB_FEATURE_PORT_POWER 8
+#define HUB_FEATURE_C_CONNECTION 16
+#define HUB_PORT_CONNECTION (1u << 0)
+#define HUB_PORT_ENABLE (1u << 1)
+#define HUB_PORT_LOW_SPEED (1u << 9)
+#define HUB_PORT_HIGH_SPEED (1u << 10)
+#define HUB_CHANGE_CONNECTION (1u << 0)
+#define HUB_CHANGE_RESET (1u << 4)
+#define HUB_CHANGE_CLEARABLE 0x1Bu
+
+enum usb_enum_state {
+    ENUM_IDLE = 0,
+    ENUM_PORT_STATUS,
+    ENUM_PORT_PARSE,
+    ENUM_PORT_CLEAR,
+    ENUM_PORT_DECIDE,
+    ENUM_RESET,
+    ENUM_ROOT_RESET_WAIT,
+    ENUM_HUB_RESET_POLL,
+    ENUM_HUB_RESET_CHECK,
+    ENUM_RESET_DONE,
+    ENUM_DESC8,
+    ENUM_ADDRESS,
+    ENUM_ADDRESS_WAIT,
+    ENUM_HOST_ADDRESS,
+    ENUM_HOST_MAX_PACKET,
+    ENUM_DESC18,
+    ENUM_CONFIG_HEADER,
+    ENUM_CONFIG,
+    ENUM_SET_CONFIG,
+    ENUM_PARSE,
+    ENUM_HID_PROTOCOL,
+    ENUM_HID_IDLE,
+    ENUM_HID_OPEN,
+    ENUM_HUB_DESC,
+    ENUM_HUB_PORTS,
+    ENUM_HUB_POWER,
+    ENUM_HUB_START,
+    ENUM_READY
+};
+
+enum usb_host_type {
+    USB_HOST_EHCI = 1,
+    USB_HOST_XHCI
+};
+
+struct usb_host {
+    uint8_t type;
+    uint8_t irq;
+    struct ehci_controller *ehci;
+    struct xhci_controller *xhci;
+};
+
+struct usb_device;
+
+struct usb_interface {
+    struct usb_device *dev;
+    uint8_t num;
     uint8_t protocol;
     uint8_t report_len;
-    uint8_t is_keyboard;
-    uint8_t is_mouse;
+    uint8_t ep;
+    uint8_t interval;
+    uint8_t status;
+    uint8_t failures;
+    uint8_t busy;
+    uint16_t max_packet;
+    int handle;
+    struct usb_hid_keyboard keyboard;
+    uint8_t buf[64] __attribute__((aligned(32)));
+};
+
+struct usb_device {
+    struct usb_device_info info;
+    struct usb_host *host;
+    uint8_t used;
+    uint8_t ready;
+    uint16_t max_packet0;
+    uint8_t tt_hub;
+    uint8_t tt_port;
+    uint8_t root_port;
+    uint32_t route;
+    uint8_t hid_count;
+    struct usb_interface hid[USB_MAX_HID_INTERFACES];
+    uint8_t hub_ep;
+    uint8_t hub_interval;
+    uint16_t hub_max_packet;
+    int hub_handle;
+    uint8_t hub_status;
+    uint8_t hub_failures;
+    uint16_t hub_pending;
+    uint8_t hub_buf[4] __attribute__((aligned(32)));
+};
+
+struct usb_enum {
+    uint8_t state;
+    uint8_t hc;
+    uint8_t port;
+    uint8_t speed;
+    uint8_t addr;
+    uint8_t index;
+    uint8_t busy;
+    uint8_t optional;
+    uint8_t status;
+    uint8_t dev_class;
+    uint16_t port_status;
+    uint16_t port_change;
+    uint16_t total_len;
+    const char *what;
+    struct usb_device *hub;
+    struct usb_device *dev;
+    uint64_t wait_until_us;
+    uint64_t deadline_us;
+    uint64_t started_us;
+    uint8_t buf[USB_CONFIG_MAX] __attribute__((aligned(32)));
 };
 
-static struct usb_device hid_device;
+static struct usb_host hosts[USB_MAX_CONTROLLERS];
+static uint32_t host_count;
+static struct usb_device devices[USB_MAX_DEVICES];
+static struct usb_enum enumerators[USB_MAX_CONTROLLERS];
+static uint32_t address_map[USB_MAX_CONTROLLERS][4];
+static uint32_t root_pending[USB_MAX_CONTROLLERS];
+static uint64_t next_port_poll_us;
+
+static struct usb_event events[USB_EVENT_QUEUE_SIZE];
+static uint32_t event_head;
+static uint32_t event_tail;
+static uint32_t generation;
+
+static void usb_push_event(uint8_t type, const struct usb_device *dev) {
+    generation++;
+    if (event_head - event_tail >= USB_EVENT_QUEUE_SIZE) {
+        event_tail++;
+    }
+    struct usb_event *ev = &events[event_head % USB_EVENT_QUEUE_SIZE];
+    ev->type = type;
+    ev->info = dev->info;
+    ev->time_us = timer_us();
+    event_head++;
+}
+
+static const char *host_name(const struct usb_host *host) {
+    return host->type == USB_HOST_XHCI ? "xHCI" : "EHCI";
+}
+
+static int host_ready(const struct usb_host *host) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return host->ehci->state == EHCI_STATE_READY;
+    case USB_HOST_XHCI:
+        return host->xhci->state == XHCI_STATE_READY;
+    default:
+        return 0;
+    }
+}
+
+static int host_step(struct usb_host *host, uint64_t now) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return host->ehci->state != EHCI_STATE_FAILED && ehci_step(host->ehci, now) == EHCI_STATE_READY;
+    case USB_HOST_XHCI:
+        return host->xhci->state != XHCI_STATE_FAILED && xhci_step(host->xhci, now) == XHCI_STATE_READY;
+    default:
+        return 0;
+    }
+}
+
+static void host_process(struct usb_host *host) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        ehci_process(host->ehci);
+        break;
+    case USB_HOST_XHCI:
+        xhci_process(host->xhci);
+        break;
+    default:
+        break;
+    }
+}
+
+static int host_enable_irq(struct usb_host *host) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_enable_irq(host->ehci, host->irq);
+    case USB_HOST_XHCI:
+        return xhci_enable_irq(host->xhci, host->irq);
+    default:
+        return 0;
+    }
+}
+
+static uint32_t host_port_count(const struct usb_host *host) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_port_count(host->ehci);
+    case USB_HOST_XHCI:
+        return xhci_port_count(host->xhci);
+    default:
+        return 0;
+    }
+}
+
+static int host_port_connected(struct usb_host *host, uint32_t port) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_port_connected(host->ehci, port);
+    case USB_HOST_XHCI:
+        return xhci_port_connected(host->xhci, port);
+    default:
+        return 0;
+    }
+}
+
+static int host_port_changed(struct usb_host *host, uint32_t port) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_port_changed(host->ehci, port);
+    case USB_HOST_XHCI:
+        return xhci_port_changed(host->xhci, port);
+    default:
+        return 0;
+    }
+}
+
+static int host_port_reset_begin(struct usb_host *host, uint32_t port, uint64_t now) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_port_reset_begin(host->ehci, port, now);
+    case USB_HOST_XHCI:
+        return xhci_port_reset_begin(host->xhci, port, now);
+    default:
+        return 0;
+    }
+}
 
-static int usb_get_device_descriptor(struct ehci_controller *ctrl, uint8_t addr, uint8_t *buf, uint32_t len) {
-    uint8_t setup[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, (uint8_t)len, 0x00 };
-    return ehci_control_transfer(ctrl, addr, 0, 64, setup, buf, len, 1);
+static enum usb_status host_port_reset_poll(struct usb_host *host, uint64_t now) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_port_reset_poll(host->ehci, now);
+    case USB_HOST_XHCI:
+        return xhci_port_reset_poll(host->xhci, now);
+    default:
+        return USB_STATUS_ERROR;
+    }
 }
 
-static int usb_set_address(struct ehci_controller *ctrl, uint8_t addr) {
-    uint8_t setup[8] = { 0x00, 0x05, addr, 0x00, 0x00, 0x00, 0x00, 0x00 };
-    return ehci_control_transfer(ctrl, 0, 0, 64, setup, 0, 0, 0);
+static uint8_t host_port_speed(struct usb_host *host, uint32_t port) {
+    switch (host->type) {
+    case USB_HOST_XHCI:
+        return (uint8_t)xhci_port_speed(host->xhci, port);
+    default:
+        return USB_SPEED_HIGH;
+    }
 }
 
-static int usb_get_config_descriptor(struct ehci_controller *ctrl, uint8_t addr, uint8_t *buf, uint32_t len) {
-    uint8_t setup[8] = { 0x80, 0x06, 0x00, 0x02, 0x00, 0x00, (uint8_t)len, 0x00 };
-    return ehci_control_transfer(ctrl, addr, 0, 64, setup, buf, len, 1);
+static int host_interrupt_open(struct usb_host *host, uint8_t addr, uint8_t ep, uint16_t max_packet,
+                               uint8_t interval, void *buf, uint16_t len, usb_callback_fn callback, void *ctx) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return ehci_interrupt_open(host->ehci, addr, ep, max_packet, interval, buf, len, callback, ctx);
+    case USB_HOST_XHCI:
+        return xhci_interrupt_open(host->xhci, addr, ep, max_packet, interval, buf, len, callback, ctx);
+    default:
+        return -1;
+    }
 }
 
-static int usb_set_configuration(struct ehci_controller *ctrl, uint8_t addr, uint8_t cfg) {
-    uint8_t setup[8] = { 0x00, 0x09, cfg, 0x00, 0x00, 0x00, 0x00, 0x00 };
-    return ehci_control_transfer(ctrl, addr, 0, 64, setup, 0, 0, 0);
+static uint8_t host_interrupt_interval(const struct usb_host *host, int handle) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        return host->ehci->interrupts[handle].interval;
+    case USB_HOST_XHCI:
+        return host->xhci->interrupts[handle].interval;
+    default:
+        return 0;
+    }
 }
 
-static int usb_set_protocol(struct ehci_controller *ctrl, uint8_t addr, uint8_t iface, uint8_t protocol) {
-    uint8_t setup[8] = { 0x21, 0x0B, protocol, 0x00, iface, 0x00, 0x00, 0x00 };
-    return ehci_control_transfer(ctrl, addr, 0, 64, setup, 0, 0, 0);
+static void host_interrupt_resume(struct usb_host *host, int handle) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        ehci_interrupt_resume(host->ehci, handle);
+        break;
+    case USB_HOST_XHCI:
+        xhci_interrupt_resume(host->xhci, handle);
+        break;
+    default:
+        break;
+    }
 }
 
-static int usb_get_report(struct ehci_controller *ctrl, uint8_t addr, uint8_t iface, uint8_t len, uint8_t *buf) {
-    uint8_t setup[8] = { 0xA1, 0x01, 0x00, 0x01, iface, 0x00, len, 0x00 };
-    return ehci_control_transfer(ctrl, addr, 0, 64, setup, buf, len, 1);
+static void host_release_device(struct usb_host *host, uint8_t addr) {
+    switch (host->type) {
+    case USB_HOST_EHCI:
+        ehci_release_device(host->ehci, addr);
+        break;
+    case USB_HOST_XHCI:
+        xhci_release_device(host->xhci, addr);
+        break;
+    default:
+        break;
+    }
+}
+
+static int usb_submit(struct usb_device *dev, uint8_t type, uint8_t request, uint16_t value, uint16_t index,
+                      void *data, uint16_t length, usb_callback_fn callback, void *ctx) {
+    uint8_t setup[8] = { type, request, (uint8_t)value, (uint8_t)(value >> 8),
+                         (uint8_t)index, (uint8_t)(index >> 8), (uint8_t)length, (uint8_t)(length >> 8) };
+    switch (dev->host->type) {
+    case USB_HOST_EHCI:
+        return ehci_control_submit(dev->host->ehci, dev->info.addr, 0, dev->max_packet0, setup, data, length,
+                                   (type & 0x80u) != 0, callback, ctx) >= 0;
+    case USB_HOST_XHCI:
+        return xhci_control_submit(dev->host->xhci, dev->info.addr, setup, data, length,
+                                   (type & 0x80u) != 0, callback, ctx) >= 0;
+    default:
+        return 0;
+    }
+}
+
+static const char *usb_speed_name(uint8_t speed) {
+    switch (speed) {
+    case USB_SPEED_LOW:
+        return "low";
+    case USB_SPEED_FULL:
+        return "full";
+    case USB_SPEED_HIGH:
+        return "high";
+    case USB_SPEED_SUPER:
+        return "super";
+    default:
+        return "?";
+    }
+}
+
+static uint8_t usb_alloc_address(uint32_t hc) {
+    for (uint32_t addr = 1; addr < 128; ++addr) {
+        if ((address_map[hc][addr >> 5] & (1u << (addr & 31u))) == 0) {
+            address_map[hc][addr >> 5] |= 1u << (addr & 31u);
+            return (uint8_t)addr;
+        }
+    }
+    return 0;
+}
+
+static void usb_free_address(uint32_t hc, uint8_t addr) {
+    address_map[hc][addr >> 5] &= ~(1u << (addr & 31u));
+}
+
+static struct usb_device *usb_alloc_device(void) {
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        if (!devices[i].used) {
+            struct usb_device *dev = &devices[i];
+            dev->used = 1;
+            dev->ready = 0;
+            dev->hid_count = 0;
+            dev->hub_ep = 0;
+            dev->hub_handle = -1;
+            dev->hub_status = USB_STATUS_OK;
+            dev->hub_failures = 0;
+            dev->hub_pending = 0;
+            dev->info.hub_ports = 0;
+            dev->info.hid_mask = 0;
+            dev->info.vendor = 0;
+            dev->info.product = 0;
+            return dev;
+        }
+    }
+    return 0;
+}
+
+static struct usb_device *usb_find_child(uint8_t hc, uint8_t parent, uint8_t port) {
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        struct usb_device *dev = &devices[i];
+        if (dev->used && dev->info.addr != 0 && dev->info.controller == hc &&
+            dev->info.parent == parent && dev->info.port == port) {
+            return dev;
+        }
+    }
+    return 0;
+}
+
+static void usb_remove_device(struct usb_device *dev) {
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        struct usb_device *child = &devices[i];
+        if (child->used && child != dev && child->info.controller == dev->info.controller &&
+            child->info.parent == dev->info.addr) {
+            usb_remove_device(child);
+        }
+    }
+    log_puts("USB: device ");
+    log_dec32(dev->info.addr);
+    log_puts(" removed\n");
+    host_release_device(dev->host, dev->info.addr);
+    usb_free_address(dev->info.controller, dev->info.addr);
+    if (dev->ready) {
+        usb_push_event(USB_EVENT_REMOVED, dev);
+    }
+    dev->used = 0;
+    dev->ready = 0;
+}
+
+static uint8_t usb_interval_frames(uint8_t speed, uint8_t interval) {
+    if (speed == USB_SPEED_LOW || speed == USB_SPEED_FULL) {
+        return interval ? interval : 1;
+    }
+    uint32_t exp = interval ? interval - 1u : 0;
+    if (exp > 15) {
+        exp = 15;
+    }
+    uint32_t frames = (1u << exp) >> 3;
+    if (frames == 0) {
+        frames = 1;
+    }
+    return frames > 255 ? 255 : (uint8_t)frames;
+}
+
+static void usb_dispatch_report(struct usb_interface *iface, const uint8_t *report, uint32_t len) {
+    switch (iface->protocol) {
+    case 1:
+        usb_hid_on_keyboard_report(&iface->keyboard, report, len);
+        break;
+    case 2:
+        usb_hid_on_mouse_report(report, len);
+        break;
+    default:
+        break;
+    }
+}
+
+static void usb_report_cb(void *ctx, enum usb_status status, const uint8_t *data, uint32_t len) {
+    struct usb_interface *iface = (struct usb_interface *)ctx;
+    iface->status = (uint8_t)status;
+    if (status != USB_STATUS_OK) {
+        return;
+    }
+    iface->failures = 0;
+    if (len > 0) {
+        usb_dispatch_report(iface, data, len);
+    }
+}
+
+static void usb_get_report_cb(void *ctx, enum usb_status status, const uint8_t *data, uint32_t len) {
+    struct usb_interface *iface = (struct usb_interface *)ctx;
+    iface->busy = 0;
+    if (status == USB_STATUS_OK && len > 0) {
+        usb_dispatch_report(iface, data, len);
+    }
+}
+
+static void usb_clear_halt_cb(void *ctx, enum usb_status status, const uint8_t *data, uint32_t len) {
+    (void)data;
+    (void)len;
+    struct usb_interface *iface = (struct usb_interface *)ctx;
+    iface->busy = 0;
+    if (status != USB_STATUS_OK) {
+        log_puts("USB: clear halt failed (");
+        log_puts(usb_status_name(status));
+        log_puts(")\n");
+    }
+    host_interrupt_resume(iface->dev->host, iface->handle);
+}
+
+static void usb_hub_cb(void *ctx, enum usb_status status, const uint8_t *data, uint32_t len) {
+    struct usb_device *hub = (struct usb_device *)ctx;
+    if (status != USB_STATUS_OK) {
+        hub->hub_status = (uint8_t)status;
+        hub->hub_pending |= 1u;
+        return;
+    }
+    hub->hub_failures = 0;
+    uint16_t bitmap = len > 0 ? data[0] : 0;
+    if (len > 1) {
+        bitmap |= (uint16_t)(data[1] << 8);
+    }
+    hub->hub_pending |= bitmap & (uint16_t)~1u;
+}
+
+static void usb_recover_interface(struct usb_device *dev, struct usb_interface *iface) {
+    if (iface->busy) {
+        return;
+    }
+    enum usb_status status = (enum usb_status)iface->status;
+    iface->status = USB_STATUS_OK;
+    if (++iface->failures > USB_MAX_ENDPOINT_FAILURES) {
+        if (iface->failures == USB_MAX_ENDPOINT_FAILURES + 1u) {
+            log_puts("USB: interrupt endpoint disabled after repeated errors\n");
+        }
+        return;
+    }
+    log_puts("USB: interrupt endpoint ");
+    log_puts(usb_status_name(status));
+    log_puts("\n");
+    if (status != USB_STATUS_STALL) {
+        host_interrupt_resume(dev->host, iface->handle);
+        return;
+    }
+    if (usb_submit(dev, 0x02, 0x01, 0, (uint16_t)(iface->ep | 0x80u), 0, 0, usb_clear_halt_cb, iface)) {
+        iface->busy = 1;
+    } else {
+        iface->status = USB_STATUS_STALL;
+        iface->failures--;
+    }
+}
+
+static void usb_parse_config(struct usb_device *dev, const uint8_t *cfg, uint32_t total_len) {
+    uint32_t idx = 0;
+    struct usb_interface *iface = 0;
+    int in_hub = 0;
+    while (idx + 2 <= total_len) {
+        uint8_t len = cfg[idx];
+        uint8_t type = cfg[idx + 1];
+        if (len < 2 || idx + len > total_len) {
+            break;
+        }
+        if (type == 0x04 && len >= 9) {
+            uint8_t iface_class = cfg[idx + 5];
+            uint8_t iface_sub = cfg[idx + 6];
+            uint8_t iface_proto = cfg[idx + 7];
+            iface = 0;
+            in_hub = iface_class == USB_CLASS_HUB;
+            if (iface_class == USB_CLASS_HID && iface_sub == 0x01 && (iface_proto == 1 || iface_proto == 2) &&
+                dev->hid_count < USB_MAX_HID_INTERFACES) {
+                iface = &dev->hid[dev->hid_count++];
+                iface->dev = dev;
+                iface->num = cfg[idx + 2];
+                iface->protocol = iface_proto;
+                iface->report_len = 0;
+                iface->ep = 0;
+                iface->interval = 0;
+                iface->max_packet = 0;
+                iface->handle = -1;
+                iface->status = USB_STATUS_OK;
+                iface->failures = 0;
+                iface->busy = 0;
+                usb_hid_keyboard_init(&iface->keyboard);
+                dev->info.hid_mask |= iface_proto == 1 ? USB_HID_KEYBOARD : USB_HID_MOUSE;
+            }
+        } else if (type == 0x05 && len >= 7) {
+            uint8_t ep_addr = cfg[idx + 2];
+            uint8_t attrs = cfg[idx + 3];
+            uint16_t max_packet = (uint16_t)((cfg[idx + 4] | (cfg[idx + 5] << 8)) & 0x7FFu);
+            if ((ep_addr & 0x80u) && (attrs & 0x03u) == 0x03u) {
+                if (iface && iface->ep == 0) {
+                    iface->ep = ep_addr & 0x0Fu;
+                    iface->max_packet = max_packet;
+                    iface->interval = cfg[idx + 6];
+                } else if (in_hub && dev->hub_ep == 0) {
+                    dev->hub_ep = ep_addr & 0x0Fu;
+                    dev->hub_max_packet = max_packet;
+                    dev->hub_interval = cfg[idx + 6];
+                }
+            }
+        } else if (type == 0x21 && len >= 9 && iface) {
+            uint16_t rep_len = (uint16_t)(cfg[idx + 7] | (cfg[idx + 8] << 8));
+            if (rep_len > 0 && rep_len <= 64) {
+                iface->report_len = (uint8_t)rep_len;
+            }
+        }
+        idx += len;
+    }
+}
+
+static void usb_enum_done(void *ctx, enum usb_status status, const uint8_t *data, uint32_t len) {
+    (void)data;
+    (void)len;
+    struct usb_enum *e = (struct usb_enum *)ctx;
+    e->status = (uint8_t)status;
+    e->busy = 0;
+}
+
+static int usb_enum_control(struct usb_enum *e, struct usb_device *dev, const char *what, uint8_t type,
+                            uint8_t request, uint16_t value, uint16_t index, uint16_t length, int optional) {
+    e->what = what;
+    e->optional = (uint8_t)optional;
+    if (!usb_submit(dev, type, request, value, index, length ? e->buf : 0, length, usb_enum_done, e)) {
+        e->status = USB_STATUS_ERROR;
+        return 0;
+    }
+    e->status = USB_STATUS_PENDING;
+    e->busy = 1;
+    return 0;
+}
+
+static void usb_enum_finish(struct usb_enum *e) {
+    e->state = ENUM_IDLE;
+    e->dev = 0;
+    e->hub = 0;
+    e->addr = 0;
+}
+
+static void usb_enum_fail(struct usb_enum *e, const char *what) {
+    log_puts("USB: ");
+    log_puts(what);
+    log_puts(" failed");
+    if (e->status != USB_STATUS_OK) {
+        log_puts(" (");
+        log_puts(usb_status_name((enum usb_status)e->status));
+        log_puts(")");
+    }
+    log_puts("\n");
+    if (e->dev) {
+        if (e->dev->info.addr != 0) {
+            usb_remove_device(e->dev);
+        } else {
+            e->dev->used = 0;
+        }
+    }
+    if (e->addr != 0 && (!e->dev || e->dev->info.addr == 0)) {
+        host_release_device(&hosts[e->hc], e->addr);
+        usb_free_address(e->hc, e->addr);
+    }
+    usb_enum_finish(e);
+}
+
+static int usb_enum_next_job(struct usb_enum *e) {
+    uint32_t hc = e->hc;
+    if (root_pending[hc]) {
+        uint32_t port = 0;
+        while ((root_pending[hc] & (1u << port)) == 0) {
+            port++;
+        }
+        root_pending[hc] &= ~(1u << port);
+        e->hub = 0;
+        e->port = (uint8_t)(port + 1u);
+        e->state = ENUM_PORT_STATUS;
+        return 1;
+    }
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        struct usb_device *hub = &devices[i];
+        if (!hub->used || !hub->ready || hub->info.controller != hc || hub->hub_pending == 0) {
+            continue;
+        }
+        if (hub->hub_pending & 1u) {
+            hub->hub_pending &= (uint16_t)~1u;
+            if (++hub->hub_failures > USB_MAX_ENDPOINT_FAILURES) {
+                continue;
+            }
+            if (hub->hub_status == USB_STATUS_STALL) {
+                usb_submit(hub, 0x02, 0x01, 0, (uint16_t)(hub->hub_ep | 0x80u), 0, 0, 0, 0);
+            }
+            hub->hub_status = USB_STATUS_OK;
+            host_interrupt_resume(hub->host, hub->hub_handle);
+            hub->hub_pending |= (uint16_t)(((1u << hub->info.hub_ports) - 1u) << 1);
+        }
+        uint8_t port = 1;
+        while (port <= hub->info.hub_ports && (hub->hub_pending & (1u << port)) == 0) {
+            port++;
+        }
+        hub->hub_pending &= (uint16_t)~(1u << port);
+        if (port > hub->info.hub_ports) {
+            continue;
+        }
+        e->hub = hub;
+        e->port = port;
+        e->state = ENUM_PORT_STATUS;
+        return 1;
+    }
+    return 0;
+}
+
+static void usb_enum_log_device(const struct usb_enum *e, const struct usb_device *dev) {
+    log_puts("USB: device ");
+    log_dec32(dev->info.addr);
+    log_puts(" vid=");
+    log_hex32(dev->info.vendor);
+    log_puts(" pid=");
+    log_hex32(dev->info.product);
+    log_puts(" ");
+    log_puts(usb_speed_name(dev->info.speed));
+    log_puts("-speed on ");
+    if (e->hub) {
+        log_puts("hub ");
+        log_dec32(e->hub->info.addr);
+    } else {
+        log_puts("root");
+    }
+    log_puts(" port ");
+    log_dec32(e->port);
+    log_puts("\n");
+}
+
+static void usb_enum_open_hid(struct usb_device *dev, struct usb_interface *iface) {
+    if (iface->ep != 0) {
+        uint16_t len = iface->report_len;
+        if (len > iface->max_packet) {
+            len = iface->max_packet;
+        }
+        iface->handle = host_interrupt_open(dev->host, dev->info.addr, iface->ep, iface->max_packet,
+                                            usb_interval_frames(dev->info.speed, iface->interval),
+                                            iface->buf, len, usb_report_cb, iface);
+    }
+    log_puts("USB: device ");
+    log_dec32(dev->info.addr);
+    log_puts(iface->protocol == 1 ? " keyboard" : " mouse");
+    if (iface->handle >= 0) {
+        log_puts(" on interrupt ep ");
+        log_dec32(iface->ep);
+        log_puts(" every ");
+        log_dec32(host_interrupt_interval(dev->host, iface->handle));
+        log_puts(" ms\n");
+    } else {
+        log_puts(", polling GET_REPORT\n");
+    }
+}
+
+static uint16_t usb_max_packet0(uint8_t speed, uint8_t size) {
+    if (speed == USB_SPEED_SUPER) {
+        return 512;
+    }
+    if (size == 8 || size == 16 || size == 32 || size == 64) {
+        return size;
+    }
+    return speed == USB_SPEED_LOW ? 8 : 64;
+}
+
+static int usb_enum_begin_device(struct usb_enum *e, uint64_t now) {
+    uint8_t depth = e->hub ? (uint8_t)(e->hub->info.depth + 1u) : 0;
+    if (depth > USB_MAX_DEPTH) {
+        usb_enum_fail(e, "hub chain depth");
+        return 0;
+    }
+    struct usb_device *dev = usb_alloc_device();
+    if (!dev) {
+        usb_enum_fail(e, "device table");
+        return 0;
+    }
+    struct usb_device *parent = e->hub;
+    dev->host = &hosts[e->hc];
+    dev->info.controller = e->hc;
+    dev->info.addr = 0;
+    dev->info.speed = e->speed;
+    dev->info.parent = parent ? parent->info.addr : 0;
+    dev->info.port = e->port;
+    dev->info.depth = depth;
+    dev->tt_hub = 0;
+    dev->tt_port = 0;
+    if ((e->speed == USB_SPEED_LOW || e->speed == USB_SPEED_FULL) && parent) {
+        dev->tt_hub = parent->info.speed == USB_SPEED_HIGH ? parent->info.addr : parent->tt_hub;
+        dev->tt_port = parent->info.speed == USB_SPEED_HIGH ? e->port : parent->tt_port;
+    }
+    dev->root_port = parent ? parent->root_port : e->port;
+    dev->route = parent ? parent->route | ((uint32_t)(e->port & 0x0Fu) << (4u * parent->info.depth)) : 0;
+    dev->max_packet0 = usb_max_packet0(e->speed, 0);
+    e->dev = dev;
+    e->started_us = now;
+    switch (dev->host->type) {
+    case USB_HOST_XHCI:
+        e->addr = usb_alloc_address(e->hc);
+        if (e->addr == 0) {
+            usb_enum_fail(e, "address allocation");
+            return 0;
+        }
+        e->what = "address device";
+        e->optional = 0;
+        e->state = ENUM_HOST_ADDRESS;
+        if (!xhci_address_device(dev->host->xhci, e->addr, (enum usb_speed)e->speed, dev->root_port, dev->route,
+                                 dev->tt_hub, dev->tt_port, dev->max_packet0, usb_enum_done, e)) {
+            e->status = USB_STATUS_ERROR;
+            return 0;
+        }
+        e->status = USB_STATUS_PENDING;
+        e->busy = 1;
+        return 0;
+    default:
+        ehci_set_route(dev->host->ehci, 0, (enum usb_speed)e->speed, dev->tt_hub, dev->tt_port);
+        e->state = ENUM_ADDRESS;
+        return usb_enum_control(e, dev, "device descriptor", 0x80, 0x06, 0x0100, 0, 8, 0);
+    }
+}
+
+static int usb_enum_step(struct usb_enum *e, uint64_t now) {
+    if (e->busy) {
+        return 0;
+    }
+    if (e->state != ENUM_IDLE && e->status != USB_STATUS_OK && !e->optional) {
+        usb_enum_fail(e, e->what ? e->what : "enumeration");
+        return 1;
+    }
+    e->status = USB_STATUS_OK;
+    e->optional = 0;
+    if (now < e->wait_until_us) {
+        return 0;
+    }
+    struct usb_host *host = &hosts[e->hc];
+    struct usb_device *dev = e->dev;
+    switch (e->state) {
+    case ENUM_IDLE:
+        return usb_enum_next_job(e);
+    case ENUM_PORT_STATUS:
+        if (!e->hub) {
+            e->port_status = host_port_connected(host, e->port - 1u) ? HUB_PORT_CONNECTION : 0;
+            e->port_change = HUB_CHANGE_CONNECTION;
+            e->state = ENUM_PORT_DECIDE;
+            return 1;
+        }
+        e->state = ENUM_PORT_PARSE;
+        return usb_enum_control(e, e->hub, "port status", 0xA3, 0x00, 0, e->port, 4, 0);
+    case ENUM_PORT_PARSE:
+        e->port_status = (uint16_t)(e->buf[0] | (e->buf[1] << 8));
+        e->port_change = (uint16_t)(e->buf[2] | (e->buf[3] << 8));
+        e->index = (uint8_t)(e->port_change & HUB_CHANGE_CLEARABLE);
+        e->state = ENUM_PORT_CLEAR;
+        return 1;
+    case ENUM_PORT_CLEAR: {
+        if (e->index == 0) {
+            e->state = ENUM_PORT_DECIDE;
+            return 1;
+        }
+        uint8_t bit = 0;
+        while ((e->index & (1u << bit)) == 0) {
+            bit++;
+        }
+        e->index &= (uint8_t)~(1u << bit);
+        return usb_enum_control(e, e->hub, "port clear", 0x23, 0x01, (uint16_t)(HUB_FEATURE_C_CONNECTION + bit),
+                                e->port, 0, 1);
+    }
+    case ENUM_PORT_DECIDE: {
+        int connected = (e->port_status & HUB_PORT_CONNECTION) != 0;
+        struct usb_device *child = usb_find_child(e->hc, e->hub ? e->hub->info.addr : 0, e->port);
+        if ((e->port_change & HUB_CHANGE_CONNECTION) == 0 && connected == (child != 0)) {
+            usb_enum_finish(e);
+            return 1;
+        }
+        if (child) {
+            usb_remove_device(child);
+        }
+        if (!connected) {
+            usb_enum_finish(e);
+            return 1;
+        }
+        e->wait_until_us = now + USB_DEBOUNCE_US;
+        e->state = ENUM_RESET;
+        return 1;
+    }
+    case ENUM_RESET:
+        if (!e->hub) {
+            if (!host_port_reset_begin(host, e->port - 1u, now)) {
+                usb_enum_finish(e);
+                return 1;
+            }
+            e->state = ENUM_ROOT_RESET_WAIT;
+            return 0;
+        }
+        e->deadline_us = now + USB_RESET_TIMEOUT_US;
+        e->wait_until_us = now + USB_RESET_POLL_US;
+        e->state = ENUM_HUB_RESET_POLL;
+        return usb_enum_control(e, e->hub, "port reset", 0x23, 0x03, HUB_FEATURE_PORT_RESET, e->port, 0, 0);
+    case ENUM_ROOT_RESET_WAIT: {
+        enum usb_status status = host_port_reset_poll(host, now);
+        if (status == USB_STATUS_PENDING) {
+            return 0;
+        }
+        if (status != USB_STATUS_OK) {
+            usb_enum_finish(e);
+            return 1;
+        }
+        e->speed = host_port_speed(host, e->port - 1u);
+        e->wait_until_us = now + USB_RESET_RECOVERY_US;
+        e->state = ENUM_DESC8;
+        return 1;
+    }
+    case ENUM_HUB_RESET_POLL:
+        e->state = ENUM_HUB_RESET_CHECK;
+        return usb_enum_control(e, e->hub, "port status", 0xA3, 0x00, 0, e->port, 4, 0);
+    case ENUM_HUB_RESET_CHECK:
+        e->port_status = (uint16_t)(e->buf[0] | (e->buf[1] << 8));
+        e->port_change = (uint16_t)(e->buf[2] | (e->buf[3] << 8));
+        if ((e->port_change & HUB_CHANGE_RESET) == 0) {
+            if (now >= e->deadline_us) {
+                usb_enum_fail(e, "port reset");
+                return 1;
+            }
+            e->wait_until_us = now + USB_RESET_POLL_US;
+            e->state = ENUM_HUB_RESET_POLL;
+            return 1;
+        }
+        e->state = ENUM_RESET_DONE;
+        return usb_enum_control(e, e->hub, "port clear", 0x23, 0x01, HUB_FEATURE_C_CONNECTION + 4u, e->port, 0, 1);
+    case ENUM_RESET_DONE:
+        if ((e->port_status & HUB_PORT_ENABLE) == 0) {
+            usb_enum_fail(e, "port enable");
+            return 1;
+        }
+        if (e->port_status & HUB_PORT_LOW_SPEED) {
+            e->speed = USB_SPEED_LOW;
+        } else if (e->port_status & HUB_PORT_HIGH_SPEED) {
+            e->speed = USB_SPEED_HIGH;
+        } else {
+            e->speed = USB_SPEED_FULL;
+        }
+        e->wait_until_us = now + USB_RESET_RECOVERY_US;
+        e->state = ENUM_DESC8;
+        return 1;
+    case ENUM_DESC8:
+        return usb_enum_begin_device(e, now);
+    case ENUM_ADDRESS:
+        dev->max_packet0 = usb_max_packet0(dev->info.speed, e->buf[7]);
+        e->addr = usb_alloc_address(e->hc);
+        if (e->addr == 0) {
+            usb_enum_fail(e, "address allocation");
+            return 1;
+        }
+        e->state = ENUM_ADDRESS_WAIT;
+        return usb_enum_control(e, dev, "set address", 0x00, 0x05, e->addr, 0, 0, 0);
+    case ENUM_ADDRESS_WAIT:
+        dev->info.addr = e->addr;
+        ehci_set_route(host->ehci, e->addr, (enum usb_speed)e->speed, dev->tt_hub, dev->tt_port);
+        e->wait_until_us = now + USB_SET_ADDRESS_US;
+        e->state = ENUM_DESC18;
+        return 1;
+    case ENUM_HOST_ADDRESS:
+        dev->info.addr = e->addr;
+        e->state = ENUM_HOST_MAX_PACKET;
+        return usb_enum_control(e, dev, "device descriptor", 0x80, 0x06, 0x0100, 0, 8, 0);
+    case ENUM_HOST_MAX_PACKET: {
+        uint16_t max_packet0 = usb_max_packet0(dev->info.speed, e->buf[7]);
+        e->state = ENUM_DESC18;
+        if (max_packet0 == dev->max_packet0) {
+            return 1;
+        }
+        dev->max_packet0 = max_packet0;
+        e->what = "max packet update";
+        if (!xhci_update_max_packet0(host->xhci, dev->info.addr, max_packet0, usb_enum_done, e)) {
+            e->status = USB_STATUS_ERROR;
+            return 1;
+        }
+        e->status = USB_STATUS_PENDING;
+        e->busy = 1;
+        return 0;
+    }
+    case ENUM_DESC18:
+        e->state = ENUM_CONFIG_HEADER;
+        return usb_enum_control(e, dev, "device descriptor", 0x80, 0x06, 0x0100, 0, 18, 0);
+    case ENUM_CONFIG_HEADER:
+        dev->info.vendor = (uint16_t)(e->buf[8] | (e->buf[9] << 8));
+        dev->info.product = (uint16_t)(e->buf[10] | (e->buf[11] << 8));
+        e->dev_class = e->buf[4];
+        e->state = ENUM_CONFIG;
+        return usb_enum_control(e, dev, "config header", 0x80, 0x06, 0x0200, 0, 9, 0);
+    case ENUM_CONFIG:
+        e->total_len = (uint16_t)(e->buf[2] | (e->buf[3] << 8));
+        if (e->total_len > USB_CONFIG_MAX) {
+            e->total_len = USB_CONFIG_MAX;
+        }
+        e->state = ENUM_SET_CONFIG;
+        return usb_enum_control(e, dev, "config descriptor", 0x80, 0x06, 0x0200, 0, e->total_len, 0);
+    case ENUM_SET_CONFIG:
+        e->state = ENUM_PARSE;
+        return usb_enum_control(e, dev, "set configuration", 0x00, 0x09, e->buf[5], 0, 0, 0);
+    case ENUM_PARSE:
+        usb_enum_log_device(e, dev);
+        usb_parse_config(dev, e->buf, e->total_len);
+        e->index = 0;
+        e->state = ENUM_HID_PROTOCOL;
+        return 1;
+    case ENUM_HID_PROTOCOL: {
+        if (e->index >= dev->hid_count) {
+            e->state = ENUM_HUB_DESC;
+            return 1;
+        }
+        struct usb_interface *iface = &dev->hid[e->index];
+        if (iface->report_len == 0) {
+            iface->report_len = iface->protocol == 1 ? 8 : 3;
+        }
+        e->state = ENUM_HID_IDLE;
+        return usb_enum_control(e, dev, "set protocol", 0x21, 0x0B, 0, iface->num, 0, 1);
+    }
+    case ENUM_HID_IDLE: {
+        struct usb_interface *iface = &dev->hid[e->index];
+        e->state = ENUM_HID_OPEN;
+        if (iface->protocol != 1) {
+            return 1;
+        }
+        return usb_enum_control(e, dev, "set idle", 0x21, 0x0A, 0, iface->num, 0, 1);
+    }
+    case ENUM_HID_OPEN:
+        usb_enum_open_hid(dev, &dev->hid[e->index]);
+        e->index++;
+        e->state = ENUM_HID_PROTOCOL;
+        return 1;
+    case ENUM_HUB_DESC:
+        if (e->dev_class != USB_CLASS_HUB && dev->hub_ep == 0) {
+            e->state = ENUM_READY;
+            return 1;
+        }
+        if (dev->info.speed == USB_SPEED_SUPER) {
+            log_puts("USB: device ");
+            log_dec32(dev->info.addr);
+            log_puts(" is a SuperSpeed hub, ports not supported\n");
+            dev->hub_ep = 0;
+            e->state = ENUM_READY;
+            return 1;
+        }
+        e->state = ENUM_HUB_PORTS;
+        return usb_enum_control(e, dev, "hub descriptor", 0xA0, 0x06, 0x2900, 0, 9, 0);
+    case ENUM_HUB_PORTS:
+        dev->info.hub_ports = e->buf[2] > USB_MAX_HUB_PORTS ? USB_MAX_HUB_PORTS : e->buf[2];
+        e->deadline_us = (uint64_t)e->buf[5] * 2000u;
+        if (e->deadline_us < 20000u) {
+            e->deadline_us = 20000u;
+        }
+        if (host->type == USB_HOST_XHCI && !xhci_set_hub(host->xhci, dev->info.addr, dev->info.hub_ports)) {
+            usb_enum_fail(e, "hub context");
+            return 1;
+        }
+        e->index = 1;
+        e->state = ENUM_HUB_POWER;
+        return 1;
+    case ENUM_HUB_POWER:
+        if (e->index > dev->info.hub_ports) {
+            e->wait_until_us = now + e->deadline_us;
+            e->state = ENUM_HUB_START;
+            return 1;
+        }
+        return usb_enum_control(e, dev, "port power", 0x23, 0x03, HUB_FEATURE_PORT_POWER, e->index++, 0, 1);
+    case ENUM_HUB_START:
+        if (dev->hub_ep != 0) {
+            uint16_t len = (uint16_t)((dev->info.hub_ports + 8u) / 8u);
+            if (len > dev->hub_max_packet) {
+                len = dev->hub_max_packet;
+            }
+            dev->hub_handle = host_interrupt_open(host, dev->info.addr, dev->hub_ep, dev->hub_max_packet,
+                                                  usb_interval_frames(dev->info.speed, dev->hub_interval),
+                                                  dev->hub_buf, len, usb_hub_cb, dev);
+        }
+        dev->hub_pending = (uint16_t)(((1u << dev->info.hub_ports) - 1u) << 1);
+        log_puts("USB: device ");
+        log_dec32(dev->info.addr);
+        log_puts(" hub with ");
+        log_dec32(dev->info.hub_ports);
+        log_puts(" ports\n");
+        e->state = ENUM_READY;
+        return 1;
+    case ENUM_READY:
+        dev->ready = 1;
+        log_puts("USB: device ");
+        log_dec32(dev->info.addr);
+        log_puts(" ready in ");
+        log_dec32((uint32_t)(now - e->started_us) / 1000u);
+        log_puts(" ms\n");
+        usb_push_event(USB_EVENT_READY, dev);
+        usb_enum_finish(e);
+        return 1;
+    default:
+        usb_enum_finish(e);
+        return 1;
+    }
+}
+
+static void usb_poll_root_ports(uint64_t now) {
+    if (now < next_port_poll_us) {
+        return;
+    }
+    next_port_poll_us = now + USB_PORT_POLL_US;
+    for (uint32_t hc = 0; hc < host_count; ++hc) {
+        if (!host_ready(&hosts[hc])) {
+            continue;
+        }
+        uint32_t ports = host_port_count(&hosts[hc]);
+        for (uint32_t port = 0; port < ports; ++port) {
+            if (host_port_changed(&hosts[hc], port)) {
+                root_pending[hc] |= 1u << port;
+            }
+        }
+    }
+}
+
+static void usb_controller_ready(uint32_t hc) {
+    struct usb_host *host = &hosts[hc];
+    if (!host_enable_irq(host)) {
+        log_puts(host_name(host));
+        log_puts(": no usable IRQ, polling completions\n");
+    }
+    uint32_t ports = host_port_count(host);
+    for (uint32_t port = 0; port < ports; ++port) {
+        host_port_changed(host, port);
+        if (host_port_connected(host, port)) {
+            root_pending[hc] |= 1u << port;
+        }
+    }
 }
 
 static void usb_device_cb(uint8_t bus, uint8_t dev, uint8_t func,
@@ -65,7 +1127,7 @@ static void usb_device_cb(uint8_t bus, uint8_t dev, uint8_t func,
             info->prog_if = prog_if;
             info->bar0 = pci_read_config32(bus, dev, func, 0x10);
         }
-        if (prog_if == 0x20 && ehci_count < USB_MAX_CONTROLLERS) {
+        if ((prog_if == 0x20 || prog_if == 0x30) && host_count < USB_MAX_CONTROLLERS) {
             uint32_t bar0 = pci_read_config32(bus, dev, func, 0x10);
             if ((bar0 & 0x1u) == 0 && bar0 != 0xFFFFFFFFu && bar0 != 0) {
                 uint32_t bar_type = bar0 & 0x6u;
@@ -75,8 +1137,24 @@ static void usb_device_cb(uint8_t bus, uint8_t dev, uint8_t func,
                         return;
                     }
                 }
-                if (ehci_init(&ehci_ctrls[ehci_count], bar0)) {
-                    ehci_count++;
+                pci_enable_bus_master(bus, dev, func);
+                struct usb_host *host = &hosts[host_count];
+                host->irq = pci_enable_intx(bus, dev, func);
+                host->ehci = &ehci_ctrls[host_count];
+                host->xhci = &xhci_ctrls[host_count];
+                switch (prog_if) {
+                case 0x20:
+                    host->type = USB_HOST_EHCI;
+                    if (ehci_init(host->ehci, bar0)) {
+                        host_count++;
+                    }
+                    break;
+                default:
+                    host->type = USB_HOST_XHCI;
+                    if (xhci_init(host->xhci, bar0)) {
+                        host_count++;
+                    }
+                    break;
                 }
             }
         }
@@ -94,119 +1172,118 @@ static void usb_device_cb(uint8_t bus, uint8_t dev, uint8_t func,
 
 void usb_init(void) {
     controller_count = 0;
-    ehci_count = 0;
+    host_count = 0;
+    event_head = 0;
+    event_tail = 0;
+    generation = 0;
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        devices[i].used = 0;
+        devices[i].ready = 0;
+    }
+    for (uint32_t hc = 0; hc < USB_MAX_CONTROLLERS; ++hc) {
+        for (uint32_t i = 0; i < 4; ++i) {
+            address_map[hc][i] = 0;
+        }
+        root_pending[hc] = 0;
+        enumerators[hc].state = ENUM_IDLE;
+        enumerators[hc].hc = (uint8_t)hc;
+        enumerators[hc].busy = 0;
+        enumerators[hc].status = USB_STATUS_OK;
+        enumerators[hc].wait_until_us = 0;
+        enumerators[hc].dev = 0;
+        enumerators[hc].hub = 0;
+        enumerators[hc].addr = 0;
+    }
     log_puts("USB scan...\n");
     pci_scan_bus0(usb_device_cb, 0);
     usb_hid_init();
+    next_port_poll_us = 0;
+}
 
-    hid_device.addr = 0;
-    hid_device.interface_num = 0;
-    hid_device.protocol = 0;
-    hid_device.report_len = 0;
-    hid_device.is_keyboard = 0;
-    hid_device.is_mouse = 0;
-
-    if (ehci_count == 0) {
-        return;
-    }
-
-    struct ehci_controller *ctrl = &ehci_ctrls[0];
-    uint8_t dev_desc[18];
-    if (!usb_get_device_descriptor(ctrl, 0, dev_desc, 8)) {
-        log_puts("USB: no device desc\n");
-        return;
-    }
-
-    if (!usb_set_address(ctrl, 1)) {
-        log_puts("USB: set address failed\n");
-        return;
-    }
-
-    hid_device.addr = 1;
-    if (!usb_get_device_descriptor(ctrl, hid_device.addr, dev_desc, 18)) {
-        log_puts("USB: full desc failed\n");
-        return;
-    }
-
-    uint8_t cfg_desc[64];
-    if (!usb_get_config_descriptor(ctrl, hid_device.addr, cfg_desc, 9)) {
-        log_puts("USB: cfg header failed\n");
-        return;
-    }
-    uint16_t total_len = (uint16_t)(cfg_desc[2] | (cfg_desc[3] << 8));
-    if (total_len > sizeof(cfg_desc)) {
-        total_len = sizeof(cfg_desc);
-    }
-    if (!usb_get_config_descriptor(ctrl, hid_device.addr, cfg_desc, (uint8_t)total_len)) {
-        log_puts("USB: cfg read failed\n");
-        return;
+void usb_poll(void) {
+    uint64_t now = timer_us();
+    for (uint32_t hc = 0; hc < host_count; ++hc) {
+        struct usb_host *host = &hosts[hc];
+        if (host_ready(host)) {
+            host_process(host);
+        } else if (host_step(host, now)) {
+            usb_controller_ready(hc);
+        }
     }
-
-    uint8_t cfg_value = cfg_desc[5];
-    if (!usb_set_configuration(ctrl, hid_device.addr, cfg_value)) {
-        log_puts("USB: set config failed\n");
-        return;
+    usb_poll_root_ports(now);
+    for (uint32_t hc = 0; hc < host_count; ++hc) {
+        if (!host_ready(&hosts[hc])) {
+            continue;
+        }
+        for (uint32_t i = 0; i < USB_ENUM_STEPS && usb_enum_step(&enumerators[hc], now); ++i) {
+        }
     }
 
-    uint32_t idx = 9;
-    while (idx + 2 < total_len) {
-        uint8_t len = cfg_desc[idx];
-        uint8_t type = cfg_desc[idx + 1];
-        if (len == 0) {
-            break;
+    static uint32_t div;
+    int report_poll = (++div % USB_REPORT_POLL_DIVIDER) == 0;
+    for (uint32_t i = 0; i < USB_MAX_DEVICES; ++i) {
+        struct usb_device *dev = &devices[i];
+        if (!dev->used || !dev->ready) {
+            continue;
         }
-        if (type == 0x04 && len >= 9) {
-            uint8_t iface = cfg_desc[idx + 2];
-            uint8_t iface_class = cfg_desc[idx + 5];
-            uint8_t iface_sub = cfg_desc[idx + 6];
-            uint8_t iface_proto = cfg_desc[idx + 7];
-            if (iface_class == 0x03 && iface_sub == 0x01) {
-                hid_device.interface_num = iface;
-                hid_device.protocol = iface_proto;
-                hid_device.is_keyboard = (iface_proto == 1);
-                hid_device.is_mouse = (iface_proto == 2);
+        for (uint32_t j = 0; j < dev->hid_count; ++j) {
+            struct usb_interface *iface = &dev->hid[j];
+            if (iface->handle >= 0) {
+                if (iface->status != USB_STATUS_OK) {
+                    usb_recover_interface(dev, iface);
+                }
+                continue;
             }
-        } else if (type == 0x21 && len >= 9) {
-            uint16_t rep_len = (uint16_t)(cfg_desc[idx + 7] | (cfg_desc[idx + 8] << 8));
-            if (rep_len > 0 && rep_len <= 64) {
-                hid_device.report_len = (uint8_t)rep_len;
+            if (report_poll && !iface->busy &&
+                usb_submit(dev, 0xA1, 0x01, 0x0100, iface->num, iface->buf, iface->report_len,
+                           usb_get_report_cb, iface)) {
+                iface->busy = 1;
             }
         }
-        idx += len;
     }
+}
 
-    if (hid_device.report_len == 0) {
-        hid_device.report_len = hid_device.is_keyboard ? 8 : 3;
-    }
+uint32_t usb_controller_count(void) {
+    return controller_count;
+}
 
-    if (hid_device.is_keyboard || hid_device.is_mouse) {
-        usb_set_protocol(ctrl, hid_device.addr, hid_device.interface_num, 0);
-        log_puts("USB HID ready\n");
-    }
+const struct usb_controller_info *usb_controller_list(void) {
+    return controllers;
 }
 
-void usb_poll(void) {
-    if (ehci_count == 0) {
-        return;
-    }
-    if (hid_device.addr == 0) {
-        return;
+const struct usb_device_info *usb_device_at(uint32_t index) {
+    if (index >= USB_MAX_DEVICES || !devices[index].used || !devices[index].ready) {
+        return 0;
     }
-    uint8_t report[64];
-    struct ehci_controller *ctrl = &ehci_ctrls[0];
-    if (usb_get_report(ctrl, hid_device.addr, hid_device.interface_num, hid_device.report_len, report)) {
-        if (hid_device.is_keyboard) {
-            usb_hid_on_keyboard_report(report, hid_device.report_len);
-        } else if (hid_device.is_mouse) {
-            usb_hid_on_mouse_report(report, hid_device.report_len);
-        }
+    return &devices[index].info;
+}
+
+int usb_next_event(struct usb_event *out) {
+    if (!out || event_tail == event_head) {
+        return 0;
     }
+    *out = events[event_tail % USB_EVENT_QUEUE_SIZE];
+    event_tail++;
+    return 1;
 }
 
-uint32_t usb_controller_count(void) {
-    return controller_count;
+uint32_t usb_generation(void) {
+    return generation;
 }
 
-const struct usb_controller_info *usb_controller_list(void) {
-    return controllers;
+const char *usb_status_name(enum usb_status status) {
+    switch (status) {
+    case USB_STATUS_PENDING:
+        return "pending";
+    case USB_STATUS_OK:
+        return "ok";
+    case USB_STATUS_STALL:
+        return "stall";
+    case USB_STATUS_ERROR:
+        return "error";
+    case USB_STATUS_TIMEOUT:
+        return "timeout";
+    default:
+        return "?";
+    }
 }
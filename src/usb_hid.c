@@ -1,11 +1,9 @@
 #include "usb_hid.h"
 #include "input.h"
 
-static uint8_t last_keys[6];
-
-static int key_in_last(uint8_t code) {
+static int key_in_last(const struct usb_hid_keyboard *kbd, uint8_t code) {
 	for (int i = 0; i < 6; ++i) {
-		if (last_keys[i] == code) {
+		if (kbd->last_keys[i] == code) {
 			return 1;
 		}
 	}
@@ -30,19 +28,30 @@ static enum key_action hid_key_to_action(uint8_t code) {
 		return KEY_TAB;
 	case 0x16:
 		return KEY_START;
+	case 0x3B:
+		return KEY_HUD;
+	case 0x3C:
+		return KEY_HEATMAP;
+	case 0x3D:
+		return KEY_LATENCY;
+	case 0x3E:
+		return KEY_RECORD;
 	default:
 		return KEY_NONE;
 	}
 }
 
 void usb_hid_init(void) {
+}
+
+void usb_hid_keyboard_init(struct usb_hid_keyboard *kbd) {
 	for (int i = 0; i < 6; ++i) {
-		last_keys[i] = 0;
+		kbd->last_keys[i] = 0;
 	}
 }
 
-void usb_hid_on_keyboard_report(const uint8_t *report, uint32_t len) {
-	if (!report || len < 8) {
+void usb_hid_on_keyboard_report(struct usb_hid_keyboard *kbd, const uint8_t *report, uint32_t len) {
+	if (!kbd || !report || len < 8) {
 		return;
 	}
 	const uint8_t *keys = report + 2;
@@ -51,15 +60,15 @@ void usb_hid_on_keyboard_report(const uint8_t *report, uint32_t len) {
 		if (code == 0) {
 			continue;
 		}
-		if (!key_in_last(code)) {
+		if (!key_in_last(kbd, code)) {
 			enum key_action action = hid_key_to_action(code);
 			if (action != KEY_NONE) {
-				input_inject_key(action);
+				input_inject_key(INPUT_DEVICE_USB_KEYBOARD, action);
 			}
 		}
 	}
 	for (int i = 0; i < 6; ++i) {
-		last_keys[i] = keys[i];
+		kbd->last_keys[i] = keys[i];
 	}
 }
 
@@ -70,7 +79,7 @@ void usb_hid_on_mouse_report(const uint8_t *report, uint32_t len) {
 	int8_t dx = (int8_t)report[1];
 	int8_t dy = (int8_t)report[2];
 	uint8_t buttons = report[0] & 0x07;
-	input_inject_mouse(dx, dy, buttons);
+	input_inject_mouse(INPUT_DEVICE_USB_MOUSE, dx, dy, buttons);
 }
 
 void usb_hid_poll(void) {
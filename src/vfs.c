@@ -31,3 +31,17 @@ int vfs_list_root(void) {
     }
     return fat_list_root(&fat, log_entry, 0);
 }
+
+int vfs_open(const char *name, struct vfs_file *file) {
+    if (!fat_mounted || !file) {
+        return 0;
+    }
+    return fat_open_root(&fat, name, &file->fat);
+}
+
+uint32_t vfs_read(struct vfs_file *file, void *buf, uint32_t len) {
+    if (!file) {
+        return 0;
+    }
+    return fat_read(&file->fat, buf, len);
+}
@@ -0,0 +1,289 @@
+#include "virtio.h"
+#include "log.h"
+#include "memory.h"
+#include "pci.h"
+
+#define VIRTIO_PCI_CAP_COMMON_CFG 1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG 2
+#define VIRTIO_PCI_CAP_ISR_CFG 3
+#define VIRTIO_PCI_CAP_DEVICE_CFG 4
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 1u
+#define VIRTIO_STATUS_DRIVER 2u
+#define VIRTIO_STATUS_DRIVER_OK 4u
+#define VIRTIO_STATUS_FEATURES_OK 8u
+#define VIRTIO_STATUS_FAILED 128u
+
+#define VIRTIO_F_VERSION_1_HI 1u
+
+#define COMMON_DEVICE_FEATURE_SELECT 0x00
+#define COMMON_DEVICE_FEATURE 0x04
+#define COMMON_DRIVER_FEATURE_SELECT 0x08
+#define COMMON_DRIVER_FEATURE 0x0C
+#define COMMON_DEVICE_STATUS 0x14
+#define COMMON_QUEUE_SELECT 0x16
+#define COMMON_QUEUE_SIZE 0x18
+#define COMMON_QUEUE_ENABLE 0x1C
+#define COMMON_QUEUE_NOTIFY_OFF 0x1E
+#define COMMON_QUEUE_DESC 0x20
+#define COMMON_QUEUE_DRIVER 0x28
+#define COMMON_QUEUE_DEVICE 0x30
+
+struct virtio_find_ctx {
+    uint16_t device_id;
+    int found;
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+};
+
+static void mmio_write8(volatile uint8_t *base, uint32_t off, uint8_t value) {
+    *(volatile uint8_t *)(base + off) = value;
+}
+
+static uint8_t mmio_read8(volatile uint8_t *base, uint32_t off) {
+    return *(volatile uint8_t *)(base + off);
+}
+
+static void mmio_write16(volatile uint8_t *base, uint32_t off, uint16_t value) {
+    *(volatile uint16_t *)(base + off) = value;
+}
+
+static uint16_t mmio_read16(volatile uint8_t *base, uint32_t off) {
+    return *(volatile uint16_t *)(base + off);
+}
+
+static void mmio_write32(volatile uint8_t *base, uint32_t off, uint32_t value) {
+    *(volatile uint32_t *)(base + off) = value;
+}
+
+static uint32_t mmio_read32(volatile uint8_t *base, uint32_t off) {
+    return *(volatile uint32_t *)(base + off);
+}
+
+static void mmio_write64(volatile uint8_t *base, uint32_t off, uint64_t value) {
+    mmio_write32(base, off, (uint32_t)value);
+    mmio_write32(base, off + 4, (uint32_t)(value >> 32));
+}
+
+static void virtio_find_cb(uint8_t bus, uint8_t dev, uint8_t func,
+                           uint8_t class_code, uint8_t subclass,
+                           uint8_t prog_if, void *ctx) {
+    (void)class_code;
+    (void)subclass;
+    (void)prog_if;
+    struct virtio_find_ctx *find = (struct virtio_find_ctx *)ctx;
+    if (find->found) {
+        return;
+    }
+    if (pci_read_config16(bus, dev, func, 0x00) != VIRTIO_PCI_VENDOR ||
+        pci_read_config16(bus, dev, func, 0x02) != find->device_id) {
+        return;
+    }
+    find->found = 1;
+    find->bus = bus;
+    find->dev = dev;
+    find->func = func;
+}
+
+static volatile uint8_t *bar_address(const struct virtio_device *vdev, uint8_t bar) {
+    if (bar > 5) {
+        return 0;
+    }
+    uint32_t lo = pci_read_config32(vdev->bus, vdev->dev, vdev->func, (uint8_t)(0x10 + bar * 4));
+    if (lo & 0x1u) {
+        return 0;
+    }
+    if ((lo & 0x6u) == 0x4u) {
+        uint32_t hi = pci_read_config32(vdev->bus, vdev->dev, vdev->func, (uint8_t)(0x14 + bar * 4));
+        if (hi != 0) {
+            return 0;
+        }
+    }
+    return (volatile uint8_t *)(uintptr_t)(lo & 0xFFFFFFF0u);
+}
+
+int virtio_pci_find(uint16_t device_id, struct virtio_device *out) {
+    if (!out) {
+        return 0;
+    }
+    struct virtio_find_ctx find = { device_id, 0, 0, 0, 0 };
+    pci_scan_bus0(virtio_find_cb, &find);
+    if (!find.found) {
+        return 0;
+    }
+
+    out->bus = find.bus;
+    out->dev = find.dev;
+    out->func = find.func;
+    out->common = 0;
+    out->notify_base = 0;
+    out->isr = 0;
+    out->device_cfg = 0;
+    out->notify_off_multiplier = 0;
+
+    uint16_t status = pci_read_config16(out->bus, out->dev, out->func, 0x06);
+    if ((status & (1u << 4)) == 0) {
+        return 0;
+    }
+
+    uint8_t cap = pci_read_config8(out->bus, out->dev, out->func, 0x34) & 0xFCu;
+    for (uint32_t guard = 0; cap != 0 && guard < 48; ++guard) {
+        uint8_t cap_id = pci_read_config8(out->bus, out->dev, out->func, cap);
+        uint8_t next = pci_read_config8(out->bus, out->dev, out->func, (uint8_t)(cap + 1)) & 0xFCu;
+        if (cap_id == 0x09) {
+            uint8_t cfg_type = pci_read_config8(out->bus, out->dev, out->func, (uint8_t)(cap + 3));
+            uint8_t bar = pci_read_config8(out->bus, out->dev, out->func, (uint8_t)(cap + 4));
+            uint32_t offset = pci_read_config32(out->bus, out->dev, out->func, (uint8_t)(cap + 8));
+            volatile uint8_t *base = bar_address(out, bar);
+            if (base) {
+                switch (cfg_type) {
+                case VIRTIO_PCI_CAP_COMMON_CFG:
+                    out->common = base + offset;
+                    break;
+                case VIRTIO_PCI_CAP_NOTIFY_CFG:
+                    out->notify_base = base + offset;
+                    out->notify_off_multiplier = pci_read_config32(out->bus, out->dev, out->func, (uint8_t)(cap + 16));
+                    break;
+                case VIRTIO_PCI_CAP_ISR_CFG:
+                    out->isr = base + offset;
+                    break;
+                case VIRTIO_PCI_CAP_DEVICE_CFG:
+                    out->device_cfg = base + offset;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        cap = next;
+    }
+
+    if (!out->common || !out->notify_base) {
+        return 0;
+    }
+    pci_enable_bus_master(out->bus, out->dev, out->func);
+    return 1;
+}
+
+int virtio_negotiate(struct virtio_device *vdev, uint32_t features_lo) {
+    if (!vdev || !vdev->common) {
+        return 0;
+    }
+    mmio_write8(vdev->common, COMMON_DEVICE_STATUS, 0);
+    for (uint32_t i = 0; i < 100000 && mmio_read8(vdev->common, COMMON_DEVICE_STATUS) != 0; ++i) {
+    }
+    mmio_write8(vdev->common, COMMON_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    mmio_write8(vdev->common, COMMON_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    mmio_write32(vdev->common, COMMON_DEVICE_FEATURE_SELECT, 1);
+    uint32_t device_hi = mmio_read32(vdev->common, COMMON_DEVICE_FEATURE);
+    if ((device_hi & VIRTIO_F_VERSION_1_HI) == 0) {
+        virtio_fail(vdev);
+        return 0;
+    }
+    mmio_write32(vdev->common, COMMON_DEVICE_FEATURE_SELECT, 0);
+    uint32_t device_lo = mmio_read32(vdev->common, COMMON_DEVICE_FEATURE);
+
+    mmio_write32(vdev->common, COMMON_DRIVER_FEATURE_SELECT, 0);
+    mmio_write32(vdev->common, COMMON_DRIVER_FEATURE, device_lo & features_lo);
+    mmio_write32(vdev->common, COMMON_DRIVER_FEATURE_SELECT, 1);
+    mmio_write32(vdev->common, COMMON_DRIVER_FEATURE, VIRTIO_F_VERSION_1_HI);
+
+    uint8_t status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_FEATURES_OK;
+    mmio_write8(vdev->common, COMMON_DEVICE_STATUS, status);
+    if ((mmio_read8(vdev->common, COMMON_DEVICE_STATUS) & VIRTIO_STATUS_FEATURES_OK) == 0) {
+        virtio_fail(vdev);
+        return 0;
+    }
+    return 1;
+}
+
+int virtio_setup_queue(struct virtio_device *vdev, struct virtqueue *vq, uint16_t index, uint16_t max_size) {
+    if (!vdev || !vq) {
+        return 0;
+    }
+    mmio_write16(vdev->common, COMMON_QUEUE_SELECT, index);
+    uint16_t size = mmio_read16(vdev->common, COMMON_QUEUE_SIZE);
+    if (size == 0) {
+        return 0;
+    }
+    if (size > max_size) {
+        size = max_size;
+    }
+    if (size > 64) {
+        size = 64;
+    }
+
+    uint32_t page = phys_alloc_page();
+    if (page == 0) {
+        return 0;
+    }
+    uint8_t *mem = (uint8_t *)(uintptr_t)page;
+    for (uint32_t i = 0; i < 4096u; ++i) {
+        mem[i] = 0;
+    }
+
+    vq->index = index;
+    vq->size = size;
+    vq->last_used = 0;
+    vq->desc = (volatile struct virtq_desc *)mem;
+    vq->avail = (volatile struct virtq_avail *)(mem + 16u * size);
+    vq->used = (volatile struct virtq_used *)(mem + 2048u);
+
+    mmio_write16(vdev->common, COMMON_QUEUE_SIZE, size);
+    mmio_write64(vdev->common, COMMON_QUEUE_DESC, (uint32_t)(uintptr_t)vq->desc);
+    mmio_write64(vdev->common, COMMON_QUEUE_DRIVER, (uint32_t)(uintptr_t)vq->avail);
+    mmio_write64(vdev->common, COMMON_QUEUE_DEVICE, (uint32_t)(uintptr_t)vq->used);
+    uint16_t notify_off = mmio_read16(vdev->common, COMMON_QUEUE_NOTIFY_OFF);
+    vq->notify = (volatile uint16_t *)(vdev->notify_base + (uint32_t)notify_off * vdev->notify_off_multiplier);
+    mmio_write16(vdev->common, COMMON_QUEUE_ENABLE, 1);
+    return 1;
+}
+
+void virtio_driver_ok(struct virtio_device *vdev) {
+    uint8_t status = mmio_read8(vdev->common, COMMON_DEVICE_STATUS);
+    mmio_write8(vdev->common, COMMON_DEVICE_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_device *vdev) {
+    uint8_t status = mmio_read8(vdev->common, COMMON_DEVICE_STATUS);
+    mmio_write8(vdev->common, COMMON_DEVICE_STATUS, status | VIRTIO_STATUS_FAILED);
+}
+
+void virtq_add_buffer_pair(struct virtqueue *vq, uint16_t head,
+                           const void *req, uint32_t req_len,
+                           void *resp, uint32_t resp_len) {
+    uint16_t next = (uint16_t)((head + 1u) % vq->size);
+    vq->desc[head].addr = (uint32_t)(uintptr_t)req;
+    vq->desc[head].len = req_len;
+    vq->desc[head].flags = VIRTQ_DESC_F_NEXT;
+    vq->desc[head].next = next;
+    vq->desc[next].addr = (uint32_t)(uintptr_t)resp;
+    vq->desc[next].len = resp_len;
+    vq->desc[next].flags = VIRTQ_DESC_F_WRITE;
+    vq->desc[next].next = 0;
+
+    uint16_t avail_idx = vq->avail->idx;
+    vq->avail->ring[avail_idx % vq->size] = head;
+    __asm__ volatile ("" : : : "memory");
+    vq->avail->idx = (uint16_t)(avail_idx + 1u);
+}
+
+void virtq_kick(struct virtqueue *vq) {
+    __asm__ volatile ("" : : : "memory");
+    *vq->notify = vq->index;
+}
+
+int virtq_wait_idle(struct virtqueue *vq, uint32_t spins) {
+    uint16_t target = vq->avail->idx;
+    for (uint32_t i = 0; i < spins; ++i) {
+        if (vq->used->idx == target) {
+            vq->last_used = target;
+            return 1;
+        }
+        __asm__ volatile ("pause");
+    }
+    log_puts("virtio: queue timeout\n");
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include "virtio_gpu.h"
+#include "log.h"
+#include "memory.h"
+
+#define VIRTIO_GPU_CMD_GET_DISPLAY_INFO 0x0100u
+#define VIRTIO_GPU_CMD_RESOURCE_CREATE_2D 0x0101u
+#define VIRTIO_GPU_CMD_SET_SCANOUT 0x0103u
+#define VIRTIO_GPU_CMD_RESOURCE_FLUSH 0x0104u
+#define VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D 0x0105u
+#define VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING 0x0106u
+
+#define VIRTIO_GPU_RESP_OK_NODATA 0x1100u
+#define VIRTIO_GPU_RESP_OK_DISPLAY_INFO 0x1101u
+
+#define VIRTIO_GPU_FORMAT_B8G8R8X8_UNORM 2u
+#define VIRTIO_GPU_MAX_SCANOUTS 16
+
+#define CMD_SLOT_SIZE 128u
+#define CMD_RESP_OFFSET 64u
+#define CMD_MAX_SLOTS (4096u / CMD_SLOT_SIZE)
+#define QUEUE_SPINS 10000000u
+
+struct vgpu_ctrl_hdr {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t fence_id;
+    uint32_t ctx_id;
+    uint32_t padding;
+} __attribute__((packed));
+
+struct vgpu_rect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} __attribute__((packed));
+
+struct vgpu_display_info {
+    struct vgpu_ctrl_hdr hdr;
+    struct {
+        struct vgpu_rect r;
+        uint32_t enabled;
+        uint32_t flags;
+    } pmodes[VIRTIO_GPU_MAX_SCANOUTS];
+} __attribute__((packed));
+
+struct vgpu_resource_create_2d {
+    struct vgpu_ctrl_hdr hdr;
+    uint32_t resource_id;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+} __attribute__((packed));
+
+struct vgpu_attach_backing {
+    struct vgpu_ctrl_hdr hdr;
+    uint32_t resource_id;
+    uint32_t nr_entries;
+    uint64_t addr;
+    uint32_t length;
+    uint32_t padding;
+} __attribute__((packed));
+
+struct vgpu_set_scanout {
+    struct vgpu_ctrl_hdr hdr;
+    struct vgpu_rect r;
+    uint32_t scanout_id;
+    uint32_t resource_id;
+} __attribute__((packed));
+
+struct vgpu_transfer_to_host_2d {
+    struct vgpu_ctrl_hdr hdr;
+    struct vgpu_rect r;
+    uint64_t offset;
+    uint32_t resource_id;
+    uint32_t padding;
+} __attribute__((packed));
+
+struct vgpu_resource_flush {
+    struct vgpu_ctrl_hdr hdr;
+    struct vgpu_rect r;
+    uint32_t resource_id;
+    uint32_t padding;
+} __attribute__((packed));
+
+static void zero(void *p, uint32_t len) {
+    uint8_t *b = (uint8_t *)p;
+    for (uint32_t i = 0; i < len; ++i) {
+        b[i] = 0;
+    }
+}
+
+static void *slot_req(struct virtio_gpu *gpu, uint32_t slot) {
+    void *req = gpu->cmd_area + slot * CMD_SLOT_SIZE;
+    zero(req, CMD_SLOT_SIZE);
+    return req;
+}
+
+static struct vgpu_ctrl_hdr *slot_resp(struct virtio_gpu *gpu, uint32_t slot) {
+    return (struct vgpu_ctrl_hdr *)(gpu->cmd_area + slot * CMD_SLOT_SIZE + CMD_RESP_OFFSET);
+}
+
+static void queue_slot(struct virtio_gpu *gpu, uint32_t slot, uint32_t req_len) {
+    virtq_add_buffer_pair(&gpu->ctrlq, (uint16_t)(slot * 2u),
+                          gpu->cmd_area + slot * CMD_SLOT_SIZE, req_len,
+                          slot_resp(gpu, slot), sizeof(struct vgpu_ctrl_hdr));
+}
+
+static int finish_slots(struct virtio_gpu *gpu, uint32_t count) {
+    virtq_kick(&gpu->ctrlq);
+    if (!virtq_wait_idle(&gpu->ctrlq, QUEUE_SPINS)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (slot_resp(gpu, i)->type != VIRTIO_GPU_RESP_OK_NODATA) {
+            log_puts("virtio-gpu: cmd failed resp=");
+            log_hex32(slot_resp(gpu, i)->type);
+            log_puts("\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int get_display_info(struct virtio_gpu *gpu) {
+    struct vgpu_ctrl_hdr *req = (struct vgpu_ctrl_hdr *)slot_req(gpu, 0);
+    struct vgpu_display_info *info = (struct vgpu_display_info *)kmalloc(sizeof(struct vgpu_display_info), 16);
+    if (!info) {
+        return 0;
+    }
+    zero(info, sizeof(*info));
+    req->type = VIRTIO_GPU_CMD_GET_DISPLAY_INFO;
+    virtq_add_buffer_pair(&gpu->ctrlq, 0, req, sizeof(*req), info, sizeof(*info));
+    virtq_kick(&gpu->ctrlq);
+    if (!virtq_wait_idle(&gpu->ctrlq, QUEUE_SPINS) || info->hdr.type != VIRTIO_GPU_RESP_OK_DISPLAY_INFO) {
+        return 0;
+    }
+    if (!info->pmodes[0].enabled) {
+        return 0;
+    }
+    gpu->width = info->pmodes[0].r.width;
+    gpu->height = info->pmodes[0].r.height;
+    return 1;
+}
+
+int virtio_gpu_init(struct virtio_gpu *gpu) {
+    if (!gpu) {
+        return 0;
+    }
+    gpu->width = 0;
+    gpu->height = 0;
+    gpu->pitch = 0;
+    gpu->resource_id = 0;
+    if (!virtio_pci_find(VIRTIO_PCI_DEVICE_GPU, &gpu->vdev)) {
+        return 0;
+    }
+    if (!virtio_negotiate(&gpu->vdev, 0)) {
+        log_puts("virtio-gpu: feature negotiation failed\n");
+        return 0;
+    }
+    if (!virtio_setup_queue(&gpu->vdev, &gpu->ctrlq, 0, 64)) {
+        log_puts("virtio-gpu: no control queue\n");
+        virtio_fail(&gpu->vdev);
+        return 0;
+    }
+    uint32_t page = phys_alloc_page();
+    if (page == 0) {
+        virtio_fail(&gpu->vdev);
+        return 0;
+    }
+    gpu->cmd_area = (uint8_t *)(uintptr_t)page;
+    gpu->cmd_slots = CMD_MAX_SLOTS;
+    if (gpu->cmd_slots > gpu->ctrlq.size / 2u) {
+        gpu->cmd_slots = gpu->ctrlq.size / 2u;
+    }
+    virtio_driver_ok(&gpu->vdev);
+
+    if (!get_display_info(gpu)) {
+        log_puts("virtio-gpu: no enabled scanout\n");
+        virtio_fail(&gpu->vdev);
+        return 0;
+    }
+    log_puts("virtio-gpu: scanout ");
+    log_dec32(gpu->width);
+    log_puts("x");
+    log_dec32(gpu->height);
+    log_puts("\n");
+    return 1;
+}
+
+int virtio_gpu_attach_surface(struct virtio_gpu *gpu, const struct framebuffer *surface) {
+    if (!gpu || !surface || surface->format != FB_FORMAT_XRGB8888) {
+        return 0;
+    }
+    gpu->resource_id = 1;
+
+    struct vgpu_resource_create_2d *create = (struct vgpu_resource_create_2d *)slot_req(gpu, 0);
+    create->hdr.type = VIRTIO_GPU_CMD_RESOURCE_CREATE_2D;
+    create->resource_id = gpu->resource_id;
+    create->format = VIRTIO_GPU_FORMAT_B8G8R8X8_UNORM;
+    create->width = surface->pitch / 4u;
+    create->height = surface->height;
+    queue_slot(gpu, 0, sizeof(*create));
+
+    struct vgpu_attach_backing *attach = (struct vgpu_attach_backing *)slot_req(gpu, 1);
+    attach->hdr.type = VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING;
+    attach->resource_id = gpu->resource_id;
+    attach->nr_entries = 1;
+    attach->addr = (uint32_t)(uintptr_t)surface->base;
+    attach->length = surface->pitch * surface->height;
+    queue_slot(gpu, 1, sizeof(*attach));
+
+    struct vgpu_set_scanout *scanout = (struct vgpu_set_scanout *)slot_req(gpu, 2);
+    scanout->hdr.type = VIRTIO_GPU_CMD_SET_SCANOUT;
+    scanout->r.width = surface->width;
+    scanout->r.height = surface->height;
+    scanout->scanout_id = 0;
+    scanout->resource_id = gpu->resource_id;
+    queue_slot(gpu, 2, sizeof(*scanout));
+
+    if (!finish_slots(gpu, 3)) {
+        gpu->resource_id = 0;
+        return 0;
+    }
+    gpu->width = surface->width;
+    gpu->height = surface->height;
+    gpu->pitch = surface->pitch;
+    return 1;
+}
+
+static struct vgpu_rect clip_rect(const struct virtio_gpu *gpu, const struct rect *r) {
+    struct rect bounds = { 0, 0, (int)gpu->width, (int)gpu->height };
+    struct rect c = rect_intersect(*r, bounds);
+    struct vgpu_rect vr = { (uint32_t)c.x, (uint32_t)c.y, (uint32_t)c.w, (uint32_t)c.h };
+    return vr;
+}
+
+int virtio_gpu_flush_rects(struct virtio_gpu *gpu, const struct rect *rects, int count) {
+    if (!gpu || gpu->resource_id == 0 || !rects) {
+        return 0;
+    }
+    uint32_t per_batch = gpu->cmd_slots / 2u;
+    int next = 0;
+    while (next < count) {
+        struct vgpu_rect batch_rects[CMD_MAX_SLOTS / 2u];
+        uint32_t batch = 0;
+        while (next < count && batch < per_batch) {
+            struct vgpu_rect vr = clip_rect(gpu, &rects[next++]);
+            if (vr.width == 0 || vr.height == 0) {
+                continue;
+            }
+            batch_rects[batch] = vr;
+            struct vgpu_transfer_to_host_2d *xfer = (struct vgpu_transfer_to_host_2d *)slot_req(gpu, batch);
+            xfer->hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
+            xfer->r = vr;
+            xfer->offset = (uint64_t)vr.y * gpu->pitch + (uint64_t)vr.x * 4u;
+            xfer->resource_id = gpu->resource_id;
+            queue_slot(gpu, batch, sizeof(*xfer));
+            batch++;
+        }
+        if (batch == 0) {
+            break;
+        }
+        for (uint32_t i = 0; i < batch; ++i) {
+            struct vgpu_resource_flush *flush = (struct vgpu_resource_flush *)slot_req(gpu, batch + i);
+            flush->hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
+            flush->r = batch_rects[i];
+            flush->resource_id = gpu->resource_id;
+            queue_slot(gpu, batch + i, sizeof(*flush));
+        }
+        if (!finish_slots(gpu, batch * 2u)) {
+            return 0;
+        }
+    }
+    return 1;
+}
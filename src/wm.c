@@ -0,0 +1,205 @@
+#include "wm.h"
+#include "memory.h"
+
+static int valid_id(const struct window_manager *wm, int id) {
+    return wm && id >= 0 && id < WM_MAX_WINDOWS && wm->windows[id].used;
+}
+
+static int grid_span(const struct window_manager *wm, struct rect r, int *c0, int *c1, int *r0, int *r1) {
+    if (!wm->grid) {
+        return 0;
+    }
+    struct rect area = { 0, 0, (int)(wm->grid_cols * WM_CELL_SIZE), (int)(wm->grid_rows * WM_CELL_SIZE) };
+    r = rect_intersect(r, area);
+    if (r.w <= 0 || r.h <= 0) {
+        return 0;
+    }
+    *c0 = r.x / WM_CELL_SIZE;
+    *r0 = r.y / WM_CELL_SIZE;
+    *c1 = (r.x + r.w - 1) / WM_CELL_SIZE;
+    *r1 = (r.y + r.h - 1) / WM_CELL_SIZE;
+    return 1;
+}
+
+static void grid_update(struct window_manager *wm, int id, int set) {
+    int c0, c1, r0, r1;
+    if (!grid_span(wm, wm->windows[id].rect, &c0, &c1, &r0, &r1)) {
+        return;
+    }
+    uint32_t bit = 1u << id;
+    for (int row = r0; row <= r1; ++row) {
+        uint32_t *cell = &wm->grid[(uint32_t)row * wm->grid_cols];
+        for (int col = c0; col <= c1; ++col) {
+            if (set) {
+                cell[col] |= bit;
+            } else {
+                cell[col] &= ~bit;
+            }
+        }
+    }
+}
+
+static void renumber(struct window_manager *wm, int from) {
+    for (int i = from; i < wm->open_count; ++i) {
+        wm->windows[wm->order[i]].z = (uint8_t)i;
+    }
+}
+
+void wm_init(struct window_manager *wm, uint32_t width, uint32_t height) {
+    for (int i = 0; i < WM_MAX_WINDOWS; ++i) {
+        wm->windows[i].used = 0;
+        wm->windows[i].open = 0;
+    }
+    wm->grid_cols = (width + WM_CELL_SIZE - 1u) / WM_CELL_SIZE;
+    wm->grid_rows = (height + WM_CELL_SIZE - 1u) / WM_CELL_SIZE;
+    uint32_t cells = wm->grid_cols * wm->grid_rows;
+    uint32_t addr = cells ? phys_alloc_pages((cells * 4u + 4095u) / 4096u) : 0;
+    wm->grid = (uint32_t *)(uintptr_t)addr;
+    for (uint32_t i = 0; wm->grid && i < cells; ++i) {
+        wm->grid[i] = 0;
+    }
+    wm->open_count = 0;
+}
+
+int wm_register(struct window_manager *wm, int owner, struct rect rect) {
+    if (!wm) {
+        return -1;
+    }
+    for (int i = 0; i < WM_MAX_WINDOWS; ++i) {
+        struct wm_window *win = &wm->windows[i];
+        if (win->used) {
+            continue;
+        }
+        win->owner = owner;
+        win->rect = rect;
+        win->used = 1;
+        win->open = 0;
+        win->z = 0;
+        return i;
+    }
+    return -1;
+}
+
+void wm_unregister(struct window_manager *wm, int id) {
+    if (!valid_id(wm, id)) {
+        return;
+    }
+    wm_close(wm, id);
+    wm->windows[id].used = 0;
+}
+
+int wm_is_open(const struct window_manager *wm, int id) {
+    return valid_id(wm, id) && wm->windows[id].open;
+}
+
+void wm_open(struct window_manager *wm, int id) {
+    if (!valid_id(wm, id) || wm->windows[id].open) {
+        return;
+    }
+    wm->windows[id].open = 1;
+    wm->order[wm->open_count++] = (uint8_t)id;
+    renumber(wm, wm->open_count - 1);
+    grid_update(wm, id, 1);
+}
+
+void wm_close(struct window_manager *wm, int id) {
+    if (!wm_is_open(wm, id)) {
+        return;
+    }
+    int z = wm->windows[id].z;
+    for (int i = z; i + 1 < wm->open_count; ++i) {
+        wm->order[i] = wm->order[i + 1];
+    }
+    wm->open_count--;
+    wm->windows[id].open = 0;
+    renumber(wm, z);
+    grid_update(wm, id, 0);
+}
+
+int wm_raise(struct window_manager *wm, int id) {
+    if (!wm_is_open(wm, id)) {
+        return 0;
+    }
+    int z = wm->windows[id].z;
+    if (z == wm->open_count - 1) {
+        return 0;
+    }
+    for (int i = z; i + 1 < wm->open_count; ++i) {
+        wm->order[i] = wm->order[i + 1];
+    }
+    wm->order[wm->open_count - 1] = (uint8_t)id;
+    renumber(wm, z);
+    return 1;
+}
+
+void wm_move(struct window_manager *wm, int id, int x, int y) {
+    if (!valid_id(wm, id)) {
+        return;
+    }
+    struct wm_window *win = &wm->windows[id];
+    if (win->open) {
+        grid_update(wm, id, 0);
+    }
+    win->rect.x = x;
+    win->rect.y = y;
+    if (win->open) {
+        grid_update(wm, id, 1);
+    }
+}
+
+struct rect wm_rect(const struct window_manager *wm, int id) {
+    if (!valid_id(wm, id)) {
+        return (struct rect){ 0, 0, 0, 0 };
+    }
+    return wm->windows[id].rect;
+}
+
+int wm_owner(const struct window_manager *wm, int id) {
+    if (!valid_id(wm, id)) {
+        return -1;
+    }
+    return wm->windows[id].owner;
+}
+
+static int window_at_linear(const struct window_manager *wm, int x, int y) {
+    for (int i = wm->open_count - 1; i >= 0; --i) {
+        int id = wm->order[i];
+        if (point_in_rect(x, y, wm->windows[id].rect)) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+int wm_window_at(const struct window_manager *wm, int x, int y) {
+    if (!wm || x < 0 || y < 0) {
+        return -1;
+    }
+    if (!wm->grid || (uint32_t)x >= wm->grid_cols * WM_CELL_SIZE || (uint32_t)y >= wm->grid_rows * WM_CELL_SIZE) {
+        return window_at_linear(wm, x, y);
+    }
+    uint32_t mask = wm->grid[((uint32_t)y / WM_CELL_SIZE) * wm->grid_cols + (uint32_t)x / WM_CELL_SIZE];
+    int best = -1;
+    int best_z = -1;
+    while (mask) {
+        int id = __builtin_ctz(mask);
+        mask &= mask - 1;
+        const struct wm_window *win = &wm->windows[id];
+        if ((int)win->z > best_z && point_in_rect(x, y, win->rect)) {
+            best = id;
+            best_z = win->z;
+        }
+    }
+    return best;
+}
+
+int wm_count(const struct window_manager *wm) {
+    return wm ? wm->open_count : 0;
+}
+
+int wm_at_depth(const struct window_manager *wm, int depth) {
+    if (!wm || depth < 0 || depth >= wm->open_count) {
+        return -1;
+    }
+    return wm->order[depth];
+}
@@ -0,0 +1,327 @@
+#include "xhci.h"
+#include "idt.h"
+#include "log.h"
+#include "pic.h"
+#include "timer.h"
+#include "xhci_regs.h"
+
+#define XHCI_IMOD_250US 1000u
+#define XHCI_HCC_CSZ (1u << 2)
+#define XHCI_HCC_PPC (1u << 3)
+#define XHCI_CAP_LEGACY 1u
+#define XHCI_CAP_PROTOCOL 2u
+#define XHCI_LEGACY_BIOS (1u << 16)
+#define XHCI_LEGACY_OS (1u << 24)
+#define XHCI_LEGACY_SMI_CLEAR 0xE0000000u
+#define XHCI_HANDOFF_TIMEOUT_US 1000000u
+#define XHCI_HALT_TIMEOUT_US 20000u
+#define XHCI_RESET_TIMEOUT_US 500000u
+#define XHCI_START_TIMEOUT_US 20000u
+#define XHCI_POWER_DELAY_US 20000u
+#define XHCI_PORT_RESET_TIMEOUT_US 500000u
+#define XHCI_MAX_IRQ_CONTROLLERS 8
+#define PORT_CONNECT (1u << 0)
+#define PORT_ENABLE (1u << 1)
+#define PORT_RESET (1u << 4)
+#define PORT_POWER (1u << 9)
+#define PORT_SPEED_SHIFT 10
+#define PORT_CONNECT_CHANGE (1u << 17)
+#define PORT_WARM_RESET_CHANGE (1u << 19)
+#define PORT_RESET_CHANGE (1u << 21)
+#define PORT_CHANGE_MASK 0x00FE0000u
+#define PORT_PRESERVE 0x0E00C3E0u
+#define PORT_WARM_RESET (1u << 31)
+#define PORT_SPEED_FULL 1u
+#define PORT_SPEED_LOW 2u
+#define PORT_SPEED_HIGH 3u
+
+enum port_reset_phase {
+    PORT_RESET_IDLE = 0,
+    PORT_RESET_ASSERT,
+    PORT_RESET_DONE
+};
+
+static struct xhci_controller *irq_ctrls[XHCI_MAX_IRQ_CONTROLLERS];
+static uint32_t irq_ctrl_count;
+
+static void scan_capabilities(struct xhci_controller *ctrl) {
+    uint32_t off = (ctrl->hcc_params1 >> 16) << 2;
+    for (uint32_t guard = 0; off != 0 && guard < 64; ++guard) {
+        uint32_t cap = mmio_read32(ctrl->base, off);
+        switch (cap & 0xFFu) {
+        case XHCI_CAP_LEGACY:
+            ctrl->legacy_cap = off;
+            break;
+        case XHCI_CAP_PROTOCOL:
+            if ((cap >> 24) == 3u) {
+                uint32_t ports = mmio_read32(ctrl->base, off + 8);
+                uint32_t first = (ports & 0xFFu) - 1u;
+                uint32_t count = (ports >> 8) & 0xFFu;
+                for (uint32_t i = first; i < first + count && i < XHCI_MAX_PORTS; ++i) {
+                    ctrl->usb3_ports |= 1u << i;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+        uint32_t next = (cap >> 8) & 0xFFu;
+        off = next ? off + (next << 2) : 0;
+    }
+}
+
+int xhci_init(struct xhci_controller *out, uint32_t bar0) {
+    if (!out) {
+        return 0;
+    }
+    uint32_t base_addr = bar0 & 0xFFFFFFF0u;
+    if (base_addr == 0) {
+        return 0;
+    }
+
+    out->base = (volatile uint8_t *)(uintptr_t)base_addr;
+    uint32_t cap_length = mmio_read32(out->base, XHCI_CAPLENGTH) & 0xFFu;
+    out->hcs_params1 = mmio_read32(out->base, XHCI_HCSPARAMS1);
+    out->hcs_params2 = mmio_read32(out->base, XHCI_HCSPARAMS2);
+    out->hcc_params1 = mmio_read32(out->base, XHCI_HCCPARAMS1);
+    if (cap_length < 0x20u || out->hcs_params1 == 0xFFFFFFFFu) {
+        return 0;
+    }
+    out->op_base = out->base + cap_length;
+    out->rt_base = out->base + (mmio_read32(out->base, XHCI_RTSOFF) & ~0x1Fu);
+    out->doorbells = (volatile uint32_t *)(out->base + (mmio_read32(out->base, XHCI_DBOFF) & ~0x3u));
+    out->context_size = (out->hcc_params1 & XHCI_HCC_CSZ) ? 64u : 32u;
+    out->max_slots = (uint8_t)(out->hcs_params1 & 0xFFu);
+    if (out->max_slots > XHCI_MAX_SLOTS) {
+        out->max_slots = XHCI_MAX_SLOTS;
+    }
+    uint32_t ports = out->hcs_params1 >> 24;
+    out->port_count = (uint8_t)(ports > XHCI_MAX_PORTS ? XHCI_MAX_PORTS : ports);
+    out->legacy_cap = 0;
+    out->usb3_ports = 0;
+    out->irq = XHCI_NO_IRQ;
+    out->irq_status = 0;
+    out->irq_events = 0;
+    out->dcbaa = 0;
+    out->reset_phase = PORT_RESET_IDLE;
+    scan_capabilities(out);
+
+    log_puts("xHCI caplen=");
+    log_dec32(cap_length);
+    log_puts(" ports=");
+    log_dec32(out->port_count);
+    log_puts(" slots=");
+    log_dec32(out->max_slots);
+    log_puts("\n");
+
+    if (out->legacy_cap) {
+        uint32_t legacy = mmio_read32(out->base, out->legacy_cap);
+        mmio_write32(out->base, out->legacy_cap, legacy | XHCI_LEGACY_OS);
+    }
+    out->state = XHCI_STATE_HANDOFF;
+    out->deadline_us = timer_us() + XHCI_HANDOFF_TIMEOUT_US;
+    return 1;
+}
+
+static enum xhci_state step_fail(struct xhci_controller *ctrl, const char *why) {
+    log_puts("xHCI: ");
+    log_puts(why);
+    log_puts("\n");
+    ctrl->state = XHCI_STATE_FAILED;
+    return XHCI_STATE_FAILED;
+}
+
+enum xhci_state xhci_step(struct xhci_controller *ctrl, uint64_t now_us) {
+    if (!ctrl || !ctrl->op_base) {
+        return XHCI_STATE_FAILED;
+    }
+    uint32_t sts = mmio_read32(ctrl->op_base, XHCI_USBSTS);
+    switch (ctrl->state) {
+    case XHCI_STATE_HANDOFF:
+        if (ctrl->legacy_cap) {
+            uint32_t legacy = mmio_read32(ctrl->base, ctrl->legacy_cap);
+            if ((legacy & XHCI_LEGACY_BIOS) && now_us < ctrl->deadline_us) {
+                break;
+            }
+            if (legacy & XHCI_LEGACY_BIOS) {
+                log_puts("xHCI: BIOS handoff timed out\n");
+            }
+            mmio_write32(ctrl->base, ctrl->legacy_cap + 4, XHCI_LEGACY_SMI_CLEAR);
+        }
+        mmio_write32(ctrl->op_base, XHCI_USBCMD,
+                     mmio_read32(ctrl->op_base, XHCI_USBCMD) & ~(XHCI_CMD_RUN | XHCI_CMD_INTE));
+        ctrl->state = XHCI_STATE_HALTING;
+        ctrl->deadline_us = now_us + XHCI_HALT_TIMEOUT_US;
+        break;
+    case XHCI_STATE_HALTING:
+        if ((sts & XHCI_STS_HALTED) == 0 && now_us < ctrl->deadline_us) {
+            break;
+        }
+        mmio_write32(ctrl->op_base, XHCI_USBCMD, XHCI_CMD_RESET);
+        ctrl->state = XHCI_STATE_RESETTING;
+        ctrl->deadline_us = now_us + XHCI_RESET_TIMEOUT_US;
+        break;
+    case XHCI_STATE_RESETTING:
+        if ((mmio_read32(ctrl->op_base, XHCI_USBCMD) & XHCI_CMD_RESET) || (sts & XHCI_STS_NOT_READY)) {
+            if (now_us >= ctrl->deadline_us) {
+                return step_fail(ctrl, "controller reset timed out");
+            }
+            break;
+        }
+        if (!xhci_schedule_init(ctrl)) {
+            return step_fail(ctrl, "ring allocation failed");
+        }
+        ctrl->state = XHCI_STATE_STARTING;
+        ctrl->deadline_us = now_us + XHCI_START_TIMEOUT_US;
+        break;
+    case XHCI_STATE_STARTING:
+        if (sts & XHCI_STS_HALTED) {
+            if (now_us >= ctrl->deadline_us) {
+                return step_fail(ctrl, "controller did not start");
+            }
+            break;
+        }
+        if (ctrl->hcc_params1 & XHCI_HCC_PPC) {
+            for (uint32_t i = 0; i < ctrl->port_count; ++i) {
+                uint32_t portsc = mmio_read32(ctrl->op_base, XHCI_PORTSC(i));
+                mmio_write32(ctrl->op_base, XHCI_PORTSC(i), (portsc & PORT_PRESERVE) | PORT_POWER);
+            }
+        }
+        ctrl->state = XHCI_STATE_POWERING;
+        ctrl->deadline_us = now_us + XHCI_POWER_DELAY_US;
+        break;
+    case XHCI_STATE_POWERING:
+        if (now_us >= ctrl->deadline_us) {
+            ctrl->state = XHCI_STATE_READY;
+        }
+        break;
+    default:
+        break;
+    }
+    return (enum xhci_state)ctrl->state;
+}
+
+uint32_t xhci_port_count(const struct xhci_controller *ctrl) {
+    return ctrl ? ctrl->port_count : 0;
+}
+
+int xhci_port_connected(struct xhci_controller *ctrl, uint32_t port) {
+    if (port >= xhci_port_count(ctrl)) {
+        return 0;
+    }
+    return (mmio_read32(ctrl->op_base, XHCI_PORTSC(port)) & PORT_CONNECT) != 0;
+}
+
+int xhci_port_changed(struct xhci_controller *ctrl, uint32_t port) {
+    if (port >= xhci_port_count(ctrl)) {
+        return 0;
+    }
+    uint32_t portsc = mmio_read32(ctrl->op_base, XHCI_PORTSC(port));
+    if ((portsc & PORT_CONNECT_CHANGE) == 0) {
+        return 0;
+    }
+    uint32_t clear = portsc & PORT_CHANGE_MASK & ~(PORT_RESET_CHANGE | PORT_WARM_RESET_CHANGE);
+    mmio_write32(ctrl->op_base, XHCI_PORTSC(port), (portsc & PORT_PRESERVE) | clear);
+    return 1;
+}
+
+enum usb_speed xhci_port_speed(struct xhci_controller *ctrl, uint32_t port) {
+    if (port >= xhci_port_count(ctrl)) {
+        return USB_SPEED_FULL;
+    }
+    uint32_t speed = (mmio_read32(ctrl->op_base, XHCI_PORTSC(port)) >> PORT_SPEED_SHIFT) & 0xFu;
+    switch (speed) {
+    case PORT_SPEED_FULL:
+        return USB_SPEED_FULL;
+    case PORT_SPEED_LOW:
+        return USB_SPEED_LOW;
+    case PORT_SPEED_HIGH:
+        return USB_SPEED_HIGH;
+    default:
+        return USB_SPEED_SUPER;
+    }
+}
+
+int xhci_port_reset_begin(struct xhci_controller *ctrl, uint32_t port, uint64_t now_us) {
+    if (port >= xhci_port_count(ctrl) || ctrl->reset_phase != PORT_RESET_IDLE) {
+        return 0;
+    }
+    uint32_t portsc = mmio_read32(ctrl->op_base, XHCI_PORTSC(port));
+    if ((portsc & PORT_CONNECT) == 0) {
+        return 0;
+    }
+    ctrl->reset_port = (uint8_t)port;
+    ctrl->reset_deadline_us = now_us + XHCI_PORT_RESET_TIMEOUT_US;
+    if (ctrl->usb3_ports & (1u << port)) {
+        if (portsc & PORT_ENABLE) {
+            ctrl->reset_phase = PORT_RESET_DONE;
+            return 1;
+        }
+        mmio_write32(ctrl->op_base, XHCI_PORTSC(port), (portsc & PORT_PRESERVE) | PORT_WARM_RESET);
+    } else {
+        mmio_write32(ctrl->op_base, XHCI_PORTSC(port), (portsc & PORT_PRESERVE) | PORT_RESET);
+    }
+    ctrl->reset_phase = PORT_RESET_ASSERT;
+    return 1;
+}
+
+enum usb_status xhci_port_reset_poll(struct xhci_controller *ctrl, uint64_t now_us) {
+    if (!ctrl || ctrl->reset_phase == PORT_RESET_IDLE) {
+        return USB_STATUS_ERROR;
+    }
+    uint32_t off = XHCI_PORTSC(ctrl->reset_port);
+    uint32_t portsc = mmio_read32(ctrl->op_base, off);
+    if (ctrl->reset_phase == PORT_RESET_ASSERT) {
+        uint32_t done = portsc & (PORT_RESET_CHANGE | PORT_WARM_RESET_CHANGE);
+        if (!done) {
+            if (now_us < ctrl->reset_deadline_us) {
+                return USB_STATUS_PENDING;
+            }
+            ctrl->reset_phase = PORT_RESET_IDLE;
+            return USB_STATUS_TIMEOUT;
+        }
+        mmio_write32(ctrl->op_base, off, (portsc & PORT_PRESERVE) | done);
+    }
+    ctrl->reset_phase = PORT_RESET_IDLE;
+    if ((portsc & (PORT_CONNECT | PORT_ENABLE)) != (PORT_CONNECT | PORT_ENABLE)) {
+        return USB_STATUS_ERROR;
+    }
+    return USB_STATUS_OK;
+}
+
+static int xhci_irq(uint8_t irq) {
+    int handled = 0;
+    for (uint32_t i = 0; i < irq_ctrl_count; ++i) {
+        struct xhci_controller *ctrl = irq_ctrls[i];
+        if (ctrl->irq != irq) {
+            continue;
+        }
+        uint32_t sts = mmio_read32(ctrl->op_base, XHCI_USBSTS) & (XHCI_STS_EVENT | XHCI_STS_HOST_ERROR);
+        if (sts == 0) {
+            continue;
+        }
+        mmio_write32(ctrl->op_base, XHCI_USBSTS, sts);
+        mmio_write32(ctrl->rt_base, XHCI_IMAN, XHCI_IMAN_ENABLE | XHCI_IMAN_PENDING);
+        ctrl->irq_status |= sts;
+        ctrl->irq_events++;
+        handled = 1;
+    }
+    return handled;
+}
+
+int xhci_enable_irq(struct xhci_controller *ctrl, uint8_t irq) {
+    if (!ctrl || !ctrl->op_base || irq >= PIC_IRQ_COUNT || irq_ctrl_count >= XHCI_MAX_IRQ_CONTROLLERS) {
+        return 0;
+    }
+    ctrl->irq = irq;
+    irq_ctrls[irq_ctrl_count++] = ctrl;
+    if (!irq_register(irq, xhci_irq)) {
+        irq_ctrl_count--;
+        ctrl->irq = XHCI_NO_IRQ;
+        return 0;
+    }
+    mmio_write32(ctrl->rt_base, XHCI_IMOD, XHCI_IMOD_250US);
+    mmio_write32(ctrl->rt_base, XHCI_IMAN, XHCI_IMAN_ENABLE | XHCI_IMAN_PENDING);
+    mmio_write32(ctrl->op_base, XHCI_USBCMD, mmio_read32(ctrl->op_base, XHCI_USBCMD) | XHCI_CMD_INTE);
+    return 1;
+}
@@ -0,0 +1,972 @@
+#include "xhci.h"
+#include "log.h"
+#include "memory.h"
+#include "timer.h"
+#include "xhci_regs.h"
+
+#define TRB_CYCLE (1u << 0)
+#define TRB_TOGGLE (1u << 1)
+#define TRB_ISP (1u << 2)
+#define TRB_CHAIN (1u << 4)
+#define TRB_IOC (1u << 5)
+#define TRB_IDT (1u << 6)
+#define TRB_DIR_IN (1u << 16)
+#define TRB_TRT_OUT (2u << 16)
+#define TRB_TRT_IN (3u << 16)
+#define TRB_TYPE(t) ((uint32_t)(t) << 10)
+#define TRB_TYPE_OF(c) (((c) >> 10) & 0x3Fu)
+#define TRB_SLOT(s) ((uint32_t)(s) << 24)
+#define TRB_EP(d) ((uint32_t)(d) << 16)
+#define TRB_MAX_BYTES 0x10000u
+#define TRB_LENGTH_MASK 0x1FFFFu
+
+#define TRB_NORMAL 1
+#define TRB_SETUP 2
+#define TRB_DATA 3
+#define TRB_STATUS 4
+#define TRB_LINK 6
+#define TRB_ENABLE_SLOT 9
+#define TRB_DISABLE_SLOT 10
+#define TRB_ADDRESS_DEVICE 11
+#define TRB_CONFIGURE_ENDPOINT 12
+#define TRB_EVALUATE_CONTEXT 13
+#define TRB_RESET_ENDPOINT 14
+#define TRB_STOP_ENDPOINT 15
+#define TRB_SET_DEQUEUE 16
+#define TRB_NOOP_COMMAND 23
+#define TRB_TRANSFER_EVENT 32
+#define TRB_COMMAND_EVENT 33
+
+#define CC_SUCCESS 1u
+#define CC_STALL 6u
+#define CC_SHORT_PACKET 13u
+#define CC_COMMAND_RING_STOPPED 24u
+#define CC_COMMAND_ABORTED 25u
+#define CC_STOPPED 26u
+#define CC_STOPPED_LENGTH 27u
+
+#define EP_TYPE_BULK_OUT 2u
+#define EP_TYPE_CONTROL 4u
+#define EP_TYPE_BULK_IN 6u
+#define EP_TYPE_INTERRUPT_IN 7u
+#define EP_ERROR_COUNT (3u << 1)
+#define SLOT_HUB (1u << 26)
+#define SLOT_SPEED_FULL 1u
+#define SLOT_SPEED_LOW 2u
+#define SLOT_SPEED_HIGH 3u
+#define SLOT_SPEED_SUPER 4u
+
+static void zero_words(void *p, uint32_t bytes) {
+    volatile uint32_t *w = (volatile uint32_t *)p;
+    for (uint32_t i = 0; i < bytes / 4u; ++i) {
+        w[i] = 0;
+    }
+}
+
+static uint32_t phys(const void *p) {
+    return (uint32_t)(uintptr_t)p;
+}
+
+static void ring_init(struct xhci_ring *ring, struct xhci_trb *trbs) {
+    zero_words(trbs, XHCI_RING_TRBS * (uint32_t)sizeof(struct xhci_trb));
+    struct xhci_trb *link = &trbs[XHCI_RING_TRBS - 1u];
+    link->param_lo = phys(trbs);
+    link->control = TRB_TYPE(TRB_LINK) | TRB_TOGGLE;
+    ring->trbs = trbs;
+    ring->index = 0;
+    ring->cycle = 1;
+}
+
+static uint32_t ring_push(struct xhci_ring *ring, uint32_t param_lo, uint32_t param_hi, uint32_t status,
+                          uint32_t control) {
+    uint32_t index = ring->index;
+    struct xhci_trb *trb = &ring->trbs[index];
+    trb->param_lo = param_lo;
+    trb->param_hi = param_hi;
+    trb->status = status;
+    __asm__ volatile ("" : : : "memory");
+    trb->control = (control & ~TRB_CYCLE) | ring->cycle;
+    if (++ring->index == XHCI_RING_TRBS - 1u) {
+        struct xhci_trb *link = &ring->trbs[XHCI_RING_TRBS - 1u];
+        link->control = (link->control & ~(TRB_CYCLE | TRB_CHAIN)) | (control & TRB_CHAIN) | ring->cycle;
+        ring->cycle ^= 1u;
+        ring->index = 0;
+    }
+    return index;
+}
+
+static uint32_t ring_next(uint32_t index) {
+    return index + 1u >= XHCI_RING_TRBS - 1u ? 0 : index + 1u;
+}
+
+static uint32_t ring_last(const struct xhci_ring *ring) {
+    return ring->index == 0 ? XHCI_RING_TRBS - 2u : ring->index - 1u;
+}
+
+static uint32_t ring_push_data(struct xhci_ring *ring, void *buf, uint32_t len, uint32_t first_type,
+                               uint32_t first_flags, uint32_t last_flags) {
+    uint32_t addr = phys(buf);
+    uint32_t first = ring->index;
+    int head = 1;
+    do {
+        uint32_t chunk = TRB_MAX_BYTES - (addr & (TRB_MAX_BYTES - 1u));
+        if (chunk > len) {
+            chunk = len;
+        }
+        uint32_t control = TRB_TYPE(head ? first_type : TRB_NORMAL) | TRB_ISP | (head ? first_flags : 0);
+        control |= chunk < len ? TRB_CHAIN : last_flags;
+        uint32_t index = ring_push(ring, addr, 0, chunk, control);
+        if (head) {
+            first = index;
+        }
+        head = 0;
+        addr += chunk;
+        len -= chunk;
+    } while (len > 0);
+    return first;
+}
+
+static uint32_t *context_at(const struct xhci_controller *ctrl, uint8_t *base, uint32_t index) {
+    return (uint32_t *)(base + index * ctrl->context_size);
+}
+
+int xhci_schedule_init(struct xhci_controller *ctrl) {
+    if (!ctrl || !ctrl->op_base) {
+        return 0;
+    }
+    uint32_t context_bytes = ctrl->context_size * 32u;
+    uint32_t ring_bytes = XHCI_RING_TRBS * (uint32_t)sizeof(struct xhci_trb);
+    uint32_t event_bytes = XHCI_EVENT_TRBS * (uint32_t)sizeof(struct xhci_trb);
+    ctrl->dcbaa = (uint64_t *)kmalloc((XHCI_MAX_SLOTS + 1u) * 8u, 64);
+    ctrl->erst = (uint32_t *)kmalloc(16, 64);
+    ctrl->input_context = (uint8_t *)kmalloc(context_bytes + ctrl->context_size, 4096);
+    ctrl->context_pool = (uint8_t *)kmalloc(context_bytes * XHCI_MAX_SLOTS, 4096);
+    ctrl->ring_pool = (struct xhci_trb *)kmalloc(ring_bytes * (XHCI_MAX_ENDPOINTS + 1u), 1024);
+    struct xhci_trb *events = (struct xhci_trb *)kmalloc(event_bytes, 4096);
+    if (!ctrl->dcbaa || !ctrl->erst || !ctrl->input_context || !ctrl->context_pool || !ctrl->ring_pool || !events) {
+        return 0;
+    }
+    zero_words(ctrl->dcbaa, (XHCI_MAX_SLOTS + 1u) * 8u);
+    zero_words(events, event_bytes);
+
+    uint32_t scratch = ((ctrl->hcs_params2 >> 21) & 0x1Fu) << 5 | ((ctrl->hcs_params2 >> 27) & 0x1Fu);
+    if (scratch > 0) {
+        uint64_t *array = (uint64_t *)kmalloc(scratch * 8u, 64);
+        if (!array) {
+            return 0;
+        }
+        for (uint32_t i = 0; i < scratch; ++i) {
+            void *page = kmalloc(4096, 4096);
+            if (!page) {
+                return 0;
+            }
+            zero_words(page, 4096);
+            array[i] = phys(page);
+        }
+        ctrl->dcbaa[0] = phys(array);
+    }
+
+    for (uint32_t i = 0; i < XHCI_MAX_SLOTS; ++i) {
+        ctrl->devices[i].used = 0;
+        ctrl->devices[i].serial = 0;
+        ctrl->devices[i].context = ctrl->context_pool + i * context_bytes;
+    }
+    for (uint32_t i = 0; i < XHCI_MAX_ENDPOINTS; ++i) {
+        ctrl->endpoints[i].used = 0;
+    }
+    for (uint32_t i = 0; i < XHCI_MAX_TRANSFERS; ++i) {
+        ctrl->transfers[i].used = 0;
+    }
+    for (uint32_t i = 0; i < XHCI_MAX_INTERRUPTS; ++i) {
+        ctrl->interrupts[i].used = 0;
+    }
+    ctrl->command_head = 0;
+    ctrl->command_tail = 0;
+    ctrl->command_busy = 0;
+    ctrl->command_aborting = 0;
+    ring_init(&ctrl->command_ring, &ctrl->ring_pool[XHCI_MAX_ENDPOINTS * XHCI_RING_TRBS]);
+    ctrl->event_ring.trbs = events;
+    ctrl->event_ring.index = 0;
+    ctrl->event_ring.cycle = 1;
+    ctrl->erst[0] = phys(events);
+    ctrl->erst[1] = 0;
+    ctrl->erst[2] = XHCI_EVENT_TRBS;
+    ctrl->erst[3] = 0;
+
+    mmio_write32(ctrl->op_base, XHCI_CONFIG, ctrl->max_slots);
+    mmio_write32(ctrl->op_base, XHCI_DCBAAP, phys(ctrl->dcbaa));
+    mmio_write32(ctrl->op_base, XHCI_DCBAAP + 4, 0);
+    mmio_write32(ctrl->op_base, XHCI_CRCR, phys(ctrl->command_ring.trbs) | TRB_CYCLE);
+    mmio_write32(ctrl->op_base, XHCI_CRCR + 4, 0);
+    mmio_write32(ctrl->rt_base, XHCI_ERSTSZ, 1);
+    mmio_write32(ctrl->rt_base, XHCI_ERDP, phys(events));
+    mmio_write32(ctrl->rt_base, XHCI_ERDP + 4, 0);
+    mmio_write32(ctrl->rt_base, XHCI_ERSTBA, phys(ctrl->erst));
+    mmio_write32(ctrl->rt_base, XHCI_ERSTBA + 4, 0);
+    mmio_write32(ctrl->op_base, XHCI_USBCMD, mmio_read32(ctrl->op_base, XHCI_USBCMD) | XHCI_CMD_RUN);
+    return 1;
+}
+
+static int device_find(const struct xhci_controller *ctrl, uint8_t dev_addr) {
+    for (int i = 0; i < XHCI_MAX_SLOTS; ++i) {
+        if (ctrl->devices[i].used && ctrl->devices[i].addr == dev_addr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int device_by_slot(const struct xhci_controller *ctrl, uint32_t slot) {
+    for (int i = 0; i < XHCI_MAX_SLOTS; ++i) {
+        if (ctrl->devices[i].used && ctrl->devices[i].slot == slot && slot != 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static struct xhci_endpoint *endpoint_find(struct xhci_controller *ctrl, int dev, uint32_t dci) {
+    for (uint32_t i = 0; i < XHCI_MAX_ENDPOINTS; ++i) {
+        struct xhci_endpoint *ep = &ctrl->endpoints[i];
+        if (ep->used && ep->dev == dev && ep->dci == dci) {
+            return ep;
+        }
+    }
+    return 0;
+}
+
+static struct xhci_endpoint *endpoint_add(struct xhci_controller *ctrl, int dev, uint32_t dci, uint32_t type,
+                                          uint16_t max_packet, uint8_t interval) {
+    if (endpoint_find(ctrl, dev, dci)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < XHCI_MAX_ENDPOINTS; ++i) {
+        struct xhci_endpoint *ep = &ctrl->endpoints[i];
+        if (ep->used) {
+            continue;
+        }
+        ring_init(&ep->ring, &ctrl->ring_pool[i * XHCI_RING_TRBS]);
+        ep->dev = (uint8_t)dev;
+        ep->dci = (uint8_t)dci;
+        ep->type = (uint8_t)type;
+        ep->max_packet = max_packet;
+        ep->interval = interval;
+        ep->configured = 0;
+        ep->recovering = 0;
+        ep->used = 1;
+        return ep;
+    }
+    return 0;
+}
+
+static uint32_t slot_speed(uint8_t speed) {
+    switch (speed) {
+    case USB_SPEED_LOW:
+        return SLOT_SPEED_LOW;
+    case USB_SPEED_FULL:
+        return SLOT_SPEED_FULL;
+    case USB_SPEED_HIGH:
+        return SLOT_SPEED_HIGH;
+    default:
+        return SLOT_SPEED_SUPER;
+    }
+}
+
+static void fill_slot(const struct xhci_device *dev, uint32_t *slot) {
+    slot[0] = (dev->route & 0xFFFFFu) | (slot_speed(dev->speed) << 20) | ((uint32_t)dev->context_entries << 27);
+    slot[1] = ((uint32_t)dev->root_port << 16) | ((uint32_t)dev->hub_ports << 24);
+    slot[2] = dev->tt_slot | ((uint32_t)dev->tt_port << 8);
+    if (dev->hub_ports) {
+        slot[0] |= SLOT_HUB;
+    }
+}
+
+static void fill_endpoint(const struct xhci_endpoint *ep, uint32_t *ctx) {
+    ctx[0] = (uint32_t)ep->interval << 16;
+    ctx[1] = EP_ERROR_COUNT | ((uint32_t)ep->type << 3) | ((uint32_t)ep->max_packet << 16);
+    ctx[2] = phys(&ep->ring.trbs[ep->ring.index]) | ep->ring.cycle;
+    ctx[3] = 0;
+    ctx[4] = ep->type == EP_TYPE_CONTROL ? 8u : ep->max_packet;
+    if (ep->type == EP_TYPE_INTERRUPT_IN) {
+        ctx[4] |= (uint32_t)ep->max_packet << 16;
+    }
+}
+
+static uint8_t *input_begin(struct xhci_controller *ctrl, uint32_t add_flags) {
+    zero_words(ctrl->input_context, ctrl->context_size * 33u);
+    uint32_t *control = context_at(ctrl, ctrl->input_context, 0);
+    control[1] = add_flags;
+    return ctrl->input_context;
+}
+
+static int command_queue(struct xhci_controller *ctrl, uint8_t type, int dev, uint8_t dci,
+                         usb_callback_fn callback, void *ctx) {
+    if (ctrl->command_tail - ctrl->command_head >= XHCI_COMMAND_QUEUE) {
+        return 0;
+    }
+    struct xhci_command *c = &ctrl->commands[ctrl->command_tail % XHCI_COMMAND_QUEUE];
+    c->type = type;
+    c->dev = (uint8_t)(dev < 0 ? 0 : dev);
+    c->serial = dev < 0 ? 0 : ctrl->devices[dev].serial;
+    c->slot = dev < 0 ? 0 : ctrl->devices[dev].slot;
+    c->dci = dci;
+    c->callback = callback;
+    c->ctx = ctx;
+    ctrl->command_tail++;
+    return 1;
+}
+
+static int command_target(const struct xhci_controller *ctrl, const struct xhci_command *c) {
+    const struct xhci_device *dev = &ctrl->devices[c->dev];
+    if (!dev->used || dev->serial != c->serial) {
+        return 0;
+    }
+    return c->type == TRB_ENABLE_SLOT || dev->slot == c->slot;
+}
+
+static void command_complete(struct xhci_controller *ctrl, enum usb_status status, uint32_t slot);
+
+static void command_issue(struct xhci_controller *ctrl) {
+    while (!ctrl->command_busy && !ctrl->command_aborting && ctrl->command_head != ctrl->command_tail) {
+        struct xhci_command *c = &ctrl->commands[ctrl->command_head % XHCI_COMMAND_QUEUE];
+        if (c->type != TRB_DISABLE_SLOT && !command_target(ctrl, c)) {
+            command_complete(ctrl, USB_STATUS_ERROR, 0);
+            continue;
+        }
+        struct xhci_device *dev = &ctrl->devices[c->dev];
+        struct xhci_endpoint *ep = endpoint_find(ctrl, c->dev, c->dci);
+        uint32_t param = 0;
+        switch (c->type) {
+        case TRB_ADDRESS_DEVICE: {
+            uint8_t *input = input_begin(ctrl, 0x3u);
+            fill_slot(dev, context_at(ctrl, input, 1));
+            fill_endpoint(ep, context_at(ctrl, input, 2));
+            param = phys(input);
+            break;
+        }
+        case TRB_CONFIGURE_ENDPOINT: {
+            uint8_t *input = input_begin(ctrl, 1u | (ep ? 1u << c->dci : 0));
+            if (ep) {
+                fill_endpoint(ep, context_at(ctrl, input, c->dci + 1u));
+            }
+            fill_slot(dev, context_at(ctrl, input, 1));
+            param = phys(input);
+            break;
+        }
+        case TRB_EVALUATE_CONTEXT: {
+            uint8_t *input = input_begin(ctrl, 0x2u);
+            fill_endpoint(ep, context_at(ctrl, input, 2));
+            param = phys(input);
+            break;
+        }
+        case TRB_SET_DEQUEUE:
+            param = phys(&ep->ring.trbs[ep->ring.index]) | ep->ring.cycle;
+            break;
+        default:
+            break;
+        }
+        uint32_t control = TRB_TYPE(c->type) | TRB_SLOT(c->slot) | TRB_EP(c->dci);
+        uint32_t index = ring_push(&ctrl->command_ring, param, 0, 0, control);
+        ctrl->command_trb = phys(&ctrl->command_ring.trbs[index]);
+        ctrl->command_busy = 1;
+        ctrl->command_deadline_tsc = timer_tsc() + timer_us_to_tsc(XHCI_COMMAND_TIMEOUT_US);
+        ctrl->doorbells[0] = 0;
+    }
+}
+
+static void transfer_finish(struct xhci_transfer *t, enum usb_status status) {
+    usb_callback_fn callback = t->callback;
+    void *ctx = t->ctx;
+    const uint8_t *data = (const uint8_t *)t->data;
+    uint32_t actual = status == USB_STATUS_OK ? t->actual : 0;
+    t->used = 0;
+    if (callback) {
+        callback(ctx, status, data, actual);
+    }
+}
+
+static struct xhci_transfer *transfer_on(struct xhci_controller *ctrl, const struct xhci_endpoint *ep) {
+    for (int i = 0; i < XHCI_MAX_TRANSFERS; ++i) {
+        if (ctrl->transfers[i].used && ctrl->transfers[i].ep == ep) {
+            return &ctrl->transfers[i];
+        }
+    }
+    return 0;
+}
+
+static struct xhci_interrupt *interrupt_on(struct xhci_controller *ctrl, const struct xhci_endpoint *ep) {
+    for (int i = 0; i < XHCI_MAX_INTERRUPTS; ++i) {
+        if (ctrl->interrupts[i].used && ctrl->interrupts[i].ep == ep) {
+            return &ctrl->interrupts[i];
+        }
+    }
+    return 0;
+}
+
+static void interrupt_arm(struct xhci_controller *ctrl, struct xhci_interrupt *intr) {
+    struct xhci_endpoint *ep = intr->ep;
+    intr->first_trb = ring_push_data(&ep->ring, intr->buf, intr->len, TRB_NORMAL, 0, TRB_IOC);
+    intr->armed = 1;
+    ctrl->doorbells[ctrl->devices[ep->dev].slot] = ep->dci;
+}
+
+static void endpoint_recover(struct xhci_controller *ctrl, struct xhci_endpoint *ep, uint8_t first) {
+    if (ep->recovering) {
+        return;
+    }
+    ep->recovering = 1;
+    if (!command_queue(ctrl, first, ep->dev, ep->dci, 0, 0) ||
+        !command_queue(ctrl, TRB_SET_DEQUEUE, ep->dev, ep->dci, 0, 0)) {
+        log_puts("xHCI: command queue full, endpoint left halted\n");
+    }
+}
+
+static void endpoint_recovered(struct xhci_controller *ctrl, struct xhci_endpoint *ep) {
+    ep->recovering = 0;
+    struct xhci_transfer *t = transfer_on(ctrl, ep);
+    if (t && t->status != USB_STATUS_PENDING) {
+        transfer_finish(t, (enum usb_status)t->status);
+    }
+    struct xhci_interrupt *intr = interrupt_on(ctrl, ep);
+    if (intr && intr->resume) {
+        intr->resume = 0;
+        interrupt_arm(ctrl, intr);
+    }
+}
+
+static void endpoint_configured(struct xhci_controller *ctrl, struct xhci_endpoint *ep, enum usb_status status) {
+    ep->configured = status == USB_STATUS_OK;
+    struct xhci_interrupt *intr = interrupt_on(ctrl, ep);
+    if (!intr || intr->halted) {
+        return;
+    }
+    if (ep->configured) {
+        interrupt_arm(ctrl, intr);
+        return;
+    }
+    intr->halted = 1;
+    intr->callback(intr->ctx, USB_STATUS_ERROR, (const uint8_t *)intr->buf, 0);
+}
+
+static void command_complete(struct xhci_controller *ctrl, enum usb_status status, uint32_t slot) {
+    struct xhci_command c = ctrl->commands[ctrl->command_head % XHCI_COMMAND_QUEUE];
+    ctrl->command_head++;
+    ctrl->command_busy = 0;
+    int live = command_target(ctrl, &c);
+    struct xhci_device *dev = &ctrl->devices[c.dev];
+    struct xhci_endpoint *ep = live ? endpoint_find(ctrl, c.dev, c.dci) : 0;
+    switch (c.type) {
+    case TRB_ENABLE_SLOT:
+        if (status == USB_STATUS_OK && !live) {
+            struct xhci_command *d = &ctrl->commands[ctrl->command_tail % XHCI_COMMAND_QUEUE];
+            if (command_queue(ctrl, TRB_DISABLE_SLOT, -1, 0, 0, 0)) {
+                d->slot = (uint8_t)slot;
+            }
+            break;
+        }
+        if (status != USB_STATUS_OK || slot == 0 || slot > XHCI_MAX_SLOTS) {
+            if (c.callback) {
+                c.callback(c.ctx, USB_STATUS_ERROR, 0, 0);
+            }
+            break;
+        }
+        dev->slot = (uint8_t)slot;
+        zero_words(dev->context, ctrl->context_size * 32u);
+        ctrl->dcbaa[slot] = phys(dev->context);
+        if (!command_queue(ctrl, TRB_ADDRESS_DEVICE, c.dev, 1, c.callback, c.ctx) && c.callback) {
+            c.callback(c.ctx, USB_STATUS_ERROR, 0, 0);
+        }
+        break;
+    case TRB_ADDRESS_DEVICE:
+        if (live && status == USB_STATUS_OK) {
+            dev->addressed = 1;
+        }
+        if (c.callback) {
+            c.callback(c.ctx, live ? status : USB_STATUS_ERROR, 0, 0);
+        }
+        break;
+    case TRB_EVALUATE_CONTEXT:
+        if (c.callback) {
+            c.callback(c.ctx, live ? status : USB_STATUS_ERROR, 0, 0);
+        }
+        break;
+    case TRB_CONFIGURE_ENDPOINT:
+        if (ep) {
+            endpoint_configured(ctrl, ep, status);
+        } else if (live && status != USB_STATUS_OK) {
+            log_puts("xHCI: slot configuration failed\n");
+        }
+        break;
+    case TRB_SET_DEQUEUE:
+        if (ep) {
+            endpoint_recovered(ctrl, ep);
+        }
+        break;
+    case TRB_DISABLE_SLOT:
+        if (c.slot != 0 && c.slot <= XHCI_MAX_SLOTS) {
+            ctrl->dcbaa[c.slot] = 0;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static enum usb_status completion_status(uint32_t code) {
+    switch (code) {
+    case CC_SUCCESS:
+    case CC_SHORT_PACKET:
+        return USB_STATUS_OK;
+    case CC_STALL:
+        return USB_STATUS_STALL;
+    default:
+        return USB_STATUS_ERROR;
+    }
+}
+
+static uint32_t data_actual(const struct xhci_ring *ring, uint32_t first, uint32_t trb_phys, uint32_t residual) {
+    uint32_t target = (trb_phys - phys(ring->trbs)) / (uint32_t)sizeof(struct xhci_trb);
+    uint32_t total = 0;
+    for (uint32_t i = first, guard = 0; i != target && guard < XHCI_RING_TRBS; i = ring_next(i), ++guard) {
+        total += ring->trbs[i].status & TRB_LENGTH_MASK;
+    }
+    uint32_t last = ring->trbs[target % XHCI_RING_TRBS].status & TRB_LENGTH_MASK;
+    return total + (residual < last ? last - residual : 0);
+}
+
+static void interrupt_event(struct xhci_controller *ctrl, struct xhci_interrupt *intr, uint32_t code,
+                            uint32_t trb_phys, uint32_t residual) {
+    enum usb_status status = completion_status(code);
+    intr->armed = 0;
+    if (status != USB_STATUS_OK) {
+        intr->halted = 1;
+        endpoint_recover(ctrl, intr->ep, TRB_RESET_ENDPOINT);
+        intr->callback(intr->ctx, status, (const uint8_t *)intr->buf, 0);
+        return;
+    }
+    uint32_t got = code == CC_SHORT_PACKET ? data_actual(&intr->ep->ring, intr->first_trb, trb_phys, residual)
+                                           : intr->len;
+    intr->callback(intr->ctx, status, (const uint8_t *)intr->buf, got);
+    if (intr->used && !intr->halted && !intr->armed) {
+        interrupt_arm(ctrl, intr);
+    }
+}
+
+static void transfer_event(struct xhci_controller *ctrl, const struct xhci_trb *event) {
+    uint32_t code = event->status >> 24;
+    uint32_t residual = event->status & 0xFFFFFFu;
+    int dev = device_by_slot(ctrl, event->control >> 24);
+    if (dev < 0 || code == CC_STOPPED || code == CC_STOPPED_LENGTH) {
+        return;
+    }
+    struct xhci_endpoint *ep = endpoint_find(ctrl, dev, (event->control >> 16) & 0x1Fu);
+    if (!ep || ep->recovering) {
+        return;
+    }
+    struct xhci_interrupt *intr = interrupt_on(ctrl, ep);
+    if (intr) {
+        interrupt_event(ctrl, intr, code, event->param_lo, residual);
+        return;
+    }
+    struct xhci_transfer *t = transfer_on(ctrl, ep);
+    if (!t) {
+        return;
+    }
+    enum usb_status status = completion_status(code);
+    if (status != USB_STATUS_OK) {
+        t->status = (uint8_t)status;
+        endpoint_recover(ctrl, ep, TRB_RESET_ENDPOINT);
+        return;
+    }
+    if (code == CC_SHORT_PACKET && t->length && !t->short_packet) {
+        t->actual = data_actual(&ep->ring, t->first_trb, event->param_lo, residual);
+        t->short_packet = 1;
+    }
+    if (event->param_lo != t->last_trb) {
+        return;
+    }
+    if (!t->short_packet) {
+        t->actual = t->length;
+    }
+    transfer_finish(t, USB_STATUS_OK);
+}
+
+static void command_stopped(struct xhci_controller *ctrl) {
+    ctrl->command_aborting = 0;
+    if (!ctrl->command_busy) {
+        return;
+    }
+    struct xhci_trb *trb = &ctrl->command_ring.trbs[(ctrl->command_trb - phys(ctrl->command_ring.trbs)) /
+                                                    (uint32_t)sizeof(struct xhci_trb)];
+    trb->control = (trb->control & TRB_CYCLE) | TRB_TYPE(TRB_NOOP_COMMAND);
+    command_complete(ctrl, USB_STATUS_TIMEOUT, 0);
+}
+
+static void command_abort(struct xhci_controller *ctrl) {
+    if (!(mmio_read32(ctrl->op_base, XHCI_CRCR) & XHCI_CRCR_CRR)) {
+        command_stopped(ctrl);
+        return;
+    }
+    ctrl->command_aborting = 1;
+    ctrl->command_deadline_tsc = timer_tsc() + timer_us_to_tsc(XHCI_COMMAND_TIMEOUT_US);
+    mmio_write32(ctrl->op_base, XHCI_CRCR, XHCI_CRCR_CA);
+}
+
+static void command_event(struct xhci_controller *ctrl, const struct xhci_trb *event) {
+    uint32_t code = event->status >> 24;
+    if (code == CC_COMMAND_RING_STOPPED) {
+        if (ctrl->command_aborting) {
+            command_stopped(ctrl);
+        }
+        return;
+    }
+    if (!ctrl->command_busy || event->param_lo != ctrl->command_trb) {
+        return;
+    }
+    enum usb_status status = code == CC_COMMAND_ABORTED ? USB_STATUS_TIMEOUT : completion_status(code);
+    command_complete(ctrl, status, event->control >> 24);
+}
+
+void xhci_process(struct xhci_controller *ctrl) {
+    if (!ctrl || !ctrl->dcbaa) {
+        return;
+    }
+    uint32_t pending = __atomic_exchange_n(&ctrl->irq_status, 0, __ATOMIC_SEQ_CST);
+    if (pending & XHCI_STS_HOST_ERROR) {
+        log_puts("xHCI: host system error\n");
+    }
+    struct xhci_ring *events = &ctrl->event_ring;
+    int drained = 0;
+    for (uint32_t n = 0; n < XHCI_EVENT_TRBS; ++n) {
+        const struct xhci_trb *event = &events->trbs[events->index];
+        uint32_t control = *(volatile const uint32_t *)&event->control;
+        if ((control & TRB_CYCLE) != events->cycle) {
+            break;
+        }
+        switch (TRB_TYPE_OF(control)) {
+        case TRB_TRANSFER_EVENT:
+            transfer_event(ctrl, event);
+            break;
+        case TRB_COMMAND_EVENT:
+            command_event(ctrl, event);
+            break;
+        default:
+            break;
+        }
+        if (++events->index == XHCI_EVENT_TRBS) {
+            events->index = 0;
+            events->cycle ^= 1u;
+        }
+        drained = 1;
+    }
+    if (drained) {
+        mmio_write32(ctrl->rt_base, XHCI_ERDP, phys(&events->trbs[events->index]) | XHCI_ERDP_BUSY);
+        mmio_write32(ctrl->rt_base, XHCI_ERDP + 4, 0);
+    }
+
+    uint64_t now = timer_tsc();
+    if (ctrl->command_aborting && now >= ctrl->command_deadline_tsc) {
+        log_puts("xHCI: command abort timed out\n");
+        command_stopped(ctrl);
+    } else if (ctrl->command_busy && !ctrl->command_aborting && now >= ctrl->command_deadline_tsc) {
+        log_puts("xHCI: command timed out\n");
+        command_abort(ctrl);
+    }
+    for (int i = 0; i < XHCI_MAX_TRANSFERS; ++i) {
+        struct xhci_transfer *t = &ctrl->transfers[i];
+        if (t->used && t->deadline_tsc && now >= t->deadline_tsc && t->status == USB_STATUS_PENDING) {
+            t->status = USB_STATUS_TIMEOUT;
+            endpoint_recover(ctrl, t->ep, TRB_STOP_ENDPOINT);
+        }
+    }
+    command_issue(ctrl);
+}
+
+int xhci_address_device(struct xhci_controller *ctrl,
+                        uint8_t dev_addr,
+                        enum usb_speed speed,
+                        uint8_t root_port,
+                        uint32_t route,
+                        uint8_t hub_addr,
+                        uint8_t hub_port,
+                        uint16_t max_packet0,
+                        usb_callback_fn callback,
+                        void *ctx) {
+    if (!ctrl || !ctrl->dcbaa || device_find(ctrl, dev_addr) >= 0) {
+        return 0;
+    }
+    int index = -1;
+    for (int i = 0; i < XHCI_MAX_SLOTS; ++i) {
+        if (!ctrl->devices[i].used) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        return 0;
+    }
+    struct xhci_device *dev = &ctrl->devices[index];
+    int hub = device_find(ctrl, hub_addr);
+    dev->addr = dev_addr;
+    dev->slot = 0;
+    dev->addressed = 0;
+    dev->speed = (uint8_t)speed;
+    dev->root_port = root_port;
+    dev->route = route;
+    dev->tt_slot = hub >= 0 && hub_addr != 0 ? ctrl->devices[hub].slot : 0;
+    dev->tt_port = dev->tt_slot ? hub_port : 0;
+    dev->hub_ports = 0;
+    dev->context_entries = 1;
+    if (!endpoint_add(ctrl, index, 1, EP_TYPE_CONTROL, max_packet0, 0)) {
+        return 0;
+    }
+    dev->serial++;
+    dev->used = 1;
+    if (!command_queue(ctrl, TRB_ENABLE_SLOT, index, 0, callback, ctx)) {
+        xhci_release_device(ctrl, dev_addr);
+        return 0;
+    }
+    command_issue(ctrl);
+    return 1;
+}
+
+int xhci_update_max_packet0(struct xhci_controller *ctrl, uint8_t dev_addr, uint16_t max_packet0,
+                            usb_callback_fn callback, void *ctx) {
+    int dev = ctrl ? device_find(ctrl, dev_addr) : -1;
+    struct xhci_endpoint *ep = dev >= 0 ? endpoint_find(ctrl, dev, 1) : 0;
+    if (!ep || !command_queue(ctrl, TRB_EVALUATE_CONTEXT, dev, 1, callback, ctx)) {
+        return 0;
+    }
+    ep->max_packet = max_packet0;
+    command_issue(ctrl);
+    return 1;
+}
+
+int xhci_set_hub(struct xhci_controller *ctrl, uint8_t dev_addr, uint8_t ports) {
+    int dev = ctrl ? device_find(ctrl, dev_addr) : -1;
+    if (dev < 0) {
+        return 0;
+    }
+    ctrl->devices[dev].hub_ports = ports;
+    if (!command_queue(ctrl, TRB_CONFIGURE_ENDPOINT, dev, 0, 0, 0)) {
+        return 0;
+    }
+    command_issue(ctrl);
+    return 1;
+}
+
+void xhci_release_device(struct xhci_controller *ctrl, uint8_t dev_addr) {
+    int dev = ctrl ? device_find(ctrl, dev_addr) : -1;
+    if (dev < 0) {
+        return;
+    }
+    for (int i = 0; i < XHCI_MAX_INTERRUPTS; ++i) {
+        struct xhci_interrupt *intr = &ctrl->interrupts[i];
+        if (intr->used && intr->ep->dev == dev) {
+            intr->used = 0;
+        }
+    }
+    for (int i = 0; i < XHCI_MAX_TRANSFERS; ++i) {
+        struct xhci_transfer *t = &ctrl->transfers[i];
+        if (t->used && t->ep->dev == dev) {
+            transfer_finish(t, USB_STATUS_ERROR);
+        }
+    }
+    for (uint32_t i = 0; i < XHCI_MAX_ENDPOINTS; ++i) {
+        if (ctrl->endpoints[i].used && ctrl->endpoints[i].dev == dev) {
+            ctrl->endpoints[i].used = 0;
+        }
+    }
+    struct xhci_device *d = &ctrl->devices[dev];
+    if (d->slot) {
+        command_queue(ctrl, TRB_DISABLE_SLOT, dev, 0, 0, 0);
+        command_issue(ctrl);
+    }
+    d->used = 0;
+}
+
+static int transfer_slot(struct xhci_controller *ctrl, const struct xhci_endpoint *ep) {
+    if (!ep || ep->recovering || transfer_on(ctrl, ep)) {
+        return -1;
+    }
+    for (int i = 0; i < XHCI_MAX_TRANSFERS; ++i) {
+        if (!ctrl->transfers[i].used) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static struct xhci_transfer *transfer_begin(struct xhci_controller *ctrl, int slot, struct xhci_endpoint *ep,
+                                            void *data, uint32_t length, usb_callback_fn callback, void *ctx) {
+    struct xhci_transfer *t = &ctrl->transfers[slot];
+    t->ep = ep;
+    t->data = data;
+    t->length = length;
+    t->actual = 0;
+    t->first_trb = ep->ring.index;
+    t->callback = callback;
+    t->ctx = ctx;
+    t->status = USB_STATUS_PENDING;
+    t->short_packet = 0;
+    t->deadline_tsc = 0;
+    t->used = 1;
+    return t;
+}
+
+int xhci_control_submit(struct xhci_controller *ctrl,
+                        uint8_t dev_addr,
+                        const void *setup,
+                        void *data,
+                        uint32_t length,
+                        int in_dir,
+                        usb_callback_fn callback,
+                        void *ctx) {
+    int dev = ctrl && setup ? device_find(ctrl, dev_addr) : -1;
+    if (dev < 0 || !ctrl->devices[dev].addressed || (length && !data)) {
+        return -1;
+    }
+    struct xhci_endpoint *ep = endpoint_find(ctrl, dev, 1);
+    int slot = transfer_slot(ctrl, ep);
+    if (slot < 0) {
+        return -1;
+    }
+    const uint8_t *s = (const uint8_t *)setup;
+    uint32_t lo = s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+    uint32_t hi = s[4] | ((uint32_t)s[5] << 8) | ((uint32_t)s[6] << 16) | ((uint32_t)s[7] << 24);
+    uint32_t transfer_type = length ? (in_dir ? TRB_TRT_IN : TRB_TRT_OUT) : 0;
+    ring_push(&ep->ring, lo, hi, 8, TRB_TYPE(TRB_SETUP) | TRB_IDT | transfer_type);
+    struct xhci_transfer *t = transfer_begin(ctrl, slot, ep, data, length, callback, ctx);
+    if (length) {
+        t->first_trb = ring_push_data(&ep->ring, data, length, TRB_DATA, in_dir ? TRB_DIR_IN : 0, 0);
+    }
+    uint32_t status_dir = length && in_dir ? 0 : TRB_DIR_IN;
+    uint32_t last = ring_push(&ep->ring, 0, 0, 0, TRB_TYPE(TRB_STATUS) | TRB_IOC | status_dir);
+    t->last_trb = phys(&ep->ring.trbs[last]);
+    t->deadline_tsc = timer_tsc() + timer_us_to_tsc(XHCI_CONTROL_TIMEOUT_US);
+    ctrl->doorbells[ctrl->devices[dev].slot] = ep->dci;
+    return slot;
+}
+
+static uint8_t interval_exponent(uint8_t frames) {
+    uint32_t exponent = 3;
+    while (exponent < 15u && (2u << (exponent - 3u)) <= frames) {
+        exponent++;
+    }
+    return (uint8_t)exponent;
+}
+
+int xhci_interrupt_open(struct xhci_controller *ctrl,
+                        uint8_t dev_addr,
+                        uint8_t ep,
+                        uint16_t max_packet,
+                        uint8_t interval,
+                        void *buf,
+                        uint16_t len,
+                        usb_callback_fn callback,
+                        void *ctx) {
+    int dev = ctrl ? device_find(ctrl, dev_addr) : -1;
+    if (dev < 0 || !buf || !callback || len == 0 || len > max_packet) {
+        return -1;
+    }
+    int handle = -1;
+    for (int i = 0; i < XHCI_MAX_INTERRUPTS; ++i) {
+        if (!ctrl->interrupts[i].used) {
+            handle = i;
+            break;
+        }
+    }
+    if (handle < 0) {
+        return -1;
+    }
+    uint32_t dci = (ep & 0x0Fu) * 2u + 1u;
+    uint8_t exponent = interval_exponent(interval);
+    struct xhci_endpoint *e = endpoint_add(ctrl, dev, dci, EP_TYPE_INTERRUPT_IN, max_packet, exponent);
+    if (!e) {
+        return -1;
+    }
+    if (!command_queue(ctrl, TRB_CONFIGURE_ENDPOINT, dev, (uint8_t)dci, 0, 0)) {
+        e->used = 0;
+        return -1;
+    }
+    if (ctrl->devices[dev].context_entries < dci) {
+        ctrl->devices[dev].context_entries = (uint8_t)dci;
+    }
+    struct xhci_interrupt *intr = &ctrl->interrupts[handle];
+    intr->ep = e;
+    intr->buf = buf;
+    intr->len = len;
+    intr->interval = (uint8_t)(1u << (exponent - 3u));
+    intr->halted = 0;
+    intr->armed = 0;
+    intr->resume = 0;
+    intr->callback = callback;
+    intr->ctx = ctx;
+    intr->used = 1;
+    command_issue(ctrl);
+    return handle;
+}
+
+int xhci_interrupt_resume(struct xhci_controller *ctrl, int handle) {
+    if (!ctrl || handle < 0 || handle >= XHCI_MAX_INTERRUPTS || !ctrl->interrupts[handle].used) {
+        return 0;
+    }
+    struct xhci_interrupt *intr = &ctrl->interrupts[handle];
+    if (!intr->halted) {
+        return 1;
+    }
+    intr->halted = 0;
+    if (!intr->ep->configured) {
+        return command_queue(ctrl, TRB_CONFIGURE_ENDPOINT, intr->ep->dev, intr->ep->dci, 0, 0);
+    }
+    if (intr->ep->recovering) {
+        intr->resume = 1;
+    } else if (!intr->armed) {
+        interrupt_arm(ctrl, intr);
+    }
+    return 1;
+}
+
+int xhci_bulk_open(struct xhci_controller *ctrl, uint8_t dev_addr, uint8_t ep, uint16_t max_packet) {
+    int dev = ctrl ? device_find(ctrl, dev_addr) : -1;
+    if (dev < 0) {
+        return -1;
+    }
+    int in_dir = (ep & 0x80u) != 0;
+    uint32_t dci = (ep & 0x0Fu) * 2u + (in_dir ? 1u : 0);
+    struct xhci_endpoint *e = endpoint_add(ctrl, dev, dci, in_dir ? EP_TYPE_BULK_IN : EP_TYPE_BULK_OUT,
+                                           max_packet, 0);
+    if (!e) {
+        return -1;
+    }
+    if (!command_queue(ctrl, TRB_CONFIGURE_ENDPOINT, dev, (uint8_t)dci, 0, 0)) {
+        e->used = 0;
+        return -1;
+    }
+    if (ctrl->devices[dev].context_entries < dci) {
+        ctrl->devices[dev].context_entries = (uint8_t)dci;
+    }
+    command_issue(ctrl);
+    return (int)(e - ctrl->endpoints);
+}
+
+int xhci_bulk_submit(struct xhci_controller *ctrl, int handle, void *data, uint32_t length,
+                     usb_callback_fn callback, void *ctx) {
+    if (!ctrl || handle < 0 || handle >= XHCI_MAX_ENDPOINTS || !data || length == 0 ||
+        length > (XHCI_RING_TRBS / 2u) * TRB_MAX_BYTES) {
+        return -1;
+    }
+    struct xhci_endpoint *ep = &ctrl->endpoints[handle];
+    if (!ep->used || !ep->configured || (ep->type != EP_TYPE_BULK_IN && ep->type != EP_TYPE_BULK_OUT)) {
+        return -1;
+    }
+    int slot = transfer_slot(ctrl, ep);
+    if (slot < 0) {
+        return -1;
+    }
+    struct xhci_transfer *t = transfer_begin(ctrl, slot, ep, data, length, callback, ctx);
+    t->first_trb = ring_push_data(&ep->ring, data, length, TRB_NORMAL, 0, TRB_IOC);
+    t->last_trb = phys(&ep->ring.trbs[ring_last(&ep->ring)]);
+    ctrl->doorbells[ctrl->devices[ep->dev].slot] = ep->dci;
+    return slot;
+}